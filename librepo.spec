@@ -8,6 +8,10 @@
 %bcond_without zchunk
 %endif
 
+%bcond_without decompression
+
+%bcond_with io_uring
+
 %global dnf_conflict 2.8.8
 
 Name:           librepo
@@ -30,9 +34,18 @@ BuildRequires:  libcurl-devel >= %{libcurl_version}
 BuildRequires:  pkgconfig(libxml-2.0)
 BuildRequires:  pkgconfig(libcrypto)
 BuildRequires:  pkgconfig(openssl)
+%if %{with decompression}
+BuildRequires:  pkgconfig(zlib)
+BuildRequires:  pkgconfig(bzip2)
+BuildRequires:  pkgconfig(liblzma)
+BuildRequires:  pkgconfig(libzstd)
+%endif
 %if %{with zchunk}
 BuildRequires:  pkgconfig(zck) >= 0.9.11
 %endif
+%if %{with io_uring}
+BuildRequires:  pkgconfig(liburing)
+%endif
 Requires:       libcurl%{?_isa} >= %{libcurl_version}
 
 %description
@@ -67,7 +80,7 @@ Python 3 bindings for the librepo library.
 %autosetup -p1
 
 %build
-%cmake %{!?with_zchunk:-DWITH_ZCHUNK=OFF}
+%cmake %{!?with_zchunk:-DWITH_ZCHUNK=OFF} -DWITH_DECOMPRESSION=%{?with_decompression:ON}%{!?with_decompression:OFF} %{?with_io_uring:-DWITH_IO_URING=ON}
 %cmake_build
 
 %check
@@ -0,0 +1,135 @@
+/* librepo - A library providing (libcURL like) API to downloading repository
+ * Copyright (C) 2026  agent
+ *
+ * Licensed under the GNU Lesser General Public License Version 2.1
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <glib.h>
+#include <assert.h>
+#include <string.h>
+
+#include "util.h"
+#include "arena_internal.h"
+
+/** Alignment of all allocations (enough for any scalar type) */
+#define ARENA_ALIGN             16
+#define ARENA_ROUND_UP(x)       (((x) + ARENA_ALIGN - 1) & ~((gsize) ARENA_ALIGN - 1))
+
+typedef struct _LrArenaBlock LrArenaBlock;
+
+struct _LrArenaBlock {
+    LrArenaBlock *next; /*!< Previously filled block */
+    gsize size;         /*!< Usable size of the block */
+    gsize used;         /*!< Used bytes of the block */
+};
+
+/** Offset of the data in a block keeps the data aligned */
+#define ARENA_HEADER_SIZE       ARENA_ROUND_UP(sizeof(LrArenaBlock))
+
+struct _LrArena {
+    LrArenaBlock *current;  /*!< Block used for new allocations */
+    LrArenaBlock *large;    /*!< Dedicated blocks of large allocations */
+    gsize block_size;       /*!< Usable size of regular blocks */
+    gsize total;            /*!< Bytes allocated from the system */
+};
+
+static LrArenaBlock *
+lr_arena_block_new(LrArena *arena, gsize size)
+{
+    LrArenaBlock *block = lr_malloc(ARENA_HEADER_SIZE + size);
+    block->next = NULL;
+    block->size = size;
+    block->used = 0;
+    arena->total += ARENA_HEADER_SIZE + size;
+    return block;
+}
+
+static void
+lr_arena_blocks_free(LrArenaBlock *block)
+{
+    while (block) {
+        LrArenaBlock *next = block->next;
+        lr_free(block);
+        block = next;
+    }
+}
+
+LrArena *
+lr_arena_new(gsize block_size)
+{
+    LrArena *arena = lr_malloc0(sizeof(*arena));
+    arena->block_size = ARENA_ROUND_UP(block_size ? block_size : LR_ARENA_BLOCK_SIZE);
+    return arena;
+}
+
+void *
+lr_arena_alloc0(LrArena *arena, gsize size)
+{
+    assert(arena);
+
+    size = ARENA_ROUND_UP(size ? size : 1);
+
+    if (size > arena->block_size / 4) {
+        // Large objects get their own block, they would waste
+        // the rest of the current one
+        LrArenaBlock *block = lr_arena_block_new(arena, size);
+        block->used = size;
+        block->next = arena->large;
+        arena->large = block;
+        return memset((char *) block + ARENA_HEADER_SIZE, 0, size);
+    }
+
+    LrArenaBlock *block = arena->current;
+    if (!block || block->size - block->used < size) {
+        block = lr_arena_block_new(arena, arena->block_size);
+        block->next = arena->current;
+        arena->current = block;
+    }
+
+    void *mem = (char *) block + ARENA_HEADER_SIZE + block->used;
+    block->used += size;
+    return memset(mem, 0, size);
+}
+
+char *
+lr_arena_strdup(LrArena *arena, const char *str)
+{
+    if (!str)
+        return NULL;
+
+    gsize len = strlen(str);
+    char *copy = lr_arena_alloc0(arena, len + 1);
+    memcpy(copy, str, len);
+    return copy;
+}
+
+gsize
+lr_arena_size(LrArena *arena)
+{
+    assert(arena);
+    return arena->total;
+}
+
+void
+lr_arena_free(LrArena *arena)
+{
+    if (!arena)
+        return;
+    lr_arena_blocks_free(arena->current);
+    lr_arena_blocks_free(arena->large);
+    lr_free(arena);
+}
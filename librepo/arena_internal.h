@@ -0,0 +1,75 @@
+/* librepo - A library providing (libcURL like) API to downloading repository
+ * Copyright (C) 2026  agent
+ *
+ * Licensed under the GNU Lesser General Public License Version 2.1
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef __LR_ARENA_INTERNAL_H__
+#define __LR_ARENA_INTERNAL_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/** Arena allocator for many small objects with the same lifetime.
+ * Memory is taken from big blocks by bumping a pointer and all of it
+ * is released at once by lr_arena_free(). Single objects cannot be freed.
+ */
+typedef struct _LrArena LrArena;
+
+/** Default size of arena blocks */
+#define LR_ARENA_BLOCK_SIZE     65536
+
+/** Create new arena.
+ * @param block_size        Size of blocks or 0 for LR_ARENA_BLOCK_SIZE
+ * @return                  New arena
+ */
+LrArena *
+lr_arena_new(gsize block_size);
+
+/** Allocate zeroed memory suitably aligned for any object.
+ * @param arena             Arena
+ * @param size              Size of the memory
+ * @return                  Memory valid until the arena is freed
+ */
+void *
+lr_arena_alloc0(LrArena *arena, gsize size);
+
+/** Copy string into the arena.
+ * @param arena             Arena
+ * @param str               String or NULL
+ * @return                  Copy valid until the arena is freed or NULL
+ */
+char *
+lr_arena_strdup(LrArena *arena, const char *str);
+
+/** Number of bytes allocated from the system by the arena.
+ * @param arena             Arena
+ * @return                  Bytes held by the arena
+ */
+gsize
+lr_arena_size(LrArena *arena);
+
+/** Release the arena and everything allocated from it.
+ * @param arena             Arena or NULL
+ */
+void
+lr_arena_free(LrArena *arena);
+
+G_END_DECLS
+
+#endif
@@ -32,11 +32,13 @@
 
 #include "cleanup.h"
 #include "checksum.h"
+#include "checksum_internal.h"
+#include "io_internal.h"
 #include "rcodes.h"
 #include "util.h"
 #include "xattr_internal.h"
+#include "trace_internal.h"
 
-#define BUFFER_SIZE             2048
 #define MAX_CHECKSUM_NAME_LEN   7
 
 LrChecksumType
@@ -102,20 +104,21 @@ lr_checksum_type_to_str(LrChecksumType type)
     return NULL;
 }
 
-char *
-lr_checksum_fd(LrChecksumType type, int fd, GError **err)
+static gboolean
+checksum_update_cb(gpointer ctx, const char *buf, gsize len)
+{
+    return EVP_DigestUpdate(ctx, buf, len) ? TRUE : FALSE;
+}
+
+/** Create a digest context initialized for the checksum type.
+ * @return          New context or NULL if err is set
+ */
+static EVP_MD_CTX *
+checksum_ctx_new(LrChecksumType type, GError **err)
 {
-    unsigned int len;
-    ssize_t readed;
-    char buf[BUFFER_SIZE];
-    unsigned char raw_checksum[EVP_MAX_MD_SIZE];
-    char *checksum;
     EVP_MD_CTX *ctx;
     const EVP_MD *ctx_type;
 
-    assert(fd > -1);
-    assert(!err || *err == NULL);
-
     switch (type) {
         case LR_CHECKSUM_MD5:       ctx_type = EVP_md5();    break;
         case LR_CHECKSUM_SHA1:      ctx_type = EVP_sha1();   break;
@@ -146,40 +149,100 @@ lr_checksum_fd(LrChecksumType type, int fd, GError **err)
         return NULL;
     }
 
+    return ctx;
+}
+
+/** Finish the digest and destroy its context.
+ * @return          Hex string of the checksum or NULL if err is set
+ */
+static char *
+checksum_ctx_final(EVP_MD_CTX *ctx, GError **err)
+{
+    unsigned int len;
+    unsigned char raw_checksum[EVP_MAX_MD_SIZE];
+    char *checksum;
+
+    if (!EVP_DigestFinal_ex(ctx, raw_checksum, &len)) {
+        g_set_error(err, LR_CHECKSUM_ERROR, LRE_OPENSSL,
+                    "EVP_DigestFinal_ex() failed");
+        EVP_MD_CTX_destroy(ctx);
+        return NULL;
+    }
+
+    EVP_MD_CTX_destroy(ctx);
+
+    checksum = lr_malloc0(sizeof(char) * (len * 2 + 1));
+    for (size_t x = 0; x < len; x++)
+        sprintf(checksum+(x*2), "%02x", raw_checksum[x]);
+
+    return checksum;
+}
+
+char *
+lr_checksum_fd(LrChecksumType type, int fd, GError **err)
+{
+    gssize readed;
+    EVP_MD_CTX *ctx;
+
+    assert(fd > -1);
+    assert(!err || *err == NULL);
+
+    ctx = checksum_ctx_new(type, err);
+    if (!ctx)
+        return NULL;
+
     if (lseek(fd, 0, SEEK_SET) == -1) {
         g_set_error(err, LR_CHECKSUM_ERROR, LRE_IO,
                     "Cannot seek to the begin of the file. "
                     "lseek(%d, 0, SEEK_SET) error: %s", fd, g_strerror(errno));
+        EVP_MD_CTX_destroy(ctx);
         return NULL;
     }
 
-    while ((readed = read(fd, buf, BUFFER_SIZE)) > 0)
-        if (!EVP_DigestUpdate(ctx, buf, readed)) {
-            g_set_error(err, LR_CHECKSUM_ERROR, LRE_OPENSSL,
-                        "EVP_DigestUpdate() failed");
-            return NULL;
-        }
+    // Big files are read ahead by io_uring (if available)
+    readed = lr_io_read_file(lr_io_ring_thread_default(), fd,
+                             checksum_update_cb, ctx);
 
-    if (readed == -1) {
+    if (readed == -ECANCELED) {
         EVP_MD_CTX_destroy(ctx);
-        g_set_error(err, LR_CHECKSUM_ERROR, LRE_IO,
-                    "read(%d) failed: %s", fd, g_strerror(errno));
+        g_set_error(err, LR_CHECKSUM_ERROR, LRE_OPENSSL,
+                    "EVP_DigestUpdate() failed");
         return NULL;
     }
 
-    if (!EVP_DigestFinal_ex(ctx, raw_checksum, &len)) {
-        g_set_error(err, LR_CHECKSUM_ERROR, LRE_OPENSSL,
-                    "EVP_DigestFinal_ex() failed");
+    if (readed < 0) {
+        EVP_MD_CTX_destroy(ctx);
+        g_set_error(err, LR_CHECKSUM_ERROR, LRE_IO,
+                    "read(%d) failed: %s", fd, g_strerror((int) -readed));
         return NULL;
     }
 
-    EVP_MD_CTX_destroy(ctx);
+    return checksum_ctx_final(ctx, err);
+}
 
-    checksum = lr_malloc0(sizeof(char) * (len * 2 + 1));
-    for (size_t x = 0; x < len; x++)
-        sprintf(checksum+(x*2), "%02x", raw_checksum[x]);
+char *
+lr_checksum_buffer(LrChecksumType type,
+                   const void *buf,
+                   gsize len,
+                   GError **err)
+{
+    EVP_MD_CTX *ctx;
 
-    return checksum;
+    assert(buf || !len);
+    assert(!err || *err == NULL);
+
+    ctx = checksum_ctx_new(type, err);
+    if (!ctx)
+        return NULL;
+
+    if (len && !EVP_DigestUpdate(ctx, buf, len)) {
+        EVP_MD_CTX_destroy(ctx);
+        g_set_error(err, LR_CHECKSUM_ERROR, LRE_OPENSSL,
+                    "EVP_DigestUpdate() failed");
+        return NULL;
+    }
+
+    return checksum_ctx_final(ctx, err);
 }
 
 gboolean
@@ -203,8 +266,24 @@ lr_checksum_fd_compare(LrChecksumType type,
                        gboolean *matches,
                        gchar **calculated,
                        GError **err)
+{
+    return lr_checksum_fd_compare_stats(type, fd, expected, caching,
+                                        matches, calculated, NULL, err);
+}
+
+gboolean
+lr_checksum_fd_compare_stats(LrChecksumType type,
+                             int fd,
+                             const char *expected,
+                             gboolean caching,
+                             gboolean *matches,
+                             gchar **calculated,
+                             LrStats *stats,
+                             GError **err)
 {
     _cleanup_free_ gchar *checksum = NULL;
+    _cleanup_trace_span_ LrTraceSpan span = LR_TRACE_SPAN_INIT(
+            "verify", "checksum", lr_checksum_type_to_str(type));
 
     assert(fd >= 0);
     assert(!err || *err == NULL);
@@ -250,6 +329,12 @@ lr_checksum_fd_compare(LrChecksumType type,
                     *matches = (strcmp(expected, buf) == 0);
                     if (calculated)
                       *calculated = g_strdup(buf);
+                    if (stats) {
+                        stats->checksum_checks++;
+                        stats->checksum_cache_hits++;
+                        if (!*matches)
+                            stats->checksum_failures++;
+                    }
                     return TRUE;
                 }
             } else {
@@ -265,6 +350,12 @@ lr_checksum_fd_compare(LrChecksumType type,
 
     *matches = (strcmp(expected, checksum)) ? FALSE : TRUE;
 
+    if (stats) {
+        stats->checksum_checks++;
+        if (!*matches)
+            stats->checksum_failures++;
+    }
+
     if (fsync(fd) != 0) {
         g_set_error(err, LR_CHECKSUM_ERROR, LRE_FILE,
                     "fsync failed: %s", strerror(errno));
@@ -284,6 +375,49 @@ lr_checksum_fd_compare(LrChecksumType type,
 }
 
 
+gboolean
+lr_checksum_buffer_compare_stats(LrChecksumType type,
+                                 const void *buf,
+                                 gsize len,
+                                 const char *expected,
+                                 gboolean *matches,
+                                 gchar **calculated,
+                                 LrStats *stats,
+                                 GError **err)
+{
+    _cleanup_free_ gchar *checksum = NULL;
+    _cleanup_trace_span_ LrTraceSpan span = LR_TRACE_SPAN_INIT(
+            "verify", "checksum", lr_checksum_type_to_str(type));
+
+    assert(!err || *err == NULL);
+
+    *matches = FALSE;
+
+    if (!expected) {
+        g_set_error(err, LR_CHECKSUM_ERROR, LRE_BADFUNCARG,
+                    "No expected checksum passed");
+        return FALSE;
+    }
+
+    checksum = lr_checksum_buffer(type, buf, len, err);
+    if (!checksum)
+        return FALSE;
+
+    *matches = (strcmp(expected, checksum)) ? FALSE : TRUE;
+
+    if (stats) {
+        stats->checksum_checks++;
+        if (!*matches)
+            stats->checksum_failures++;
+    }
+
+    if (calculated)
+        *calculated = g_strdup(checksum);
+
+    return TRUE;
+}
+
+
 void
 lr_checksum_clear_cache(int fd)
 {
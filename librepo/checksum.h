@@ -68,6 +68,19 @@ lr_checksum_type_to_str(LrChecksumType type);
 char *
 lr_checksum_fd(LrChecksumType type, int fd, GError **err);
 
+/** Calculate checksum for data in memory.
+ * @param type      Checksum type
+ * @param buf       Data
+ * @param len       Length of the data
+ * @param err       GError **
+ * @return          Malloced checksum string or NULL on error.
+ */
+char *
+lr_checksum_buffer(LrChecksumType type,
+                   const void *buf,
+                   gsize len,
+                   GError **err);
+
 /** Calculate checksum for data pointed by file descriptor and
  * compare it to the expected checksum value.
  * @param type      Checksum type
@@ -0,0 +1,70 @@
+/* librepo - A library providing (libcURL like) API to downloading repository
+ * Copyright (C) 2026  agent
+ *
+ * Licensed under the GNU Lesser General Public License Version 2.1
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef __LR_CHECKSUM_INTERNAL_H__
+#define __LR_CHECKSUM_INTERNAL_H__
+
+#include <glib.h>
+
+#include "checksum.h"
+#include "stats.h"
+
+G_BEGIN_DECLS
+
+/** The same as lr_checksum_fd_compare() but the verification
+ * is counted in the statistics.
+ * @param stats         Statistics to update or NULL
+ */
+gboolean
+lr_checksum_fd_compare_stats(LrChecksumType type,
+                             int fd,
+                             const char *expected,
+                             gboolean caching,
+                             gboolean *matches,
+                             gchar **calculated,
+                             LrStats *stats,
+                             GError **err);
+
+/** Calculate checksum for data in memory, compare it to the expected
+ * checksum value and count the verification in the statistics.
+ * @param type          Checksum type
+ * @param buf           Data
+ * @param len           Length of the data
+ * @param expected      String with expected checksum value
+ * @param matches       Set pointed variable to TRUE if checksum matches.
+ * @param calculated    If not NULL, the calculated checksum will be pointed
+ *                      here, the pointed string must be freed by caller.
+ * @param stats         Statistics to update or NULL
+ * @param err           GError **
+ * @return              returns TRUE if error is not set and FALSE if it is
+ */
+gboolean
+lr_checksum_buffer_compare_stats(LrChecksumType type,
+                                 const void *buf,
+                                 gsize len,
+                                 const char *expected,
+                                 gboolean *matches,
+                                 gchar **calculated,
+                                 LrStats *stats,
+                                 GError **err);
+
+G_END_DECLS
+
+#endif
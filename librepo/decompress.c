@@ -0,0 +1,583 @@
+/* librepo - A library providing (libcURL like) API to downloading repository
+ * Copyright (C) 2026  agent
+ *
+ * Licensed under the GNU Lesser General Public License Version 2.1
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <glib.h>
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/xattr.h>
+#include <openssl/evp.h>
+
+#ifdef WITH_DECOMPRESSION
+#include <zlib.h>
+#include <bzlib.h>
+#include <lzma.h>
+#include <zstd.h>
+#endif /* WITH_DECOMPRESSION */
+
+#include "cleanup.h"
+#include "decompress_internal.h"
+#include "rcodes.h"
+#include "util.h"
+#include "xattr_internal.h"
+
+#define BUFFER_SIZE             (128*1024)
+
+static const struct {
+    const char *suffix;
+    LrCompressionType type;
+} compression_suffixes[] = {
+    { ".gz",  LR_COMPRESSION_GZ },
+    { ".bz2", LR_COMPRESSION_BZ2 },
+    { ".xz",  LR_COMPRESSION_XZ },
+    { ".zst", LR_COMPRESSION_ZSTD },
+    { NULL,   LR_COMPRESSION_NONE },
+};
+
+LrCompressionType
+lr_detect_compression(const char *path)
+{
+    if (!path)
+        return LR_COMPRESSION_NONE;
+
+    for (int x = 0; compression_suffixes[x].suffix; x++)
+        if (g_str_has_suffix(path, compression_suffixes[x].suffix))
+            return compression_suffixes[x].type;
+
+    return LR_COMPRESSION_NONE;
+}
+
+char *
+lr_path_without_compression_suffix(const char *path)
+{
+    if (!path)
+        return NULL;
+
+    for (int x = 0; compression_suffixes[x].suffix; x++)
+        if (g_str_has_suffix(path, compression_suffixes[x].suffix))
+            return g_strndup(path, strlen(path)
+                                   - strlen(compression_suffixes[x].suffix));
+
+    return NULL;
+}
+
+#ifdef WITH_DECOMPRESSION
+
+/** Destination of the decompressed data */
+typedef struct {
+    int fd;             /*!< Output file descriptor */
+    EVP_MD_CTX *ctx;    /*!< Checksum context or NULL */
+} LrDecompressSink;
+
+static gboolean
+sink_write(LrDecompressSink *sink,
+           const unsigned char *buf,
+           size_t len,
+           GError **err)
+{
+    if (len == 0)
+        return TRUE;
+
+    if (sink->ctx && !EVP_DigestUpdate(sink->ctx, buf, len)) {
+        g_set_error(err, LR_YUM_ERROR, LRE_OPENSSL,
+                    "EVP_DigestUpdate() failed");
+        return FALSE;
+    }
+
+    while (len > 0) {
+        ssize_t written = write(sink->fd, buf, len);
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            g_set_error(err, LR_YUM_ERROR, LRE_IO,
+                        "write() failed: %s", g_strerror(errno));
+            return FALSE;
+        }
+        buf += written;
+        len -= written;
+    }
+
+    return TRUE;
+}
+
+static ssize_t
+source_read(int fd, unsigned char *buf, GError **err)
+{
+    ssize_t readed;
+
+    do {
+        readed = read(fd, buf, BUFFER_SIZE);
+    } while (readed < 0 && errno == EINTR);
+
+    if (readed < 0)
+        g_set_error(err, LR_YUM_ERROR, LRE_IO,
+                    "read() failed: %s", g_strerror(errno));
+
+    return readed;
+}
+
+static gboolean
+decompress_gz(int in_fd, LrDecompressSink *sink, GError **err)
+{
+    gboolean ret = FALSE;
+    gboolean stream_end = FALSE;
+    unsigned char *in = lr_malloc(BUFFER_SIZE);
+    unsigned char *out = lr_malloc(BUFFER_SIZE);
+    z_stream strm;
+
+    memset(&strm, 0, sizeof(strm));
+    // 15 + 32 - Max window size with automatic gzip/zlib header detection
+    if (inflateInit2(&strm, 15 + 32) != Z_OK) {
+        g_set_error(err, LR_YUM_ERROR, LRE_DECOMPRESS,
+                    "inflateInit2() failed");
+        goto out;
+    }
+
+    while (1) {
+        ssize_t readed = source_read(in_fd, in, err);
+        if (readed < 0)
+            goto cleanup;
+        if (readed == 0)
+            break;
+
+        strm.next_in = in;
+        strm.avail_in = readed;
+
+        while (strm.avail_in > 0) {
+            if (stream_end) {
+                // Concatenated gzip members (e.g. output of pigz)
+                inflateReset(&strm);
+                stream_end = FALSE;
+            }
+
+            strm.next_out = out;
+            strm.avail_out = BUFFER_SIZE;
+
+            int rc = inflate(&strm, Z_NO_FLUSH);
+            if (rc != Z_OK && rc != Z_STREAM_END && rc != Z_BUF_ERROR) {
+                g_set_error(err, LR_YUM_ERROR, LRE_DECOMPRESS,
+                            "inflate() failed: %s",
+                            strm.msg ? strm.msg : "unknown error");
+                goto cleanup;
+            }
+
+            if (!sink_write(sink, out, BUFFER_SIZE - strm.avail_out, err))
+                goto cleanup;
+
+            if (rc == Z_STREAM_END)
+                stream_end = TRUE;
+        }
+    }
+
+    if (!stream_end) {
+        g_set_error(err, LR_YUM_ERROR, LRE_DECOMPRESS,
+                    "Unexpected end of gzip stream");
+        goto cleanup;
+    }
+
+    ret = TRUE;
+
+cleanup:
+    inflateEnd(&strm);
+out:
+    lr_free(in);
+    lr_free(out);
+    return ret;
+}
+
+static gboolean
+decompress_bz2(int in_fd, LrDecompressSink *sink, GError **err)
+{
+    gboolean ret = FALSE;
+    gboolean stream_end = FALSE;
+    unsigned char *in = lr_malloc(BUFFER_SIZE);
+    unsigned char *out = lr_malloc(BUFFER_SIZE);
+    bz_stream strm;
+
+    memset(&strm, 0, sizeof(strm));
+    if (BZ2_bzDecompressInit(&strm, 0, 0) != BZ_OK) {
+        g_set_error(err, LR_YUM_ERROR, LRE_DECOMPRESS,
+                    "BZ2_bzDecompressInit() failed");
+        goto out;
+    }
+
+    while (1) {
+        ssize_t readed = source_read(in_fd, in, err);
+        if (readed < 0)
+            goto cleanup;
+        if (readed == 0)
+            break;
+
+        strm.next_in = (char *) in;
+        strm.avail_in = readed;
+
+        while (strm.avail_in > 0) {
+            if (stream_end) {
+                // Concatenated bzip2 streams (e.g. output of pbzip2)
+                BZ2_bzDecompressEnd(&strm);
+                char *next_in = strm.next_in;
+                unsigned int avail_in = strm.avail_in;
+                memset(&strm, 0, sizeof(strm));
+                if (BZ2_bzDecompressInit(&strm, 0, 0) != BZ_OK) {
+                    g_set_error(err, LR_YUM_ERROR, LRE_DECOMPRESS,
+                                "BZ2_bzDecompressInit() failed");
+                    goto out;
+                }
+                strm.next_in = next_in;
+                strm.avail_in = avail_in;
+                stream_end = FALSE;
+            }
+
+            strm.next_out = (char *) out;
+            strm.avail_out = BUFFER_SIZE;
+
+            int rc = BZ2_bzDecompress(&strm);
+            if (rc != BZ_OK && rc != BZ_STREAM_END) {
+                g_set_error(err, LR_YUM_ERROR, LRE_DECOMPRESS,
+                            "BZ2_bzDecompress() failed: %d", rc);
+                goto cleanup;
+            }
+
+            if (!sink_write(sink, out, BUFFER_SIZE - strm.avail_out, err))
+                goto cleanup;
+
+            if (rc == BZ_STREAM_END)
+                stream_end = TRUE;
+        }
+    }
+
+    if (!stream_end) {
+        g_set_error(err, LR_YUM_ERROR, LRE_DECOMPRESS,
+                    "Unexpected end of bzip2 stream");
+        goto cleanup;
+    }
+
+    ret = TRUE;
+
+cleanup:
+    BZ2_bzDecompressEnd(&strm);
+out:
+    lr_free(in);
+    lr_free(out);
+    return ret;
+}
+
+static gboolean
+decompress_xz(int in_fd, LrDecompressSink *sink, GError **err)
+{
+    gboolean ret = FALSE;
+    unsigned char *in = lr_malloc(BUFFER_SIZE);
+    unsigned char *out = lr_malloc(BUFFER_SIZE);
+    lzma_stream strm = LZMA_STREAM_INIT;
+    lzma_action action = LZMA_RUN;
+
+    if (lzma_stream_decoder(&strm, UINT64_MAX, LZMA_CONCATENATED) != LZMA_OK) {
+        g_set_error(err, LR_YUM_ERROR, LRE_DECOMPRESS,
+                    "lzma_stream_decoder() failed");
+        goto out;
+    }
+
+    while (1) {
+        if (strm.avail_in == 0 && action == LZMA_RUN) {
+            ssize_t readed = source_read(in_fd, in, err);
+            if (readed < 0)
+                goto cleanup;
+            if (readed == 0)
+                action = LZMA_FINISH;
+            strm.next_in = in;
+            strm.avail_in = readed;
+        }
+
+        strm.next_out = out;
+        strm.avail_out = BUFFER_SIZE;
+
+        lzma_ret rc = lzma_code(&strm, action);
+        if (rc != LZMA_OK && rc != LZMA_STREAM_END) {
+            g_set_error(err, LR_YUM_ERROR, LRE_DECOMPRESS,
+                        "lzma_code() failed: %d", rc);
+            goto cleanup;
+        }
+
+        if (!sink_write(sink, out, BUFFER_SIZE - strm.avail_out, err))
+            goto cleanup;
+
+        if (rc == LZMA_STREAM_END)
+            break;
+    }
+
+    ret = TRUE;
+
+cleanup:
+    lzma_end(&strm);
+out:
+    lr_free(in);
+    lr_free(out);
+    return ret;
+}
+
+static gboolean
+decompress_zstd(int in_fd, LrDecompressSink *sink, GError **err)
+{
+    gboolean ret = FALSE;
+    size_t rc = 0;
+    unsigned char *in = lr_malloc(BUFFER_SIZE);
+    unsigned char *out = lr_malloc(BUFFER_SIZE);
+    ZSTD_DStream *strm = ZSTD_createDStream();
+
+    if (!strm) {
+        g_set_error(err, LR_YUM_ERROR, LRE_DECOMPRESS,
+                    "ZSTD_createDStream() failed");
+        goto out;
+    }
+
+    while (1) {
+        ssize_t readed = source_read(in_fd, in, err);
+        if (readed < 0)
+            goto out;
+        if (readed == 0)
+            break;
+
+        ZSTD_inBuffer input = { in, readed, 0 };
+        while (input.pos < input.size) {
+            ZSTD_outBuffer output = { out, BUFFER_SIZE, 0 };
+
+            rc = ZSTD_decompressStream(strm, &output, &input);
+            if (ZSTD_isError(rc)) {
+                g_set_error(err, LR_YUM_ERROR, LRE_DECOMPRESS,
+                            "ZSTD_decompressStream() failed: %s",
+                            ZSTD_getErrorName(rc));
+                goto out;
+            }
+
+            if (!sink_write(sink, out, output.pos, err))
+                goto out;
+        }
+    }
+
+    // Non-zero value means the last frame is not complete
+    if (rc != 0) {
+        g_set_error(err, LR_YUM_ERROR, LRE_DECOMPRESS,
+                    "Unexpected end of zstd stream");
+        goto out;
+    }
+
+    ret = TRUE;
+
+out:
+    ZSTD_freeDStream(strm);
+    lr_free(in);
+    lr_free(out);
+    return ret;
+}
+
+static const EVP_MD *
+checksum_evp_md(LrChecksumType type)
+{
+    switch (type) {
+        case LR_CHECKSUM_MD5:       return EVP_md5();
+        case LR_CHECKSUM_SHA1:      return EVP_sha1();
+        case LR_CHECKSUM_SHA224:    return EVP_sha224();
+        case LR_CHECKSUM_SHA256:    return EVP_sha256();
+        case LR_CHECKSUM_SHA384:    return EVP_sha384();
+        case LR_CHECKSUM_SHA512:    return EVP_sha512();
+        case LR_CHECKSUM_UNKNOWN:
+        default:                    return NULL;
+    }
+}
+
+/** Store the verified checksum of the decompressed file in its extended
+ * attributes, so later lr_checksum_fd_cmp() with caching enabled doesn't
+ * need to read the file again.
+ */
+static void
+cache_checksum(int fd, LrChecksumType type, const char *checksum)
+{
+    struct stat st;
+
+    if (fstat(fd, &st) != 0)
+        return;
+
+    _cleanup_free_ gchar *timestamp_str = g_strdup_printf("%lli", (long long) st.st_mtime);
+    _cleanup_free_ gchar *timestamp_key = g_strconcat(XATTR_CHKSUM_PREFIX, "mtime", NULL);
+    _cleanup_free_ gchar *checksum_key = g_strconcat(XATTR_CHKSUM_PREFIX,
+                                                     lr_checksum_type_to_str(type),
+                                                     NULL);
+    FSETXATTR(fd, timestamp_key, timestamp_str, strlen(timestamp_str), 0);
+    FSETXATTR(fd, checksum_key, checksum, strlen(checksum), 0);
+}
+
+gboolean
+lr_decompress_file(const char *path,
+                   const char *dest,
+                   LrChecksumType checksum_type,
+                   const char *expected,
+                   GError **err)
+{
+    gboolean ret = FALSE;
+    LrDecompressSink sink = { -1, NULL };
+    _cleanup_fd_close_ int in_fd = -1;
+    _cleanup_free_ gchar *tmp_dest = NULL;
+    _cleanup_free_ gchar *checksum = NULL;
+
+    assert(path);
+    assert(dest);
+    assert(!err || *err == NULL);
+
+    LrCompressionType type = lr_detect_compression(path);
+    if (type == LR_COMPRESSION_NONE) {
+        g_set_error(err, LR_YUM_ERROR, LRE_DECOMPRESS,
+                    "Unknown compression of %s", path);
+        return FALSE;
+    }
+
+    const EVP_MD *md = NULL;
+    if (checksum_type != LR_CHECKSUM_UNKNOWN) {
+        md = checksum_evp_md(checksum_type);
+        if (!md || !expected) {
+            g_set_error(err, LR_YUM_ERROR, LRE_UNKNOWNCHECKSUM,
+                        "Cannot verify checksum of decompressed %s", path);
+            return FALSE;
+        }
+    }
+
+    in_fd = open(path, O_RDONLY);
+    if (in_fd < 0) {
+        g_set_error(err, LR_YUM_ERROR, LRE_IO,
+                    "Cannot open %s: %s", path, g_strerror(errno));
+        return FALSE;
+    }
+
+#ifdef POSIX_FADV_SEQUENTIAL
+    posix_fadvise(in_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+    tmp_dest = g_strconcat(dest, ".part", NULL);
+    sink.fd = open(tmp_dest, O_CREAT|O_TRUNC|O_WRONLY, 0666);
+    if (sink.fd < 0) {
+        g_set_error(err, LR_YUM_ERROR, LRE_IO,
+                    "Cannot create %s: %s", tmp_dest, g_strerror(errno));
+        return FALSE;
+    }
+
+    if (md) {
+        sink.ctx = EVP_MD_CTX_create();
+        if (!sink.ctx || !EVP_DigestInit_ex(sink.ctx, md, NULL)) {
+            g_set_error(err, LR_YUM_ERROR, LRE_OPENSSL,
+                        "Cannot initialize checksum context");
+            goto out;
+        }
+    }
+
+    switch (type) {
+        case LR_COMPRESSION_GZ:
+            ret = decompress_gz(in_fd, &sink, err);
+            break;
+        case LR_COMPRESSION_BZ2:
+            ret = decompress_bz2(in_fd, &sink, err);
+            break;
+        case LR_COMPRESSION_XZ:
+            ret = decompress_xz(in_fd, &sink, err);
+            break;
+        case LR_COMPRESSION_ZSTD:
+            ret = decompress_zstd(in_fd, &sink, err);
+            break;
+        case LR_COMPRESSION_NONE:
+        default:
+            assert(0);
+    }
+
+    if (!ret) {
+        g_prefix_error(err, "Cannot decompress %s: ", path);
+        goto out;
+    }
+
+    if (sink.ctx) {
+        unsigned char raw_checksum[EVP_MAX_MD_SIZE];
+        unsigned int len;
+
+        if (!EVP_DigestFinal_ex(sink.ctx, raw_checksum, &len)) {
+            g_set_error(err, LR_YUM_ERROR, LRE_OPENSSL,
+                        "EVP_DigestFinal_ex() failed");
+            ret = FALSE;
+            goto out;
+        }
+
+        checksum = lr_malloc0(sizeof(char) * (len * 2 + 1));
+        for (size_t x = 0; x < len; x++)
+            sprintf(checksum+(x*2), "%02x", raw_checksum[x]);
+
+        if (strcmp(checksum, expected)) {
+            g_set_error(err, LR_YUM_ERROR, LRE_BADCHECKSUM,
+                        "Checksum of decompressed %s doesn't match "
+                        "(expected: %s calculated: %s)",
+                        path, expected, checksum);
+            ret = FALSE;
+            goto out;
+        }
+    }
+
+    if (fsync(sink.fd) != 0) {
+        g_set_error(err, LR_YUM_ERROR, LRE_FILE,
+                    "fsync failed: %s", g_strerror(errno));
+        ret = FALSE;
+        goto out;
+    }
+
+    if (rename(tmp_dest, dest) != 0) {
+        g_set_error(err, LR_YUM_ERROR, LRE_IO,
+                    "Cannot rename %s to %s: %s",
+                    tmp_dest, dest, g_strerror(errno));
+        ret = FALSE;
+        goto out;
+    }
+
+    if (checksum)
+        cache_checksum(sink.fd, checksum_type, checksum);
+
+out:
+    if (sink.ctx)
+        EVP_MD_CTX_destroy(sink.ctx);
+    close(sink.fd);
+    if (!ret)
+        unlink(tmp_dest);
+    return ret;
+}
+
+#else /* WITH_DECOMPRESSION */
+
+gboolean
+lr_decompress_file(const char *path,
+                   G_GNUC_UNUSED const char *dest,
+                   G_GNUC_UNUSED LrChecksumType checksum_type,
+                   G_GNUC_UNUSED const char *expected,
+                   GError **err)
+{
+    g_set_error(err, LR_YUM_ERROR, LRE_DECOMPRESS,
+                "Cannot decompress %s: librepo was built without "
+                "decompression support", path);
+    return FALSE;
+}
+
+#endif /* WITH_DECOMPRESSION */
@@ -0,0 +1,77 @@
+/* librepo - A library providing (libcURL like) API to downloading repository
+ * Copyright (C) 2026  agent
+ *
+ * Licensed under the GNU Lesser General Public License Version 2.1
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef __LR_DECOMPRESS_INTERNAL_H__
+#define __LR_DECOMPRESS_INTERNAL_H__
+
+#include <glib.h>
+
+#include "checksum.h"
+
+G_BEGIN_DECLS
+
+/** Supported compression formats of metadata files */
+typedef enum {
+    LR_COMPRESSION_NONE,    /*!< Not compressed (or unknown suffix) */
+    LR_COMPRESSION_GZ,      /*!< gzip (.gz) */
+    LR_COMPRESSION_BZ2,     /*!< bzip2 (.bz2) */
+    LR_COMPRESSION_XZ,      /*!< xz (.xz) */
+    LR_COMPRESSION_ZSTD,    /*!< zstd (.zst) */
+} LrCompressionType;
+
+/** Detect compression format from the suffix of the filename.
+ * @param path      Path or filename
+ * @return          Compression type, LR_COMPRESSION_NONE if the suffix
+ *                  is not recognized.
+ */
+LrCompressionType
+lr_detect_compression(const char *path);
+
+/** Return path without the compression suffix.
+ * @param path      Path of a compressed file
+ * @return          Newly allocated path or NULL if the path doesn't have
+ *                  a recognized compression suffix.
+ */
+char *
+lr_path_without_compression_suffix(const char *path);
+
+/** Decompress file and verify the checksum of the decompressed content.
+ * The content is decompressed into "<dest>.part" file, the checksum
+ * is calculated on the fly and the file is renamed to dest only if
+ * the checksum matches. The calculated checksum is cached in extended
+ * attributes of the dest file, the same way as lr_checksum_fd_cmp() does.
+ * @param path              Path of the compressed file
+ * @param dest              Path of the decompressed file
+ * @param checksum_type     Type of the expected checksum or
+ *                          LR_CHECKSUM_UNKNOWN to skip the check
+ * @param expected          Expected checksum of the decompressed content
+ * @param err               GError **
+ * @return                  If FALSE then err is set.
+ */
+gboolean
+lr_decompress_file(const char *path,
+                   const char *dest,
+                   LrChecksumType checksum_type,
+                   const char *expected,
+                   GError **err);
+
+G_END_DECLS
+
+#endif
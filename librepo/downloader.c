@@ -18,13 +18,15 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
  */
 
-#define _XOPEN_SOURCE   500 // Because of fdopen() and ftruncate()
+#define _XOPEN_SOURCE   500 // Because of pwrite() and ftruncate()
 #define _DEFAULT_SOURCE     // Because of futimes()
 #define _BSD_SOURCE         // Because of futimes()
+#define _GNU_SOURCE         // Because of F_OFD_SETLK and fallocate()
 
 #include <glib.h>
 #include <assert.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <time.h>
 #include <unistd.h>
 #include <string.h>
@@ -52,6 +54,11 @@
 #include "url_substitution.h"
 #include "yum_internal.h"
 #include "xattr_internal.h"
+#include "trace_internal.h"
+#include "checksum_internal.h"
+#include "stats_internal.h"
+#include "arena_internal.h"
+#include "io_internal.h"
 
 
 volatile sig_atomic_t lr_interrupt = 0;
@@ -62,6 +69,9 @@ lr_sigint_handler(G_GNUC_UNUSED int sig)
     lr_interrupt = 1;
 }
 
+/** Length of the dedup key of a target (hex SHA-256) */
+#define LR_DEDUP_KEY_LEN        64
+
 typedef enum {
     LR_DS_WAITING, /*!<
         The target is waiting to be processed. */
@@ -71,6 +81,9 @@ typedef enum {
         The transfer is successfully finished. */
     LR_DS_FAILED, /*!<
         The transfer is finished without success. */
+    LR_DS_DUPLICATE, /*!<
+        The target waits for the transfer of an identical target
+        (see add_target()). */
 } LrDownloadState;
 
 typedef enum {
@@ -100,14 +113,6 @@ typedef enum {
         The zchunk file is finished being downloaded. */
 } LrZckState;
 
-typedef struct {
-    LrHandle *handle; /*!<
-        Handle (could be NULL) */
-    GSList *lrmirrors; /*!<
-        List of LrMirrors created from the handle internal mirrorlist
-        (could be NULL) */
-} LrHandleMirrors;
-
 typedef struct {
     LrInternalMirror *mirror; /*!<
         Mirror */
@@ -126,8 +131,117 @@ typedef struct {
     int max_ranges; /*!<
         Maximum ranges supported in a single request.  This will be automatically
         adjusted when mirrors respond with 200 to a range request */
+    guint position; /*!<
+        Position of the mirror in the order of its LrHandleMirrors */
 } LrMirror;
 
+typedef struct {
+    LrHandle *handle; /*!<
+        Handle (could be NULL) */
+    LrMirror *mirrors; /*!<
+        Array of LrMirrors created from the handle internal mirrorlist
+        (could be NULL). The array is never reallocated, so pointers
+        to its items stay valid for the whole download */
+    guint nmirrors; /*!<
+        Number of items in the mirrors array */
+    guint *order; /*!<
+        Indexes to the mirrors array in the current order of
+        preference (see sort_mirrors()) */
+    gboolean rqheaders_ready; /*!<
+        Whether the rqheaders were already built */
+    struct curl_slist *rqheaders; /*!<
+        Request headers from LRO_HTTPHEADER of the handle shared by all
+        its transfers which don't need any extra header (could be NULL) */
+} LrHandleMirrors;
+
+/** Item of the list of mirrors already tried by a target. The items
+ * live in the arena of the download and are reused by other targets
+ * when they are removed from the list (see LrDownload.spare_tried_mirrors)
+ */
+typedef struct _LrTriedMirror LrTriedMirror;
+
+struct _LrTriedMirror {
+    LrTriedMirror *next; /*!<
+        Next item of the list or NULL */
+    LrMirror *mirror; /*!<
+        Tried mirror (NULL if the target was downloaded without mirror) */
+};
+
+/** Summarized progress of all targets of a download
+ * (see LRO_TOTALPROGRESSCB)
+ */
+typedef struct {
+    LrProgressCb cb; /*!<
+        User callback or NULL */
+    void *cbdata; /*!<
+        User data for the callback */
+    double total; /*!<
+        Sum of total sizes of the targets */
+    double downloaded; /*!<
+        Sum of downloaded sizes of the targets */
+    LrProgressLimiter limiter; /*!<
+        Rate limiting of the callback */
+} LrTotalProgress;
+
+/** State of a target which is needed only during its transfer.
+ * It's attached to the target when the transfer is being prepared and
+ * detached when the transfer ends, so waiting and finished targets
+ * don't carry it. Detached transfers are reused by next transfers.
+ */
+typedef struct {
+    CURL *curl_handle; /*!<
+        Used curl handle or NULL */
+    int fd; /*!<
+        Descriptor of the target file (opened by its filename or dup of
+        the descriptor from LrDownloadTarget) or -1 */
+    char *wbuf; /*!<
+        Page aligned buffer of LR_WRITE_BUFFER_SIZE bytes for the data
+        written to fd or NULL. It's kept when the transfer is reused. */
+    size_t wbuf_len; /*!<
+        Number of bytes in wbuf */
+    gint64 wpos; /*!<
+        Offset of fd where the data are written or -1 if they are
+        written at the current offset of fd (zchunk moves the offset
+        itself, pipes cannot be positioned) */
+    gboolean writeback; /*!<
+        Start the writeback of the written data (LRO_DROPPAGECACHE) */
+    LrIoRing *ring; /*!<
+        Ring of the download for asynchronous writes or NULL */
+    char *wbuf_spare; /*!<
+        Second write buffer which is written asynchronously while wbuf
+        is filled or NULL. It's kept when the transfer is reused. */
+    guint pending_writes; /*!<
+        Asynchronous writes of the transfer which are not completed */
+    int write_errno; /*!<
+        errno of a failed asynchronous write or 0 */
+    GByteArray *data; /*!<
+        Buffer of an in-memory target (owned by the LrDownloadTarget)
+        where the data are appended instead of fd or NULL */
+    gint64 data_max; /*!<
+        Maximal length of data (expectedsize of the target or
+        LR_DOWNLOADTARGET_DATA_MAX) */
+    gboolean data_exceeded; /*!<
+        The transfer was interrupted because it brought more than
+        data_max bytes */
+    char errorbuffer[CURL_ERROR_SIZE]; /*!<
+        Error buffer used in curl handle */
+    LrHeaderCbState headercb_state; /*!<
+        State of the header callback for current transfer */
+    gchar *headercb_interrupt_reason; /*!<
+        Reason why was the transfer interrupted */
+    gint64 writecb_recieved; /*!<
+        Total number of bytes received by the write function
+        during the current transfer. */
+    gboolean writecb_required_range_written; /*!<
+        If a byte range was specified to download and the
+        range was downloaded, it is TRUE. Otherwise FALSE. */
+    struct curl_slist *curl_rqheaders; /*!<
+        Extra headers for request. */
+    gboolean curl_rqheaders_shared; /*!<
+        The curl_rqheaders are the handle_mirrors->rqheaders
+        and must not be freed with the transfer */
+} LrTransfer;
+
 typedef struct {
     LrDownloadState state; /*!<
         State of the download (transfer). */
@@ -146,16 +260,14 @@ typedef struct {
         was done. */
     LrProtocol protocol; /*!<
         Current protocol */
-    CURL *curl_handle; /*!<
-        Used curl handle or NULL */
-    FILE *f; /*!<
-        fdopened file descriptor from LrDownloadTarget and used
-        in curl_handle. */
-    char errorbuffer[CURL_ERROR_SIZE]; /*!<
-        Error buffer used in curl handle */
-    GSList *tried_mirrors; /*!<
-        List of already tried mirrors (LrMirror *).
+    LrTransfer *transfer; /*!<
+        State of the current transfer. Only set while the target
+        is LR_DS_RUNNING (or being prepared to run), otherwise NULL */
+    LrTriedMirror *tried_mirrors; /*!<
+        List of already tried mirrors.
         This mirrors won't be tried again. */
+    guint num_tried_mirrors; /*!<
+        Length of the tried_mirrors list */
     gboolean resume; /*!<
         Is resume enabled? Download target may state that resume is True
         but Librepo can decide that resuming won't be done.
@@ -165,34 +277,82 @@ typedef struct {
         the downloading. If resume is not enabled, then value is -1. */
     gint resume_count; /*!<
         How many resumes were done */
-    GSList *lrmirrors; /*!<
-        List of all available mirors (LrMirror *).
-        This list is generated from LrHandle related to this target
-        and is common for all targets that uses the handle. */
+    LrHandleMirrors *handle_mirrors; /*!<
+        All available mirrors and other data common for all
+        targets that use the handle of this target */
+    guint index; /*!<
+        Index of the target in the targets array of the download */
     LrHandle *handle; /*!<
         LrHandle associated with this target */
-    LrHeaderCbState headercb_state; /*!<
-        State of the header callback for current transfer */
-    gchar *headercb_interrupt_reason; /*!<
-        Reason why was the transfer interrupted */
-    gint64 writecb_recieved; /*!<
-        Total number of bytes received by the write function
-        during the current transfer. */
-    gboolean writecb_required_range_written; /*!<
-        If a byte range was specified to download and the
-        range was downloaded, it is TRUE. Otherwise FALSE. */
     LrCbReturnCode cb_return_code; /*!<
         Last cb return code. */
-    struct curl_slist *curl_rqheaders; /*!<
-        Extra headers for request. */
 
     #ifdef WITH_ZCHUNK
     LrZckState zck_state; /*!<
         Zchunk download status */
+    gint64 zck_reused; /*!<
+        Size of the chunks found in local files or -1 if they weren't
+        looked for yet. Counted in the statistics when the target is
+        finished */
     #endif /* WITH_ZCHUNK */
 
     gboolean range_fail; /*!<
         Whether range request failed. */
+
+    gboolean notmodified; /*!<
+        Conditional transfer only. Server reported that the local
+        copy of the target is up to date. */
+
+    gchar *etag; /*!<
+        Conditional transfer only. ETag sent by the server
+        in the current transfer or NULL. */
+
+    gint64 filetime; /*!<
+        Conditional transfer only. Remote time of the target
+        (seconds since the Epoch) or -1 if unknown. */
+
+    LrProgressLimiter progress_limiter; /*!<
+        Rate limiting of the progress callback of the target */
+
+    LrTotalProgress *total_progress; /*!<
+        Summarized progress of the download or NULL if nobody
+        is interested in it */
+
+    double reported_total; /*!<
+        Total size of the target counted in the total_progress */
+
+    double reported_downloaded; /*!<
+        Downloaded size of the target counted in the total_progress */
+
+    gint64 trace_start; /*!<
+        Start of the current transfer for the trace or -1 */
+
+    gboolean done; /*!<
+        The target reached its final state and the donecb was called */
+
+    const char *dedup_key; /*!<
+        Key of the target in the dedup table of the download (points
+        to the dedup_key_buf) or NULL if the target cannot share its
+        transfer (see target_dedup_key()) */
+    gchar dedup_key_buf[LR_DEDUP_KEY_LEN + 1]; /*!<
+        Storage of the dedup_key, the target keeps it when it's reused */
+
+    GSList *duplicates; /*!<
+        Identical targets (LR_DS_DUPLICATE) which wait for the transfer
+        of this target (LrTarget *) */
+
+    int lock_fd; /*!<
+        Descriptor holding the lock of the target file from the start
+        of the first transfer until the target is done or -1
+        (see lock_target_file()) */
+
+    gint64 lock_retry; /*!<
+        Monotonic time of the next attempt to lock the target file
+        locked by another process or 0 if it wasn't locked */
+
+    gint64 lock_deadline; /*!<
+        Monotonic time when the waiting for the lock of the target file
+        runs out (see LRO_LOCKTIMEOUT) */
 } LrTarget;
 
 typedef struct {
@@ -222,14 +382,64 @@ typedef struct {
     CURLM *multi_handle; /*!<
         Curl Multi handle */
 
-    GSList *handle_mirrors; /*!<
-        All mirrors (list of pointers to LrHandleMirrors structures) */
+    GPtrArray *handle_mirrors; /*!<
+        All mirrors (array of pointers to LrHandleMirrors structures) */
+
+    GPtrArray *targets; /*!<
+        All targets in the order of their addition (array of pointers
+        to LrTarget structures) */
+
+    guint first_waiting; /*!<
+        All targets before this index in the targets array are
+        not waiting. The scheduler starts its search here */
+
+    GPtrArray *running_transfers; /*!<
+        Running transfers in the order of their start (array of pointers
+        to LrTarget structures) */
+
+    GPtrArray *spare_transfers; /*!<
+        LrTransfers detached from finished transfers ready to be reused */
+
+    LrTargetDoneCb donecb; /*!<
+        Called when a target reaches its final state. New targets returned
+        by the callback are appended to the running download (could be NULL) */
+
+    void *donecbdata; /*!<
+        User data for the donecb */
 
-    GSList *targets; /*!<
-        List of all targets (list of pointers to LrTarget stuctures) */
+    LrTotalProgress total_progress; /*!<
+        Summarized progress of all targets */
 
-    GSList *running_transfers; /*!<
-        List of running transfers (list of pointer to LrTarget structures) */
+    LrArena *arena; /*!<
+        Memory of the targets, mirrors and other objects which live
+        as long as the download. Released at once by lr_download_clear() */
+
+    LrTargetReleaseCb releasecb; /*!<
+        If set, done targets are removed from the download as soon as
+        possible and handed over to this callback together with the
+        donecbdata (see lr_download_streamed()). Could be NULL */
+
+    guint done_targets; /*!<
+        Number of done targets in the targets array (only counted
+        if the releasecb is set) */
+
+    GPtrArray *spare_targets; /*!<
+        Released LrTargets ready to be reused (only with releasecb) */
+
+    LrTriedMirror *spare_tried_mirrors; /*!<
+        Items removed from the tried_mirrors lists ready to be reused */
+
+    GHashTable *dedup; /*!<
+        Dedup key -> LrTarget which is downloaded for all the identical
+        targets added while it's not done */
+
+    LrIoRing *ring; /*!<
+        Ring used for asynchronous writes of the received data or NULL
+        if io_uring is not available */
+
+    gboolean lock_waiting; /*!<
+        A waiting target was skipped by the last scheduling, because
+        its file is locked by another process */
 
 } LrDownload;
 
@@ -244,10 +454,10 @@ typedef struct {
  * |                              |   /->|  LrHandleMirrors  |
  * |                              |  |   +-------------------+
  * | CURLM *multi_handle          |  |   | LrHandle *handle  |
- * |                              |  |   | GSList *lrmirrors --\
- * | GSList *handle_mirrors      ---/    +-------------------+ |
- * | GSList *targets             --\                           |
- * | GSList *running_transfers   ---\                          |
+ * |                              |  |   | LrMirror *mirrors --\
+ * | GPtrArray *handle_mirrors   ---/    | guint *order      | |
+ * | GPtrArray *targets          --\     +-------------------+ |
+ * | GPtrArray *running_transfers --\                          |
  * +------------------------------+  |                         |
  *                                   |                         |
  *   /------------------------------/                          |
@@ -279,14 +489,14 @@ typedef struct {
  *       | LrDownloadState state      | | |   |  |  | char *baseurl            |
  *       | LrDownloadTarget *target  -----------/   | int fd                   |
  *       | LrMirror *mirror          --------/      | LrChecksumType checks..  |
- *       | CURL *curl_handle          |-+           | char *checksum           |
- *       | FILE *f                    |             | int resume               |
- *       | GSList *tried_mirrors      |             | LrProgressCb progresscb  |
- *       | gint64 original_offset     |             | void *cbdata             |
- *       | GSlist *lrmirrors         ---\           | GStringChunk *chunk      |
+ *       | LrTransfer *transfer       |-+           | char *checksum           |
+ *       | LrTriedMirror *tried_mirr. |             | int resume               |
+ *       | gint64 original_offset     |             | LrProgressCb progresscb  |
+ *       |                            |             | void *cbdata             |
+ *       | LrHandleMirrors *handle_m. ---\          | GStringChunk *chunk      |
  *       +----------------------------+  |          | int rcode                |
  *                                       |          | char *err                |
- *      Points to list of LrMirrors <---/           +--------------------------+
+ *      Points to its LrHandleMirrors <-/           +--------------------------+
  */
 
 static gboolean
@@ -355,31 +565,88 @@ mirror_update_statistics(LrMirror *mirror, gboolean transfer_success)
         mirror->failed_transfers++;
 }
 
-/** Create GSList of LrMirrors (if it doesn't exist) for a handle.
- * If the list already exists (if more targets use the same handle)
- * then just set the list to the current target.
- * If the list doesn't exist yet, create it then create a mapping between
- * the list and the handle (LrHandleMirrors) and set the list to
- * the current target.
+/** Whether the mirror is in the tried_mirrors list of the target
  */
-static GSList *
-lr_prepare_lrmirrors(GSList *list, LrTarget *target)
+static gboolean
+is_tried_mirror(const LrTarget *target, const LrMirror *mirror)
+{
+    for (LrTriedMirror *item = target->tried_mirrors; item; item = item->next)
+        if (item->mirror == mirror)
+            return TRUE;
+    return FALSE;
+}
+
+/** Add the mirror to the tried_mirrors list of the target
+ */
+static void
+add_tried_mirror(LrDownload *dd, LrTarget *target, LrMirror *mirror)
+{
+    LrTriedMirror *item = dd->spare_tried_mirrors;
+    if (item)
+        dd->spare_tried_mirrors = item->next;
+    else
+        item = lr_arena_alloc0(dd->arena, sizeof(*item));
+    item->mirror = mirror;
+    item->next = target->tried_mirrors;
+    target->tried_mirrors = item;
+    target->num_tried_mirrors++;
+}
+
+/** Remove the mirror from the tried_mirrors list of the target
+ * (if it's there), so it can be tried again
+ */
+static void
+remove_tried_mirror(LrDownload *dd, LrTarget *target, const LrMirror *mirror)
+{
+    for (LrTriedMirror **link = &target->tried_mirrors; *link; link = &(*link)->next) {
+        LrTriedMirror *item = *link;
+        if (item->mirror != mirror)
+            continue;
+        *link = item->next;
+        item->next = dd->spare_tried_mirrors;
+        dd->spare_tried_mirrors = item;
+        target->num_tried_mirrors--;
+        return;
+    }
+}
+
+/** Empty the tried_mirrors list of the target
+ */
+static void
+clear_tried_mirrors(LrDownload *dd, LrTarget *target)
+{
+    while (target->tried_mirrors)
+        remove_tried_mirror(dd, target, target->tried_mirrors->mirror);
+}
+
+/** Create LrHandleMirrors with an array of LrMirrors for the handle
+ * of the target (if it doesn't exist yet) and set it to the target.
+ * If it already exists (if more targets use the same handle)
+ * then just set it to the current target.
+ */
+static void
+lr_prepare_lrmirrors(LrArena *arena, GPtrArray *handle_mirrors_array, LrTarget *target)
 {
     LrHandle *handle = target->handle;
 
-    for (GSList *elem = list; elem; elem = g_slist_next(elem)) {
-        LrHandleMirrors *handle_mirrors = elem->data;
+    for (guint i = 0; i < handle_mirrors_array->len; i++) {
+        LrHandleMirrors *handle_mirrors = g_ptr_array_index(handle_mirrors_array, i);
         if (handle_mirrors->handle == handle) {
-            // List of LrMirrors for this handle is already created
-            target->lrmirrors = handle_mirrors->lrmirrors;
-            return list;
+            // LrMirrors for this handle are already created
+            target->handle_mirrors = handle_mirrors;
+            return;
         }
     }
 
-    GSList *lrmirrors = NULL;
+    LrHandleMirrors *handle_mirrors = lr_arena_alloc0(arena, sizeof(*handle_mirrors));
+    handle_mirrors->handle = handle;
 
     if (handle && handle->internal_mirrorlist) {
         g_debug("%s: Preparing internal mirror list for handle id: %p", __func__, handle);
+        guint length = g_slist_length(handle->internal_mirrorlist);
+        handle_mirrors->mirrors = lr_arena_alloc0(arena, length * sizeof(LrMirror));
+        handle_mirrors->order = lr_arena_alloc0(arena, length * sizeof(guint));
+
         for (GSList *elem = handle->internal_mirrorlist;
              elem;
              elem = g_slist_next(elem))
@@ -394,23 +661,130 @@ lr_prepare_lrmirrors(GSList *list, LrTarget *target)
 
             g_debug("%s: Mirror: %s", __func__, imirror->url);
 
-            LrMirror *mirror = lr_malloc0(sizeof(*mirror));
+            guint idx = handle_mirrors->nmirrors++;
+            LrMirror *mirror = &handle_mirrors->mirrors[idx];
             mirror->mirror = imirror;
             mirror->max_ranges = 256;
-            lrmirrors = g_slist_append(lrmirrors, mirror);
+            mirror->position = idx;
+            handle_mirrors->order[idx] = idx;
         }
     }
 
-    LrHandleMirrors *handle_mirrors = lr_malloc0(sizeof(*handle_mirrors));
-    handle_mirrors->handle = handle;
-    handle_mirrors->lrmirrors = lrmirrors;
+    target->handle_mirrors = handle_mirrors;
+    g_ptr_array_add(handle_mirrors_array, handle_mirrors);
+}
+
+
+void
+lr_progresslimiter_init(LrProgressLimiter *limiter, LrHandle *handle)
+{
+    memset(limiter, 0, sizeof(*limiter));
+    limiter->last_time = -1;
+    if (handle) {
+        limiter->interval = (gint64) handle->progressinterval * 1000;
+        limiter->bytes = (double) handle->progressbytes;
+    }
+}
+
+gboolean
+lr_progresslimiter_check(LrProgressLimiter *limiter,
+                         double total,
+                         double downloaded)
+{
+    gint64 now = 0;
+
+    if (limiter->interval <= 0 && limiter->bytes <= 0)
+        return TRUE;  // No limits
+
+    if (limiter->interval > 0)
+        now = g_get_monotonic_time();
+
+    if (limiter->last_time < 0
+        || downloaded < limiter->last_downloaded  // Download was restarted
+        || (total > 0 && downloaded >= total
+            && downloaded != limiter->last_downloaded)  // Just finished
+        || ((limiter->interval <= 0
+             || now - limiter->last_time >= limiter->interval)
+            && (limiter->bytes <= 0
+                || downloaded - limiter->last_downloaded >= limiter->bytes)))
+    {
+        limiter->last_time = now;
+        limiter->last_total = total;
+        limiter->last_downloaded = downloaded;
+        limiter->pending = FALSE;
+        return TRUE;
+    }
+
+    limiter->pending = TRUE;
+    limiter->pending_total = total;
+    limiter->pending_downloaded = downloaded;
+    return FALSE;
+}
+
+gboolean
+lr_progresslimiter_flush(LrProgressLimiter *limiter,
+                         double *total,
+                         double *downloaded)
+{
+    if (!limiter->pending)
+        return FALSE;
+
+    limiter->pending = FALSE;
+    limiter->last_total = *total = limiter->pending_total;
+    limiter->last_downloaded = *downloaded = limiter->pending_downloaded;
+    return TRUE;
+}
+
+/** Add progress of the target to the summarized progress of the download
+ * and call the LRO_TOTALPROGRESSCB.
+ */
+static int
+lr_totalprogress_update(LrTarget *target,
+                        double total_to_download,
+                        double now_downloaded)
+{
+    LrTotalProgress *progress = target->total_progress;
+
+    // Until the size is known, the expected one is counted
+    if (total_to_download <= 0 && target->target->expectedsize > 0)
+        total_to_download = (double) target->target->expectedsize;
+
+    progress->total += total_to_download - target->reported_total;
+    progress->downloaded += now_downloaded - target->reported_downloaded;
+    target->reported_total = total_to_download;
+    target->reported_downloaded = now_downloaded;
+
+    double total = MAX(progress->total, progress->downloaded);
+    if (!lr_progresslimiter_check(&progress->limiter, total, progress->downloaded))
+        return LR_CB_OK;
 
-    target->lrmirrors = lrmirrors;
-    list = g_slist_append(list, handle_mirrors);
+    return progress->cb(progress->cbdata, total, progress->downloaded);
+}
+
+/** Pass the progress suppressed by the limiter to the LRO_TOTALPROGRESSCB.
+ */
+static void
+lr_totalprogress_flush(LrTotalProgress *progress)
+{
+    double total, downloaded;
 
-    return list;
+    if (progress->cb && lr_progresslimiter_flush(&progress->limiter,
+                                                 &total, &downloaded))
+        progress->cb(progress->cbdata, total, downloaded);
 }
 
+/** Pass the summarized progress suppressed by the limiter of the shared
+ * callback data to the callback (see lr_multi_progress_func()).
+ */
+static void
+lr_multi_progress_flush(LrCallbackData *cbdata)
+{
+    LrSharedCallbackData *shared_cbdata = cbdata->sharedcbdata;
+    double total, downloaded;
+
+    if (lr_progresslimiter_flush(&shared_cbdata->limiter, &total, &downloaded))
+        shared_cbdata->cb(cbdata->userdata, total, downloaded);
+}
 
 /** Progress callback for CURL handles.
  * progress callback set by the user of librepo.
@@ -431,9 +805,6 @@ lr_progresscb(void *ptr,
     if (target->state != LR_DS_RUNNING)
         return ret;
 
-    if (!target->target->progresscb)
-        return ret;
-
 #ifdef WITH_ZCHUNK
     if (target->target->is_zchunk) {
         total_to_download = target->target->total_to_download;
@@ -441,9 +812,22 @@ lr_progresscb(void *ptr,
     }
 #endif /* WITH_ZCHUNK */
 
-    ret = target->target->progresscb(target->target->cbdata,
-                                     total_to_download,
-                                     now_downloaded);
+    if (target->total_progress)
+        ret = lr_totalprogress_update(target, total_to_download, now_downloaded);
+
+    // Progress of targets sharing one callback is limited after it is
+    // summarized by the lr_multi_progress_func()
+    if (ret == LR_CB_OK
+        && target->target->progresscb
+        && (target->target->progresscb == lr_multi_progress_func
+            || lr_progresslimiter_check(&target->progress_limiter,
+                                        total_to_download,
+                                        now_downloaded)))
+    {
+        ret = target->target->progresscb(target->target->cbdata,
+                                         total_to_download,
+                                         now_downloaded);
+    }
 
     target->cb_return_code = ret;
 
@@ -459,7 +843,7 @@ size_t lr_zckheadercb(char *b, size_t l, size_t c, void *dl_v) {
     assert(target && target->target);
 
     long code = -1;
-    curl_easy_getinfo(target->curl_handle, CURLINFO_RESPONSE_CODE, &code);
+    curl_easy_getinfo(target->transfer->curl_handle, CURLINFO_RESPONSE_CODE, &code);
     if(code == 200) {
         g_debug("%s: Too many ranges were attempted in one download", __func__);
         target->range_fail = 1;
@@ -469,11 +853,29 @@ size_t lr_zckheadercb(char *b, size_t l, size_t c, void *dl_v) {
 }
 #endif /* WITH_ZCHUNK */
 
+/** Remember the ETag of a conditional transfer.
+ * A redirect produces a block of headers per response, only the ETag
+ * of the last response is kept.
+ */
+static void
+lr_headercb_etag(LrTarget *lrtarget, const char *header)
+{
+    if (g_str_has_prefix(header, "HTTP/")) {
+        g_free(lrtarget->etag);
+        lrtarget->etag = NULL;
+    } else if (g_ascii_strncasecmp(header, "ETag:", 5) == 0) {
+        g_free(lrtarget->etag);
+        lrtarget->etag = g_strchug(g_strdup(header + 5));
+    }
+}
+
 /** Header callback for CURL handles.
  * It parses HTTP and FTP headers and try to find length of the content
  * (file size of the target). If the size is different then the expected
  * size, then the transfer is interrupted.
- * This callback is used only if the expected size is specified.
+ * For conditional targets, it also records the ETag of the response.
+ * This callback is used only if the expected size is specified
+ * or the target is conditional.
  */
 static size_t
 lr_headercb(void *ptr, size_t size, size_t nmemb, void *userdata)
@@ -482,7 +884,14 @@ lr_headercb(void *ptr, size_t size, size_t nmemb, void *userdata)
 
     size_t ret = size * nmemb;
     LrTarget *lrtarget = userdata;
-    LrHeaderCbState state = lrtarget->headercb_state;
+    LrHeaderCbState state = lrtarget->transfer->headercb_state;
+
+    if (lrtarget->target->conditional
+        && lrtarget->protocol == LR_PROTOCOL_HTTP) {
+        char *header = g_strstrip(g_strndup(ptr, size*nmemb));
+        lr_headercb_etag(lrtarget, header);
+        g_free(header);
+    }
 
     if (state == LR_HCS_DONE || state == LR_HCS_INTERRUPTED) {
         // Nothing to do
@@ -494,6 +903,11 @@ lr_headercb(void *ptr, size_t size, size_t nmemb, void *userdata)
         return lr_zckheadercb(ptr, size, nmemb, userdata);
     #endif /* WITH_ZCHUNK */
 
+    if (lrtarget->target->expectedsize <= 0) {
+        // No size to check
+        return ret;
+    }
+
     char *header = g_strstrip(g_strndup(ptr, size*nmemb));
     gint64 expected = lrtarget->target->expectedsize;
 
@@ -507,7 +921,7 @@ lr_headercb(void *ptr, size_t size, size_t nmemb, void *userdata)
                             g_strrstr(header, "Connection established") ||
                             g_strrstr(header, "Connection Established")
                         )) {
-                lrtarget->headercb_state = LR_HCS_HTTP_STATE_OK;
+                lrtarget->transfer->headercb_state = LR_HCS_HTTP_STATE_OK;
             } else {
                 // Do nothing (do not change the state)
                 // in case of redirection, 200 OK still could come
@@ -529,14 +943,14 @@ lr_headercb(void *ptr, size_t size, size_t nmemb, void *userdata)
                     g_debug("%s: Size doesn't match (%"G_GINT64_FORMAT
                             " != %"G_GINT64_FORMAT")",
                             __func__, content_length, expected);
-                    lrtarget->headercb_state = LR_HCS_INTERRUPTED;
-                    lrtarget->headercb_interrupt_reason = g_strdup_printf(
+                    lrtarget->transfer->headercb_state = LR_HCS_INTERRUPTED;
+                    lrtarget->transfer->headercb_interrupt_reason = g_strdup_printf(
                         "FTP server reports size: %"G_GINT64_FORMAT" "
                         "via 213 code, but expected size is: %"G_GINT64_FORMAT,
                         content_length, expected);
                     ret++;  // Return error value
                 } else {
-                    lrtarget->headercb_state = LR_HCS_DONE;
+                    lrtarget->transfer->headercb_state = LR_HCS_DONE;
                 }
             } else if (g_str_has_prefix(header, "150")) {
                 // Code 150 should keep the file size
@@ -560,14 +974,14 @@ lr_headercb(void *ptr, size_t size, size_t nmemb, void *userdata)
                 g_debug("%s: Size doesn't match (%"G_GINT64_FORMAT
                         " != %"G_GINT64_FORMAT")",
                         __func__, content_length, expected);
-                lrtarget->headercb_state = LR_HCS_INTERRUPTED;
-                lrtarget->headercb_interrupt_reason = g_strdup_printf(
+                lrtarget->transfer->headercb_state = LR_HCS_INTERRUPTED;
+                lrtarget->transfer->headercb_interrupt_reason = g_strdup_printf(
                     "Server reports Content-Length: %"G_GINT64_FORMAT" but "
                     "expected size is: %"G_GINT64_FORMAT,
                     content_length, expected);
                 ret++;  // Return error value
             } else {
-                lrtarget->headercb_state = LR_HCS_DONE;
+                lrtarget->transfer->headercb_state = LR_HCS_DONE;
             }
         }
     }
@@ -592,6 +1006,198 @@ lr_zck_writecb(char *ptr, size_t size, size_t nmemb, void *userdata)
 }
 #endif /* WITH_ZCHUNK */
 
+/** Size of the buffer of the data written to the target file */
+#define LR_WRITE_BUFFER_SIZE    (256 * 1024)
+
+/** Depth of the ring for asynchronous writes of a download */
+#define LR_DOWNLOAD_RING_DEPTH  64
+
+/** Write the data to the file of the transfer at its write position.
+ * @return          FALSE and errno set if a write failed
+ */
+static gboolean
+write_transfer_file(LrTransfer *transfer, const char *buf, size_t len)
+{
+    gint64 start = transfer->wpos;
+
+    while (len > 0) {
+        ssize_t written;
+        if (transfer->wpos < 0)
+            written = write(transfer->fd, buf, len);
+        else
+            written = pwrite(transfer->fd, buf, len, (off_t) transfer->wpos);
+        if (written == -1) {
+            if (errno == EINTR)
+                continue;
+            return FALSE;
+        }
+        buf += written;
+        len -= written;
+        if (transfer->wpos >= 0)
+            transfer->wpos += written;
+    }
+
+#ifdef SYNC_FILE_RANGE_WRITE
+    // Start the writeback now, so the pages are clean and can be
+    // dropped from the page cache when the file is verified
+    if (transfer->writeback && start >= 0 && transfer->wpos > start)
+        sync_file_range(transfer->fd, start, transfer->wpos - start,
+                        SYNC_FILE_RANGE_WRITE);
+#else
+    (void) start;
+#endif
+
+    return TRUE;
+}
+
+/** Allocate a page aligned write buffer.
+ * @return          Buffer of LR_WRITE_BUFFER_SIZE bytes or NULL
+ */
+static char *
+alloc_write_buffer(void)
+{
+    long page_size = sysconf(_SC_PAGESIZE);
+    void *wbuf = NULL;
+    if (posix_memalign(&wbuf, page_size > 0 ? page_size : 4096,
+                       LR_WRITE_BUFFER_SIZE) != 0)
+        return NULL;
+    return wbuf;
+}
+
+static void
+transfer_write_done(gpointer data, gint64 offset, gssize res)
+{
+    LrTransfer *transfer = data;
+
+    transfer->pending_writes--;
+    if (res < 0) {
+        if (!transfer->write_errno)
+            transfer->write_errno = (int) -res;
+        return;
+    }
+
+#ifdef SYNC_FILE_RANGE_WRITE
+    if (transfer->writeback && res > 0)
+        sync_file_range(transfer->fd, offset, res, SYNC_FILE_RANGE_WRITE);
+#else
+    (void) offset;
+#endif
+}
+
+/** Wait for the asynchronous writes of the transfer.
+ * @return          FALSE and errno set if a write failed
+ */
+static gboolean
+wait_transfer_writes(LrTransfer *transfer)
+{
+    while (transfer->pending_writes)
+        lr_io_ring_complete(transfer->ring, TRUE);
+
+    if (transfer->write_errno) {
+        errno = transfer->write_errno;
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/** Write the buffered data of the transfer to its file. With a ring,
+ * the buffer is written asynchronously and the spare buffer is filled
+ * meanwhile.
+ * @return          FALSE and errno set if a write failed
+ */
+static gboolean
+flush_transfer_buffer(LrTransfer *transfer)
+{
+    size_t len = transfer->wbuf_len;
+    transfer->wbuf_len = 0;
+    if (!len)
+        return TRUE;
+
+    if (transfer->ring && transfer->wpos >= 0) {
+        // The spare buffer can be filled when its write is completed
+        if (!wait_transfer_writes(transfer))
+            return FALSE;
+        if (!transfer->wbuf_spare)
+            transfer->wbuf_spare = alloc_write_buffer();
+        if (transfer->wbuf_spare
+            && lr_io_ring_write(transfer->ring, transfer->fd, transfer->wbuf,
+                                len, transfer->wpos, transfer_write_done,
+                                transfer))
+        {
+            char *wbuf = transfer->wbuf;
+            transfer->pending_writes++;
+            transfer->wpos += len;
+            transfer->wbuf = transfer->wbuf_spare;
+            transfer->wbuf_spare = wbuf;
+            return TRUE;
+        }
+    }
+
+    return write_transfer_file(transfer, transfer->wbuf, len);
+}
+
+/** Write all the data of the transfer to its file and wait until they
+ * are written.
+ * @return          FALSE and errno set if a write failed
+ */
+static gboolean
+finish_transfer_writes(LrTransfer *transfer)
+{
+    gboolean ret = flush_transfer_buffer(transfer);
+    if (!wait_transfer_writes(transfer))
+        ret = FALSE;
+    return ret;
+}
+
+/** Write the data to the file of the transfer. Small blocks received
+ * from curl are collected in the write buffer, so the file is written
+ * by large blocks. The data of an in-memory target are appended to its
+ * buffer up to data_max bytes.
+ * @return          FALSE and errno set if a write failed or the data
+ *                  exceed data_max (data_exceeded is set)
+ */
+static gboolean
+write_transfer_data(LrTransfer *transfer, const char *ptr, size_t len)
+{
+    if (transfer->data) {
+        if ((gint64) (transfer->data->len + len) > transfer->data_max) {
+            transfer->data_exceeded = TRUE;
+            errno = EFBIG;
+            return FALSE;
+        }
+        g_byte_array_append(transfer->data, (const guint8 *) ptr, len);
+        return TRUE;
+    }
+
+    // An asynchronous write failed
+    if (transfer->write_errno) {
+        errno = transfer->write_errno;
+        return FALSE;
+    }
+
+    if (transfer->wbuf_len == 0 && len >= LR_WRITE_BUFFER_SIZE)
+        return write_transfer_file(transfer, ptr, len);
+
+    if (!transfer->wbuf) {
+        transfer->wbuf = alloc_write_buffer();
+        if (!transfer->wbuf)
+            return write_transfer_file(transfer, ptr, len);
+    }
+
+    while (len > 0) {
+        size_t n = MIN(len, LR_WRITE_BUFFER_SIZE - transfer->wbuf_len);
+        memcpy(transfer->wbuf + transfer->wbuf_len, ptr, n);
+        transfer->wbuf_len += n;
+        ptr += n;
+        len -= n;
+        if (transfer->wbuf_len == LR_WRITE_BUFFER_SIZE
+            && !flush_transfer_buffer(transfer))
+            return FALSE;
+    }
+
+    return TRUE;
+}
+
 /** Write callback for CURL handles.
  * This callback handles situation when an user wants only specified
  * byte range of the target file.
@@ -600,7 +1206,6 @@ size_t
 lr_writecb(char *ptr, size_t size, size_t nmemb, void *userdata)
 {
     size_t cur_written_expected = nmemb;
-    size_t cur_written;
     LrTarget *target = (LrTarget *) userdata;
     #ifdef WITH_ZCHUNK
     if(target->target->is_zchunk && !target->range_fail && target->mirror->mirror->protocol == LR_PROTOCOL_HTTP)
@@ -613,18 +1218,23 @@ lr_writecb(char *ptr, size_t size, size_t nmemb, void *userdata)
 
     if (range_start <= 0 && range_end <= 0) {
         // Write everything curl give to you
-        target->writecb_recieved += all;
-        return fwrite(ptr, size, nmemb, target->f);
+        target->transfer->writecb_recieved += all;
+        if (!write_transfer_data(target->transfer, ptr, all)) {
+            if (!target->transfer->data_exceeded)
+                g_warning("Error while writing file: %s", g_strerror(errno));
+            return 0; // There was an error
+        }
+        return nmemb;
     }
 
     /* Deal with situation when user wants only specific byte range of the
      * target file, and write only the range.
      */
 
-    gint64 cur_range_start = target->writecb_recieved;
+    gint64 cur_range_start = target->transfer->writecb_recieved;
     gint64 cur_range_end = cur_range_start + all;
 
-    target->writecb_recieved += all;
+    target->transfer->writecb_recieved += all;
 
     if (target->target->byterangestart > 0) {
         // If byterangestart is specified, then CURLOPT_RESUME_FROM_LARGE
@@ -644,7 +1254,7 @@ lr_writecb(char *ptr, size_t size, size_t nmemb, void *userdata)
         // The wanted byte range is over
         // Return zero that will lead to transfer abortion
         // with error code CURLE_WRITE_ERROR
-        target->writecb_required_range_written = TRUE;
+        target->transfer->writecb_required_range_written = TRUE;
         return 0;
     }
 
@@ -679,23 +1289,56 @@ lr_writecb(char *ptr, size_t size, size_t nmemb, void *userdata)
     }
 
     assert(nmemb > 0);
-    cur_written = fwrite(ptr, size, nmemb, target->f);
-    if (cur_written != nmemb) {
-        g_warning("Error while writing file: %s", g_strerror(errno));
+    if (!write_transfer_data(target->transfer, ptr, nmemb)) {
+        if (!target->transfer->data_exceeded)
+            g_warning("Error while writing file: %s", g_strerror(errno));
         return 0; // There was an error
     }
 
     return cur_written_expected;
 }
 
-/** Select a suitable mirror
- */
-static gboolean
-select_suitable_mirror(LrDownload *dd,
-                       LrTarget *target,
-                       LrMirror **selected_mirror,
-                       GError **err)
-{
+static void
+target_done(LrDownload *dd, LrTarget *target);
+
+static void
+finish_without_transfer(LrTarget *target,
+                        LrTransferStatus status,
+                        const char *msg);
+
+static void
+release_done_targets(LrDownload *dd);
+
+static gboolean
+lock_target_file(LrTarget *target, gboolean create);
+
+static void
+unlock_target_file(LrTarget *target);
+
+static gboolean
+acquire_target_file(LrDownload *dd,
+                    LrTarget *target,
+                    gboolean *acquired,
+                    GError **err);
+
+/** Put the target back among the waiting targets.
+ */
+static void
+requeue_target(LrDownload *dd, LrTarget *target)
+{
+    target->state = LR_DS_WAITING;
+    if (target->index < dd->first_waiting)
+        dd->first_waiting = target->index;
+}
+
+/** Select a suitable mirror
+ */
+static gboolean
+select_suitable_mirror(LrDownload *dd,
+                       LrTarget *target,
+                       LrMirror **selected_mirror,
+                       GError **err)
+{
 
     gboolean at_least_one_suitable_mirror_found = FALSE;
     //  ^^^ This variable is used to indentify that all possible mirrors
@@ -715,17 +1358,18 @@ select_suitable_mirror(LrDownload *dd,
     //  the first iteration, relax the conditions (by allowing previously
     //  failing mirrors to be used again) and do additional iterations up to
     //  number of allowed failures equal to dd->allowed_mirror_failures.
+    LrHandleMirrors *handle_mirrors = target->handle_mirrors;
     do {
-        // Iterate over mirror for the target
-        for (GSList *elem = target->lrmirrors; elem; elem = g_slist_next(elem)) {
-            LrMirror *c_mirror = elem->data;
+        // Iterate over mirror for the target in the order of preference
+        for (guint i = 0; i < handle_mirrors->nmirrors; i++) {
+            LrMirror *c_mirror = &handle_mirrors->mirrors[handle_mirrors->order[i]];
             gchar *mirrorurl = c_mirror->mirror->url;
 
             // first iteration, filter out mirrors that failed previously
             if (mirrors_iterated == 0) {
                 if (c_mirror->mirror->protocol != LR_PROTOCOL_FILE)
                     reiterate = TRUE;
-                if (g_slist_find(target->tried_mirrors, c_mirror)) {
+                if (is_tried_mirror(target, c_mirror)) {
                     // This mirror was already tried for this target
                     continue;
                 }
@@ -791,7 +1435,7 @@ select_suitable_mirror(LrDownload *dd,
             *selected_mirror = c_mirror;
             return TRUE;
         }
-    } while (reiterate && g_slist_length(target->tried_mirrors) < dd->allowed_mirror_failures &&
+    } while (reiterate && target->num_tried_mirrors < dd->allowed_mirror_failures &&
     ++mirrors_iterated < dd->allowed_mirror_failures);
 
     if (!at_least_one_suitable_mirror_found) {
@@ -828,6 +1472,8 @@ select_suitable_mirror(LrDownload *dd,
                         target->target->path);
             return FALSE;
         }
+
+        target_done(dd, target);
     }
 
     return TRUE;
@@ -850,14 +1496,22 @@ select_next_target(LrDownload *dd,
     *selected_target = NULL;
     *selected_full_url = NULL;
 
-    for (GSList *elem = dd->targets; elem; elem = g_slist_next(elem)) {
-        LrTarget *target = elem->data;
+    // Targets before dd->first_waiting are known to be running or done.
+    // The cursor moves forward over such targets, so scheduling does not
+    // rescan the whole array for every new transfer.
+    gboolean waiting_before = FALSE;
+    for (guint i = dd->first_waiting; i < dd->targets->len; i++) {
+        LrTarget *target = g_ptr_array_index(dd->targets, i);
         LrMirror *mirror = NULL;
         char *full_url = NULL;
         int complete_url_in_path = 0;
 
-        if (target->state != LR_DS_WAITING)  // Pick only waiting targets
+        if (target->state != LR_DS_WAITING) {  // Pick only waiting targets
+            if (!waiting_before)
+                dd->first_waiting = i + 1;
             continue;
+        }
+        waiting_before = TRUE;
 
         // Determine if path is a complete URL
 
@@ -866,7 +1520,7 @@ select_next_target(LrDownload *dd,
         // Sanity check
 
         if (!target->target->baseurl
-            && !target->lrmirrors
+            && !target->handle_mirrors->nmirrors
             && !complete_url_in_path)
         {
             // Used relative path with empty internal mirrorlist
@@ -950,6 +1604,24 @@ select_next_target(LrDownload *dd,
                             target->target->path);
                 return FALSE;
             }
+
+            g_free(full_url);
+            full_url = NULL;
+            target_done(dd, target);
+        }
+
+        if (full_url) {
+            gboolean acquired;
+            if (!acquire_target_file(dd, target, &acquired, err)) {
+                g_free(full_url);
+                return FALSE;
+            }
+            if (!acquired) {
+                // The file is locked by another process or it was
+                // downloaded by the process meanwhile
+                g_free(full_url);
+                full_url = NULL;
+            }
         }
 
         if (full_url) {  // A waiting target found
@@ -1015,6 +1687,8 @@ remove_librepo_xattr(LrDownloadTarget * target)
         FREMOVEXATTR(fd, XATTR_LIBREPO);
         return;
     }
+    if (!target->fn)  // In-memory target
+        return;
     // If file descriptor wasn't set, file name was, and we need to open it
     fd = open(target->fn, O_RDWR, 0666);
     if (fd == -1) {
@@ -1028,9 +1702,9 @@ remove_librepo_xattr(LrDownloadTarget * target)
 gboolean
 lr_zck_clear_header(LrTarget *target, GError **err)
 {
-    assert(target && target->f && target->target && target->target->path);
+    assert(target && target->transfer->fd != -1 && target->target && target->target->path);
 
-    int fd = fileno(target->f);
+    int fd = target->transfer->fd;
     lseek(fd, 0, SEEK_END);
     if(ftruncate(fd, 0) < 0) {
         g_set_error(err, LR_DOWNLOADER_ERROR, LRE_IO,
@@ -1046,7 +1720,7 @@ find_local_zck_header(LrTarget *target, GError **err)
 {
     zckCtx *zck = NULL;
     gboolean found = FALSE;
-    int fd = fileno(target->f);
+    int fd = target->transfer->fd;
 
     if(target->target->handle->cachedir) {
         g_debug("%s: Cache directory: %s\n", __func__,
@@ -1124,7 +1798,7 @@ static gboolean
 prep_zck_header(LrTarget *target, GError **err)
 {
     zckCtx *zck = NULL;
-    int fd = fileno(target->f);
+    int fd = target->transfer->fd;
     GError *tmp_err = NULL;
 
     if(lr_zck_valid_header(target->target, target->target->path, fd,
@@ -1182,7 +1856,7 @@ find_local_zck_chunks(LrTarget *target, GError **err)
     assert(target && target->target && target->target->zck_dl);
 
     zckCtx *zck = zck_dl_get_zck(target->target->zck_dl);
-    int fd = fileno(target->f);
+    int fd = target->transfer->fd;
     if(zck && fd != zck_get_fd(zck) && !zck_set_fd(zck, fd)) {
         g_set_error(err, LR_DOWNLOADER_ERROR, LRE_ZCK,
                     "Unable to set zchunk file descriptor for %s: %s",
@@ -1250,7 +1924,7 @@ static gboolean
 prep_zck_body(LrTarget *target, GError **err)
 {
     zckCtx *zck = zck_dl_get_zck(target->target->zck_dl);
-    int fd = fileno(target->f);
+    int fd = target->transfer->fd;
     if(zck && fd != zck_get_fd(zck) && !zck_set_fd(zck, fd)) {
         g_set_error(err, LR_DOWNLOADER_ERROR, LRE_ZCK,
                     "Unable to set zchunk file descriptor for %s: %s",
@@ -1286,11 +1960,27 @@ prep_zck_body(LrTarget *target, GError **err)
     return TRUE;
 }
 
+/** Remember size of the chunks found in local files. Only the first
+ * check counts, the chunks valid in the later ones (e.g. after a retry)
+ * could be downloaded meanwhile.
+ */
+static void
+count_zck_reused(LrTarget *target, zckCtx *zck)
+{
+    if (target->zck_reused != -1)
+        return;
+
+    target->zck_reused = 0;
+    for(zckChunk *idx = zck_get_first_chunk(zck); idx != NULL; idx = zck_get_next_chunk(idx))
+        if(zck_get_chunk_valid(idx) == 1)
+            target->zck_reused += zck_get_chunk_comp_size(idx);
+}
+
 static gboolean
 check_zck(LrTarget *target, GError **err)
 {
     assert(!err || *err == NULL);
-    assert(target && target->f && target->target);
+    assert(target && target->transfer->fd != -1 && target->target);
 
     if(target->mirror->max_ranges == 0 || target->mirror->mirror->protocol != LR_PROTOCOL_HTTP) {
         target->zck_state = LR_ZCK_DL_BODY;
@@ -1347,6 +2037,7 @@ check_zck(LrTarget *target, GError **err)
 
         if(cks_good == 1) {  // All checksums good
             g_debug("%s: File is complete", __func__);
+            count_zck_reused(target, zck);
             if(target->target->zck_dl)
                 zck_dl_free(&(target->target->zck_dl));
             target->zck_state = LR_ZCK_DL_FINISHED;
@@ -1368,11 +2059,13 @@ check_zck(LrTarget *target, GError **err)
         }
 
         if(cks_good == 1) {  // All checksums good
+            count_zck_reused(target, zck);
             if(target->target->zck_dl)
                 zck_dl_free(&(target->target->zck_dl));
             target->zck_state = LR_ZCK_DL_FINISHED;
             return TRUE;
         }
+        count_zck_reused(target, zck);
     }
     zck_reset_failed_chunks(zck);
     /* Recalculate how many bytes remain to be downloaded by subtracting from total_to_download */
@@ -1386,11 +2079,10 @@ check_zck(LrTarget *target, GError **err)
 
 /** Open the file to write to
  */
-static FILE*
+static int
 open_target_file(LrTarget *target, GError **err)
 {
     int fd;
-    FILE *f;
 
     if (target->target->fd != -1) {
         // Use supplied filedescriptor
@@ -1399,7 +2091,7 @@ open_target_file(LrTarget *target, GError **err)
             g_set_error(err, LR_DOWNLOADER_ERROR, LRE_IO,
                         "dup(%d) failed: %s",
                         target->target->fd, g_strerror(errno));
-           return NULL;
+           return -1;
         }
     } else {
         // Use supplied filename
@@ -1407,25 +2099,103 @@ open_target_file(LrTarget *target, GError **err)
         if (target->resume || target->target->is_zchunk)
             open_flags &= ~O_TRUNC;
 
+        // The file could be a hard link of a cached (or another)
+        // file, don't overwrite the other links. Locked files were
+        // already replaced by acquire_target_file().
+        struct stat st;
+        if ((open_flags & O_TRUNC)
+            && target->lock_fd == -1
+            && lstat(target->target->fn, &st) == 0
+            && S_ISREG(st.st_mode)
+            && st.st_nlink > 1)
+            unlink(target->target->fn);
+
         fd = open(target->target->fn, open_flags, 0666);
         if (fd == -1) {
             g_set_error(err, LR_DOWNLOADER_ERROR, LRE_IO,
                         "Cannot open %s: %s",
                         target->target->fn, g_strerror(errno));
-            return NULL;
+            return -1;
         }
     }
 
-    f = fdopen(fd, "w+b");
-    if (!f) {
-        close(fd);
-        g_set_error(err, LR_DOWNLOADER_ERROR, LRE_IO,
-                    "fdopen(%d) failed: %s",
-                    fd, g_strerror(errno));
+    return fd;
+}
+
+/** Build the request headers from LRO_HTTPHEADER of the handle.
+ */
+static struct curl_slist *
+lr_httpheader_list(LrHandle *handle)
+{
+    struct curl_slist *headers = NULL;
+
+    if (!handle || !handle->httpheader)
         return NULL;
+
+    for (int x=0; handle->httpheader[x]; x++) {
+        headers = curl_slist_append(headers, handle->httpheader[x]);
+        if (!headers)
+            lr_out_of_memory();
+    }
+
+    return headers;
+}
+
+/** Attach a transfer state to the target. Transfers detached from
+ * the previous targets are reused, so the download holds only about
+ * as many of them as is the number of parallel transfers.
+ */
+static void
+attach_transfer(LrDownload *dd, LrTarget *target)
+{
+    assert(!target->transfer);
+
+    if (dd->spare_transfers->len)
+        target->transfer = g_ptr_array_remove_index_fast(dd->spare_transfers,
+                                                         dd->spare_transfers->len - 1);
+    else {
+        target->transfer = lr_arena_alloc0(dd->arena, sizeof(LrTransfer));
+        target->transfer->fd = -1;
     }
+}
+
+/** Release the curl handle, the file and the request headers of the
+ * transfer of the target and detach the transfer from the target.
+ * The curl handle must not be in the multi handle anymore.
+ */
+static void
+detach_transfer(LrDownload *dd, LrTarget *target)
+{
+    LrTransfer *transfer = target->transfer;
+
+    if (!transfer)
+        return;
 
-    return f;
+    if (transfer->curl_handle)
+        curl_easy_cleanup(transfer->curl_handle);
+    if (transfer->fd != -1) {
+        // Keep the received data of an interrupted transfer for resume
+        if (!finish_transfer_writes(transfer))
+            g_debug("%s: Cannot write %s: %s", __func__,
+                    target->target->path, g_strerror(errno));
+        // The supplied descriptor shares the offset with its dup,
+        // leave it behind the written data
+        if (target->target->fd != -1 && transfer->wpos >= 0)
+            lseek(transfer->fd, (off_t) transfer->wpos, SEEK_SET);
+        close(transfer->fd);
+    }
+    g_free(transfer->headercb_interrupt_reason);
+    if (transfer->curl_rqheaders && !transfer->curl_rqheaders_shared)
+        curl_slist_free_all(transfer->curl_rqheaders);
+
+    char *wbuf = transfer->wbuf;
+    char *wbuf_spare = transfer->wbuf_spare;
+    memset(transfer, 0, sizeof(*transfer));
+    transfer->fd = -1;
+    transfer->wbuf = wbuf;
+    transfer->wbuf_spare = wbuf_spare;
+    g_ptr_array_add(dd->spare_transfers, transfer);
+    target->transfer = NULL;
 }
 
 /** Prepare next transfer
@@ -1472,6 +2242,7 @@ prepare_next_transfer(LrDownload *dd, gboolean *candidatefound, GError **err)
     protocol = lr_detect_protocol(full_url);
 
     // Prepare CURL easy handle
+    attach_transfer(dd, target);
     CURLcode c_rc;
     CURL *h;
     if (target->handle)
@@ -1484,7 +2255,7 @@ prepare_next_transfer(LrDownload *dd, gboolean *candidatefound, GError **err)
                     "curl_easy_duphandle() call failed");
         goto fail;
     }
-    target->curl_handle = h;
+    target->transfer->curl_handle = h;
 
     // Set URL
     c_rc = curl_easy_setopt(h, CURLOPT_URL, full_url);
@@ -1496,28 +2267,56 @@ prepare_next_transfer(LrDownload *dd, gboolean *candidatefound, GError **err)
     }
 
     // Set error buffer
-    target->errorbuffer[0] = '\0';
-    c_rc = curl_easy_setopt(h, CURLOPT_ERRORBUFFER, target->errorbuffer);
+    target->transfer->errorbuffer[0] = '\0';
+    c_rc = curl_easy_setopt(h, CURLOPT_ERRORBUFFER, target->transfer->errorbuffer);
     if (c_rc != CURLE_OK) {
         g_set_error(err, LR_DOWNLOADER_ERROR, LRE_CURL,
-                    "curl_easy_setopt(h, CURLOPT_ERRORBUFFER, target->errorbuffer) failed: %s",
+                    "curl_easy_setopt(h, CURLOPT_ERRORBUFFER, target->transfer->errorbuffer) failed: %s",
                     curl_easy_strerror(c_rc));
         goto fail;
     }
 
-    // Prepare FILE
-    target->f = open_target_file(target, err);
-    if (!target->f)
-        goto fail;
-    target->writecb_recieved = 0;
-    target->writecb_required_range_written = FALSE;
+    // Prepare file
+    target->transfer->wbuf_len = 0;
+    if (target->target->data) {
+        // In-memory target, there is no file to open
+        g_byte_array_set_size(target->target->data, 0);
+        target->transfer->data = target->target->data;
+        target->transfer->data_max = target->target->expectedsize > 0
+                                     ? target->target->expectedsize
+                                     : LR_DOWNLOADTARGET_DATA_MAX;
+        target->transfer->wpos = -1;
+        target->transfer->writeback = FALSE;
+    } else {
+        target->transfer->fd = open_target_file(target, err);
+        if (target->transfer->fd == -1)
+            goto fail;
+        // Data are written at the current offset of the file. Zchunk
+        // moves the offset itself and a pipe has no offset, so they
+        // are written by write() instead of pwrite().
+        target->transfer->wpos = target->target->is_zchunk
+                                 ? -1 : lseek(target->transfer->fd, 0, SEEK_CUR);
+        target->transfer->writeback = target->target->handle
+                                      && target->target->handle->droppagecache;
+    }
+    target->transfer->ring = dd->ring;
+    target->transfer->writecb_recieved = 0;
+    target->transfer->writecb_required_range_written = FALSE;
+    target->transfer->data_exceeded = FALSE;
 
     #ifdef WITH_ZCHUNK
     // If file is zchunk, prep it
     if(target->target->is_zchunk) {
         GError *tmp_err = NULL;
+        gboolean zck_ok;
+
+        {
+            _cleanup_trace_span_ LrTraceSpan span = LR_TRACE_SPAN_INIT(
+                    "zchunk", "zchunk check", target->target->path);
+            zck_ok = check_zck(target, &tmp_err);
+        }
 
-        if (!check_zck(target, &tmp_err)) {
+        if (!zck_ok) {
             g_set_error(err, LR_DOWNLOADER_ERROR, LRE_ZCK,
                         "Unable to initialize zchunk file %s: %s",
                         target->target->path,
@@ -1528,20 +2327,16 @@ prepare_next_transfer(LrDownload *dd, gboolean *candidatefound, GError **err)
         // If zchunk is finished, we're done, so move to next target
         if(target->zck_state == LR_ZCK_DL_FINISHED) {
             g_debug("%s: Target already fully downloaded: %s", __func__, target->target->path);
-            target->state = LR_DS_FINISHED;
-            curl_easy_cleanup(target->curl_handle);
-            target->curl_handle = NULL;
-            g_free(target->headercb_interrupt_reason);
-            target->headercb_interrupt_reason = NULL;
-            fclose(target->f);
-            target->f = NULL;
-            lr_downloadtarget_set_error(target->target, LRE_OK, NULL);
+            detach_transfer(dd, target);
+            finish_without_transfer(target, LR_TRANSFER_ALREADYEXISTS,
+                                    "Already downloaded");
+            target_done(dd, target);
             return prepare_next_transfer(dd, candidatefound, err);
         }
     }
     # endif /* WITH_ZCHUNK */
 
-    int fd = fileno(target->f);
+    int fd = target->transfer->fd;
 
     // Allow resume only for files that were originally being
     // downloaded by librepo
@@ -1568,8 +2363,7 @@ prepare_next_transfer(LrDownload *dd, gboolean *candidatefound, GError **err)
 
         if (target->original_offset == -1) {
             // Determine offset
-            fseek(target->f, 0L, SEEK_END);
-            gint64 determined_offset = ftell(target->f);
+            gint64 determined_offset = lseek(fd, 0, SEEK_END);
             if (determined_offset == -1) {
                 // An error while determining offset =>
                 // Download the whole file again
@@ -1585,6 +2379,10 @@ prepare_next_transfer(LrDownload *dd, gboolean *candidatefound, GError **err)
         c_rc = curl_easy_setopt(h, CURLOPT_RESUME_FROM_LARGE,
                                 (curl_off_t) used_offset);
         assert(c_rc == CURLE_OK);
+
+        // The data continue behind the original content
+        if (target->transfer->wpos >= 0)
+            target->transfer->wpos = used_offset;
     }
 
     // Add librepo extended attribute to the file
@@ -1593,7 +2391,23 @@ prepare_next_transfer(LrDownload *dd, gboolean *candidatefound, GError **err)
     // If librepo tries to resume a download, it checks if the xattr is present.
     // If it isn't the download is not resumed, but whole file is
     // downloaded again.
-    add_librepo_xattr(fd, target->target->fn);
+    if (fd != -1)
+        add_librepo_xattr(fd, target->target->fn);
+
+#ifdef FALLOC_FL_KEEP_SIZE
+    // Preallocate the rest of the file to avoid its fragmentation.
+    // The size of the file is kept, so an incomplete file has its real
+    // size (e.g. for resume). Errors (e.g. not supported by the
+    // filesystem) are not important.
+    gint64 wpos = target->transfer->wpos;
+    gint64 expectedsize = target->target->expectedsize;
+    if (wpos >= 0 && expectedsize > wpos
+        && target->target->byterangestart <= 0
+        && target->target->byterangeend <= 0
+        && fallocate(fd, FALLOC_FL_KEEP_SIZE, wpos, expectedsize - wpos) == -1)
+        g_debug("%s: Cannot preallocate %s: %s", __func__,
+                target->target->path, g_strerror(errno));
+#endif /* FALLOC_FL_KEEP_SIZE */
 
     if (target->target->byterangestart > 0) {
         assert(!target->target->resume && !target->target->range);
@@ -1613,7 +2427,8 @@ prepare_next_transfer(LrDownload *dd, gboolean *candidatefound, GError **err)
 
     // Prepare progress callback
     target->cb_return_code = LR_CB_OK;
-    if (target->target->progresscb) {
+    lr_progresslimiter_init(&target->progress_limiter, target->target->handle);
+    if (target->target->progresscb || target->total_progress) {
         c_rc = curl_easy_setopt(h, CURLOPT_PROGRESSFUNCTION, lr_progresscb) ||
                curl_easy_setopt(h, CURLOPT_NOPROGRESS, 0) ||
                curl_easy_setopt(h, CURLOPT_PROGRESSDATA, target);
@@ -1621,26 +2436,52 @@ prepare_next_transfer(LrDownload *dd, gboolean *candidatefound, GError **err)
     }
 
     // Prepare header callback
-    if (target->target->expectedsize > 0) {
+    if (target->target->expectedsize > 0 || target->target->conditional) {
         c_rc = curl_easy_setopt(h, CURLOPT_HEADERFUNCTION, lr_headercb) ||
                curl_easy_setopt(h, CURLOPT_HEADERDATA, target);
         assert(c_rc == CURLE_OK);
     }
 
+    // Prepare conditional request
+    target->notmodified = FALSE;
+    target->filetime = -1;
+    g_free(target->etag);
+    target->etag = NULL;
+    if (target->target->conditional) {
+        c_rc = curl_easy_setopt(h, CURLOPT_FILETIME, 1L);
+        assert(c_rc == CURLE_OK);
+        if (target->target->lastmodified > 0) {
+            c_rc = curl_easy_setopt(h, CURLOPT_TIMECONDITION,
+                                    (long) CURL_TIMECOND_IFMODSINCE) ||
+                   curl_easy_setopt(h, CURLOPT_TIMEVALUE,
+                                    (long) target->target->lastmodified);
+            assert(c_rc == CURLE_OK);
+        }
+    }
+
     // Prepare write callback
     c_rc = curl_easy_setopt(h, CURLOPT_WRITEFUNCTION, lr_writecb) ||
-           curl_easy_setopt(h, CURLOPT_WRITEDATA, target);
+           curl_easy_setopt(h, CURLOPT_WRITEDATA, target) ||
+           curl_easy_setopt(h, CURLOPT_PRIVATE, target);
     assert(c_rc == CURLE_OK);
 
     // Set extra HTTP headers
     struct curl_slist *headers = NULL;
-    if (target->handle && target->handle->httpheader) {
-        // Fill in headers specified by user in LrHandle via LRO_HTTPHEADER
-        for (int x=0; target->handle->httpheader[x]; x++) {
-            headers = curl_slist_append(headers, target->handle->httpheader[x]);
-            if (!headers)
-                lr_out_of_memory();
+    gboolean extra_headers = target->target->no_cache
+                             || (target->target->conditional && target->target->etag);
+    LrHandleMirrors *handle_mirrors = target->handle_mirrors;
+    if (!extra_headers && handle_mirrors) {
+        // Headers from LRO_HTTPHEADER are built only once for all
+        // transfers of the handle
+        if (!handle_mirrors->rqheaders_ready) {
+            handle_mirrors->rqheaders = lr_httpheader_list(target->handle);
+            handle_mirrors->rqheaders_ready = TRUE;
         }
+        headers = handle_mirrors->rqheaders;
+        target->transfer->curl_rqheaders_shared = TRUE;
+    } else {
+        headers = lr_httpheader_list(target->handle);
+        target->transfer->curl_rqheaders_shared = FALSE;
     }
     if (target->target->no_cache) {
         // Add headers that tell proxy to serve us fresh data
@@ -1649,13 +2490,22 @@ prepare_next_transfer(LrDownload *dd, gboolean *candidatefound, GError **err)
         if (!headers)
             lr_out_of_memory();
     }
-    target->curl_rqheaders = headers;
+    if (target->target->conditional && target->target->etag) {
+        // Ask for the target only if it differs from the local copy
+        _cleanup_free_ gchar *inm = g_strdup_printf("If-None-Match: %s",
+                                                    target->target->etag);
+        headers = curl_slist_append(headers, inm);
+        if (!headers)
+            lr_out_of_memory();
+    }
+    target->transfer->curl_rqheaders = headers;
     c_rc = curl_easy_setopt(h, CURLOPT_HTTPHEADER, headers);
     assert(c_rc == CURLE_OK);
 
     // Add the new handle to the curl multi handle
     CURLMcode cm_rc = curl_multi_add_handle(dd->multi_handle, h);
     assert(cm_rc == CURLM_OK);
+    target->trace_start = lr_trace_now();
 
     // Set the state of transfer as running
     target->state = LR_DS_RUNNING;
@@ -1666,28 +2516,21 @@ prepare_next_transfer(LrDownload *dd, gboolean *candidatefound, GError **err)
     }
 
     // Set the state of header callback for this transfer
-    target->headercb_state = LR_HCS_DEFAULT;
-    g_free(target->headercb_interrupt_reason);
-    target->headercb_interrupt_reason = NULL;
+    target->transfer->headercb_state = LR_HCS_DEFAULT;
+    g_free(target->transfer->headercb_interrupt_reason);
+    target->transfer->headercb_interrupt_reason = NULL;
 
     // Set protocol of the target
     target->protocol = protocol;
 
     // Add the transfer to the list of running transfers
-    dd->running_transfers = g_slist_append(dd->running_transfers, target);
+    g_ptr_array_add(dd->running_transfers, target);
 
     return TRUE;
 
 fail:
     // Cleanup target
-    if (target->curl_handle) {
-        curl_easy_cleanup(target->curl_handle);
-        target->curl_handle = NULL;
-    }
-    if (target->f != NULL) {
-        fclose(target->f);
-        target->f = NULL;
-    }
+    detach_transfer(dd, target);
 
     return FALSE;
 }
@@ -1697,13 +2540,13 @@ set_max_speeds_to_transfers(LrDownload *dd, GError **err)
 {
     assert(!err || *err == NULL);
 
-    if (!g_slist_length(dd->running_transfers)) // Nothing to do
+    if (!dd->running_transfers->len) // Nothing to do
         return TRUE;
 
     // Compute number of running downloads from repos with limited speed
     GHashTable *num_running_downloads_per_repo = g_hash_table_new(NULL, NULL);
-    for (GSList *elem = dd->running_transfers; elem; elem = g_slist_next(elem)) {
-        const LrTarget *ltarget = elem->data;
+    for (guint i = 0; i < dd->running_transfers->len; i++) {
+        const LrTarget *ltarget = g_ptr_array_index(dd->running_transfers, i);
 
         if (!ltarget->handle || !ltarget->handle->maxspeed) // Skip repos with unlimited speed or without handle
             continue;
@@ -1730,10 +2573,10 @@ set_max_speeds_to_transfers(LrDownload *dd, GError **err)
         const gint64 single_target_speed =
             (repo->maxspeed + (num_running_downloads_from_repo - 1)) / num_running_downloads_from_repo;
 
-        for (GSList *elem = dd->running_transfers; elem; elem = g_slist_next(elem)) {
-            LrTarget *ltarget = elem->data;
+        for (guint i = 0; i < dd->running_transfers->len; i++) {
+            LrTarget *ltarget = g_ptr_array_index(dd->running_transfers, i);
             if (ltarget->handle == repo) {
-                CURL *curl_handle = ltarget->curl_handle;
+                CURL *curl_handle = ltarget->transfer->curl_handle;
                 CURLcode code = curl_easy_setopt(curl_handle,
                                                  CURLOPT_MAX_RECV_SPEED_LARGE,
                                                  (curl_off_t)single_target_speed);
@@ -1756,7 +2599,10 @@ set_max_speeds_to_transfers(LrDownload *dd, GError **err)
 static gboolean
 prepare_next_transfers(LrDownload *dd, GError **err)
 {
-    guint length = g_slist_length(dd->running_transfers);
+    release_done_targets(dd);
+    dd->lock_waiting = FALSE;
+
+    guint length = dd->running_transfers->len;
     guint free_slots = dd->max_parallel_connections - length;
 
     assert(!err || *err == NULL);
@@ -1778,6 +2624,124 @@ prepare_next_transfers(LrDownload *dd, GError **err)
 }
 
 
+/** Name of the current transfer of the target in the trace.
+ */
+static const char *
+transfer_trace_name(LrTarget *target)
+{
+    #ifdef WITH_ZCHUNK
+    if (target->target->is_zchunk) {
+        switch (target->zck_state) {
+            case LR_ZCK_DL_HEADER_CK:
+            case LR_ZCK_DL_HEADER:
+                return "zchunk header";
+            case LR_ZCK_DL_BODY_CK:
+            case LR_ZCK_DL_BODY:
+                return "zchunk body";
+            default:
+                break;
+        }
+    }
+    #endif /* WITH_ZCHUNK */
+    return target->target->path;
+}
+
+/** Statistics where the transfers of the target are counted or NULL.
+ */
+static LrStats *
+target_stats(LrTarget *target)
+{
+    return target->target->handle ? &target->target->handle->stats : NULL;
+}
+
+/** URL under which the current transfer is counted in the statistics.
+ */
+static const char *
+target_stats_url(LrTarget *target)
+{
+    if (target->mirror)
+        return target->mirror->mirror->url;
+    if (target->target->baseurl)
+        return target->target->baseurl;
+    return target->target->path;
+}
+
+/** Count the finished transfer (successful or not) in the statistics.
+ * Must be called after save_transfer_stats().
+ */
+static void
+count_transfer(LrTarget *target)
+{
+    LrStats *stats = target_stats(target);
+    LrTransferStats *transfer = target->target->stats;
+
+    if (!stats || !transfer)
+        return;
+
+    LrMirrorStats *mirror = lr_stats_mirror(stats, target_stats_url(target));
+
+    stats->transfers++;
+    stats->bytes_downloaded += transfer->downloaded;
+    if (transfer->reused)
+        stats->reused_connections++;
+    #ifdef WITH_ZCHUNK
+    // Only the chunks, the header is not reused from local files
+    if (target->target->is_zchunk && target->zck_state != LR_ZCK_DL_HEADER)
+        stats->zck_bytes_downloaded += transfer->downloaded;
+    #endif /* WITH_ZCHUNK */
+    mirror->transfers++;
+    mirror->bytes += transfer->downloaded;
+}
+
+/** Store the timing and size breakdown of the finished transfer
+ * to the target.
+ */
+static void
+save_transfer_stats(LrTarget *target, CURL *curl_handle)
+{
+    LrTransferStats stats = {0};
+    long http_version = 0;
+    long num_connects = 0;
+
+    curl_easy_getinfo(curl_handle, CURLINFO_NAMELOOKUP_TIME, &stats.namelookup_time);
+    curl_easy_getinfo(curl_handle, CURLINFO_CONNECT_TIME, &stats.connect_time);
+    curl_easy_getinfo(curl_handle, CURLINFO_APPCONNECT_TIME, &stats.appconnect_time);
+    curl_easy_getinfo(curl_handle, CURLINFO_PRETRANSFER_TIME, &stats.pretransfer_time);
+    curl_easy_getinfo(curl_handle, CURLINFO_STARTTRANSFER_TIME, &stats.starttransfer_time);
+    curl_easy_getinfo(curl_handle, CURLINFO_REDIRECT_TIME, &stats.redirect_time);
+    curl_easy_getinfo(curl_handle, CURLINFO_TOTAL_TIME, &stats.total_time);
+
+#if LIBCURL_VERSION_NUM >= 0x073700  // 7.55.0
+    curl_off_t size_download = 0, speed_download = 0;
+    curl_easy_getinfo(curl_handle, CURLINFO_SIZE_DOWNLOAD_T, &size_download);
+    curl_easy_getinfo(curl_handle, CURLINFO_SPEED_DOWNLOAD_T, &speed_download);
+    stats.downloaded = (gint64) size_download;
+    stats.speed = (double) speed_download;
+#else
+    double size_download = 0;
+    curl_easy_getinfo(curl_handle, CURLINFO_SIZE_DOWNLOAD, &size_download);
+    curl_easy_getinfo(curl_handle, CURLINFO_SPEED_DOWNLOAD, &stats.speed);
+    stats.downloaded = (gint64) size_download;
+#endif
+
+    curl_easy_getinfo(curl_handle, CURLINFO_HTTP_VERSION, &http_version);
+    switch (http_version) {
+        case CURL_HTTP_VERSION_1_0: stats.http_version = 10; break;
+        case CURL_HTTP_VERSION_1_1: stats.http_version = 11; break;
+        case CURL_HTTP_VERSION_2_0: stats.http_version = 20; break;
+#if LIBCURL_VERSION_NUM >= 0x074200  // 7.66.0
+        case CURL_HTTP_VERSION_3:   stats.http_version = 30; break;
+#endif
+        default:                    stats.http_version = 0;  break;
+    }
+
+    // No new connection had to be opened for the transfer
+    curl_easy_getinfo(curl_handle, CURLINFO_NUM_CONNECTS, &num_connects);
+    stats.reused = (num_connects == 0);
+
+    lr_downloadtarget_set_stats(target->target, &stats);
+}
+
 /** Check the finished transfer
  * Evaluate CURL return code and status code of protocol if needed.
  * @param serious_error     Serious error is an error that isn't fatal,
@@ -1816,7 +2780,7 @@ check_finished_transfer_status(CURLMsg *msg,
         // There was an error that is reported by CURLcode
 
         if (msg->data.result == CURLE_WRITE_ERROR &&
-            target->writecb_required_range_written)
+            target->transfer->writecb_required_range_written)
         {
             // Download was interrupted by writecb because
             // user want only specified byte range of the
@@ -1827,11 +2791,18 @@ check_finished_transfer_status(CURLMsg *msg,
                     "was downloaded.", __func__,
                     target->target->byterangestart,
                     target->target->byterangeend);
-        } else if (target->headercb_state == LR_HCS_INTERRUPTED) {
+        } else if (target->transfer->data_exceeded) {
+            // The in-memory target got more data than it can hold,
+            // another mirror could have the right file
+            g_set_error(transfer_err, LR_DOWNLOADER_ERROR, LRE_IO,
+                        "Downloaded data of %s exceed the maximal "
+                        "size %"G_GINT64_FORMAT" bytes", effective_url,
+                        target->transfer->data_max);
+        } else if (target->transfer->headercb_state == LR_HCS_INTERRUPTED) {
             // Download was interrupted by header callback
             g_set_error(transfer_err, LR_DOWNLOADER_ERROR, LRE_CURL,
                         "Interrupted by header callback: %s",
-                        target->headercb_interrupt_reason);
+                        target->transfer->headercb_interrupt_reason);
         }
         #ifdef WITH_ZCHUNK
         else if (target->range_fail) {
@@ -1871,7 +2842,7 @@ check_finished_transfer_status(CURLMsg *msg,
                         msg->data.result,
                         curl_easy_strerror(msg->data.result),
                         effective_url,
-                        target->errorbuffer);
+                        target->transfer->errorbuffer);
 
             switch (msg->data.result) {
             case CURLE_ABORTED_BY_CALLBACK:
@@ -1894,7 +2865,7 @@ check_finished_transfer_status(CURLMsg *msg,
                        msg->data.result,
                        curl_easy_strerror(msg->data.result),
                        effective_url,
-                       target->errorbuffer);
+                       target->transfer->errorbuffer);
                 *fatal_error = TRUE;
                 break;
             case CURLE_OPERATION_TIMEDOUT:
@@ -1903,7 +2874,7 @@ check_finished_transfer_status(CURLMsg *msg,
                        msg->data.result,
                        curl_easy_strerror(msg->data.result),
                        effective_url,
-                       target->errorbuffer);
+                       target->transfer->errorbuffer);
                 *serious_error = TRUE;
                 break;
             default:
@@ -1917,6 +2888,24 @@ check_finished_transfer_status(CURLMsg *msg,
 
     // curl return code is CURLE_OK but we need to check status code
     curl_easy_getinfo(msg->easy_handle, CURLINFO_RESPONSE_CODE, &code);
+
+    if (target->target->conditional) {
+        long unmet = 0;
+        long filetime = -1;
+
+        curl_easy_getinfo(msg->easy_handle, CURLINFO_FILETIME, &filetime);
+        target->filetime = filetime;
+
+        // 304 is the answer to If-None-Match, unmet time condition
+        // is reported also for the protocols without status codes
+        curl_easy_getinfo(msg->easy_handle, CURLINFO_CONDITION_UNMET, &unmet);
+        if (unmet || code == 304) {
+            g_debug("%s: Target not modified: %s", __func__, effective_url);
+            target->notmodified = TRUE;
+            return TRUE;
+        }
+    }
+
     if (code) {
         char * effective_ip = NULL;
         curl_easy_getinfo(msg->easy_handle,
@@ -1981,7 +2970,9 @@ list_of_checksums_to_str(GSList *checksums)
 
 static gboolean
 check_finished_transfer_checksum(int fd,
+                                 const GByteArray *data,
                                  GSList *checksums,
+                                 LrStats *stats,
                                  gboolean *checksum_matches,
                                  GError **transfer_err,
                                  GError **err)
@@ -1998,14 +2989,26 @@ check_finished_transfer_checksum(int fd,
         if (!chksum || !chksum->value || chksum->type == LR_CHECKSUM_UNKNOWN)
             continue;  // Bad checksum
 
-        lseek(fd, 0, SEEK_SET);
-        ret = lr_checksum_fd_compare(chksum->type,
-                                     fd,
-                                     chksum->value,
-                                     1,
-                                     &matches,
-                                     &calculated,
-                                     err);
+        if (data) {
+            ret = lr_checksum_buffer_compare_stats(chksum->type,
+                                                   data->data,
+                                                   data->len,
+                                                   chksum->value,
+                                                   &matches,
+                                                   &calculated,
+                                                   stats,
+                                                   err);
+        } else {
+            lseek(fd, 0, SEEK_SET);
+            ret = lr_checksum_fd_compare_stats(chksum->type,
+                                               fd,
+                                               chksum->value,
+                                               1,
+                                               &matches,
+                                               &calculated,
+                                               stats,
+                                               err);
+        }
         if (!ret)
             goto cleanup;
 
@@ -2061,6 +3064,12 @@ truncate_transfer_file(LrTarget *target, GError **err)
 
     assert(!err || *err == NULL);
 
+    if (target->target->data) {
+        // In-memory target, just drop the data
+        g_byte_array_set_size(target->target->data, 0);
+        return TRUE;
+    }
+
     if (target->original_offset > -1)
         // If resume is enabled -> truncate file to its original position
         original_offset = target->original_offset;
@@ -2111,38 +3120,49 @@ mirror_rank(LrMirror *mirror)
 }
 
 
+/** Swap positions of two mirrors in the order of handle_mirrors.
+ */
+static void
+swap_mirrors(LrHandleMirrors *handle_mirrors, guint pos_a, guint pos_b)
+{
+    guint idx_a = handle_mirrors->order[pos_a];
+    guint idx_b = handle_mirrors->order[pos_b];
+
+    handle_mirrors->order[pos_a] = idx_b;
+    handle_mirrors->order[pos_b] = idx_a;
+    handle_mirrors->mirrors[idx_a].position = pos_b;
+    handle_mirrors->mirrors[idx_b].position = pos_a;
+}
+
 /** Sort mirrors. Penalize the error ones.
  * In fact only move the current finished mirror forward or backward
  * by one position.
- * @param mirrors   GSList of mirrors (order of list elements won't be
- *                  changed, only data pointers)
- * @param mirror    Mirror of just finished transfer
- * @param success   Was download from the mirror successful
- * @param serious   If success is FALSE, serious mean that error was serious
- *                  (like connection timeout), and the mirror should be
- *                  penalized more that usual.
+ * @param handle_mirrors    Mirrors (only their order will be changed,
+ *                          the mirrors stay on their place in the array)
+ * @param mirror            Mirror of just finished transfer
+ * @param success           Was download from the mirror successful
+ * @param serious           If success is FALSE, serious mean that error
+ *                          was serious (like connection timeout), and
+ *                          the mirror should be penalized more that usual.
  */
 static gboolean
-sort_mirrors(GSList *mirrors, LrMirror *mirror, gboolean success, gboolean serious)
+sort_mirrors(LrHandleMirrors *handle_mirrors, LrMirror *mirror, gboolean success, gboolean serious)
 {
-    GSList *elem = mirrors;
-    GSList *prev = NULL;
-    GSList *next = NULL;
     gdouble rank_cur;
 
-    assert(mirrors);
+    assert(handle_mirrors);
     assert(mirror);
 
-    for (; elem && elem->data != mirror; elem = g_slist_next(elem))
-        prev = elem;
+    guint pos = mirror->position;
+    guint last = handle_mirrors->nmirrors - 1;
 
-    assert(elem);  // Mirror should always exists in the list of mirrors
+    // Mirror should always exists in the mirrors of the handle
+    assert(pos < handle_mirrors->nmirrors);
+    assert(&handle_mirrors->mirrors[handle_mirrors->order[pos]] == mirror);
 
-    next = g_slist_next(elem);
-
-    if (!success && !next)
+    if (!success && pos == last)
         goto exit; // Penalization not needed - Mirror is already the last one
-    if (success && !prev)
+    if (success && pos == 0)
         goto exit; // Bonus not needed - Mirror is already the first one
 
     // Serious errors
@@ -2150,9 +3170,7 @@ sort_mirrors(GSList *mirrors, LrMirror *mirror, gboolean success, gboolean serio
         // Mirror that encounter a serious error and has no successful
         // transfers should be moved at the end of the list
         // (such mirror is probably down/broken/buggy)
-        GSList *last = g_slist_last(elem);
-        elem->data = last->data;
-        last->data = (gpointer) mirror;
+        swap_mirrors(handle_mirrors, pos, last);
         g_debug("%s: Mirror %s was moved at the end", __func__, mirror->mirror->url);
         goto exit; // No more hadling needed
     }
@@ -2165,18 +3183,18 @@ sort_mirrors(GSList *mirrors, LrMirror *mirror, gboolean success, gboolean serio
 
     if (!success) {
         // Penalize
-        gdouble rank_next = mirror_rank(next->data);
+        LrMirror *next = &handle_mirrors->mirrors[handle_mirrors->order[pos + 1]];
+        gdouble rank_next = mirror_rank(next);
         if (rank_next < 0.0 || rank_next > rank_cur) {
-            elem->data = next->data;
-            next->data = (gpointer) mirror;
+            swap_mirrors(handle_mirrors, pos, pos + 1);
             g_debug("%s: Mirror %s was penalized", __func__, mirror->mirror->url);
         }
     } else {
         // Bonus
-        gdouble rank_prev = mirror_rank(prev->data);
+        LrMirror *prev = &handle_mirrors->mirrors[handle_mirrors->order[pos - 1]];
+        gdouble rank_prev = mirror_rank(prev);
         if (rank_prev < rank_cur) {
-            elem->data = prev->data;
-            prev->data = mirror;
+            swap_mirrors(handle_mirrors, pos, pos - 1);
             g_debug("%s: Mirror %s was awarded", __func__, mirror->mirror->url);
         }
     }
@@ -2184,9 +3202,9 @@ sort_mirrors(GSList *mirrors, LrMirror *mirror, gboolean success, gboolean serio
 exit:
     if (g_getenv("LIBREPO_DEBUG_ADAPTIVEMIRRORSORTING")) {
         // Debug
-        g_debug("%s: Updated order of mirrors (for %p):", __func__, mirrors);
-        for (GSList *elem = mirrors; elem; elem = g_slist_next(elem)) {
-            LrMirror *m = elem->data;
+        g_debug("%s: Updated order of mirrors (for %p):", __func__, handle_mirrors);
+        for (guint i = 0; i < handle_mirrors->nmirrors; i++) {
+            LrMirror *m = &handle_mirrors->mirrors[handle_mirrors->order[i]];
             g_debug(" %s (s: %d f: %d)", m->mirror->url,
                    m->successful_transfers, m->failed_transfers);
         }
@@ -2196,93 +3214,664 @@ exit:
 }
 
 
+/** Interval between two attempts to lock a target file which is locked
+ * by another process (in microseconds) */
+#define LR_LOCK_RETRY_INTERVAL  (G_USEC_PER_SEC / 5)
+
+/** Lock the file of the target by an open file description lock, so
+ * processes which download into the same file (e.g. into a shared
+ * cache directory) don't race on it. Only targets written to a file
+ * are locked. If the system or the filesystem doesn't support the
+ * locks, the target is not locked.
+ * @param create    Create the file if it doesn't exist
+ * @return          FALSE if the file is locked by another process
+ */
 static gboolean
-check_transfer_statuses(LrDownload *dd, GError **err)
+lock_target_file(LrTarget *target, gboolean create)
 {
-    assert(dd);
-    assert(!err || *err == NULL);
-
-    int msgs_in_queue;
-    CURLMsg *msg;
+#ifdef F_OFD_SETLK
+    if (target->lock_fd != -1 || !target->target->fn)
+        return TRUE;
 
-    while ((msg = curl_multi_info_read(dd->multi_handle, &msgs_in_queue))) {
-        LrTarget *target = NULL;
-        _cleanup_free_ char *effective_url = NULL;
-        int fd;
-        gboolean matches = TRUE;
-        GError *transfer_err = NULL;
-        GError *tmp_err = NULL;
-        gboolean ret;
-        gboolean serious_error = FALSE;
-        gboolean fatal_error = FALSE;
-        GError *fail_fast_error = NULL;
+    int flags = O_RDWR | O_CLOEXEC | (create ? O_CREAT : 0);
+    int fd = open(target->target->fn, flags, 0666);
+    if (fd == -1)
+        return TRUE;  // Nothing to lock, the transfer reports the error
 
-        if (msg->msg != CURLMSG_DONE) {
-            // We are only interested in messages about finished transfers
-            continue;
+    struct flock fl = { .l_type = F_WRLCK, .l_whence = SEEK_SET };
+    if (fcntl(fd, F_OFD_SETLK, &fl) == -1) {
+        int errsv = errno;
+        close(fd);
+        if (errsv == EAGAIN || errsv == EACCES) {
+            g_debug("%s: %s is locked by another process",
+                    __func__, target->target->fn);
+            return FALSE;
         }
+        g_debug("%s: Cannot lock %s: %s",
+                __func__, target->target->fn, g_strerror(errsv));
+        return TRUE;
+    }
 
-        // Find the target with this curl easy handle
-        for (GSList *elem = dd->running_transfers; elem; elem = g_slist_next(elem)) {
-            LrTarget *ltarget = elem->data;
-            if (ltarget->curl_handle == msg->easy_handle)
-                target = ltarget;
-        }
+    target->lock_fd = fd;
+#endif /* F_OFD_SETLK */
+    return TRUE;
+}
 
-        assert(target);  // Each easy handle used in the multi handle
-                         // should always belong to some target from
-                         // the running_transfers list
+/** Release the lock of the target file (if it's held).
+ */
+static void
+unlock_target_file(LrTarget *target)
+{
+    if (target->lock_fd == -1)
+        return;
+    close(target->lock_fd);
+    target->lock_fd = -1;
+}
 
-        curl_easy_getinfo(msg->easy_handle,
-                          CURLINFO_EFFECTIVE_URL,
-                          &effective_url);
+/** Remove file created for the target if download was
+ * unsuccessful and the file doesn't exists before or
+ * its original content was overwritten.
+ */
+static void
+remove_target_file(LrTarget *target)
+{
+    if (target->state == LR_DS_FINISHED)
+        return;
 
-        effective_url = g_strdup(effective_url); // Make the effective url
-                                                 // persistent to survive
-                                                 // the curl_easy_cleanup()
+    if (!target->resume || target->original_offset == 0) {
+        // Remove target file if the file doesn't
+        // exist before or was empty or was overwritten
+        if (target->target->fn) {
+            // We can remove only files that were specified by fn
+            if (unlink(target->target->fn) != 0) {
+                g_warning("Error while removing: %s", g_strerror(errno));
+            }
+        }
+    }
+}
 
-        g_debug("Transfer finished: %s (Effective url: %s)", target->target->path, effective_url);
+/** Finish the target whose file was made without a transfer
+ * (downloaded by another process or by an identical target).
+ * The progress and the end callbacks are called as if it was
+ * downloaded.
+ */
+static void
+finish_without_transfer(LrTarget *target,
+                        LrTransferStatus status,
+                        const char *msg)
+{
+    target->state = LR_DS_FINISHED;
+
+    struct stat st;
+    int rc = target->target->fn ? stat(target->target->fn, &st)
+                                : fstat(target->target->fd, &st);
+    double size = (rc == 0) ? (double) st.st_size : 0.0;
+    if (target->total_progress)
+        lr_totalprogress_update(target, size, size);
+    if (target->target->progresscb)
+        target->target->progresscb(target->target->cbdata, size, size);
+
+    // Call end callback, there is no transfer, so
+    // LR_CB_ERROR cannot abort it
+    LrEndCb end_cb = target->target->endcb;
+    if (end_cb && end_cb(target->target->cbdata, status, msg) == LR_CB_ERROR) {
+        target->cb_return_code = LR_CB_ERROR;
+        g_debug("%s: LR_CB_ERROR from end callback ignored", __func__);
+    }
 
-        //
-        // Check status of finished transfer
-        //
-        ret = check_finished_transfer_status(msg, target, &serious_error,
-                                             &fatal_error, &transfer_err, err);
-        if (!ret)  // Error
+    lr_downloadtarget_set_error(target->target, LRE_OK, NULL);
+}
+
+/** Fail the target whose file stays locked by another process
+ * longer than LRO_LOCKTIMEOUT.
+ * @return          FALSE if the whole download should be stopped
+ */
+static gboolean
+fail_locked_target(LrDownload *dd, LrTarget *target, GError **err)
+{
+    g_debug("%s: %s is still locked by another process",
+            __func__, target->target->fn);
+
+    target->state = LR_DS_FAILED;
+    lr_downloadtarget_set_error(target->target, LRE_FILE,
+            "Cannot download, the file is still locked by another process");
+
+    LrEndCb end_cb = target->target->endcb;
+    if (end_cb) {
+        int ret = end_cb(target->target->cbdata,
+                         LR_TRANSFER_ERROR,
+                         "Cannot download: The file is still locked "
+                         "by another process");
+        if (ret == LR_CB_ERROR) {
+            target->cb_return_code = LR_CB_ERROR;
+            g_debug("%s: Downloading was aborted by LR_CB_ERROR "
+                    "from end callback", __func__);
+            g_set_error(err, LR_DOWNLOADER_ERROR, LRE_CBINTERRUPTED,
+                        "Interrupted by LR_CB_ERROR from end callback");
             return FALSE;
+        }
+    }
 
-        if (transfer_err)  // Transfer was unsuccessful
-            goto transfer_error;
+    if (dd->failfast) {
+        g_set_error(err, LR_DOWNLOADER_ERROR, LRE_FILE,
+                    "Cannot download %s: The file is still locked "
+                    "by another process", target->target->path);
+        return FALSE;
+    }
 
-        //
-        // Checksum checking
-        //
-        fflush(target->f);
-        fd = fileno(target->f);
+    target_done(dd, target);
+    return TRUE;
+}
 
-        // Preserve timestamp of downloaded file if requested
-        if (target->target->handle && target->target->handle->preservetime) {
-            CURLcode c_rc;
-            long remote_filetime = -1;
-            c_rc = curl_easy_getinfo(target->curl_handle, CURLINFO_FILETIME, &remote_filetime);
-            if (c_rc == CURLE_OK && remote_filetime >= 0) {
-                const struct timeval tv[] = {{remote_filetime, 0}, {remote_filetime, 0}};
-                if (futimes(fd, tv) == -1)
-                    g_debug("%s: Failed to change timestamps of downloaded file \"%s\"",
-                            __func__, target->target->path);
-            } else {
-                g_debug("%s: Unable to get remote time of retrieved document \"%s\"",
-                        __func__, target->target->path);
-            }
-        }
+/** Let the target wait for the lock of its file held by another process.
+ * @return          FALSE if the whole download should be stopped
+ */
+static gboolean
+wait_for_target_file(LrDownload *dd, LrTarget *target, GError **err)
+{
+    gint64 now = g_get_monotonic_time();
+
+    if (!target->lock_retry) {
+        long timeout = target->handle ? target->handle->locktimeout
+                                      : LRO_LOCKTIMEOUT_DEFAULT;
+        target->lock_deadline = now + (gint64) timeout * G_USEC_PER_SEC;
+        if (timeout > 0)
+            g_info("%s: %s is locked by another process, waiting for it "
+                   "at most %ld s", __func__, target->target->fn, timeout);
+    }
+    if (now >= target->lock_deadline)
+        return fail_locked_target(dd, target, err);
+    target->lock_retry = now + LR_LOCK_RETRY_INTERVAL;
+    dd->lock_waiting = TRUE;
+    return TRUE;
+}
 
-        #ifdef WITH_ZCHUNK
-        if (target->target->is_zchunk) {
-            zckCtx *zck = NULL;
-            if (target->zck_state == LR_ZCK_DL_HEADER) {
-                if(target->mirror->max_ranges > 0 && target->mirror->mirror->protocol == LR_PROTOCOL_HTTP &&
-                   !lr_zck_valid_header(target->target, target->target->path,
-                                        fd, &transfer_err))
+/** The locked file of the target is going to be transferred. If it's
+ * a hard link of another file (e.g. a cached one), it's replaced
+ * by a new file, so the transfer doesn't overwrite the other links.
+ * The lock stays on the unlinked file, so the new file is locked again.
+ * If another process locked it meanwhile, the target waits for it.
+ * @param acquired  Set to TRUE if the target can be transferred now
+ * @return          FALSE if the whole download should be stopped
+ */
+static gboolean
+replace_linked_target_file(LrDownload *dd,
+                           LrTarget *target,
+                           gboolean *acquired,
+                           GError **err)
+{
+    struct stat st;
+
+    *acquired = TRUE;
+    if (target->resume
+        || target->target->is_zchunk
+        || target->lock_fd == -1
+        || lstat(target->target->fn, &st) != 0
+        || !S_ISREG(st.st_mode)
+        || st.st_nlink <= 1
+        || unlink(target->target->fn) != 0)
+        return TRUE;
+
+    unlock_target_file(target);
+    if (lock_target_file(target, TRUE))
+        return TRUE;
+
+    g_debug("%s: %s was locked by another process after it was replaced",
+            __func__, target->target->fn);
+    *acquired = FALSE;
+    return wait_for_target_file(dd, target, err);
+}
+
+/** Lock the file of the target before its first transfer. While it's
+ * locked by another process, the target waits (at most LRO_LOCKTIMEOUT
+ * seconds, then it fails). The process probably downloaded the file
+ * meanwhile, so when the lock is acquired and the file matches the
+ * checksum (which is usually cached in the extended attributes by the
+ * process), the target is finished without any transfer.
+ * @param acquired  Set to TRUE if the target can be transferred now
+ * @return          FALSE if the whole download should be stopped
+ */
+static gboolean
+acquire_target_file(LrDownload *dd,
+                    LrTarget *target,
+                    gboolean *acquired,
+                    GError **err)
+{
+    *acquired = FALSE;
+
+    if (target->lock_fd != -1 || !target->target->fn) {
+        *acquired = TRUE;
+        return TRUE;
+    }
+
+    gint64 now = g_get_monotonic_time();
+    if (target->lock_retry > now) {
+        dd->lock_waiting = TRUE;
+        return TRUE;
+    }
+
+    if (!lock_target_file(target, TRUE))
+        return wait_for_target_file(dd, target, err);
+
+    if (!target->lock_retry || target->lock_fd == -1) {
+        // Nobody else was downloading the file
+        return replace_linked_target_file(dd, target, acquired, err);
+    }
+
+    gboolean has_checksum = FALSE;
+    for (GSList *elem = target->target->checksums; elem; elem = g_slist_next(elem)) {
+        LrDownloadTargetChecksum *checksum = elem->data;
+        if (checksum && checksum->value && checksum->type != LR_CHECKSUM_UNKNOWN)
+            has_checksum = TRUE;
+    }
+    if (!has_checksum)
+        return replace_linked_target_file(dd, target, acquired, err);
+
+    gboolean matches = FALSE;
+    GError *transfer_err = NULL, *tmp_err = NULL;
+    if (!check_finished_transfer_checksum(target->lock_fd,
+                                          NULL,
+                                          target->target->checksums,
+                                          NULL, &matches,
+                                          &transfer_err, &tmp_err)) {
+        g_debug("%s: Cannot check %s: %s",
+                __func__, target->target->fn, tmp_err->message);
+        g_error_free(tmp_err);
+        matches = FALSE;
+    }
+    g_clear_error(&transfer_err);
+    if (!matches)
+        return replace_linked_target_file(dd, target, acquired, err);
+
+    g_debug("%s: %s was downloaded by another process",
+            __func__, target->target->fn);
+    finish_without_transfer(target, LR_TRANSFER_ALREADYEXISTS,
+                            "Already downloaded by another process");
+    target_done(dd, target);
+    return TRUE;
+}
+
+/** Free what the target holds and remove its file if the download
+ * was unsuccessful. There must be no transfer of the target.
+ */
+static void
+clear_target(LrDownload *dd, LrTarget *target)
+{
+    assert(target->transfer == NULL);
+
+    // Done targets were cleaned up by target_done(). A file locked
+    // by another process is not touched, the process works on it.
+    if (!target->done && lock_target_file(target, FALSE))
+        remove_target_file(target);
+    unlock_target_file(target);
+
+    clear_tried_mirrors(dd, target);
+    g_slist_free(target->duplicates);
+    target->duplicates = NULL;
+    g_free(target->etag);
+    target->etag = NULL;
+}
+
+/** Hand the done targets over to the dd->releasecb and remove them
+ * from the targets array. Their LrTargets are reused by next targets,
+ * so the memory of the download is given by the number of unfinished
+ * targets, not by the number of all targets.
+ * Must not be called while the targets array is being iterated.
+ */
+static void
+release_done_targets(LrDownload *dd)
+{
+    if (!dd->releasecb || !dd->done_targets)
+        return;
+
+    guint kept = 0;
+    for (guint i = 0; i < dd->targets->len; i++) {
+        LrTarget *target = g_ptr_array_index(dd->targets, i);
+        if (target->done) {
+            clear_target(dd, target);
+            dd->releasecb(target->target, dd->donecbdata);
+            memset(target, 0, sizeof(*target));
+            g_ptr_array_add(dd->spare_targets, target);
+            continue;
+        }
+        target->index = kept;
+        dd->targets->pdata[kept++] = target;
+    }
+    g_ptr_array_set_size(dd->targets, kept);
+    dd->first_waiting = 0;
+    dd->done_targets = 0;
+}
+
+/** Key identifying the content of the download target. Targets
+ * with the same checksum, or without checksums but with the same
+ * handle and URL, are identical and only one of them is downloaded.
+ * Targets which don't write to a file or download only a part of it
+ * (byte range, zchunk, conditional download) are never deduplicated.
+ * The key is hashed, so it fits into the dedup_key_buf of the target.
+ * @return          Key stored in the target or NULL
+ */
+static const char *
+target_dedup_key(LrTarget *target, LrDownloadTarget *dtarget)
+{
+    if (!dtarget->fn
+        || dtarget->byterangestart
+        || dtarget->byterangeend
+        || dtarget->range
+        || dtarget->is_zchunk
+        || dtarget->conditional)
+        return NULL;
+
+    _cleanup_free_ gchar *key = NULL;
+    for (GSList *elem = dtarget->checksums; elem; elem = g_slist_next(elem)) {
+        LrDownloadTargetChecksum *checksum = elem->data;
+        if (checksum->type == LR_CHECKSUM_UNKNOWN || !checksum->value)
+            continue;
+        _cleanup_free_ gchar *value = g_ascii_strdown(checksum->value, -1);
+        key = g_strdup_printf("%s:%s",
+                              lr_checksum_type_to_str(checksum->type), value);
+        break;
+    }
+
+    if (!key && !dtarget->checksums)
+        key = g_strdup_printf("%p:%s:%s", (void *) dtarget->handle,
+                              dtarget->baseurl ? dtarget->baseurl : "",
+                              dtarget->path);
+
+    if (!key)
+        return NULL;
+
+    _cleanup_free_ gchar *digest = g_compute_checksum_for_string(G_CHECKSUM_SHA256,
+                                                                 key, -1);
+    g_strlcpy(target->dedup_key_buf, digest, sizeof(target->dedup_key_buf));
+    return target->dedup_key_buf;
+}
+
+/** Create a LrTarget for the download target and append it
+ * to the list of targets of the download. If an identical target is
+ * already waiting or running, the new one waits for its transfer
+ * instead of being downloaded again.
+ */
+static void
+add_target(LrDownload *dd, LrDownloadTarget *dtarget)
+{
+    // Assertions
+    assert(dtarget);
+    assert(dtarget->path);
+    assert((dtarget->fd > 0 && !dtarget->fn)
+           || (dtarget->fd < 0 && (dtarget->fn || dtarget->data)));
+    g_debug("%s: Target: %s (%s)", __func__,
+            dtarget->path,
+            (dtarget->baseurl) ? dtarget->baseurl : "-");
+
+    // Cleanup of LrDownloadTarget
+    lr_downloadtarget_reset(dtarget);
+
+    // Create and fill LrTarget
+    LrTarget *target;
+    if (dd->spare_targets->len)
+        target = g_ptr_array_remove_index_fast(dd->spare_targets,
+                                               dd->spare_targets->len - 1);
+    else
+        target = lr_arena_alloc0(dd->arena, sizeof(*target));
+    target->state           = LR_DS_WAITING;
+    target->target          = dtarget;
+    target->original_offset = -1;
+    target->lock_fd         = -1;
+    #ifdef WITH_ZCHUNK
+    target->zck_reused      = -1;
+    #endif /* WITH_ZCHUNK */
+    target->resume          = dtarget->resume && !dtarget->data;
+    target->target->rcode   = LRE_UNFINISHED;
+    target->target->err     = "Not finished";
+    target->handle          = dtarget->handle;
+    if (dd->total_progress.cb) {
+        // Count the target to the total size as soon as possible
+        target->total_progress = &dd->total_progress;
+        if (dtarget->expectedsize > 0) {
+            target->reported_total = (double) dtarget->expectedsize;
+            dd->total_progress.total += target->reported_total;
+        }
+    }
+    target->index = dd->targets->len;
+    g_ptr_array_add(dd->targets, target);
+    // Add mirrors of the handle to dd->handle_mirrors
+    // if they don't exist yet and set them to the target.
+    lr_prepare_lrmirrors(dd->arena, dd->handle_mirrors, target);
+
+    target->dedup_key = target_dedup_key(target, dtarget);
+    if (target->dedup_key) {
+        LrTarget *primary = g_hash_table_lookup(dd->dedup, target->dedup_key);
+        if (primary) {
+            g_debug("%s: %s is a duplicate of %s", __func__,
+                    dtarget->fn, primary->target->fn);
+            target->state = LR_DS_DUPLICATE;
+            primary->duplicates = g_slist_append(primary->duplicates, target);
+        } else {
+            g_hash_table_insert(dd->dedup, (gpointer) target->dedup_key,
+                                target);
+        }
+    }
+}
+
+/** Give the duplicate the file downloaded by the target and finish it
+ * the same way as if it was downloaded.
+ * @return          FALSE if the file cannot be copied
+ */
+static gboolean
+finish_duplicate(LrTarget *target, LrTarget *duplicate)
+{
+    const char *src = target->target->fn;
+    const char *dst = duplicate->target->fn;
+
+    if (strcmp(src, dst)) {
+        // Another process works on the file, the duplicate waits for it
+        if (!lock_target_file(duplicate, FALSE))
+            return FALSE;
+        unlock_target_file(duplicate);
+
+        if (unlink(dst) == -1 && errno != ENOENT) {
+            g_debug("%s: Cannot remove %s: %s", __func__, dst,
+                    g_strerror(errno));
+            return FALSE;
+        }
+        // Not a hard link, the user could modify the files in place
+        if (!lr_reflink_or_copy(src, dst))
+            return FALSE;
+    }
+
+    g_debug("%s: %s taken from %s", __func__, dst, src);
+    duplicate->mirror = target->mirror;
+    finish_without_transfer(duplicate, LR_TRANSFER_SUCCESSFUL, NULL);
+    if (target->target->usedmirror)
+        lr_downloadtarget_set_usedmirror(duplicate->target,
+                                         target->target->usedmirror);
+    if (target->target->effectiveurl)
+        lr_downloadtarget_set_effectiveurl(duplicate->target,
+                                           target->target->effectiveurl);
+    return TRUE;
+}
+
+/** Resolve the duplicates which waited for the done target. If it was
+ * downloaded, they get its file. Otherwise (or if the file cannot be
+ * copied) the first of them is downloaded on its own and
+ * the others wait for it.
+ */
+static void
+resolve_duplicates(LrDownload *dd, LrTarget *target)
+{
+    if (g_hash_table_lookup(dd->dedup, target->dedup_key) == target)
+        g_hash_table_remove(dd->dedup, target->dedup_key);
+
+    GSList *duplicates = target->duplicates;
+    target->duplicates = NULL;
+
+    LrTarget *successor = NULL;
+    for (GSList *elem = duplicates; elem; elem = g_slist_next(elem)) {
+        LrTarget *duplicate = elem->data;
+
+        if (target->state == LR_DS_FINISHED
+            && finish_duplicate(target, duplicate))
+        {
+            target_done(dd, duplicate);
+            continue;
+        }
+
+        if (!successor) {
+            successor = duplicate;
+            requeue_target(dd, successor);
+            if (!g_hash_table_contains(dd->dedup, successor->dedup_key))
+                g_hash_table_insert(dd->dedup,
+                                    (gpointer) successor->dedup_key,
+                                    successor);
+        } else {
+            successor->duplicates = g_slist_append(successor->duplicates,
+                                                   duplicate);
+        }
+    }
+
+    g_slist_free(duplicates);
+}
+
+/** Notify the donecb about a target which reached its final state
+ * and enqueue all targets the callback asked for.
+ */
+static void
+target_done(LrDownload *dd, LrTarget *target)
+{
+    target->done = TRUE;
+    if (dd->releasecb)
+        dd->done_targets++;
+
+    #ifdef WITH_ZCHUNK
+    if (target->state == LR_DS_FINISHED && target->zck_reused > 0
+        && target_stats(target))
+        target_stats(target)->zck_bytes_reused += target->zck_reused;
+    #endif /* WITH_ZCHUNK */
+
+    if (dd->donecb) {
+        GSList *new_targets = dd->donecb(target->target, dd->donecbdata);
+        for (GSList *elem = new_targets; elem; elem = g_slist_next(elem))
+            add_target(dd, elem->data);
+        g_slist_free(new_targets);
+    }
+
+    if (target->dedup_key)
+        resolve_duplicates(dd, target);
+
+    // The file is complete (or removed), other processes may use it.
+    // A file locked by another process is not touched.
+    if (lock_target_file(target, FALSE))
+        remove_target_file(target);
+    unlock_target_file(target);
+}
+
+static gboolean
+check_transfer_statuses(LrDownload *dd, GError **err)
+{
+    assert(dd);
+    assert(!err || *err == NULL);
+
+    int msgs_in_queue;
+    CURLMsg *msg;
+
+    // Submit the writes of the data received by curl at once
+    // and complete the finished ones
+    if (dd->ring)
+        lr_io_ring_complete(dd->ring, FALSE);
+
+    while ((msg = curl_multi_info_read(dd->multi_handle, &msgs_in_queue))) {
+        LrTarget *target = NULL;
+        _cleanup_free_ char *effective_url = NULL;
+        int fd;
+        gboolean matches = TRUE;
+        GError *transfer_err = NULL;
+        GError *tmp_err = NULL;
+        gboolean ret;
+        gboolean serious_error = FALSE;
+        gboolean fatal_error = FALSE;
+        GError *fail_fast_error = NULL;
+
+        if (msg->msg != CURLMSG_DONE) {
+            // We are only interested in messages about finished transfers
+            continue;
+        }
+
+        // Find the target with this curl easy handle
+        char *priv = NULL;
+        curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, &priv);
+        target = (LrTarget *) priv;
+
+        assert(target);  // Each easy handle used in the multi handle
+                         // should always belong to some target from
+                         // the running_transfers list
+
+        curl_easy_getinfo(msg->easy_handle,
+                          CURLINFO_EFFECTIVE_URL,
+                          &effective_url);
+
+        effective_url = g_strdup(effective_url); // Make the effective url
+                                                 // persistent to survive
+                                                 // the curl_easy_cleanup()
+
+        g_debug("Transfer finished: %s (Effective url: %s)", target->target->path, effective_url);
+
+        save_transfer_stats(target, msg->easy_handle);
+        count_transfer(target);
+        lr_trace_async(target->trace_start, (guint64) GPOINTER_TO_SIZE(target),
+                       "transfer", transfer_trace_name(target), effective_url);
+
+        //
+        // Check status of finished transfer
+        //
+        ret = check_finished_transfer_status(msg, target, &serious_error,
+                                             &fatal_error, &transfer_err, err);
+        if (!ret)  // Error
+            return FALSE;
+
+        if (transfer_err)  // Transfer was unsuccessful
+            goto transfer_error;
+
+        if (target->notmodified) { // Nothing was transferred, nothing to check
+            if (target_stats(target))
+                target_stats(target)->notmodified++;
+            goto transfer_error;
+        }
+
+        //
+        // Checksum checking
+        //
+        if (!finish_transfer_writes(target->transfer)) {
+            g_set_error(&transfer_err, LR_DOWNLOADER_ERROR, LRE_IO,
+                        "Cannot write %s: %s",
+                        target->target->path, g_strerror(errno));
+            goto transfer_error;
+        }
+        fd = target->transfer->fd;
+
+        // Preserve timestamp of downloaded file if requested
+        if (fd != -1 && target->target->handle
+            && target->target->handle->preservetime) {
+            CURLcode c_rc;
+            long remote_filetime = -1;
+            c_rc = curl_easy_getinfo(target->transfer->curl_handle, CURLINFO_FILETIME, &remote_filetime);
+            if (c_rc == CURLE_OK && remote_filetime >= 0) {
+                const struct timeval tv[] = {{remote_filetime, 0}, {remote_filetime, 0}};
+                if (futimes(fd, tv) == -1)
+                    g_debug("%s: Failed to change timestamps of downloaded file \"%s\"",
+                            __func__, target->target->path);
+            } else {
+                g_debug("%s: Unable to get remote time of retrieved document \"%s\"",
+                        __func__, target->target->path);
+            }
+        }
+
+        #ifdef WITH_ZCHUNK
+        if (target->target->is_zchunk) {
+            zckCtx *zck = NULL;
+            if (target->zck_state == LR_ZCK_DL_HEADER) {
+                if(target->mirror->max_ranges > 0 && target->mirror->mirror->protocol == LR_PROTOCOL_HTTP &&
+                   !lr_zck_valid_header(target->target, target->target->path,
+                                        fd, &transfer_err))
                     goto transfer_error;
             } else if(target->zck_state == LR_ZCK_DL_BODY) {
                 if(target->mirror->max_ranges > 0 && target->mirror->mirror->protocol == LR_PROTOCOL_HTTP) {
@@ -2315,10 +3904,13 @@ check_transfer_statuses(LrDownload *dd, GError **err)
         } else {
         #endif /* WITH_ZCHUNK */
             // New file was downloaded - clear checksums cached in extended attributes
-            lr_checksum_clear_cache(fd);
+            if (fd != -1)
+                lr_checksum_clear_cache(fd);
 
             ret = check_finished_transfer_checksum(fd,
+                                                  target->transfer->data,
                                                   target->target->checksums,
+                                                  target_stats(target),
                                                   &matches,
                                                   &transfer_err,
                                                   &tmp_err);
@@ -2338,39 +3930,39 @@ check_transfer_statuses(LrDownload *dd, GError **err)
         // Any other checks should go here
         //
 
+        // The data are verified and written back, drop them from
+        // the page cache if requested
+        if (target->transfer->writeback)
+            posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+
 transfer_error:
 
         //
         // Cleanup
         //
-        curl_multi_remove_handle(dd->multi_handle, target->curl_handle);
-        curl_easy_cleanup(target->curl_handle);
-        target->curl_handle = NULL;
-        g_free(target->headercb_interrupt_reason);
-        target->headercb_interrupt_reason = NULL;
-        fclose(target->f);
-        target->f = NULL;
-        if (target->curl_rqheaders) {
-            curl_slist_free_all(target->curl_rqheaders);
-            target->curl_rqheaders = NULL;
-        }
-
-        dd->running_transfers = g_slist_remove(dd->running_transfers,
-                                               (gconstpointer) target);
-        target->tried_mirrors = g_slist_append(target->tried_mirrors,
-                                               target->mirror);
+        curl_multi_remove_handle(dd->multi_handle, target->transfer->curl_handle);
+        detach_transfer(dd, target);
+
+        g_ptr_array_remove(dd->running_transfers, target);
+        add_tried_mirror(dd, target, target->mirror);
 
         if (target->mirror) {
             gboolean success = transfer_err == NULL;
             mirror_update_statistics(target->mirror, success);
             if (dd->adaptivemirrorsorting)
-                sort_mirrors(target->lrmirrors, target->mirror, success, serious_error);
+                sort_mirrors(target->handle_mirrors, target->mirror, success, serious_error);
         }
 
         if (transfer_err) {  // There was an error during transfer
             int complete_url_in_path = strstr(target->target->path, "://") ? 1 : 0;
-            guint num_of_tried_mirrors = g_slist_length(target->tried_mirrors);
+            guint num_of_tried_mirrors = target->num_tried_mirrors;
             gboolean retry = FALSE;
+            LrStats *stats = target_stats(target);
+
+            if (stats) {
+                stats->failed_transfers++;
+                lr_stats_mirror(stats, target_stats_url(target))->failures++;
+            }
 
             g_info("Error during transfer: %s", transfer_err->message);
 
@@ -2416,8 +4008,8 @@ transfer_error:
                         target->mirror->allowed_parallel_connections = 1;
 
                     // Give used mirror another chance
-                    target->tried_mirrors = g_slist_remove(target->tried_mirrors, target->mirror);
-                    num_of_tried_mirrors = g_slist_length(target->tried_mirrors);
+                    remove_tried_mirror(dd, target, target->mirror);
+                    num_of_tried_mirrors = target->num_tried_mirrors;
                 }
                 // complete_url_in_path and target->baseurl doesn't have an alternatives like using
                 // mirrors, therefore they are handled differently
@@ -2430,9 +4022,11 @@ transfer_error:
                   } else {
                       g_debug("%s: Ignore error - Try another mirror", __func__);
                   }
-                  target->state = LR_DS_WAITING;
+                  requeue_target(dd, target);
                   retry = TRUE;
                   g_error_free(transfer_err);  // Ignore the error
+                  if (stats)
+                      stats->retries++;
 
                   // Truncate file - remove downloaded garbage (error html page etc.)
                   #ifdef WITH_ZCHUNK
@@ -2481,6 +4075,7 @@ transfer_error:
                     // error, so this download is aborted, but other download
                     // can continue (do not abort whole downloading)
                     g_error_free(transfer_err);
+                    target_done(dd, target);
                 }
             }
 
@@ -2491,12 +4086,12 @@ transfer_error:
                target->zck_state != LR_ZCK_DL_FINISHED) {
                 // If we haven't finished downloading zchunk file, setup next
                 // download
-                target->state           = LR_DS_WAITING;
+                requeue_target(dd, target);
                 target->original_offset = -1;
                 target->target->rcode   = LRE_UNFINISHED;
                 target->target->err     = "Not finished";
                 target->handle          = target->target->handle;
-                target->tried_mirrors = g_slist_remove(target->tried_mirrors, target->mirror);
+                remove_tried_mirror(dd, target, target->mirror);
             } else {
             #endif /* WITH_ZCHUNK */
                 target->state = LR_DS_FINISHED;
@@ -2506,6 +4101,16 @@ transfer_error:
                 // and the xattr is not needed (is is useful only for resuming)
                 remove_librepo_xattr(target->target);
 
+                // Report the final progress suppressed by the limiter
+                double total, downloaded;
+                if (target->target->progresscb
+                    && lr_progresslimiter_flush(&target->progress_limiter,
+                                                &total, &downloaded))
+                    target->target->progresscb(target->target->cbdata,
+                                               total, downloaded);
+                if (target->target->progresscb == lr_multi_progress_func)
+                    lr_multi_progress_flush(target->target->cbdata);
+
                 // Call end callback
                 LrEndCb end_cb = target->target->endcb;
                 if (end_cb) {
@@ -2531,6 +4136,20 @@ transfer_error:
             lr_downloadtarget_set_error(target->target, LRE_OK, NULL);
             lr_downloadtarget_set_effectiveurl(target->target,
                                                effective_url);
+
+            if (target->target->conditional) {
+                // Remember validators of the target for the next time
+                target->target->notmodified = target->notmodified;
+                if (target->etag || !target->notmodified)
+                    lr_downloadtarget_set_etag(target->target, target->etag);
+                if (target->filetime >= 0)
+                    target->target->lastmodified = target->filetime;
+                else if (!target->notmodified)
+                    target->target->lastmodified = 0;
+            }
+
+            if (target->state == LR_DS_FINISHED && !fail_fast_error)
+                target_done(dd, target);
         }
 
         if (fail_fast_error) {
@@ -2543,7 +4162,14 @@ transfer_error:
 
     // At this point, after handles of finished transfers were removed
     // from the multi_handle, we could add new waiting transfers.
-    return prepare_next_transfers(dd, err);
+    if (!prepare_next_transfers(dd, err))
+        return FALSE;
+
+    // Nothing more to download, report the final summarized progress
+    if (!dd->running_transfers->len)
+        lr_totalprogress_flush(&dd->total_progress);
+
+    return TRUE;
 }
 
 
@@ -2583,8 +4209,14 @@ lr_perform(LrDownload *dd, GError **err)
             return FALSE;
 
         // Leave if there's nothing to wait for
-        if (!still_running && !dd->running_transfers)
-            break;
+        if (!still_running && !dd->running_transfers->len) {
+            if (!dd->lock_waiting)
+                break;
+            // Only targets whose files are locked by other processes
+            // are left, wait before the next attempt to lock them
+            g_usleep(LR_LOCK_RETRY_INTERVAL);
+            continue;
+        }
 
         long curl_timeout = -1;
 
@@ -2645,89 +4277,193 @@ gboolean
 lr_download(GSList *targets,
             gboolean failfast,
             GError **err)
+{
+    return lr_download_pipelined(targets, failfast, NULL, NULL, err);
+}
+
+/** Initialize download data. Downloader configuration (max parallel
+ * connections etc.) is taken from the handle, which could be NULL.
+ */
+static gboolean
+lr_download_init(LrDownload *dd,
+                 LrHandle *lr_handle,
+                 gboolean failfast,
+                 LrTargetDoneCb donecb,
+                 void *donecbdata,
+                 GError **err)
+{
+    memset(dd, 0, sizeof(*dd));
+    dd->failfast = failfast;
+
+    if (lr_handle) {
+        dd->max_parallel_connections = lr_handle->maxparalleldownloads;
+        dd->max_connection_per_host = lr_handle->maxdownloadspermirror;
+        dd->max_mirrors_to_try = lr_handle->maxmirrortries;
+        dd->allowed_mirror_failures = lr_handle->allowed_mirror_failures;
+        dd->adaptivemirrorsorting = lr_handle->adaptivemirrorsorting;
+        dd->total_progress.cb = lr_handle->totalprogresscb;
+        dd->total_progress.cbdata = lr_handle->totalprogressdata;
+    } else {
+        // No handle, this is allowed when a complete URL is passed
+        // via relative_url param.
+        dd->max_parallel_connections = LRO_MAXPARALLELDOWNLOADS_DEFAULT;
+        dd->max_connection_per_host = LRO_MAXDOWNLOADSPERMIRROR_DEFAULT;
+        dd->max_mirrors_to_try = LRO_MAXMIRRORTRIES_DEFAULT;
+        dd->allowed_mirror_failures = LRO_ALLOWEDMIRRORFAILURES_DEFAULT;
+        dd->adaptivemirrorsorting = LRO_ADAPTIVEMIRRORSORTING_DEFAULT;
+    }
+
+    dd->multi_handle = curl_multi_init();
+    if (!dd->multi_handle) {
+        // Something went wrong
+        g_set_error(err, LR_DOWNLOADER_ERROR, LRE_CURLM,
+                    "curl_multi_init() call failed");
+        return FALSE;
+    }
+
+    dd->arena = lr_arena_new(0);
+    dd->handle_mirrors = g_ptr_array_new();
+    dd->targets = g_ptr_array_new();
+    dd->first_waiting = 0;
+    dd->running_transfers = g_ptr_array_new();
+    dd->spare_transfers = g_ptr_array_new();
+    dd->spare_targets = g_ptr_array_new();
+    dd->dedup = g_hash_table_new(g_str_hash, g_str_equal);
+    dd->ring = lr_io_ring_new(LR_DOWNLOAD_RING_DEPTH);
+    dd->donecb = donecb;
+    dd->donecbdata = donecbdata;
+    lr_progresslimiter_init(&dd->total_progress.limiter, lr_handle);
+
+    return TRUE;
+}
+
+/** Stop all transfers that are in progress because of the error.
+ */
+static void
+lr_download_abort(LrDownload *dd, const GError *error)
+{
+    g_info("Error while downloading: %s", error->message);
+
+    for (guint i = 0; i < dd->running_transfers->len; i++) {
+        LrTarget *target = g_ptr_array_index(dd->running_transfers, i);
+
+        curl_multi_remove_handle(dd->multi_handle, target->transfer->curl_handle);
+        detach_transfer(dd, target);
+
+        // Call end callback
+        LrEndCb end_cb =  target->target->endcb;
+        if (end_cb) {
+            gchar *msg = g_strdup_printf("Not finished - interrupted by "
+                                         "error: %s", error->message);
+            end_cb(target->target->cbdata, LR_TRANSFER_ERROR, msg);
+            // No need to check end_cb return value, because there
+            // already was an error
+            g_free(msg);
+        }
+
+        lr_downloadtarget_set_error(target->target, LRE_UNFINISHED,
+                "Not finished - interrupted by error: %s",
+                error->message);
+    }
+
+    g_ptr_array_set_size(dd->running_transfers, 0);
+}
+
+/** Free download data. There must be no running transfers.
+ */
+static void
+lr_download_clear(LrDownload *dd)
+{
+    assert(dd->running_transfers->len == 0);
+
+    curl_multi_cleanup(dd->multi_handle);
+    dd->multi_handle = NULL;
+
+    // Clean up dd->handle_mirrors (the structures live in the arena)
+    for (guint i = 0; i < dd->handle_mirrors->len; i++) {
+        LrHandleMirrors *handle_mirrors = g_ptr_array_index(dd->handle_mirrors, i);
+        curl_slist_free_all(handle_mirrors->rqheaders);
+    }
+    g_ptr_array_free(dd->handle_mirrors, TRUE);
+    dd->handle_mirrors = NULL;
+
+    // Clean up targets
+    for (guint i = 0; i < dd->targets->len; i++) {
+        LrTarget *target = g_ptr_array_index(dd->targets, i);
+        clear_target(dd, target);
+        if (dd->releasecb)
+            dd->releasecb(target->target, dd->donecbdata);
+    }
+    g_ptr_array_free(dd->targets, TRUE);
+    dd->targets = NULL;
+    g_ptr_array_free(dd->running_transfers, TRUE);
+    dd->running_transfers = NULL;
+    for (guint i = 0; i < dd->spare_transfers->len; i++) {
+        LrTransfer *transfer = g_ptr_array_index(dd->spare_transfers, i);
+        free(transfer->wbuf);
+        free(transfer->wbuf_spare);
+    }
+    g_ptr_array_free(dd->spare_transfers, TRUE);
+    dd->spare_transfers = NULL;
+    g_ptr_array_free(dd->spare_targets, TRUE);
+    dd->spare_targets = NULL;
+    dd->spare_tried_mirrors = NULL;
+    g_hash_table_destroy(dd->dedup);
+    lr_io_ring_free(dd->ring);
+    dd->ring = NULL;
+    dd->dedup = NULL;
+
+    // Targets, mirrors, ... are released at once
+    lr_arena_free(dd->arena);
+    dd->arena = NULL;
+}
+
+static gboolean
+lr_download_run(GSList *targets,
+                gboolean failfast,
+                LrTargetDoneCb donecb,
+                LrTargetReleaseCb releasecb,
+                void *cbdata,
+                GError **err)
 {
     gboolean ret = FALSE;
     LrDownload dd;             // dd stands for Download Data
     GError *tmp_err = NULL;
+    _cleanup_trace_span_ LrTraceSpan span = LR_TRACE_SPAN_INIT(
+            "download", "lr_download", NULL);
 
     assert(!err || *err == NULL);
 
+    gboolean initialized = FALSE;
     if (lr_interrupt) {
         g_set_error(err, LR_DOWNLOADER_ERROR, LRE_INTERRUPTED,
                     "Interrupted by signal");
-        return FALSE;
-    }
-
-    if (!targets) {
+    } else if (!targets) {
         g_debug("%s: No targets", __func__);
         return TRUE;
-    }
-
-    // XXX: Downloader configuration (max parallel connections etc.)
-    // is taken from the handle of the first target.
-    LrHandle *lr_handle = ((LrDownloadTarget *) targets->data)->handle;
-
-    // Prepare download data
-    dd.failfast = failfast;
-
-    if (lr_handle) {
-        dd.max_parallel_connections = lr_handle->maxparalleldownloads;
-        dd.max_connection_per_host = lr_handle->maxdownloadspermirror;
-        dd.max_mirrors_to_try = lr_handle->maxmirrortries;
-        dd.allowed_mirror_failures = lr_handle->allowed_mirror_failures;
-        dd.adaptivemirrorsorting = lr_handle->adaptivemirrorsorting;
     } else {
-        // No handle, this is allowed when a complete URL is passed
-        // via relative_url param.
-        dd.max_parallel_connections = LRO_MAXPARALLELDOWNLOADS_DEFAULT;
-        dd.max_connection_per_host = LRO_MAXDOWNLOADSPERMIRROR_DEFAULT;
-        dd.max_mirrors_to_try = LRO_MAXMIRRORTRIES_DEFAULT;
-        dd.allowed_mirror_failures = LRO_ALLOWEDMIRRORFAILURES_DEFAULT;
-        dd.adaptivemirrorsorting = LRO_ADAPTIVEMIRRORSORTING_DEFAULT;
+        // XXX: Downloader configuration (max parallel connections etc.)
+        // is taken from the handle of the first target.
+        LrHandle *lr_handle = ((LrDownloadTarget *) targets->data)->handle;
+
+        // Prepare download data
+        initialized = lr_download_init(&dd, lr_handle, failfast,
+                                       donecb, cbdata, err);
     }
 
-    dd.multi_handle = curl_multi_init();
-    if (!dd.multi_handle) {
-        // Something went wrong
-        g_set_error(err, LR_DOWNLOADER_ERROR, LRE_CURLM,
-                    "curl_multi_init() call failed");
+    if (!initialized) {
+        // The targets never got into the download, but they
+        // are released all the same
+        if (releasecb)
+            for (GSList *elem = targets; elem; elem = g_slist_next(elem))
+                releasecb(elem->data, cbdata);
         return FALSE;
     }
+    dd.releasecb = releasecb;
 
     // Prepare list of LrTargets and LrHandleMirrors
-    dd.handle_mirrors = NULL;
-    dd.targets = NULL;
-    for (GSList *elem = targets; elem; elem = g_slist_next(elem)) {
-        LrDownloadTarget *dtarget = elem->data;
-
-        // Assertions
-        assert(dtarget);
-        assert(dtarget->path);
-        assert((dtarget->fd > 0 && !dtarget->fn) || (dtarget->fd < 0 && dtarget->fn));
-        g_debug("%s: Target: %s (%s)", __func__,
-                dtarget->path,
-                (dtarget->baseurl) ? dtarget->baseurl : "-");
-
-        // Cleanup of LrDownloadTarget
-        lr_downloadtarget_reset(dtarget);
-
-        // Create and fill LrTarget
-        LrTarget *target = lr_malloc0(sizeof(*target));
-        target->state           = LR_DS_WAITING;
-        target->target          = dtarget;
-        target->original_offset = -1;
-        target->resume          = dtarget->resume;
-        target->target->rcode   = LRE_UNFINISHED;
-        target->target->err     = "Not finished";
-        target->handle          = dtarget->handle;
-        dd.targets = g_slist_append(dd.targets, target);
-        // Add list of handle internal mirrors to dd.handle_mirrors
-        // if doesn't exists yet and set the list reference
-        // to the target.
-        dd.handle_mirrors = lr_prepare_lrmirrors(dd.handle_mirrors, target);
-    }
-
-    dd.running_transfers = NULL;
+    for (GSList *elem = targets; elem; elem = g_slist_next(elem))
+        add_target(&dd, elem->data);
 
     // Prepare the first set of transfers
     if (!prepare_next_transfers(&dd, &tmp_err))
@@ -2743,85 +4479,35 @@ lr_download_cleanup:
 
     if (tmp_err) {
         // If there was an error, stop all transfers that are in progress.
-        g_info("Error while downloading: %s", tmp_err->message);
-
-        for (GSList *elem = dd.running_transfers; elem; elem = g_slist_next(elem)){
-            LrTarget *target = elem->data;
-
-            curl_multi_remove_handle(dd.multi_handle, target->curl_handle);
-            curl_easy_cleanup(target->curl_handle);
-            target->curl_handle = NULL;
-            fclose(target->f);
-            target->f = NULL;
-            g_free(target->headercb_interrupt_reason);
-            target->headercb_interrupt_reason = NULL;
-
-            // Call end callback
-            LrEndCb end_cb =  target->target->endcb;
-            if (end_cb) {
-                gchar *msg = g_strdup_printf("Not finished - interrupted by "
-                                             "error: %s", tmp_err->message);
-                end_cb(target->target->cbdata, LR_TRANSFER_ERROR, msg);
-                // No need to check end_cb return value, because there
-                // already was an error
-                g_free(msg);
-            }
-
-            lr_downloadtarget_set_error(target->target, LRE_UNFINISHED,
-                    "Not finished - interrupted by error: %s",
-                    tmp_err->message);
-        }
-
-        g_slist_free(dd.running_transfers);
-        dd.running_transfers = NULL;
-
+        lr_download_abort(&dd, tmp_err);
         g_propagate_error(err, tmp_err);
     }
 
-    assert(dd.running_transfers == NULL);
+    lr_download_clear(&dd);
 
-    curl_multi_cleanup(dd.multi_handle);
-
-    // Clean up dd.handle_mirrors
-    for (GSList *elem = dd.handle_mirrors; elem; elem = g_slist_next(elem)) {
-        LrHandleMirrors *handle_mirrors = elem->data;
-        for (GSList *el = handle_mirrors->lrmirrors; el; el = g_slist_next(el)) {
-            LrMirror *mirror = el->data;
-            lr_free(mirror);
-        }
-        g_slist_free(handle_mirrors->lrmirrors);
-        lr_free(handle_mirrors);
-    }
-    g_slist_free(dd.handle_mirrors);
-
-    // Clean up targets
-    for (GSList *elem = dd.targets; elem; elem = g_slist_next(elem)) {
-        LrTarget *target = elem->data;
-        assert(target->curl_handle == NULL);
-        assert(target->f == NULL);
-
-        // Remove file created for the target if download was
-        // unsuccessful and the file doesn't exists before or
-        // its original content was overwritten
-        if (target->state != LR_DS_FINISHED) {
-            if (!target->resume || target->original_offset == 0) {
-                // Remove target file if the file doesn't
-                // exist before or was empty or was overwritten
-                if (target->target->fn) {
-                    // We can remove only files that were specified by fn
-                    if (unlink(target->target->fn) != 0) {
-                        g_warning("Error while removing: %s", g_strerror(errno));
-                    }
-                }
-            }
-        }
+    return ret;
+}
 
-        g_slist_free(target->tried_mirrors);
-        lr_free(target);
-    }
-    g_slist_free(dd.targets);
+gboolean
+lr_download_pipelined(GSList *targets,
+                      gboolean failfast,
+                      LrTargetDoneCb donecb,
+                      void *donecbdata,
+                      GError **err)
+{
+    return lr_download_run(targets, failfast, donecb, NULL, donecbdata, err);
+}
 
-    return ret;
+gboolean
+lr_download_streamed(GSList *targets,
+                     gboolean failfast,
+                     LrTargetDoneCb donecb,
+                     LrTargetReleaseCb releasecb,
+                     void *cbdata,
+                     GError **err)
+{
+    assert(releasecb);
+    return lr_download_run(targets, failfast, donecb, releasecb, cbdata, err);
 }
 
 gboolean
@@ -2890,6 +4576,9 @@ lr_multi_progress_func(void* ptr,
     if (downloaded > totalsize)
         totalsize = downloaded;
 
+    if (!lr_progresslimiter_check(&shared_cbdata->limiter, totalsize, downloaded))
+        return LR_CB_OK;
+
     // Call user callback
     return shared_cbdata->cb(cbdata->userdata,
                              totalsize,
@@ -2910,6 +4599,19 @@ lr_download_single_cb(GSList *targets,
                       LrProgressCb cb,
                       LrMirrorFailureCb mfcb,
                       GError **err)
+{
+    return lr_download_single_cb_pipelined(targets, failfast, cb, mfcb,
+                                           NULL, NULL, err);
+}
+
+gboolean
+lr_download_single_cb_pipelined(GSList *targets,
+                                gboolean failfast,
+                                LrProgressCb cb,
+                                LrMirrorFailureCb mfcb,
+                                LrTargetDoneCb donecb,
+                                void *donecbdata,
+                                GError **err)
 {
     gboolean ret;
     LrSharedCallbackData shared_cbdata;
@@ -2919,6 +4621,8 @@ lr_download_single_cb(GSList *targets,
     shared_cbdata.cb                 = cb;
     shared_cbdata.mfcb               = mfcb;
     shared_cbdata.singlecbdata       = NULL;
+    lr_progresslimiter_init(&shared_cbdata.limiter,
+            targets ? ((LrDownloadTarget *) targets->data)->handle : NULL);
 
     // "Inject" callbacks and callback data to the targets
     for (GSList *elem = targets; elem; elem = g_slist_next(elem)) {
@@ -2938,7 +4642,7 @@ lr_download_single_cb(GSList *targets,
                                                     lrcbdata);
     }
 
-    ret = lr_download(targets, failfast, err);
+    ret = lr_download_pipelined(targets, failfast, donecb, donecbdata, err);
 
     // Remove callbacks and callback data
     for (GSList *elem = targets; elem; elem = g_slist_next(elem)) {
@@ -2953,3 +4657,507 @@ lr_download_single_cb(GSList *targets,
 
     return ret;
 }
+
+struct _LrDownloadSession {
+    LrDownload dd; /*!<
+        Download data, driven by curl_multi_socket_action() */
+    GHashTable *sockets; /*!<
+        Sockets the curl waits for (curl_socket_t -> GIOCondition) */
+    guint sockets_serial; /*!<
+        Incremented on every change of the sockets */
+    gint64 deadline; /*!<
+        Monotonic time (in microseconds) when the curl timeout expires
+        or -1 if there is no timeout */
+    GQueue finished; /*!<
+        Finished targets (LrDownloadTarget *) not popped yet */
+    gboolean changed; /*!<
+        A target was finished or the session failed since the session
+        GSource called its callback for the last time */
+    GError *error; /*!<
+        Error which stopped the session or NULL */
+    LrTargetDoneCb donecb; /*!<
+        Target done callback of the session owner or NULL */
+    void *donecbdata; /*!<
+        User data for the donecb */
+};
+
+static int
+lr_download_session_socket_cb(G_GNUC_UNUSED CURL *easy,
+                              curl_socket_t s,
+                              int what,
+                              void *userp,
+                              G_GNUC_UNUSED void *socketp)
+{
+    LrDownloadSession *session = userp;
+
+    if (what == CURL_POLL_REMOVE) {
+        g_hash_table_remove(session->sockets, GINT_TO_POINTER(s));
+    } else {
+        GIOCondition condition = 0;
+        if (what & CURL_POLL_IN)
+            condition |= G_IO_IN;
+        if (what & CURL_POLL_OUT)
+            condition |= G_IO_OUT;
+        g_hash_table_insert(session->sockets, GINT_TO_POINTER(s),
+                            GUINT_TO_POINTER(condition));
+    }
+
+    session->sockets_serial++;
+    return 0;
+}
+
+static int
+lr_download_session_timer_cb(G_GNUC_UNUSED CURLM *multi,
+                             long timeout_ms,
+                             void *userp)
+{
+    LrDownloadSession *session = userp;
+
+    if (timeout_ms < 0)
+        session->deadline = -1;
+    else
+        session->deadline = g_get_monotonic_time() + timeout_ms * 1000;
+
+    return 0;
+}
+
+/** LrTargetDoneCb of the session */
+static GSList *
+lr_download_session_target_done(LrDownloadTarget *target, void *cbdata)
+{
+    LrDownloadSession *session = cbdata;
+    GSList *new_targets = NULL;
+
+    if (session->donecb)
+        new_targets = session->donecb(target, session->donecbdata);
+
+    g_queue_push_tail(&session->finished, target);
+    session->changed = TRUE;
+
+    return new_targets;
+}
+
+/** LrTargetReleaseCb of the session. The done targets were already
+ * queued as finished by lr_download_session_target_done(), releasing
+ * them just lets the session reuse their LrTargets, so its memory
+ * doesn't grow with the number of added targets.
+ */
+static void
+lr_download_session_target_release(G_GNUC_UNUSED LrDownloadTarget *target,
+                                   G_GNUC_UNUSED void *cbdata)
+{
+}
+
+/** Stop the session because of the error. The session takes
+ * the ownership of the error.
+ */
+static void
+lr_download_session_fail(LrDownloadSession *session, GError *error)
+{
+    LrDownload *dd = &session->dd;
+
+    // Transfers stopped by the error are finished too
+    for (guint i = 0; i < dd->running_transfers->len; i++) {
+        LrTarget *target = g_ptr_array_index(dd->running_transfers, i);
+        g_queue_push_tail(&session->finished, target->target);
+    }
+
+    lr_download_abort(dd, error);
+
+    // Targets which didn't start yet won't be downloaded anymore
+    for (guint i = 0; i < dd->targets->len; i++) {
+        LrTarget *target = g_ptr_array_index(dd->targets, i);
+        if (target->done
+            || (target->state != LR_DS_WAITING
+                && target->state != LR_DS_DUPLICATE))
+            continue;
+
+        target->state = LR_DS_FAILED;
+        target->done = TRUE;
+        if (dd->releasecb)
+            dd->done_targets++;
+        lr_downloadtarget_set_error(target->target, LRE_INTERRUPTED,
+                "Not started - interrupted by error: %s", error->message);
+
+        LrEndCb end_cb = target->target->endcb;
+        if (end_cb) {
+            // The return value doesn't matter, there already is an error
+            end_cb(target->target->cbdata, LR_TRANSFER_ERROR,
+                   target->target->err);
+        }
+        g_queue_push_tail(&session->finished, target->target);
+    }
+
+    session->error = error;
+    session->changed = TRUE;
+}
+
+LrDownloadSession *
+lr_download_session_new(LrHandle *handle, gboolean failfast, GError **err)
+{
+    return lr_download_session_new_pipelined(handle, failfast, NULL, NULL, err);
+}
+
+LrDownloadSession *
+lr_download_session_new_pipelined(LrHandle *handle,
+                                  gboolean failfast,
+                                  LrTargetDoneCb donecb,
+                                  void *donecbdata,
+                                  GError **err)
+{
+    assert(!err || *err == NULL);
+
+    LrDownloadSession *session = lr_malloc0(sizeof(*session));
+    session->donecb = donecb;
+    session->donecbdata = donecbdata;
+
+    if (!lr_download_init(&session->dd, handle, failfast,
+                          lr_download_session_target_done, session, err)) {
+        lr_free(session);
+        return NULL;
+    }
+
+    session->dd.releasecb = lr_download_session_target_release;
+    session->sockets = g_hash_table_new(g_direct_hash, g_direct_equal);
+    session->deadline = -1;
+    g_queue_init(&session->finished);
+
+    CURLM *multi = session->dd.multi_handle;
+    if (curl_multi_setopt(multi, CURLMOPT_SOCKETFUNCTION, lr_download_session_socket_cb) != CURLM_OK
+        || curl_multi_setopt(multi, CURLMOPT_SOCKETDATA, session) != CURLM_OK
+        || curl_multi_setopt(multi, CURLMOPT_TIMERFUNCTION, lr_download_session_timer_cb) != CURLM_OK
+        || curl_multi_setopt(multi, CURLMOPT_TIMERDATA, session) != CURLM_OK)
+    {
+        g_set_error(err, LR_DOWNLOADER_ERROR, LRE_CURLM,
+                    "curl_multi_setopt() call failed");
+        lr_download_session_free(session);
+        return NULL;
+    }
+
+    return session;
+}
+
+gboolean
+lr_download_session_add_target(LrDownloadSession *session,
+                               LrDownloadTarget *target,
+                               GError **err)
+{
+    GError *tmp_err = NULL;
+
+    assert(session);
+    assert(!err || *err == NULL);
+
+    if (session->error) {
+        g_set_error(err, LR_DOWNLOADER_ERROR, session->error->code,
+                    "Download session failed: %s", session->error->message);
+        return FALSE;
+    }
+
+    add_target(&session->dd, target);
+
+    if (!prepare_next_transfers(&session->dd, &tmp_err)) {
+        g_propagate_error(err, g_error_copy(tmp_err));
+        lr_download_session_fail(session, tmp_err);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+GPollFD *
+lr_download_session_get_fds(LrDownloadSession *session, guint *nfds)
+{
+    GHashTableIter iter;
+    gpointer key, value;
+    guint x = 0;
+
+    assert(session);
+    assert(nfds);
+
+    *nfds = g_hash_table_size(session->sockets);
+    if (*nfds == 0)
+        return NULL;
+
+    GPollFD *fds = g_new0(GPollFD, *nfds);
+    g_hash_table_iter_init(&iter, session->sockets);
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+        fds[x].fd = GPOINTER_TO_INT(key);
+        fds[x].events = GPOINTER_TO_UINT(value);
+        x++;
+    }
+
+    return fds;
+}
+
+long
+lr_download_session_get_timeout(LrDownloadSession *session)
+{
+    assert(session);
+
+    if (session->error)
+        return -1;
+
+    // Targets locked by other processes are tried again periodically
+    gint64 deadline = session->deadline;
+    if (session->dd.lock_waiting) {
+        gint64 retry = g_get_monotonic_time() + LR_LOCK_RETRY_INTERVAL;
+        if (deadline < 0 || retry < deadline)
+            deadline = retry;
+    }
+
+    if (deadline < 0)
+        return -1;
+
+    gint64 remaining = deadline - g_get_monotonic_time();
+    if (remaining <= 0)
+        return 0;
+
+    // Round up, so the timeout is really expired when it's reported
+    return (long) ((remaining + 999) / 1000);
+}
+
+gboolean
+lr_download_session_step(LrDownloadSession *session,
+                         int fd,
+                         GIOCondition condition,
+                         GError **err)
+{
+    CURLMcode cm_rc;
+    int still_running = 0;
+    int ev_bitmask = 0;
+    GError *tmp_err = NULL;
+
+    assert(session);
+    assert(!err || *err == NULL);
+
+    if (session->error) {
+        g_set_error(err, LR_DOWNLOADER_ERROR, session->error->code,
+                    "Download session failed: %s", session->error->message);
+        return FALSE;
+    }
+
+    if (lr_interrupt) {
+        // The same check as in lr_download(), the SIGINT handler
+        // of the caller (see lr_sigint_handler()) stops the session
+        g_set_error(&tmp_err, LR_DOWNLOADER_ERROR, LRE_INTERRUPTED,
+                    "Interrupted by signal");
+        g_propagate_error(err, g_error_copy(tmp_err));
+        lr_download_session_fail(session, tmp_err);
+        return FALSE;
+    }
+
+    if (fd < 0) {
+        // Curl sets a new timeout by the timer callback if it needs one
+        session->deadline = -1;
+        cm_rc = curl_multi_socket_action(session->dd.multi_handle,
+                                         CURL_SOCKET_TIMEOUT, 0,
+                                         &still_running);
+    } else {
+        if (condition & G_IO_IN)
+            ev_bitmask |= CURL_CSELECT_IN;
+        if (condition & G_IO_OUT)
+            ev_bitmask |= CURL_CSELECT_OUT;
+        if (condition & (G_IO_ERR | G_IO_HUP))
+            ev_bitmask |= CURL_CSELECT_ERR;
+        cm_rc = curl_multi_socket_action(session->dd.multi_handle,
+                                         fd, ev_bitmask, &still_running);
+    }
+
+    if (cm_rc != CURLM_OK) {
+        g_set_error(&tmp_err, LR_DOWNLOADER_ERROR, LRE_CURLM,
+                    "curl_multi_socket_action() error: %s",
+                    curl_multi_strerror(cm_rc));
+    } else {
+        // Check if any handle finished and potentially add one or more
+        // waiting downloads to the multi_handle.
+        check_transfer_statuses(&session->dd, &tmp_err);
+    }
+
+    if (tmp_err) {
+        g_propagate_error(err, g_error_copy(tmp_err));
+        lr_download_session_fail(session, tmp_err);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+LrDownloadTarget *
+lr_download_session_pop_finished(LrDownloadSession *session)
+{
+    assert(session);
+    return g_queue_pop_head(&session->finished);
+}
+
+gboolean
+lr_download_session_is_finished(LrDownloadSession *session)
+{
+    assert(session);
+    return session->error
+           || (!session->dd.running_transfers->len
+               && !session->dd.lock_waiting);
+}
+
+const GError *
+lr_download_session_get_error(LrDownloadSession *session)
+{
+    assert(session);
+    return session->error;
+}
+
+void
+lr_download_session_cancel(LrDownloadSession *session)
+{
+    assert(session);
+
+    if (session->error)
+        return;
+
+    lr_download_session_fail(session,
+        g_error_new(LR_DOWNLOADER_ERROR, LRE_INTERRUPTED,
+                    "Download session was cancelled"));
+}
+
+void
+lr_download_session_free(LrDownloadSession *session)
+{
+    if (!session)
+        return;
+
+    if (session->dd.running_transfers->len)
+        lr_download_session_cancel(session);
+
+    if (session->dd.multi_handle)
+        lr_download_clear(&session->dd);
+    g_hash_table_destroy(session->sockets);
+    g_queue_clear(&session->finished);
+    if (session->error)
+        g_error_free(session->error);
+    lr_free(session);
+}
+
+/** GSource which drives a LrDownloadSession */
+typedef struct {
+    GSource source;
+    LrDownloadSession *session; /*!<
+        Related session */
+    GSList *pollfds; /*!<
+        GPollFDs added to the source */
+    guint sockets_serial; /*!<
+        Serial of the session sockets when the pollfds were updated */
+} LrDownloadSessionSource;
+
+static void
+lr_download_session_source_clear_fds(LrDownloadSessionSource *src)
+{
+    for (GSList *elem = src->pollfds; elem; elem = g_slist_next(elem)) {
+        g_source_remove_poll(&src->source, elem->data);
+        g_free(elem->data);
+    }
+    g_slist_free(src->pollfds);
+    src->pollfds = NULL;
+}
+
+static gboolean
+lr_download_session_source_prepare(GSource *source, gint *timeout)
+{
+    LrDownloadSessionSource *src = (LrDownloadSessionSource *) source;
+    LrDownloadSession *session = src->session;
+
+    if (!src->pollfds || src->sockets_serial != session->sockets_serial) {
+        guint nfds;
+        _cleanup_free_ GPollFD *fds = lr_download_session_get_fds(session, &nfds);
+
+        lr_download_session_source_clear_fds(src);
+        for (guint x = 0; x < nfds; x++) {
+            GPollFD *pollfd = g_new(GPollFD, 1);
+            *pollfd = fds[x];
+            g_source_add_poll(source, pollfd);
+            src->pollfds = g_slist_prepend(src->pollfds, pollfd);
+        }
+        src->sockets_serial = session->sockets_serial;
+    }
+
+    long session_timeout = lr_download_session_get_timeout(session);
+    *timeout = (session_timeout > G_MAXINT) ? G_MAXINT : (gint) session_timeout;
+
+    return session->changed || session_timeout == 0;
+}
+
+static gboolean
+lr_download_session_source_check(GSource *source)
+{
+    LrDownloadSessionSource *src = (LrDownloadSessionSource *) source;
+
+    if (src->session->changed
+        || lr_download_session_get_timeout(src->session) == 0)
+        return TRUE;
+
+    for (GSList *elem = src->pollfds; elem; elem = g_slist_next(elem))
+        if (((GPollFD *) elem->data)->revents)
+            return TRUE;
+
+    return FALSE;
+}
+
+static gboolean
+lr_download_session_source_dispatch(GSource *source,
+                                    GSourceFunc callback,
+                                    gpointer user_data)
+{
+    LrDownloadSessionSource *src = (LrDownloadSessionSource *) source;
+    LrDownloadSession *session = src->session;
+
+    // Errors are kept in the session, the callback gets them
+    // by lr_download_session_get_error()
+    for (GSList *elem = src->pollfds; elem; elem = g_slist_next(elem)) {
+        GPollFD *pollfd = elem->data;
+        if (pollfd->revents && !session->error)
+            lr_download_session_step(session, pollfd->fd,
+                                     pollfd->revents, NULL);
+        pollfd->revents = 0;
+    }
+
+    if (!session->error && lr_download_session_get_timeout(session) == 0)
+        lr_download_session_step(session, -1, 0, NULL);
+
+    if (!session->changed)
+        return G_SOURCE_CONTINUE;
+
+    session->changed = FALSE;
+    if (!callback)
+        return G_SOURCE_CONTINUE;
+
+    return ((LrDownloadSessionFunc) (void (*)(void)) callback)(session, user_data);
+}
+
+static void
+lr_download_session_source_finalize(GSource *source)
+{
+    lr_download_session_source_clear_fds((LrDownloadSessionSource *) source);
+}
+
+static GSourceFuncs lr_download_session_source_funcs = {
+    lr_download_session_source_prepare,
+    lr_download_session_source_check,
+    lr_download_session_source_dispatch,
+    lr_download_session_source_finalize,
+    NULL,
+    NULL,
+};
+
+GSource *
+lr_download_session_source_new(LrDownloadSession *session)
+{
+    assert(session);
+
+    GSource *source = g_source_new(&lr_download_session_source_funcs,
+                                   sizeof(LrDownloadSessionSource));
+    LrDownloadSessionSource *src = (LrDownloadSessionSource *) source;
+    src->session = session;
+    src->pollfds = NULL;
+    src->sockets_serial = 0;
+    g_source_set_name(source, "librepo download session");
+
+    return source;
+}
@@ -46,6 +46,12 @@ void
 lr_sigint_handler(int sig);
 
 /** Main download function.
+ * Identical targets (with the same checksum, or without checksums
+ * and with the same handle and URL) written to files are downloaded only
+ * once. The other ones get a reflink (where supported) or a copy of
+ * the downloaded file and their callbacks are called as if they were
+ * downloaded. The files never share their inode, modifying one of them
+ * in place doesn't change the others.
  * @param targets   GSList with one or more ::LrDownloadTarget.
  *                  Could be NULL. Then return immediately with LRE_OK
  *                  return code.
@@ -102,6 +108,153 @@ lr_download_single_cb(GSList *targets,
                       LrMirrorFailureCb mfcb,
                       GError **err);
 
+/** Non-blocking download session.
+ *
+ * The blocking functions above (::lr_download etc.) run the whole
+ * download inside of one call. The session allows to drive the same
+ * downloader from an external event loop:
+ *
+ * 1. Create the session by ::lr_download_session_new and add targets
+ *    by ::lr_download_session_add_target (targets could be added even
+ *    later, while the session is running).
+ * 2. Wait until a file descriptor from ::lr_download_session_get_fds
+ *    is ready or the timeout from ::lr_download_session_get_timeout
+ *    expires and call ::lr_download_session_step.
+ * 3. Collect finished targets by ::lr_download_session_pop_finished.
+ * 4. Repeat until ::lr_download_session_is_finished returns TRUE.
+ *
+ * For GLib based applications, ::lr_download_session_source_new
+ * creates a GSource which does steps 2 and 3 in a GMainContext.
+ *
+ * Like ::lr_download, the session checks lr_interrupt (set by
+ * ::lr_sigint_handler) in every ::lr_download_session_step and fails
+ * with LRE_INTERRUPTED when it's set. The session doesn't install the
+ * signal handler itself. Use ::lr_download_session_cancel to stop it
+ * from the application.
+ */
+typedef struct _LrDownloadSession LrDownloadSession;
+
+/** Create new download session.
+ * @param handle    Handle whose downloader configuration (max parallel
+ *                  downloads etc.) is used or NULL for defaults.
+ * @param failfast  If TRUE, the session fails after first failed
+ *                  download. See ::lr_download
+ * @param err       GError **
+ * @return          New session or NULL if err is set.
+ */
+LrDownloadSession *
+lr_download_session_new(LrHandle *handle, gboolean failfast, GError **err);
+
+/** Add target to the session. Its transfer starts immediately if the
+ * limits of parallel downloads allow it. The target must not be freed
+ * before it is returned by ::lr_download_session_pop_finished or
+ * the session is freed.
+ * @param session   Download session
+ * @param target    Download target
+ * @param err       GError **
+ * @return          If FALSE then err is set.
+ */
+gboolean
+lr_download_session_add_target(LrDownloadSession *session,
+                               LrDownloadTarget *target,
+                               GError **err);
+
+/** Get file descriptors which the session waits for.
+ * @param session   Download session
+ * @param nfds      Number of returned file descriptors
+ * @return          Newly allocated array (free it by g_free()) of file
+ *                  descriptors and events (G_IO_IN, G_IO_OUT) or NULL
+ *                  if there are no file descriptors.
+ */
+GPollFD *
+lr_download_session_get_fds(LrDownloadSession *session, guint *nfds);
+
+/** Get time after which ::lr_download_session_step should be called
+ * with fd -1 even if no file descriptor is ready.
+ * @param session   Download session
+ * @return          Timeout in milliseconds, 0 means call it right now,
+ *                  -1 means there is no timeout.
+ */
+long
+lr_download_session_get_timeout(LrDownloadSession *session);
+
+/** Process events of the session.
+ * @param session   Download session
+ * @param fd        Ready file descriptor or -1 if the timeout expired
+ * @param condition Ready events of the fd (G_IO_IN, G_IO_OUT, G_IO_ERR)
+ * @param err       GError **
+ * @return          If FALSE then err is set and the session failed
+ *                  (all its running transfers were stopped, see
+ *                  ::lr_download_session_cancel). LRE_INTERRUPTED if
+ *                  lr_interrupt is set.
+ */
+gboolean
+lr_download_session_step(LrDownloadSession *session,
+                         int fd,
+                         GIOCondition condition,
+                         GError **err);
+
+/** Pop next finished (downloaded or failed) target.
+ * @param session   Download session
+ * @return          Finished target (check its rcode) or NULL.
+ */
+LrDownloadTarget *
+lr_download_session_pop_finished(LrDownloadSession *session);
+
+/** Check if the session has nothing more to do.
+ * @param session   Download session
+ * @return          TRUE if there are no running transfers or
+ *                  the session failed.
+ */
+gboolean
+lr_download_session_is_finished(LrDownloadSession *session);
+
+/** Get error of a failed session.
+ * @param session   Download session
+ * @return          Error which stopped the session or NULL.
+ */
+const GError *
+lr_download_session_get_error(LrDownloadSession *session);
+
+/** Stop all running transfers of the session. Their targets are set
+ * to LRE_UNFINISHED state, the targets which didn't start yet are set
+ * to LRE_INTERRUPTED state (their end callbacks are called with
+ * LR_TRANSFER_ERROR). All of them are returned by
+ * ::lr_download_session_pop_finished and the session fails with
+ * LRE_INTERRUPTED error. A session which fails because of an error
+ * finishes its targets the same way.
+ * @param session   Download session
+ */
+void
+lr_download_session_cancel(LrDownloadSession *session);
+
+/** Free the session. Running transfers are cancelled.
+ * @param session   Download session
+ */
+void
+lr_download_session_free(LrDownloadSession *session);
+
+/** Callback of the session GSource.
+ * @param session   Download session
+ * @param user_data User data
+ * @return          G_SOURCE_REMOVE to remove the source
+ *                  or G_SOURCE_CONTINUE.
+ */
+typedef gboolean (*LrDownloadSessionFunc)(LrDownloadSession *session,
+                                          gpointer user_data);
+
+/** Create GSource which drives the session in a GMainContext.
+ * The callback (set by g_source_set_callback() with the
+ * ::LrDownloadSessionFunc type) is called after every step which
+ * finished some targets or finished or failed the whole session.
+ * The source holds no reference to the session, the session must
+ * outlive the source.
+ * @param session   Download session
+ * @return          New GSource, attach it by g_source_attach().
+ */
+GSource *
+lr_download_session_source_new(LrDownloadSession *session);
+
 /** @} */
 
 G_END_DECLS
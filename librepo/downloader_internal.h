@@ -21,7 +21,66 @@
 #ifndef LIBREPO_DOWNLOADER_INTERNAL_H
 #define LIBREPO_DOWNLOADER_INTERNAL_H
 
+#include <glib.h>
+
 #include "handle.h"
+#include "downloadtarget.h"
+#include "downloader.h"
+
+/** Rate limiting of a progress callback
+ * (see LRO_PROGRESSINTERVAL and LRO_PROGRESSBYTES)
+ */
+typedef struct {
+    gint64 interval; /*!<
+        Minimal interval between two calls (microseconds) */
+    double bytes; /*!<
+        Minimal number of downloaded bytes between two calls */
+    gint64 last_time; /*!<
+        Monotonic time of the last call or -1 if there was no call yet */
+    double last_total; /*!<
+        Total size passed to the last call */
+    double last_downloaded; /*!<
+        Downloaded size passed to the last call */
+    gboolean pending; /*!<
+        A call was suppressed since the last call */
+    double pending_total; /*!<
+        Total size of the latest suppressed call */
+    double pending_downloaded; /*!<
+        Downloaded size of the latest suppressed call */
+} LrProgressLimiter;
+
+/** Init the limiter with the limits of the handle.
+ * @param limiter       Progress limiter
+ * @param handle        Handle or NULL (no limits)
+ */
+void
+lr_progresslimiter_init(LrProgressLimiter *limiter, LrHandle *handle);
+
+/** Decide if the progress should be passed to the callback.
+ * @param limiter       Progress limiter
+ * @param total         Total size
+ * @param downloaded    Downloaded size
+ * @return              TRUE if the callback should be called,
+ *                      FALSE if the call is suppressed (it is remembered
+ *                      as pending).
+ */
+gboolean
+lr_progresslimiter_check(LrProgressLimiter *limiter,
+                         double total,
+                         double downloaded);
+
+/** Take the latest suppressed progress.
+ * @param limiter       Progress limiter
+ * @param total         Total size of the pending call
+ * @param downloaded    Downloaded size of the pending call
+ * @return              TRUE if a call was suppressed since the last call,
+ *                      the callback should be called with the returned
+ *                      values then.
+ */
+gboolean
+lr_progresslimiter_flush(LrProgressLimiter *limiter,
+                         double *total,
+                         double *downloaded);
 
 typedef struct {
     LrProgressCb cb; /*!<
@@ -33,6 +92,9 @@ typedef struct {
     GSList *singlecbdata; /*!<
         List of LrCallbackData */
 
+    LrProgressLimiter limiter; /*!<
+        Rate limiting of the summarized progress */
+
 } LrSharedCallbackData;
 
 typedef struct {
@@ -42,4 +104,105 @@ typedef struct {
     LrSharedCallbackData *sharedcbdata; /*!< Shared cb data */
 } LrCallbackData;
 
+/** Progress callback which reports summarized progress of all targets
+ * which share the LrSharedCallbackData. Its clientp is LrCallbackData.
+ */
+int
+lr_multi_progress_func(void* ptr,
+                       double total_to_download,
+                       double now_downloaded);
+
+/** Mirror failure callback counterpart of lr_multi_progress_func(). */
+int
+lr_multi_mf_func(void *ptr, const char *msg, const char *url);
+
+/** Called when a target reaches its final state (successfully downloaded
+ * or failed without any other mirror to try).
+ * @param target        Finished download target. Its rcode, err and
+ *                      usedmirror are already set.
+ * @param cbdata        User data passed to lr_download_pipelined()
+ * @return              List of new ::LrDownloadTarget objects which should
+ *                      be added to the running download or NULL.
+ *                      The list (but not the targets) is freed by
+ *                      the downloader.
+ */
+typedef GSList *(*LrTargetDoneCb)(LrDownloadTarget *target, void *cbdata);
+
+/** Same as lr_download(), but every time a target is finished the donecb
+ * is called and it can enqueue new targets into the same download.
+ * This way dependent downloads (e.g. repomd.xml -> primary.xml) of
+ * several repositories could be processed in one shared event loop
+ * and one slow repository doesn't block the others.
+ * The downloader configuration is taken from the first target in
+ * the targets list, same as in lr_download().
+ * @param targets       List of initial ::LrDownloadTarget objects
+ * @param failfast      If TRUE, return after first failed download
+ * @param donecb        Target done callback or NULL
+ * @param donecbdata    User data for the donecb
+ * @param err           GError **
+ * @return              If FALSE then err is set.
+ */
+gboolean
+lr_download_pipelined(GSList *targets,
+                      gboolean failfast,
+                      LrTargetDoneCb donecb,
+                      void *donecbdata,
+                      GError **err);
+
+/** Called when the downloader doesn't need a target anymore, see
+ * lr_download_streamed().
+ * @param target        Released download target. Its rcode, err and
+ *                      usedmirror are final.
+ * @param cbdata        User data passed to lr_download_streamed()
+ */
+typedef void (*LrTargetReleaseCb)(LrDownloadTarget *target, void *cbdata);
+
+/** Same as lr_download_pipelined(), but the download doesn't keep its
+ * done targets till its end. Every target (from the targets list or
+ * returned by the donecb) is handed over to the releasecb exactly once,
+ * some time after its donecb was called, when the download is stopped
+ * by an error or when it couldn't be started at all. The caller may free
+ * the target in the releasecb. Bookkeeping of the download is then given
+ * by the number of unfinished targets, not by the number of all targets.
+ * @param targets       List of initial ::LrDownloadTarget objects
+ * @param failfast      If TRUE, return after first failed download
+ * @param donecb        Target done callback or NULL
+ * @param releasecb     Target release callback
+ * @param cbdata        User data for both callbacks
+ * @param err           GError **
+ * @return              If FALSE then err is set.
+ */
+gboolean
+lr_download_streamed(GSList *targets,
+                     gboolean failfast,
+                     LrTargetDoneCb donecb,
+                     LrTargetReleaseCb releasecb,
+                     void *cbdata,
+                     GError **err);
+
+/** Same as lr_download_single_cb(), but with a target done callback
+ * like lr_download_pipelined(). The callback must not enqueue new
+ * targets, their callbacks wouldn't be injected.
+ */
+gboolean
+lr_download_single_cb_pipelined(GSList *targets,
+                                gboolean failfast,
+                                LrProgressCb cb,
+                                LrMirrorFailureCb mfcb,
+                                LrTargetDoneCb donecb,
+                                void *donecbdata,
+                                GError **err);
+
+/** Same as lr_download_session_new(), but the donecb is called for every
+ * finished target (before the target is queued for
+ * lr_download_session_pop_finished()) and it can enqueue new targets
+ * into the session, see lr_download_pipelined().
+ */
+LrDownloadSession *
+lr_download_session_new_pipelined(LrHandle *handle,
+                                  gboolean failfast,
+                                  LrTargetDoneCb donecb,
+                                  void *donecbdata,
+                                  GError **err);
+
 #endif //LIBREPO_DOWNLOADER_INTERNAL_H
@@ -72,7 +72,8 @@ lr_downloadtarget_new(LrHandle *handle,
     _cleanup_free_ gchar *final_baseurl = NULL;
 
     assert(path);
-    assert((fd >= 0 && !fn) || (fd < 0 && fn));
+    assert(fd < 0 || !fn);
+    assert(fd >= 0 || fn || !is_zchunk);
 
     if (byterangestart && resume) {
         g_warning("Cannot specify byterangestart and set resume to TRUE at the same time");
@@ -80,13 +81,9 @@ lr_downloadtarget_new(LrHandle *handle,
     }
 
     // Substitute variables in URLs
-    if (handle && handle->urlvars) {
-        final_path      = lr_url_substitute(path, handle->urlvars);
-        final_baseurl   = lr_url_substitute(baseurl, handle->urlvars);
-    } else {
-        final_path      = g_strdup(path);
-        final_baseurl   = g_strdup(baseurl);
-    }
+    LrUrlSubst *urlsubst = lr_handle_urlsubst(handle);
+    final_path      = lr_urlsubst_url(urlsubst, path);
+    final_baseurl   = lr_urlsubst_url(urlsubst, baseurl);
 
 
     target = lr_malloc0(sizeof(*target));
@@ -113,6 +110,9 @@ lr_downloadtarget_new(LrHandle *handle,
     target->no_cache        = no_cache;
     target->is_zchunk       = is_zchunk;
 
+    if (fd < 0 && !fn)
+        target->data = g_byte_array_new();
+
     return target;
 }
 
@@ -126,6 +126,21 @@ lr_downloadtarget_reset(LrDownloadTarget *target)
     target->effectiveurl = NULL;
     target->rcode = LRE_OK;
     target->err = NULL;
+    target->notmodified = FALSE;
+    g_clear_pointer(&target->stats, g_free);
+    if (target->data)
+        g_byte_array_set_size(target->data, 0);
+}
+
+void
+lr_downloadtarget_set_conditional(LrDownloadTarget *target,
+                                  const char *etag,
+                                  gint64 lastmodified)
+{
+    assert(target);
+    target->conditional = TRUE;
+    target->etag = lr_string_chunk_insert(target->chunk, etag);
+    target->lastmodified = lastmodified;
 }
 
 void
@@ -137,6 +152,9 @@ lr_downloadtarget_free(LrDownloadTarget *target)
     g_slist_free_full(target->checksums,
                       (GDestroyNotify) lr_downloadtargetchecksum_free);
     g_string_chunk_free(target->chunk);
+    g_free(target->stats);
+    if (target->data)
+        g_byte_array_unref(target->data);
     lr_free(target);
 }
 
@@ -186,3 +204,21 @@ lr_downloadtarget_set_effectiveurl(LrDownloadTarget *target, const char *url)
     assert(target);
     target->effectiveurl = lr_string_chunk_insert(target->chunk, url);
 }
+
+void
+lr_downloadtarget_set_etag(LrDownloadTarget *target, const char *etag)
+{
+    assert(target);
+    target->etag = lr_string_chunk_insert(target->chunk, etag);
+}
+
+void
+lr_downloadtarget_set_stats(LrDownloadTarget *target,
+                            const LrTransferStats *stats)
+{
+    assert(target);
+    assert(stats);
+    if (!target->stats)
+        target->stats = g_new0(LrTransferStats, 1);
+    *target->stats = *stats;
+}
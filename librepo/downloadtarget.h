@@ -35,6 +35,12 @@
 
 G_BEGIN_DECLS
 
+/** Maximal size of the data of an in-memory target (see
+ * LrDownloadTarget.data) without expectedsize. A target with
+ * expectedsize cannot get more than expectedsize bytes. If a transfer
+ * brings more data, it fails with LRE_IO error. */
+#define LR_DOWNLOADTARGET_DATA_MAX          (G_GINT64_CONSTANT(64) * 1024 * 1024)
+
 typedef struct {
     LrChecksumType type;
     gchar *value;
@@ -53,6 +59,46 @@ lr_downloadtargetchecksum_new(LrChecksumType type, const gchar *value);
 void
 lr_downloadtargetchecksum_free(LrDownloadTargetChecksum *dtch);
 
+/** Timing and size breakdown of a transfer.
+ * All times are in seconds since the start of the transfer.
+ */
+typedef struct {
+    double namelookup_time; /*!<
+        Name resolving was completed */
+
+    double connect_time; /*!<
+        Connection to the remote host (or proxy) was established */
+
+    double appconnect_time; /*!<
+        SSL/TLS handshake was completed (0 if no TLS was used) */
+
+    double pretransfer_time; /*!<
+        Transfer was about to begin */
+
+    double starttransfer_time; /*!<
+        First byte was received (time to first byte) */
+
+    double redirect_time; /*!<
+        Time spent by redirects before the final transfer was started */
+
+    double total_time; /*!<
+        Total time of the transfer */
+
+    gint64 downloaded; /*!<
+        Number of bytes downloaded */
+
+    double speed; /*!<
+        Average download speed in bytes per second */
+
+    long http_version; /*!<
+        Used HTTP version: 10 (HTTP/1.0), 11 (HTTP/1.1), 20 (HTTP/2),
+        30 (HTTP/3) or 0 if unknown or other protocol than HTTP was used */
+
+    gboolean reused; /*!<
+        TRUE if an already opened connection was reused */
+
+} LrTransferStats;
+
 /** Single download target
  */
 typedef struct {
@@ -69,7 +115,8 @@ typedef struct {
 
     int fd; /*!<
         Opened file descriptor where data will be written or -1.
-        Note: Only one, fd or fn, is set simultaneously. */
+        Note: Only one, fd or fn, is set simultaneously. If none of them
+        is set, the data are kept in memory (see data). */
 
     char *fn; /*!<
         Filename where data will be written or NULL.
@@ -164,6 +211,39 @@ typedef struct {
         Amount already downloaded in zchunk file */
     #endif /* WITH_ZCHUNK */
 
+    // Conditional download - put at end to maintain API stability
+    gboolean conditional; /*!<
+        If TRUE, etag and lastmodified are sent as If-None-Match and
+        If-Modified-Since and both are replaced by the validators
+        the server returned. See lr_downloadtarget_set_conditional() */
+
+    char *etag; /*!<
+        Entity tag of the local copy of the target or NULL */
+
+    gint64 lastmodified; /*!<
+        Modification time (seconds since the Epoch) of the local copy
+        of the target or 0 if unknown */
+
+    gboolean notmodified; /*!<
+        Filled by downloader. TRUE if the server reported that the local
+        copy is up to date. Nothing was written to the target then. */
+
+    // Transfer statistics - put at end to maintain API stability
+    LrTransferStats *stats; /*!<
+        Filled by downloader. Timing and size breakdown of the last
+        transfer of the target (successful or not) or NULL if no
+        transfer was done. */
+
+    // In-memory target - put at end to maintain API stability
+    GByteArray *data; /*!<
+        Buffer with the downloaded data of a target which has neither
+        fd nor fn set, NULL for the other targets. It's filled by
+        downloader and emptied when the target is downloaded again.
+        It holds at most expectedsize bytes or
+        LR_DOWNLOADTARGET_DATA_MAX if expectedsize is not set.
+        The buffer is freed by lr_downloadtarget_free() unless it's
+        taken over (and the pointer set to NULL) by the user. */
+
 } LrDownloadTarget;
 
 /** Create new empty ::LrDownloadTarget.
@@ -174,7 +254,11 @@ typedef struct {
  *                          or -1.
  *                          Note: Set this or fn, no both!
  * @param fn                Filename where data will be written or NULL.
- *                          Note: Set this or fd, no both!
+ *                          Note: Set this or fd, no both! If none of them
+ *                          is set, the data are kept in memory in the
+ *                          data buffer of the target. This is meant for
+ *                          small files (mirrorlists, metalinks) which
+ *                          are parsed right away, not for zchunk files.
  * @param possiblechecksums NULL or GSList with pointers to
  *                          LrDownloadTargetChecksum structures. With possible
  *                          checksums of the file. Checksum check is stopped
@@ -243,6 +327,20 @@ lr_downloadtarget_new(LrHandle *handle,
 void
 lr_downloadtarget_reset(LrDownloadTarget *target);
 
+/** Make the download of the target conditional. The server is asked to
+ * send the target only if it differs from the local copy described by
+ * the validators. If it doesn't, the transfer is successful, nothing is
+ * written and notmodified is set. In both cases, etag and lastmodified
+ * are updated with validators returned by the server.
+ * @param target        Target
+ * @param etag          Entity tag of the local copy or NULL
+ * @param lastmodified  Modification time of the local copy or 0
+ */
+void
+lr_downloadtarget_set_conditional(LrDownloadTarget *target,
+                                  const char *etag,
+                                  gint64 lastmodified);
+
 /** Free a ::LrDownloadTarget element and its content.
  * @param target        Target to free.
  */
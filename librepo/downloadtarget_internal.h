@@ -48,6 +48,19 @@ lr_downloadtarget_set_usedmirror(LrDownloadTarget *target, const char *url);
 void
 lr_downloadtarget_set_effectiveurl(LrDownloadTarget *target, const char *url);
 
+/** Helper function to comfortable setting etag attribute
+ * of ::LrDownloadTarget
+ */
+void
+lr_downloadtarget_set_etag(LrDownloadTarget *target, const char *etag);
+
+/** Helper function to comfortable setting stats attribute
+ * of ::LrDownloadTarget. The stats are copied.
+ */
+void
+lr_downloadtarget_set_stats(LrDownloadTarget *target,
+                            const LrTransferStats *stats);
+
 G_END_DECLS
 
 #endif
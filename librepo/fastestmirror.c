@@ -32,6 +32,7 @@
 #include "rcodes.h"
 #include "fastestmirror.h"
 #include "fastestmirror_internal.h"
+#include "trace_internal.h"
 
 #define LENGTH_OF_MEASUREMENT        2.0    // Number of seconds (float point!)
 #define HALF_OF_SECOND_IN_MICROS    500000
@@ -395,6 +396,9 @@ lr_fastestmirror_perform(GSList *list,
     if (!list)
         return TRUE;
 
+    _cleanup_trace_span_ LrTraceSpan span = LR_TRACE_SPAN_INIT(
+            "mirrors", "fastestmirror", NULL);
+
     CURLM *multihandle = curl_multi_init();
     if (!multihandle) {
         g_set_error(err, LR_FASTESTMIRROR_ERROR, LRE_CURL,
@@ -31,6 +31,7 @@
 #include "rcodes.h"
 #include "util.h"
 #include "gpg.h"
+#include "trace_internal.h"
 
 /*
  * Creates the '/run/user/$UID' directory if it doesn't exist. If this
@@ -73,6 +74,8 @@ lr_gpg_check_signature_fd(int signature_fd,
     gpgme_data_t data_data;
     gpgme_verify_result_t result;
     gpgme_signature_t sig;
+    _cleanup_trace_span_ LrTraceSpan span = LR_TRACE_SPAN_INIT(
+            "verify", "gpg", home_dir);
 
     assert(!err || *err == NULL);
 
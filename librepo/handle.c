@@ -47,6 +47,7 @@
 #include "downloader.h"
 #include "fastestmirror_internal.h"
 #include "cleanup.h"
+#include "trace_internal.h"
 
 CURL *
 lr_get_curl_handle()
@@ -81,6 +82,46 @@ lr_handle_free_list(char ***list)
     *list = NULL;
 }
 
+LrUrlSubst *
+lr_handle_urlsubst(LrHandle *handle)
+{
+    if (!handle)
+        return NULL;
+    if (!handle->urlsubst)
+        handle->urlsubst = lr_urlsubst_new(handle->urlvars);
+    return handle->urlsubst;
+}
+
+LrSharedChunk *
+lr_handle_packagetarget_chunk(LrHandle *handle)
+{
+    LrSharedChunk *shared = handle->packagetarget_chunk;
+
+    if (!shared) {
+        shared = lr_malloc0(sizeof(*shared));
+        shared->chunk = g_string_chunk_new(LR_SHARED_CHUNK_SIZE);
+        shared->refcount = 1;  // Reference of the handle
+        handle->packagetarget_chunk = shared;
+    } else if (g_atomic_int_get(&shared->refcount) == 1) {
+        // All targets are gone, their strings are not needed anymore
+        g_string_chunk_clear(shared->chunk);
+    }
+
+    g_atomic_int_inc(&shared->refcount);
+    return shared;
+}
+
+void
+lr_shared_chunk_unref(LrSharedChunk *shared)
+{
+    if (!shared)
+        return;
+    if (g_atomic_int_dec_and_test(&shared->refcount)) {
+        g_string_chunk_free(shared->chunk);
+        lr_free(shared);
+    }
+}
+
 LrHandle *
 lr_handle_init(void)
 {
@@ -93,8 +134,6 @@ lr_handle_init(void)
     handle = lr_malloc0(sizeof(LrHandle));
     handle->curl_handle = curl;
     handle->fastestmirrormaxage = LRO_FASTESTMIRRORMAXAGE_DEFAULT;
-    handle->mirrorlist_fd = -1;
-    handle->metalink_fd = -1;
     handle->onetimeflag_apply = FALSE;
     handle->checks |= LR_CHECK_CHECKSUM;
     handle->maxparalleldownloads = LRO_MAXPARALLELDOWNLOADS_DEFAULT;
@@ -117,6 +156,17 @@ lr_handle_init(void)
     handle->ftpuseepsv = LRO_FTPUSEEPSV_DEFAULT;
     handle->cachedir = NULL;
     handle->preservetime = 0;
+    handle->conditionalrefresh = LRO_CONDITIONALREFRESH_DEFAULT;
+    handle->decompress = LRO_DECOMPRESS_DEFAULT;
+    handle->progressinterval = LRO_PROGRESSINTERVAL_DEFAULT;
+    handle->progressbytes = LRO_PROGRESSBYTES_DEFAULT;
+    handle->packagecache = LRO_PACKAGECACHE_DEFAULT;
+    handle->droppagecache = LRO_DROPPAGECACHE_DEFAULT;
+    handle->locktimeout = LRO_LOCKTIMEOUT_DEFAULT;
+    const char *tracefile = g_getenv(LR_TRACE_ENV);
+    if (tracefile && *tracefile && lr_trace_acquire(tracefile)) {
+        handle->tracefile = g_strdup(tracefile);
+    }
 
     return handle;
 }
@@ -128,10 +178,12 @@ lr_handle_free(LrHandle *handle)
         return;
     if (handle->curl_handle)
         curl_easy_cleanup(handle->curl_handle);
-    if (handle->mirrorlist_fd != -1)
-        close(handle->mirrorlist_fd);
-    if (handle->metalink_fd != -1)
-        close(handle->metalink_fd);
+    g_clear_pointer(&handle->mirrorlist_data, g_byte_array_unref);
+    g_clear_pointer(&handle->metalink_data, g_byte_array_unref);
+    g_clear_pointer(&handle->mirrorlist_prefetch_data, g_byte_array_unref);
+    g_clear_pointer(&handle->metalink_prefetch_data, g_byte_array_unref);
+    g_clear_error(&handle->mirrorlist_prefetch_err);
+    g_clear_error(&handle->metalink_prefetch_err);
     lr_handle_free_list(&handle->urls);
     lr_free(handle->fastestmirrorcache);
     lr_free(handle->mirrorlist);
@@ -157,9 +209,15 @@ lr_handle_free(LrHandle *handle)
     lr_urlvars_free(handle->yumslist);
     lr_handle_free_list(&handle->yumblist);
     lr_urlvars_free(handle->urlvars);
+    lr_urlsubst_free(handle->urlsubst);
+    lr_shared_chunk_unref(handle->packagetarget_chunk);
     lr_free(handle->gnupghomedir);
     lr_free(handle->cachedir);
     lr_handle_free_list(&handle->httpheader);
+    if (handle->tracefile)
+        lr_trace_release();
+    lr_free(handle->tracefile);
+    lr_stats_clear(&handle->stats);
     lr_free(handle);
 }
 
@@ -231,17 +289,17 @@ lr_handle_remote_sources_changed(LrHandle *handle, LrChangedRemoteSource type)
     if (type == LR_REMOTESOURCE_MIRRORLIST) {
         lr_lrmirrorlist_free(handle->mirrorlist_mirrors);
         handle->mirrorlist_mirrors = NULL;
-        if (handle->mirrorlist_fd != -1)
-            close(handle->mirrorlist_fd);
-        handle->mirrorlist_fd = -1;
+        g_clear_pointer(&handle->mirrorlist_data, g_byte_array_unref);
+        g_clear_pointer(&handle->mirrorlist_prefetch_data, g_byte_array_unref);
+        g_clear_error(&handle->mirrorlist_prefetch_err);
     }
 
     if (type == LR_REMOTESOURCE_METALINK) {
         lr_lrmirrorlist_free(handle->metalink_mirrors);
         handle->metalink_mirrors = NULL;
-        if (handle->metalink_fd != -1)
-            close(handle->metalink_fd);
-        handle->metalink_fd = -1;
+        g_clear_pointer(&handle->metalink_data, g_byte_array_unref);
+        g_clear_pointer(&handle->metalink_prefetch_data, g_byte_array_unref);
+        g_clear_error(&handle->metalink_prefetch_err);
         lr_metalink_free(handle->metalink);
         handle->metalink = NULL;
     }
@@ -560,6 +618,8 @@ lr_handle_setopt(LrHandle *handle,
         LrUrlVars *vars = va_arg(arg, LrUrlVars *);
         lr_urlvars_free(handle->urlvars);
         handle->urlvars = vars;
+        lr_urlsubst_free(handle->urlsubst);
+        handle->urlsubst = NULL;
 
         /* Do not do copy
         for (LrUrlVars *elem = vars; elem; elem = lr_list_next(elem)) {
@@ -795,6 +855,94 @@ lr_handle_setopt(LrHandle *handle,
         c_rc = curl_easy_setopt(c_h, CURLOPT_FILETIME, handle->preservetime);
         break;
 
+    case LRO_CONDITIONALREFRESH:
+        handle->conditionalrefresh = va_arg(arg, long) ? 1 : 0;
+        break;
+
+    case LRO_DECOMPRESS:
+        handle->decompress = va_arg(arg, long) ? 1 : 0;
+#ifndef WITH_DECOMPRESSION
+        if (handle->decompress) {
+            g_set_error(err, LR_HANDLE_ERROR, LRE_BADOPTARG,
+                        "Librepo was built without decompression support");
+            handle->decompress = 0;
+            ret = FALSE;
+        }
+#endif /* WITH_DECOMPRESSION */
+        break;
+
+    case LRO_PROGRESSINTERVAL:
+        val_long = va_arg(arg, long);
+
+        if (val_long < 0) {
+            g_set_error(err, LR_HANDLE_ERROR, LRE_BADOPTARG,
+                        "Value of LRO_PROGRESSINTERVAL cannot be negative.");
+            ret = FALSE;
+        } else {
+            handle->progressinterval = val_long;
+        }
+
+        break;
+
+    case LRO_PROGRESSBYTES:
+        val_long = va_arg(arg, long);
+
+        if (val_long < 0) {
+            g_set_error(err, LR_HANDLE_ERROR, LRE_BADOPTARG,
+                        "Value of LRO_PROGRESSBYTES cannot be negative.");
+            ret = FALSE;
+        } else {
+            handle->progressbytes = val_long;
+        }
+
+        break;
+
+    case LRO_TOTALPROGRESSCB:
+        handle->totalprogresscb = va_arg(arg, LrProgressCb);
+        break;
+
+    case LRO_TOTALPROGRESSDATA:
+        handle->totalprogressdata = va_arg(arg, void *);
+        break;
+
+    case LRO_TRACEFILE: {
+        char *tracefile = va_arg(arg, char *);
+        if (tracefile && !*tracefile)
+            tracefile = NULL;
+        // Before release to keep the trace
+        if (!lr_trace_acquire(tracefile)) {
+            g_set_error(err, LR_HANDLE_ERROR, LRE_BADOPTARG,
+                        "Trace is already recorded to another file "
+                        "than %s", tracefile);
+            ret = FALSE;
+            break;
+        }
+        if (handle->tracefile)
+            lr_trace_release();
+        lr_free(handle->tracefile);
+        handle->tracefile = g_strdup(tracefile);
+        break;
+    }
+
+    case LRO_PACKAGECACHE:
+        handle->packagecache = va_arg(arg, long) ? 1 : 0;
+        break;
+
+    case LRO_DROPPAGECACHE:
+        handle->droppagecache = va_arg(arg, long) ? 1 : 0;
+        break;
+
+    case LRO_LOCKTIMEOUT:
+        val_long = va_arg(arg, long);
+        if (val_long < 0) {
+            g_set_error(err, LR_HANDLE_ERROR, LRE_BADOPTARG,
+                        "Value of LRO_LOCKTIMEOUT cannot be negative.");
+            ret = FALSE;
+        } else {
+            handle->locktimeout = val_long;
+        }
+        break;
+
     default:
         g_set_error(err, LR_HANDLE_ERROR, LRE_BADOPTARG,
                     "Unknown option");
@@ -845,7 +993,7 @@ lr_handle_prepare_urls(LrHandle *handle, GError **err)
         handle->urls_mirrors = lr_lrmirrorlist_append_url(
                                             handle->urls_mirrors,
                                             final_url,
-                                            handle->urlvars);
+                                            lr_handle_urlsubst(handle));
     }
 
     return TRUE;
@@ -853,13 +1001,13 @@ lr_handle_prepare_urls(LrHandle *handle, GError **err)
 
 static gboolean
 lr_yum_download_url_retry(int attempts, LrHandle *lr_handle, const char *url,
-                          int fd, gboolean no_cache, gboolean is_zchunk,
+                          gboolean no_cache, GByteArray **data,
                           GError **err)
 {
     gboolean ret = FALSE;
 
     for (int i = 1;; i++) {
-        ret = lr_yum_download_url(lr_handle, url, fd, no_cache, is_zchunk, err);
+        ret = lr_yum_download_url_data(lr_handle, url, no_cache, data, err);
         if (ret)
             return ret;
 
@@ -868,20 +1016,39 @@ lr_yum_download_url_retry(int attempts, LrHandle *lr_handle, const char *url,
 
         g_debug("%s: Attempt #%d to download %s failed: %s",
                 __func__, i, url, (*err)->message);
-        ftruncate(fd, 0);
         g_clear_error (err);
     }
 }
 
+/** Read the whole local file into memory.
+ * @return          Content of the file or NULL if err is set
+ */
+static GByteArray *
+lr_handle_read_local_file(const char *path, GError **err)
+{
+    gchar *content = NULL;
+    gsize len = 0;
+    GError *tmp_err = NULL;
+
+    if (!g_file_get_contents(path, &content, &len, &tmp_err)) {
+        g_set_error(err, LR_HANDLE_ERROR, LRE_IO,
+                    "Cannot read %s: %s", path, tmp_err->message);
+        g_error_free(tmp_err);
+        return NULL;
+    }
+
+    return g_byte_array_new_take((guint8 *) content, len);
+}
+
 static gboolean
 lr_handle_prepare_mirrorlist(LrHandle *handle, gchar *localpath, GError **err)
 {
-    assert(handle->mirrorlist_fd == -1);
+    assert(!handle->mirrorlist_data);
     assert(!handle->mirrorlist_mirrors);
 
-    int fd = -1;
+    GByteArray *data = NULL;
 
-    // Get file descriptor with content
+    // Get the content
 
     if (!localpath && !handle->mirrorlisturl) {
         // Nothing to do
@@ -893,13 +1060,9 @@ lr_handle_prepare_mirrorlist(LrHandle *handle, gchar *localpath, GError **err)
 
         if (g_file_test(path, G_FILE_TEST_IS_REGULAR)) {
             g_debug("%s: Local mirrorlist found at %s", __func__, path);
-            fd = open(path, O_RDONLY);
-            if (fd < 0) {
-                g_set_error(err, LR_HANDLE_ERROR, LRE_IO,
-                            "Cannot open %s: %s",
-                            path, g_strerror(errno));
+            data = lr_handle_read_local_file(path, err);
+            if (!data)
                 return FALSE;
-            }
         } else {
             // No local mirrorlist
             return TRUE;
@@ -917,46 +1080,37 @@ lr_handle_prepare_mirrorlist(LrHandle *handle, gchar *localpath, GError **err)
         g_debug("%s: LRO_LOCAL used, remote mirrorlist ignored: %s",
                 __func__, handle->mirrorlisturl);
         return TRUE;
+    } else if (handle->mirrorlist_prefetch_err) {
+        // Batched download of remote mirrorlist already failed
+        g_propagate_error(err, handle->mirrorlist_prefetch_err);
+        handle->mirrorlist_prefetch_err = NULL;
+        return FALSE;
+    } else if (handle->mirrorlist_prefetch_data) {
+        // Remote mirrorlist was already downloaded in a batch
+        data = handle->mirrorlist_prefetch_data;
+        handle->mirrorlist_prefetch_data = NULL;
     } else if (handle->mirrorlisturl) {
-        // Download remote mirrorlist
+        // Download remote mirrorlist into memory
         _cleanup_free_ gchar *url = NULL;
 
-        fd = lr_gettmpfile();
-        if (fd < 0) {
-            g_debug("%s: Cannot create a temporary file", __func__);
-            g_set_error(err, LR_HANDLE_ERROR, LRE_IO,
-                        "Cannot create a temporary file");
-            return FALSE;
-        }
-
         url = lr_prepend_url_protocol(handle->mirrorlisturl);
         handle->onetimeflag_apply = TRUE;
-        if (!lr_yum_download_url_retry(3, handle, url, fd, TRUE, FALSE, err)) {
-            close(fd);
+        if (!lr_yum_download_url_retry(3, handle, url, TRUE, &data, err))
             return FALSE;
-        }
-
-        if (lseek(fd, 0, SEEK_SET) != 0) {
-            g_debug("%s: Seek error: %s", __func__, g_strerror(errno));
-            g_set_error(err, LR_HANDLE_ERROR, LRE_IO,
-                        "lseek(%d, 0, SEEK_SET) error: %s",
-                        fd, g_strerror(errno));
-            close(fd);
-            return FALSE;
-        }
     }
 
-    assert(fd >= 0);
+    assert(data);
 
-    // Parse the file descriptor content
+    // Parse the content
 
     g_debug("%s: Parsing mirrorlist", __func__);
 
     LrMirrorlist *ml = lr_mirrorlist_init();
-    gboolean ret = lr_mirrorlist_parse_file(ml, fd, err);
+    gboolean ret = lr_mirrorlist_parse_buffer(ml, (const char *) data->data,
+                                              data->len, err);
     if (!ret) {
         g_debug("%s: Error while parsing mirrorlist", __func__);
-        close(fd);
+        g_byte_array_unref(data);
         lr_mirrorlist_free(ml);
         return FALSE;
     }
@@ -964,7 +1118,7 @@ lr_handle_prepare_mirrorlist(LrHandle *handle, gchar *localpath, GError **err)
     if (!ml->urls) {
         g_debug("%s: No URLs in mirrorlist", __func__);
         g_set_error(err, LR_HANDLE_ERROR, LRE_MLBAD, "No URLs in mirrorlist");
-        close(fd);
+        g_byte_array_unref(data);
         lr_mirrorlist_free(ml);
         return FALSE;
     }
@@ -979,8 +1133,8 @@ lr_handle_prepare_mirrorlist(LrHandle *handle, gchar *localpath, GError **err)
     handle->mirrorlist_mirrors = lr_lrmirrorlist_append_mirrorlist(
                                             NULL,
                                             ml,
-                                            handle->urlvars);
-    handle->mirrorlist_fd = fd;
+                                            lr_handle_urlsubst(handle));
+    handle->mirrorlist_data = data;
 
     lr_mirrorlist_free(ml);
 
@@ -991,13 +1145,13 @@ lr_handle_prepare_mirrorlist(LrHandle *handle, gchar *localpath, GError **err)
 static gboolean
 lr_handle_prepare_metalink(LrHandle *handle, gchar *localpath, GError **err)
 {
-    assert(handle->metalink_fd == -1);
+    assert(!handle->metalink_data);
     assert(!handle->metalink_mirrors);
     assert(!handle->metalink);
 
-    int fd = -1;
+    GByteArray *data = NULL;
 
-    // Get file descriptor with content
+    // Get the content
 
     if (!localpath && !handle->metalinkurl) {
         // Nothing to do
@@ -1009,13 +1163,9 @@ lr_handle_prepare_metalink(LrHandle *handle, gchar *localpath, GError **err)
 
         if (g_file_test(path, G_FILE_TEST_IS_REGULAR)) {
             g_debug("%s: Local metalink.xml found at %s", __func__, path);
-            fd = open(path, O_RDONLY);
-            if (fd < 0) {
-                g_set_error(err, LR_HANDLE_ERROR, LRE_IO,
-                            "Cannot open %s: %s",
-                            path, g_strerror(errno));
+            data = lr_handle_read_local_file(path, err);
+            if (!data)
                 return FALSE;
-            }
         } else {
             // No local metalink
             return TRUE;
@@ -1033,38 +1183,28 @@ lr_handle_prepare_metalink(LrHandle *handle, gchar *localpath, GError **err)
         g_debug("%s: LRO_LOCAL used, remote metalink ignored: %s",
                 __func__, handle->metalinkurl);
         return TRUE;
+    } else if (handle->metalink_prefetch_err) {
+        // Batched download of remote metalink already failed
+        g_propagate_error(err, handle->metalink_prefetch_err);
+        handle->metalink_prefetch_err = NULL;
+        return FALSE;
+    } else if (handle->metalink_prefetch_data) {
+        // Remote metalink was already downloaded in a batch
+        data = handle->metalink_prefetch_data;
+        handle->metalink_prefetch_data = NULL;
     } else if (handle->metalinkurl) {
-        // Download remote metalink
+        // Download remote metalink into memory
         _cleanup_free_ gchar *url = NULL;
 
-        fd = lr_gettmpfile();
-        if (fd < 0) {
-            g_debug("%s: Cannot create a temporary file", __func__);
-            g_set_error(err, LR_HANDLE_ERROR, LRE_IO,
-                        "Cannot create a temporary file");
-            return FALSE;
-        }
-
         url = lr_prepend_url_protocol(handle->metalinkurl);
         handle->onetimeflag_apply = TRUE;
-        if (!lr_yum_download_url_retry(3, handle, url, fd, TRUE, FALSE, err)) {
-            close(fd);
-            return FALSE;
-        }
-
-        if (lseek(fd, 0, SEEK_SET) != 0) {
-            g_debug("%s: Seek error: %s", __func__, g_strerror(errno));
-            g_set_error(err, LR_HANDLE_ERROR, LRE_IO,
-                        "lseek(%d, 0, SEEK_SET) error: %s",
-                        fd, g_strerror(errno));
-            close(fd);
+        if (!lr_yum_download_url_retry(3, handle, url, TRUE, &data, err))
             return FALSE;
-        }
     }
 
-    assert(fd >= 0);
+    assert(data);
 
-    // Parse the file descriptor content
+    // Parse the content
 
     g_debug("%s: Parsing metalink.xml", __func__);
 
@@ -1076,15 +1216,16 @@ lr_handle_prepare_metalink(LrHandle *handle, gchar *localpath, GError **err)
     }
 
     LrMetalink *ml = lr_metalink_init();
-    gboolean ret = lr_metalink_parse_file(ml,
-                                          fd,
-                                          metalink_file,
-                                          lr_xml_parser_warning_logger,
-                                          "Metalink xml parser",
-                                          err);
+    gboolean ret = lr_metalink_parse_buffer(ml,
+                                            (const char *) data->data,
+                                            data->len,
+                                            metalink_file,
+                                            lr_xml_parser_warning_logger,
+                                            "Metalink xml parser",
+                                            err);
     if (!ret) {
         g_warning("Error while parsing metalink");
-        close(fd);
+        g_byte_array_unref(data);
         lr_metalink_free(ml);
         return FALSE;
     }
@@ -1092,7 +1233,7 @@ lr_handle_prepare_metalink(LrHandle *handle, gchar *localpath, GError **err)
     if (!ml->urls) {
         g_debug("%s: No URLs in metalink", __func__);
         g_set_error(err, LR_HANDLE_ERROR, LRE_MLBAD, "No URLs in metalink");
-        close(fd);
+        g_byte_array_unref(data);
         lr_metalink_free(ml);
         return FALSE;
     }
@@ -1108,14 +1249,180 @@ lr_handle_prepare_metalink(LrHandle *handle, gchar *localpath, GError **err)
                                             NULL,
                                             ml,
                                             metalink_suffix,
-                                            handle->urlvars);
-    handle->metalink_fd = fd;
+                                            lr_handle_urlsubst(handle));
+    handle->metalink_data = data;
     handle->metalink = ml;
 
     g_debug("%s: Metalink parsed", __func__);
     return TRUE;
 }
 
+/** Returns TRUE if the list specified by url (LRO_MIRRORLISTURL or
+ * LRO_METALINKURL) should be downloaded by
+ * lr_handle_prepare_internal_mirrorlist()
+ */
+static gboolean
+lr_handle_list_needs_download(LrHandle *handle,
+                              const char *url,
+                              LrInternalMirrorlist *mirrors,
+                              GByteArray *data,
+                              GByteArray *prefetch_data,
+                              GError *prefetch_err)
+{
+    if (!url || mirrors || data || prefetch_data || prefetch_err)
+        return FALSE;
+
+    // Local lists are cheap to load, leave them to
+    // lr_handle_prepare_internal_mirrorlist()
+    if (lr_is_local_path(url))
+        return FALSE;
+
+    return !handle->offline && !handle->local;
+}
+
+static LrDownloadTarget *
+lr_handle_list_download_target(LrHandle *handle,
+                               const char *list_url,
+                               LrChangedRemoteSource type)
+{
+    _cleanup_free_ gchar *url = NULL;
+    CbData *cbdata = NULL;
+
+    url = lr_prepend_url_protocol(list_url);
+
+    if (handle->user_cb || handle->hmfcb)
+        cbdata = lr_cbdata_new(handle->user_data,
+                               NULL,
+                               handle->user_cb,
+                               handle->hmfcb,
+                               url);
+
+    // Type of the list is stored in userdata, see
+    // lr_handle_mirrorlist_target_done(). The list is small and parsed
+    // right away, so it's downloaded into memory.
+    return lr_downloadtarget_new(handle,
+                                 url, NULL, -1, NULL,
+                                 NULL, 0, 0,
+                                 (handle->user_cb) ? lr_yum_progresscb : NULL,
+                                 cbdata,
+                                 NULL,
+                                 (handle->hmfcb) ? hmfcb : NULL,
+                                 GINT_TO_POINTER(type),
+                                 0, 0, NULL, TRUE, FALSE);
+}
+
+GSList *
+lr_handle_mirrorlist_download_targets(LrHandle *handle)
+{
+    GSList *targets = NULL;
+    LrDownloadTarget *target;
+
+    if (handle->internal_mirrorlist)
+        return NULL;  // Internal mirrorlist already exists
+
+    // Mirrorlist goes first, the LRO_ONETIMEFLAG is applied
+    // only to the first request, same as in
+    // lr_handle_prepare_internal_mirrorlist()
+    if (lr_handle_list_needs_download(handle,
+                                      handle->mirrorlisturl,
+                                      handle->mirrorlist_mirrors,
+                                      handle->mirrorlist_data,
+                                      handle->mirrorlist_prefetch_data,
+                                      handle->mirrorlist_prefetch_err)) {
+        target = lr_handle_list_download_target(handle,
+                                                handle->mirrorlisturl,
+                                                LR_REMOTESOURCE_MIRRORLIST);
+        if (target)
+            targets = g_slist_append(targets, target);
+    }
+
+    if (lr_handle_list_needs_download(handle,
+                                      handle->metalinkurl,
+                                      handle->metalink_mirrors,
+                                      handle->metalink_data,
+                                      handle->metalink_prefetch_data,
+                                      handle->metalink_prefetch_err)) {
+        target = lr_handle_list_download_target(handle,
+                                                handle->metalinkurl,
+                                                LR_REMOTESOURCE_METALINK);
+        if (target)
+            targets = g_slist_append(targets, target);
+    }
+
+    if (targets)
+        handle->onetimeflag_apply = TRUE;
+
+    return targets;
+}
+
+void
+lr_handle_mirrorlist_target_done(LrHandle *handle, LrDownloadTarget *target)
+{
+    LrChangedRemoteSource type = GPOINTER_TO_INT(target->userdata);
+    GByteArray **prefetch_data;
+    GError **prefetch_err;
+
+    if (type == LR_REMOTESOURCE_MIRRORLIST) {
+        prefetch_data = &handle->mirrorlist_prefetch_data;
+        prefetch_err = &handle->mirrorlist_prefetch_err;
+    } else {
+        prefetch_data = &handle->metalink_prefetch_data;
+        prefetch_err = &handle->metalink_prefetch_err;
+    }
+
+    if (target->rcode == LRE_OK) {
+        // Take over the downloaded data
+        if (!*prefetch_data) {
+            *prefetch_data = target->data;
+            target->data = NULL;
+        }
+    } else if (target->rcode != LRE_UNFINISHED) {
+        // Unfinished (interrupted) target is just forgotten
+        g_set_error(prefetch_err, LR_DOWNLOADER_ERROR, target->rcode,
+                    "Cannot download %s: %s", target->path, target->err);
+    }
+
+    lr_cbdata_free(target->cbdata);
+    target->cbdata = NULL;
+}
+
+gboolean
+lr_handle_prefetch_mirrorlists(GSList *handles, GError **err)
+{
+    gboolean ret;
+    GSList *targets = NULL;
+    GSList *seen = NULL;
+
+    assert(!err || *err == NULL);
+
+    for (GSList *elem = handles; elem; elem = g_slist_next(elem)) {
+        LrHandle *handle = elem->data;
+        if (!handle || g_slist_find(seen, handle))
+            continue;
+        seen = g_slist_prepend(seen, handle);
+        targets = g_slist_concat(targets,
+                                 lr_handle_mirrorlist_download_targets(handle));
+    }
+    g_slist_free(seen);
+
+    if (!targets)
+        return TRUE;
+
+    g_debug("%s: Downloading %d mirrorlists/metalinks",
+            __func__, g_slist_length(targets));
+
+    ret = lr_download(targets, FALSE, err);
+
+    for (GSList *elem = targets; elem; elem = g_slist_next(elem)) {
+        LrDownloadTarget *target = elem->data;
+        lr_handle_mirrorlist_target_done(target->handle, target);
+        lr_downloadtarget_free(target);
+    }
+    g_slist_free(targets);
+
+    return ret;
+}
+
 gboolean
 lr_handle_prepare_internal_mirrorlist(LrHandle *handle,
                                       gboolean usefastestmirror,
@@ -1170,6 +1477,8 @@ lr_handle_prepare_internal_mirrorlist(LrHandle *handle,
     if (!handle->mirrorlist_mirrors && (handle->mirrorlisturl || local_path)) {
         g_clear_error(&tmp_err);
         at_least_one_present = TRUE;
+        _cleanup_trace_span_ LrTraceSpan span = LR_TRACE_SPAN_INIT(
+                "mirrors", "mirrorlist", handle->mirrorlisturl);
         ret_mirrorlist = lr_handle_prepare_mirrorlist(handle, local_path, &tmp_err);
         if (!ret_mirrorlist) {
             assert(tmp_err);
@@ -1181,6 +1490,8 @@ lr_handle_prepare_internal_mirrorlist(LrHandle *handle,
     if (!handle->metalink_mirrors && (handle->metalinkurl || local_path)) {
         g_clear_error(&tmp_err);
         at_least_one_present = TRUE;
+        _cleanup_trace_span_ LrTraceSpan span = LR_TRACE_SPAN_INIT(
+                "mirrors", "metalink", handle->metalinkurl);
         ret_metalink = lr_handle_prepare_metalink(handle, local_path, &tmp_err);
         if (!ret_metalink) {
             assert(tmp_err);
@@ -1250,6 +1561,8 @@ lr_handle_perform(LrHandle *handle, LrResult *result, GError **err)
 {
     int ret = TRUE;
     GError *tmp_err = NULL;
+    _cleanup_trace_span_ LrTraceSpan span = LR_TRACE_SPAN_INIT(
+            "repo", "lr_handle_perform", NULL);
 
     assert(handle);
     assert(!err || *err == NULL);
@@ -1653,6 +1966,64 @@ lr_handle_getinfo(LrHandle *handle,
         *str = handle->cachedir;
         break;
 
+    case LRI_CONDITIONALREFRESH:
+        lnum = va_arg(arg, long *);
+        *lnum = (long) handle->conditionalrefresh;
+        break;
+
+    case LRI_DECOMPRESS:
+        lnum = va_arg(arg, long *);
+        *lnum = (long) handle->decompress;
+        break;
+
+    case LRI_PROGRESSINTERVAL:
+        lnum = va_arg(arg, long *);
+        *lnum = handle->progressinterval;
+        break;
+
+    case LRI_PROGRESSBYTES:
+        lnum = va_arg(arg, long *);
+        *lnum = handle->progressbytes;
+        break;
+
+    case LRI_TOTALPROGRESSCB: {
+        LrProgressCb *cb = va_arg(arg, LrProgressCb *);
+        *cb = handle->totalprogresscb;
+        break;
+    }
+
+    case LRI_TOTALPROGRESSDATA: {
+        void **data = va_arg(arg, void **);
+        *data = handle->totalprogressdata;
+        break;
+    }
+
+    case LRI_TRACEFILE:
+        str = va_arg(arg, char **);
+        *str = handle->tracefile;
+        break;
+
+    case LRI_PACKAGECACHE:
+        lnum = va_arg(arg, long *);
+        *lnum = (long) handle->packagecache;
+        break;
+
+    case LRI_DROPPAGECACHE:
+        lnum = va_arg(arg, long *);
+        *lnum = (long) handle->droppagecache;
+        break;
+
+    case LRI_LOCKTIMEOUT:
+        lnum = va_arg(arg, long *);
+        *lnum = handle->locktimeout;
+        break;
+
+    case LRI_STATS: {
+        LrStats **stats = va_arg(arg, LrStats **);
+        *stats = &handle->stats;
+        break;
+    }
+
     default:
         rc = FALSE;
         g_set_error(err, LR_HANDLE_ERROR, LRE_UNKNOWNOPT,
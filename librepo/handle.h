@@ -24,6 +24,7 @@
 #include <glib.h>
 
 #include "result.h"
+#include "stats.h"
 
 G_BEGIN_DECLS
 
@@ -121,6 +122,27 @@ typedef struct _LrHandle LrHandle;
 /** LRO_FTPUSEEPSV default value */
 #define LRO_FTPUSEEPSV_DEFAULT              1L
 
+/** LRO_CONDITIONALREFRESH default value */
+#define LRO_CONDITIONALREFRESH_DEFAULT      0L
+
+/** LRO_DECOMPRESS default value */
+#define LRO_DECOMPRESS_DEFAULT              0L
+
+/** LRO_PACKAGECACHE default value */
+#define LRO_PACKAGECACHE_DEFAULT            0L
+
+/** LRO_DROPPAGECACHE default value */
+#define LRO_DROPPAGECACHE_DEFAULT           0L
+
+/** LRO_LOCKTIMEOUT default value */
+#define LRO_LOCKTIMEOUT_DEFAULT             30L
+
+/** LRO_PROGRESSINTERVAL default value */
+#define LRO_PROGRESSINTERVAL_DEFAULT        0L
+
+/** LRO_PROGRESSBYTES default value */
+#define LRO_PROGRESSBYTES_DEFAULT           0L
+
 
 /** Handle options for the ::lr_handle_setopt function. */
 typedef enum {
@@ -428,6 +450,104 @@ typedef enum {
         Path to a file containing the list of PEM format trusted CA
         certificates. Used for proxy. */
 
+    LRO_CONDITIONALREFRESH, /*!< (long 1 or 0)
+        If enabled, validators (ETag, Last-Modified) of the downloaded
+        repomd.xml are stored to repodata/repomd.xml.validators in the
+        LRO_DESTDIR and the next download into the same LRO_DESTDIR sends
+        them in If-None-Match and If-Modified-Since headers. If the server
+        replies that repomd.xml is not modified, the repository already
+        present in the LRO_DESTDIR is used and no other metadata
+        are downloaded. If a metalink is used and repomd.xml in the
+        LRO_DESTDIR matches its checksum, even the request for repomd.xml
+        is skipped. The existing repodata/ directory in the LRO_DESTDIR
+        is reused when this option is enabled.
+        Only lr_handle_perform() supports this option,
+        lr_download_metadata() ignores it and always downloads
+        the whole repository. */
+
+    LRO_DECOMPRESS, /*!< (long 1 or 0)
+        If enabled, every compressed (.gz, .bz2, .xz, .zst) metadata file
+        is decompressed as soon as its download is finished, while it is
+        still in the page cache, and the uncompressed file is written
+        next to it (with the compression suffix stripped). If
+        LR_CHECK_CHECKSUM is set, the open-checksum from repomd.xml is
+        verified. The uncompressed file is available in the LrYumRepo
+        under the "<type>_open" type (e.g. "primary_open").
+        Zchunk files are not decompressed. */
+
+    LRO_PROGRESSINTERVAL, /*!< (long)
+        Minimal interval in milliseconds between two calls of a progress
+        callback of the same target (LRO_PROGRESSCB, progress callbacks
+        of LrDownloadTarget, LrPackageTarget and LrMetadataTarget) or
+        of LRO_TOTALPROGRESSCB. Progress reported by the curl meanwhile
+        is aggregated and only the latest state is passed to the callback.
+        The first call and the call which reports a finished transfer
+        are never suppressed. 0 (default) means no limit. */
+
+    LRO_PROGRESSBYTES, /*!< (long)
+        Minimal number of bytes which has to be downloaded between two calls
+        of a progress callback. It limits the same callbacks as the
+        LRO_PROGRESSINTERVAL does. If both are set, a callback is called
+        only when both limits are crossed. 0 (default) means no limit. */
+
+    LRO_TOTALPROGRESSCB, /*!< (LrProgressCb)
+        Progress callback of the whole download. It reports summarized
+        progress of all targets downloaded together with targets of this
+        handle (by lr_handle_perform(), lr_download_packages(),
+        lr_download_metadata(), ...). Settings of the handle of the first
+        target are used when targets of more handles are downloaded
+        together. The total size grows as sizes of the targets are
+        discovered. */
+
+    LRO_TOTALPROGRESSDATA, /*!< (void *)
+        User data for LRO_TOTALPROGRESSCB */
+
+    LRO_TRACEFILE, /*!< (char *)
+        If set, spans of the operations done by librepo (mirrorlist and
+        metalink fetching, fastest mirror detection, transfers, checksum
+        and GPG verification, zchunk processing, ...) are recorded and
+        written to this file in the Chrome trace-event JSON format
+        (viewable by chrome://tracing or Perfetto) when the handle is freed.
+        The trace is shared by the whole process; while it is recorded,
+        spans of all handles are included and other filenames are refused
+        with LRE_BADOPTARG.
+        The default value is taken from the LIBREPO_TRACE environment
+        variable. NULL disables the tracing for this handle. */
+
+    LRO_PACKAGECACHE, /*!< (long 1 or 0)
+        If enabled and LRO_CACHEDIR is set, packages with a known checksum
+        are kept in a content-addressed store in the "packages"
+        subdirectory of the LRO_CACHEDIR (named by their checksum type
+        and value). Before a package is downloaded by
+        lr_download_packages() (and the other package download functions),
+        the store is searched and if the package is there and its checksum
+        matches, it is hard-linked (or reflinked or copied, if the
+        destination is on another filesystem) to the destination instead
+        of being downloaded. Successfully downloaded and verified packages
+        are added to the store the same way. Handles sharing the same
+        LRO_CACHEDIR share the store. Targets with a byte range are not
+        cached. */
+
+    LRO_DROPPAGECACHE, /*!< (long 1 or 0)
+        If enabled, the writeback of downloaded data is started while
+        the file is being written and once the file is downloaded and
+        verified, its data are dropped from the page cache
+        (posix_fadvise(POSIX_FADV_DONTNEED)). This keeps bulk downloads
+        (e.g. mirroring) from evicting more useful data from the memory,
+        but files read right after the download are read from the disk
+        again. */
+
+    LRO_LOCKTIMEOUT, /*!< (long)
+        Maximal time in seconds to wait for a target file which is
+        locked by another process (which is probably downloading it).
+        When the time runs out, the target fails. 0 means the target
+        fails right away if its file is locked.
+        Note: While only such waiting targets are left, blocking calls
+        like lr_download() sleep (no transfer is running) until the lock
+        is released or the time runs out. A ::LrDownloadSession doesn't
+        block, lr_download_session_get_timeout() tells when to try
+        again. */
+
     LRO_SENTINEL,    /*!< Sentinel */
 
 } LrHandleOption; /*!< Handle config options */
@@ -503,6 +623,20 @@ typedef enum {
     LRI_PROXY_SSLCLIENTCERT,    /*!< (char **) */
     LRI_PROXY_SSLCLIENTKEY,     /*!< (char **) */
     LRI_PROXY_SSLCACERT,        /*!< (char **) */
+    LRI_CONDITIONALREFRESH,     /*!< (long *) */
+    LRI_DECOMPRESS,             /*!< (long *) */
+    LRI_PROGRESSINTERVAL,       /*!< (long *) */
+    LRI_PROGRESSBYTES,          /*!< (long *) */
+    LRI_TOTALPROGRESSCB,        /*!< (LrProgressCb *) */
+    LRI_TOTALPROGRESSDATA,      /*!< (void **) */
+    LRI_TRACEFILE,              /*!< (char **) */
+    LRI_PACKAGECACHE,           /*!< (long *) */
+    LRI_DROPPAGECACHE,          /*!< (long *) */
+    LRI_LOCKTIMEOUT,            /*!< (long *) */
+    LRI_STATS,                  /*!< (LrStats **)
+        Statistics of all downloads done with targets of the handle
+        since it was created. The statistics are owned by the handle
+        and can be reset by lr_stats_clear(). */
 
     LRI_SENTINEL,
 } LrHandleInfoOption; /*!< Handle info options */
@@ -28,11 +28,27 @@
 #include "handle.h"
 #include "lrmirrorlist.h"
 #include "url_substitution.h"
+#include "url_substitution_internal.h"
+#include "downloadtarget.h"
+#include "stats.h"
 
 G_BEGIN_DECLS
 
 #define TMP_DIR_TEMPLATE    "librepo-XXXXXX"
 
+/** Size of blocks of the string chunk shared by package targets */
+#define LR_SHARED_CHUNK_SIZE    4096
+
+/** String chunk shared by all package targets created with the same
+ * handle. The handle and every such target hold a reference.
+ */
+typedef struct _LrSharedChunk {
+    GStringChunk *chunk; /*!<
+        Strings of the targets */
+    gint refcount; /*!<
+        Number of references */
+} LrSharedChunk;
+
 struct _LrHandle {
 
     CURL *curl_handle; /*!<
@@ -74,8 +90,8 @@ struct _LrHandle {
     char *mirrorlisturl; /*!<
         Mirrorlist URL */
 
-    int mirrorlist_fd; /*!<
-        Raw downloaded mirrorlist file */
+    GByteArray *mirrorlist_data; /*!<
+        Raw downloaded mirrorlist or NULL */
 
     LrInternalMirrorlist *mirrorlist_mirrors; /*!<
         Mirrors from mirrorlist */
@@ -85,8 +101,8 @@ struct _LrHandle {
     char * metalinkurl; /*!<
         Metalink URL */
 
-    int metalink_fd; /*!<
-        Raw downloaded metalink file */
+    GByteArray *metalink_data; /*!<
+        Raw downloaded metalink or NULL */
 
     LrInternalMirrorlist *metalink_mirrors; /*!<
         Mirrors from metalink */
@@ -156,6 +172,14 @@ struct _LrHandle {
     LrUrlVars *urlvars; /*!<
         List with url substitutions */
 
+    LrUrlSubst *urlsubst; /*!<
+        Compiled urlvars with cache of substituted URLs. Created on demand
+        by lr_handle_urlsubst() and dropped when LRO_VARSUB changes. */
+
+    LrSharedChunk *packagetarget_chunk; /*!<
+        String chunk of package targets of this handle or NULL.
+        Created on demand by lr_handle_packagetarget_chunk() */
+
     long lowspeedtime; /*!<
         The time in seconds that the transfer should be below the
         LRO_LOWSPEEDLIMIT for the library to consider it too slow
@@ -249,6 +273,55 @@ struct _LrHandle {
         Preserve timestamps of downloaded files */
 
     LrUrlVars *yumslist;
+
+    GByteArray *mirrorlist_prefetch_data; /*!<
+        LRO_MIRRORLISTURL content downloaded in advance as a part of
+        a batched download or NULL */
+
+    GError *mirrorlist_prefetch_err; /*!<
+        Error of the batched LRO_MIRRORLISTURL download or NULL */
+
+    GByteArray *metalink_prefetch_data; /*!<
+        LRO_METALINKURL content downloaded in advance as a part of
+        a batched download or NULL */
+
+    GError *metalink_prefetch_err; /*!<
+        Error of the batched LRO_METALINKURL download or NULL */
+
+    long conditionalrefresh; /*!<
+        Refresh repomd.xml in destdir by a conditional request */
+
+    long decompress; /*!<
+        Decompress downloaded metadata files */
+
+    long progressinterval; /*!<
+        Minimal interval between two progress callback calls (ms) */
+
+    long progressbytes; /*!<
+        Minimal number of bytes between two progress callback calls */
+
+    LrProgressCb totalprogresscb; /*!<
+        Progress callback of the whole download */
+
+    void *totalprogressdata; /*!<
+        User data for totalprogresscb */
+
+    char *tracefile; /*!<
+        Where the trace is written or NULL. While set, the handle
+        holds a reference to the trace. */
+
+    long packagecache; /*!<
+        Use the package cache in the cachedir */
+
+    long droppagecache; /*!<
+        Drop downloaded data from the page cache */
+
+    long locktimeout; /*!<
+        Max time in seconds to wait for a target file locked
+        by another process */
+
+    LrStats stats; /*!<
+        Statistics of downloads of targets of this handle */
 };
 
 /** Return new CURL easy handle with some default options setted.
@@ -256,6 +329,29 @@ struct _LrHandle {
 CURL *
 lr_get_curl_handle();
 
+/** Return compiled LRO_VARSUB of the handle (create it if needed).
+ * @param handle            Librepo handle.
+ * @return                  Substitution owned by the handle or NULL
+ *                          if there are no variables.
+ */
+LrUrlSubst *
+lr_handle_urlsubst(LrHandle *handle);
+
+/** Return a new reference to the string chunk shared by package targets
+ * of the handle (create it if needed). If no target holds a reference
+ * anymore, the strings of the previous targets are dropped first.
+ * @param handle            Librepo handle.
+ * @return                  Reference, release it by lr_shared_chunk_unref()
+ */
+LrSharedChunk *
+lr_handle_packagetarget_chunk(LrHandle *handle);
+
+/** Release a reference to the shared string chunk.
+ * @param shared            Shared chunk or NULL.
+ */
+void
+lr_shared_chunk_unref(LrSharedChunk *shared);
+
 /**
  * Create (if do not exists) internal mirrorlist. Insert baseurl (if
  * specified) and download, parse and insert mirrors from mirrorlist url.
@@ -269,6 +365,43 @@ lr_handle_prepare_internal_mirrorlist(LrHandle *handle,
                                       gboolean usefastestmirror,
                                       GError **err);
 
+/**
+ * Prepare download targets for remote LRO_MIRRORLISTURL and LRO_METALINKURL
+ * which will be needed by lr_handle_prepare_internal_mirrorlist().
+ * This allows to download lists of all handles in one batch (together
+ * with other targets) instead of downloading them one by one.
+ * Every returned target must be passed to lr_handle_mirrorlist_target_done()
+ * after it is finished.
+ * @param handle            Librepo handle.
+ * @return                  List of ::LrDownloadTarget or NULL if there
+ *                          is nothing to download.
+ */
+GSList *
+lr_handle_mirrorlist_download_targets(LrHandle *handle);
+
+/**
+ * Store the result of a finished target created by
+ * lr_handle_mirrorlist_download_targets() to the handle, so the following
+ * lr_handle_prepare_internal_mirrorlist() just parses it (or reports
+ * the download error). The target itself is not freed, but its data
+ * are taken over and its callback data are not valid anymore.
+ * @param handle            Librepo handle.
+ * @param target            Finished download target.
+ */
+void
+lr_handle_mirrorlist_target_done(LrHandle *handle, LrDownloadTarget *target);
+
+/**
+ * Download remote mirrorlists and metalinks of all handles in one
+ * lr_download() call.
+ * @param handles           List of LrHandle (may contain duplicates)
+ * @param err               GError **
+ * @return                  FALSE if the download itself failed (e.g.
+ *                          was interrupted). Errors of individual lists
+ *                          are reported by lr_handle_prepare_internal_mirrorlist().
+ */
+gboolean
+lr_handle_prefetch_mirrorlists(GSList *handles, GError **err);
 
 G_END_DECLS
 
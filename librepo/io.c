@@ -0,0 +1,484 @@
+/* librepo - A library providing (libcURL like) API to downloading repository
+ * Copyright (C) 2026  agent
+ *
+ * Licensed under the GNU Lesser General Public License Version 2.1
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#define _GNU_SOURCE     // Because of pread() and pwrite()
+
+#include <glib.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef WITH_IO_URING
+#include <liburing.h>
+#endif /* WITH_IO_URING */
+
+#include "io_internal.h"
+
+/** Size of a block read by lr_io_read_file() */
+#define LR_IO_READ_BLOCK        (128 * 1024)
+
+/** Number of blocks read ahead by lr_io_read_file() */
+#define LR_IO_READ_AHEAD        4
+
+/** Depth of the ring of a thread */
+#define LR_IO_THREAD_RING_DEPTH 16
+
+/** Single read or write */
+typedef struct {
+    LrIoDoneCb cb;      /*!< Completion callback */
+    gpointer data;      /*!< User data of the callback */
+    int fd;             /*!< File descriptor */
+    gboolean write;     /*!< Write (TRUE) or read (FALSE) */
+    char *buf;          /*!< Buffer */
+    gsize len;          /*!< Length of the buffer */
+    gint64 offset;      /*!< File offset */
+    gsize done;         /*!< Bytes already written by a short write */
+} LrIoRequest;
+
+struct _LrIoRing {
+#ifdef WITH_IO_URING
+    struct io_uring ring;
+#endif /* WITH_IO_URING */
+    guint queued;       /*!< Requests queued but not submitted */
+    guint pending;      /*!< Requests not completed */
+};
+
+/** Do the (rest of the) request by a synchronous system call.
+ * @return          Number of transferred bytes or -errno
+ */
+static gssize
+sync_request(LrIoRequest *req)
+{
+    if (!req->write) {
+        ssize_t n;
+        do {
+            n = pread(req->fd, req->buf, req->len, (off_t) req->offset);
+        } while (n == -1 && errno == EINTR);
+        return n == -1 ? -errno : n;
+    }
+
+    while (req->done < req->len) {
+        ssize_t n = pwrite(req->fd, req->buf + req->done, req->len - req->done,
+                           (off_t) (req->offset + req->done));
+        if (n == -1) {
+            if (errno == EINTR)
+                continue;
+            return -errno;
+        }
+        if (n == 0)
+            return -EIO;
+        req->done += n;
+    }
+    return req->done;
+}
+
+#ifdef WITH_IO_URING
+
+static gboolean
+queue_request(LrIoRing *ring, LrIoRequest *req)
+{
+    struct io_uring_sqe *sqe = io_uring_get_sqe(&ring->ring);
+    if (!sqe) {
+        // The submission queue is full, make room for the request
+        lr_io_ring_submit(ring);
+        sqe = io_uring_get_sqe(&ring->ring);
+        if (!sqe)
+            return FALSE;
+    }
+
+    unsigned len = (unsigned) MIN(req->len - req->done, (gsize) G_MAXINT);
+    if (req->write)
+        io_uring_prep_write(sqe, req->fd, req->buf + req->done, len,
+                            (__u64) (req->offset + req->done));
+    else
+        io_uring_prep_read(sqe, req->fd, req->buf, len, (__u64) req->offset);
+    io_uring_sqe_set_data(sqe, req);
+    ring->queued++;
+    return TRUE;
+}
+
+static void
+finish_request(LrIoRing *ring, LrIoRequest *req, int res)
+{
+    gssize result;
+
+    if (res == -EINVAL || res == -EOPNOTSUPP) {
+        // The operation is not supported by the kernel (or the file)
+        result = sync_request(req);
+    } else if (!req->write) {
+        result = res;
+    } else if (res <= 0) {
+        result = res ? res : -EIO;
+    } else {
+        req->done += res;
+        if (req->done < req->len && queue_request(ring, req))
+            return;  // Short write, the rest is written by the next request
+        result = sync_request(req);
+    }
+
+    ring->pending--;
+    req->cb(req->data, req->offset, result);
+    g_free(req);
+}
+
+static gboolean
+new_request(LrIoRing *ring,
+            gboolean write,
+            int fd,
+            void *buf,
+            gsize len,
+            gint64 offset,
+            LrIoDoneCb cb,
+            gpointer data)
+{
+    LrIoRequest *req = g_new(LrIoRequest, 1);
+    req->cb = cb;
+    req->data = data;
+    req->fd = fd;
+    req->write = write;
+    req->buf = buf;
+    req->len = len;
+    req->offset = offset;
+    req->done = 0;
+
+    if (!queue_request(ring, req)) {
+        g_free(req);
+        return FALSE;
+    }
+
+    ring->pending++;
+    return TRUE;
+}
+
+#endif /* WITH_IO_URING */
+
+LrIoRing *
+lr_io_ring_new(guint depth)
+{
+#ifdef WITH_IO_URING
+    LrIoRing *ring = g_new0(LrIoRing, 1);
+    int rc = io_uring_queue_init(depth, &ring->ring, 0);
+    if (rc < 0) {
+        // E.g. an old kernel or io_uring disabled by seccomp or sysctl
+        g_debug("%s: io_uring is not available: %s", __func__, g_strerror(-rc));
+        g_free(ring);
+        return NULL;
+    }
+    return ring;
+#else
+    (void) depth;
+    return NULL;
+#endif /* WITH_IO_URING */
+}
+
+void
+lr_io_ring_free(LrIoRing *ring)
+{
+    if (!ring)
+        return;
+
+#ifdef WITH_IO_URING
+    while (ring->pending)
+        lr_io_ring_complete(ring, TRUE);
+    io_uring_queue_exit(&ring->ring);
+#endif /* WITH_IO_URING */
+    g_free(ring);
+}
+
+#ifdef WITH_IO_URING
+/** Marks a thread where io_uring is not available */
+static char lr_io_no_ring;
+#define LR_IO_NO_RING   ((gpointer) &lr_io_no_ring)
+
+static void
+thread_ring_free(gpointer ring)
+{
+    if (ring != LR_IO_NO_RING)
+        lr_io_ring_free(ring);
+}
+
+static GPrivate lr_io_thread_ring_key = G_PRIVATE_INIT(thread_ring_free);
+#endif /* WITH_IO_URING */
+
+LrIoRing *
+lr_io_ring_thread_default(void)
+{
+#ifdef WITH_IO_URING
+    gpointer ring = g_private_get(&lr_io_thread_ring_key);
+    if (!ring) {
+        ring = lr_io_ring_new(LR_IO_THREAD_RING_DEPTH);
+        if (!ring)
+            ring = LR_IO_NO_RING;
+        g_private_set(&lr_io_thread_ring_key, ring);
+    }
+    return ring == LR_IO_NO_RING ? NULL : ring;
+#else
+    return NULL;
+#endif /* WITH_IO_URING */
+}
+
+gboolean
+lr_io_ring_write(LrIoRing *ring,
+                 int fd,
+                 const void *buf,
+                 gsize len,
+                 gint64 offset,
+                 LrIoDoneCb cb,
+                 gpointer data)
+{
+#ifdef WITH_IO_URING
+    return new_request(ring, TRUE, fd, (void *) buf, len, offset, cb, data);
+#else
+    (void) ring; (void) fd; (void) buf; (void) len;
+    (void) offset; (void) cb; (void) data;
+    return FALSE;
+#endif /* WITH_IO_URING */
+}
+
+gboolean
+lr_io_ring_read(LrIoRing *ring,
+                int fd,
+                void *buf,
+                gsize len,
+                gint64 offset,
+                LrIoDoneCb cb,
+                gpointer data)
+{
+#ifdef WITH_IO_URING
+    return new_request(ring, FALSE, fd, buf, len, offset, cb, data);
+#else
+    (void) ring; (void) fd; (void) buf; (void) len;
+    (void) offset; (void) cb; (void) data;
+    return FALSE;
+#endif /* WITH_IO_URING */
+}
+
+void
+lr_io_ring_submit(LrIoRing *ring)
+{
+#ifdef WITH_IO_URING
+    if (!ring->queued)
+        return;
+
+    int rc;
+    do {
+        rc = io_uring_submit(&ring->ring);
+    } while (rc == -EINTR);
+
+    if (rc < 0) {
+        // E.g. -EBUSY or -EAGAIN, the requests stay queued
+        // and they are submitted again later
+        g_debug("%s: io_uring_submit() failed: %s", __func__, g_strerror(-rc));
+        return;
+    }
+    ring->queued -= MIN((guint) rc, ring->queued);
+#else
+    (void) ring;
+#endif /* WITH_IO_URING */
+}
+
+guint
+lr_io_ring_complete(LrIoRing *ring, gboolean wait)
+{
+    guint count = 0;
+
+#ifdef WITH_IO_URING
+    while (ring->pending) {
+        struct io_uring_cqe *cqe = NULL;
+        int rc;
+
+        lr_io_ring_submit(ring);
+
+        if (!wait || count) {
+            rc = io_uring_peek_cqe(&ring->ring, &cqe);
+        } else if (ring->pending > ring->queued) {
+            rc = io_uring_wait_cqe(&ring->ring, &cqe);
+        } else {
+            // Nothing is submitted yet, try it again a bit later
+            g_usleep(1000);
+            continue;
+        }
+
+        if (rc < 0) {
+            if (!wait || count)
+                break;  // Nothing else is completed
+            continue;   // Interrupted, wait again
+        }
+
+        LrIoRequest *req = io_uring_cqe_get_data(cqe);
+        int res = cqe->res;
+        io_uring_cqe_seen(&ring->ring, cqe);
+        finish_request(ring, req, res);
+        count++;
+    }
+#else
+    (void) ring;
+    (void) wait;
+#endif /* WITH_IO_URING */
+
+    return count;
+}
+
+guint
+lr_io_ring_pending(LrIoRing *ring)
+{
+    return ring->pending;
+}
+
+/** Block of lr_io_read_file() which is read ahead */
+typedef struct {
+    char *buf;          /*!< Buffer of LR_IO_READ_BLOCK bytes */
+    gint64 offset;      /*!< File offset of the block */
+    gssize res;         /*!< Result of the read */
+    gboolean queued;    /*!< The block is being read or it's read
+                             and not passed to the callback yet */
+    gboolean pending;   /*!< The read is not completed yet */
+} LrIoReadSlot;
+
+static void
+read_slot_done(gpointer data, G_GNUC_UNUSED gint64 offset, gssize res)
+{
+    LrIoReadSlot *slot = data;
+    slot->res = res;
+    slot->pending = FALSE;
+}
+
+static gboolean
+queue_read_slot(LrIoRing *ring, int fd, LrIoReadSlot *slot, gint64 offset)
+{
+    slot->offset = offset;
+    slot->pending = TRUE;
+    if (!lr_io_ring_read(ring, fd, slot->buf, LR_IO_READ_BLOCK, offset,
+                         read_slot_done, slot)) {
+        slot->pending = FALSE;
+        return FALSE;
+    }
+    slot->queued = TRUE;
+    return TRUE;
+}
+
+static gssize
+read_file_sync(int fd, char *buf, LrIoBlockCb cb, gpointer data)
+{
+    gssize total = 0;
+
+    for (;;) {
+        ssize_t n = read(fd, buf, LR_IO_READ_BLOCK);
+        if (n == -1) {
+            if (errno == EINTR)
+                continue;
+            return -errno;
+        }
+        if (n == 0)
+            return total;
+        if (!cb(data, buf, n))
+            return -ECANCELED;
+        total += n;
+    }
+}
+
+gssize
+lr_io_read_file(LrIoRing *ring, int fd, LrIoBlockCb cb, gpointer data)
+{
+    LrIoReadSlot slots[LR_IO_READ_AHEAD];
+    gint64 pos = -1;
+    gssize ret;
+    struct stat st;
+
+    char *buf = g_malloc(LR_IO_READ_BLOCK * LR_IO_READ_AHEAD);
+
+    // Read ahead only regular files which have more than a block left
+    if (ring && fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+        pos = lseek(fd, 0, SEEK_CUR);
+        if (pos >= 0 && st.st_size - pos <= LR_IO_READ_BLOCK)
+            pos = -1;
+    }
+
+    if (pos < 0) {
+        ret = read_file_sync(fd, buf, cb, data);
+        g_free(buf);
+        return ret;
+    }
+
+    // Queue reads of the first blocks. The blocks are consumed in order
+    // and a consumed slot is queued again for the block after the last
+    // queued one. If a read cannot be queued, the rest of the file is
+    // read synchronously once the queued blocks are consumed.
+    gint64 next = pos;
+    for (guint i = 0; i < LR_IO_READ_AHEAD; i++) {
+        slots[i].buf = buf + i * LR_IO_READ_BLOCK;
+        slots[i].queued = FALSE;
+        slots[i].pending = FALSE;
+    }
+    for (guint i = 0; i < LR_IO_READ_AHEAD; i++) {
+        if (!queue_read_slot(ring, fd, &slots[i], next))
+            break;
+        next += LR_IO_READ_BLOCK;
+    }
+
+    ret = 0;
+    gboolean read_rest = TRUE;
+    for (guint head = 0; slots[head].queued; head = (head + 1) % LR_IO_READ_AHEAD) {
+        LrIoReadSlot *slot = &slots[head];
+
+        while (slot->pending)
+            lr_io_ring_complete(ring, TRUE);
+        slot->queued = FALSE;
+
+        if (slot->res < 0) {
+            ret = slot->res;
+            read_rest = FALSE;
+            break;
+        }
+        if (slot->res > 0 && !cb(data, slot->buf, slot->res)) {
+            ret = -ECANCELED;
+            read_rest = FALSE;
+            break;
+        }
+        ret += slot->res;
+        pos += slot->res;
+
+        // The end of the file or a short read, the rest (if any)
+        // is read synchronously
+        if (slot->res < LR_IO_READ_BLOCK)
+            break;
+
+        if (queue_read_slot(ring, fd, slot, next))
+            next += LR_IO_READ_BLOCK;
+    }
+
+    // The buffers can be freed only when all the reads are completed
+    for (guint i = 0; i < LR_IO_READ_AHEAD; i++)
+        while (slots[i].pending)
+            lr_io_ring_complete(ring, TRUE);
+
+    if (read_rest) {
+        if (lseek(fd, (off_t) pos, SEEK_SET) == -1) {
+            ret = -errno;
+        } else {
+            gssize rest = read_file_sync(fd, buf, cb, data);
+            ret = rest < 0 ? rest : ret + rest;
+        }
+    }
+
+    g_free(buf);
+    return ret;
+}
@@ -0,0 +1,135 @@
+/* librepo - A library providing (libcURL like) API to downloading repository
+ * Copyright (C) 2026  agent
+ *
+ * Licensed under the GNU Lesser General Public License Version 2.1
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef __LR_IO_INTERNAL_H__
+#define __LR_IO_INTERNAL_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/** Asynchronous file I/O by io_uring. Requests are queued and submitted
+ * to the kernel in batches by lr_io_ring_submit() (or when the queue is
+ * full), their callbacks are called by lr_io_ring_complete(). A ring is
+ * not thread safe. If librepo is built without io_uring support or the
+ * kernel doesn't allow it, no ring can be created and the callers fall
+ * back to the synchronous I/O.
+ */
+typedef struct _LrIoRing LrIoRing;
+
+/** Callback called when a request is completed.
+ * @param data          User data of the request
+ * @param offset        File offset of the request
+ * @param res           Number of bytes transferred or -errno. A write is
+ *                      completed only when all its data are written or
+ *                      it failed, a read could be short.
+ */
+typedef void (*LrIoDoneCb)(gpointer data, gint64 offset, gssize res);
+
+/** Callback called for every block of a file read by lr_io_read_file().
+ * @return              FALSE to stop the reading
+ */
+typedef gboolean (*LrIoBlockCb)(gpointer data, const char *buf, gsize len);
+
+/** Create a ring.
+ * @param depth         Number of requests submitted at once
+ * @return              New ring or NULL if io_uring is not available
+ */
+LrIoRing *
+lr_io_ring_new(guint depth);
+
+/** Wait for all the requests and free the ring.
+ * @param ring          Ring or NULL
+ */
+void
+lr_io_ring_free(LrIoRing *ring);
+
+/** Ring of the calling thread, it's created by the first call and freed
+ * when the thread exits.
+ * @return              Ring or NULL if io_uring is not available
+ */
+LrIoRing *
+lr_io_ring_thread_default(void);
+
+/** Queue a write of the buffer. The buffer must not be changed or freed
+ * until the request is completed.
+ * @return              FALSE if the request cannot be queued
+ */
+gboolean
+lr_io_ring_write(LrIoRing *ring,
+                 int fd,
+                 const void *buf,
+                 gsize len,
+                 gint64 offset,
+                 LrIoDoneCb cb,
+                 gpointer data);
+
+/** Queue a read into the buffer. The buffer must not be used or freed
+ * until the request is completed.
+ * @return              FALSE if the request cannot be queued
+ */
+gboolean
+lr_io_ring_read(LrIoRing *ring,
+                int fd,
+                void *buf,
+                gsize len,
+                gint64 offset,
+                LrIoDoneCb cb,
+                gpointer data);
+
+/** Submit the queued requests to the kernel by a single system call.
+ * @param ring          Ring
+ */
+void
+lr_io_ring_submit(LrIoRing *ring);
+
+/** Submit the queued requests and call the callbacks of the completed
+ * ones.
+ * @param ring          Ring
+ * @param wait          Wait until at least one request is completed
+ *                      (if any is pending)
+ * @return              Number of completed requests
+ */
+guint
+lr_io_ring_complete(LrIoRing *ring, gboolean wait);
+
+/** Number of requests which are not completed yet.
+ * @param ring          Ring
+ */
+guint
+lr_io_ring_pending(LrIoRing *ring);
+
+/** Read the file from its current offset to the end and pass it to the
+ * callback in blocks. With a ring, the next blocks are read ahead while
+ * the callback processes the current one. The offset of the file is at
+ * its end afterwards.
+ * @param ring          Ring or NULL (synchronous reads)
+ * @param fd            File descriptor
+ * @param cb            Callback
+ * @param data          User data for the callback
+ * @return              Number of read bytes, -errno if a read failed
+ *                      or -ECANCELED if the callback stopped the reading
+ */
+gssize
+lr_io_read_file(LrIoRing *ring, int fd, LrIoBlockCb cb, gpointer data);
+
+G_END_DECLS
+
+#endif
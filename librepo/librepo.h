@@ -35,6 +35,7 @@
 #include "repomd.h"
 #include "repoutil_yum.h"
 #include "result.h"
+#include "stats.h"
 #include "types.h"
 #include "url_substitution.h"
 #include "util.h"
@@ -46,12 +46,12 @@ lr_detect_protocol(const char *url)
 }
 
 static LrInternalMirror *
-lr_lrmirror_new(const char *url, LrUrlVars *urlvars)
+lr_lrmirror_new(const char *url, LrUrlSubst *urlsubst)
 {
     LrInternalMirror *mirror;
 
     mirror = lr_malloc0(sizeof(*mirror));
-    mirror->url = lr_url_substitute(url, urlvars);
+    mirror->url = lr_urlsubst_url(urlsubst, url);
     return mirror;
 }
 
@@ -75,12 +75,12 @@ lr_lrmirrorlist_free(LrInternalMirrorlist *list)
 LrInternalMirrorlist *
 lr_lrmirrorlist_append_url(LrInternalMirrorlist *list,
                            const char *url,
-                           LrUrlVars *urlvars)
+                           LrUrlSubst *urlsubst)
 {
     if (!url || !strlen(url))
         return list;
 
-    LrInternalMirror *mirror = lr_lrmirror_new(url, urlvars);
+    LrInternalMirror *mirror = lr_lrmirror_new(url, urlsubst);
     mirror->preference = 100;
     mirror->protocol = lr_detect_protocol(mirror->url);
 
@@ -92,33 +92,35 @@ lr_lrmirrorlist_append_url(LrInternalMirrorlist *list,
 LrInternalMirrorlist *
 lr_lrmirrorlist_append_mirrorlist(LrInternalMirrorlist *list,
                                   LrMirrorlist *mirrorlist,
-                                  LrUrlVars *urlvars)
+                                  LrUrlSubst *urlsubst)
 {
     if (!mirrorlist || !mirrorlist->urls)
         return list;
 
+    LrInternalMirrorlist *new_mirrors = NULL;
+
     for (GSList *elem = mirrorlist->urls; elem; elem = g_slist_next(elem)) {
         char *url = elem->data;
 
         if (!url || !strlen(url))
             continue;
 
-        LrInternalMirror *mirror = lr_lrmirror_new(url, urlvars);
+        LrInternalMirror *mirror = lr_lrmirror_new(url, urlsubst);
         mirror->preference = 100;
         mirror->protocol = lr_detect_protocol(mirror->url);
-        list = g_slist_append(list, mirror);
+        new_mirrors = g_slist_prepend(new_mirrors, mirror);
 
         //g_debug("%s: Appending URL: %s", __func__, mirror->url);
     }
 
-    return list;
+    return g_slist_concat(list, g_slist_reverse(new_mirrors));
 }
 
 LrInternalMirrorlist *
 lr_lrmirrorlist_append_metalink(LrInternalMirrorlist *list,
                                 LrMetalink *metalink,
                                 const char *suffix,
-                                LrUrlVars *urlvars)
+                                LrUrlSubst *urlsubst)
 {
     size_t suffix_len = 0;
 
@@ -128,6 +130,10 @@ lr_lrmirrorlist_append_metalink(LrInternalMirrorlist *list,
     if (suffix)
         suffix_len = strlen(suffix);
 
+    // Prepend to a new list and concatenate it at the end,
+    // appending one by one is quadratic for long metalinks
+    LrInternalMirrorlist *new_mirrors = NULL;
+
     for (GSList *elem = metalink->urls; elem; elem = g_slist_next(elem)) {
         LrMetalinkUrl *metalinkurl = elem->data;
         assert(metalinkurl);
@@ -141,28 +147,29 @@ lr_lrmirrorlist_append_metalink(LrInternalMirrorlist *list,
         if (!url_len)
             continue;  // No url present
 
-        char *url_copy = NULL;
-
-        if (suffix_len) {
-            /* Remove suffix if necessary */
-            if (url_len >= suffix_len
-                && !strcmp(url+(url_len-suffix_len), suffix))
-                url_copy = g_strndup(url, url_len-suffix_len);
+        /* Remove suffix if necessary */
+        if (suffix_len
+            && url_len >= suffix_len
+            && !strcmp(url+(url_len-suffix_len), suffix))
+            url_len -= suffix_len;
+
+        // The URL is copied only once, the substitution makes its own copy
+        LrInternalMirror *mirror = lr_malloc0(sizeof(*mirror));
+        if (urlsubst && memchr(url, '$', url_len)) {
+            char *url_copy = g_strndup(url, url_len);
+            mirror->url = lr_urlsubst_url(urlsubst, url_copy);
+            lr_free(url_copy);
+        } else {
+            mirror->url = g_strndup(url, url_len);
         }
-
-        if (!url_copy)
-            url_copy = g_strdup(url);
-
-        LrInternalMirror *mirror = lr_lrmirror_new(url_copy, urlvars);
         mirror->preference = metalinkurl->preference;
         mirror->protocol = lr_detect_protocol(mirror->url);
-        lr_free(url_copy);
-        list = g_slist_append(list, mirror);
+        new_mirrors = g_slist_prepend(new_mirrors, mirror);
 
         //g_debug("%s: Appending URL: %s", __func__, mirror->url);
     }
 
-    return list;
+    return g_slist_concat(list, g_slist_reverse(new_mirrors));
 }
 
 LrInternalMirrorlist *
@@ -24,6 +24,7 @@
 #include <glib.h>
 
 #include "url_substitution.h"
+#include "url_substitution_internal.h"
 #include "mirrorlist.h"
 #include "metalink.h"
 
@@ -56,37 +57,37 @@ lr_detect_protocol(const char *url);
  /** Append url to the mirrorlist.
  * @param list          a LrInternalMirrorlist or NULL
  * @param url           the Url
- * @param urlvars       a LrUrlVars or NULL
+ * @param urlsubst      a LrUrlSubst or NULL
  * @return              the new start of the LrInternalMirrorlist
  */
 LrInternalMirrorlist *
 lr_lrmirrorlist_append_url(LrInternalMirrorlist *list,
                            const char *url,
-                           LrUrlVars *urlvars);
+                           LrUrlSubst *urlsubst);
 
 /** Append mirrors from mirrorlist to the internal mirrorlist.
  * @param iml           Internal mirrorlist or NULL
  * @param mirrorlist    Mirrorlist
- * @param urlvars       a LrUrlVars or NULL
+ * @param urlsubst      a LrUrlSubst or NULL
  * @return              the new start of the LrInternalMirrorlist
  */
 LrInternalMirrorlist *
 lr_lrmirrorlist_append_mirrorlist(LrInternalMirrorlist *list,
                                   LrMirrorlist *mirrorlist,
-                                  LrUrlVars *urlvars);
+                                  LrUrlSubst *urlsubst);
 
 /** Append mirrors from metalink to the internal mirrorlist.
  * @param iml           Internal mirrorlist or NULL
  * @param metalink      Metalink
  * @param suffix        Suffix that shoud be removed from the metalink urls
- * @param urlvars       a LrUrlVars or NULL
+ * @param urlsubst      a LrUrlSubst or NULL
  * @return              the new start of the LrInternalMirrorlist
  */
 LrInternalMirrorlist *
 lr_lrmirrorlist_append_metalink(LrInternalMirrorlist *list,
                                 LrMetalink *metalink,
                                 const char *suffix,
-                                LrUrlVars *urlvars);
+                                LrUrlSubst *urlsubst);
 
 /** Append mirrors from another LrInternalMirrorlist.
  * @param iml           Internal mirrorlist
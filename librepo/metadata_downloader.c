@@ -25,11 +25,17 @@
 #include <string.h>
 #include <errno.h>
 #include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include <zconf.h>
 
 #include "librepo/librepo.h"
 
 #include "handle_internal.h"
+#include "downloader_internal.h"
+#include "yum_internal.h"
+#include "cleanup.h"
+#include "trace_internal.h"
 #include "librepo.h"
 
 LrMetadataTarget *
@@ -163,75 +169,224 @@ lr_restore_sigaction(struct sigaction *old_sigact,
     return TRUE;
 }
 
-GSList *
-appendFdValue(GSList *fd_list, int fd)
+/** Stage of the metadata download of a single repository */
+typedef enum {
+    LR_MDS_MIRRORLISTS, /*!<
+        Waiting for the remote mirrorlist and metalink of the handle */
+    LR_MDS_REPOMD, /*!<
+        Waiting for repomd.xml */
+    LR_MDS_SIGNATURE, /*!<
+        Waiting for repomd.xml.asc */
+    LR_MDS_DONE, /*!<
+        Metadata files were enqueued or the repository failed */
+} LrMetadataStage;
+
+/** Download state of a single repository */
+typedef struct {
+    LrMetadataTarget *target; /*!<
+        Related metadata target */
+    LrMetadataStage stage; /*!<
+        Current stage */
+    int fd; /*!<
+        File descriptor of repomd.xml or -1 */
+    char *path; /*!<
+        Path to repomd.xml */
+    char *signature; /*!<
+        Path to repomd.xml.asc */
+    LrDownloadTarget *signature_target; /*!<
+        Download target for repomd.xml.asc */
+    GSList *list_targets; /*!<
+        Unfinished mirrorlist and metalink download targets */
+} LrMetadataRepo;
+
+/** Metadata download of all repositories
+ *
+ * Every repository advances mirrorlist/metalink -> repomd.xml ->
+ * repomd.xml.asc -> metadata files on its own. The next stage is
+ * enqueued into the running download as soon as the previous one is
+ * finished (see metadata_target_done()), so a slow repository doesn't
+ * block the others.
+ */
+typedef struct {
+    GSList *repos; /*!<
+        List of LrMetadataRepo */
+    GSList *download_targets; /*!<
+        Download targets of repomd.xml and repomd.xml.asc files */
+    GSList *list_targets; /*!<
+        Download targets of mirrorlists and metalinks */
+    GSList *records; /*!<
+        Download targets of metadata files of all repositories */
+    GSList *cbdata_list; /*!<
+        List of CbData used by the records */
+    GHashTable *record_targets; /*!<
+        LrMetadataTarget of every record (download target of a metadata
+        file). Repositories may share a handle, so the handle of the
+        record doesn't tell which one it belongs to. */
+    LrSharedCallbackData shared_cbdata; /*!<
+        Progress of all records is reported together */
+    LrDecompressStage *decompress; /*!<
+        Decompression of finished records (see LRO_DECOMPRESS) */
+} LrMetadataPipeline;
+
+static void
+lr_metadatarepo_free(LrMetadataRepo *repo)
 {
-    int *fd_allocated = malloc(sizeof(int));
-    *fd_allocated = fd;
-    fd_list = g_slist_append(fd_list, fd_allocated);
-    return fd_list;
+    if (!repo)
+        return;
+    if (repo->fd != -1)
+        close(repo->fd);
+    if (repo->stage == LR_MDS_SIGNATURE)  // Download was interrupted
+        close(repo->signature_target->fd);
+    for (GSList *elem = repo->list_targets; elem; elem = g_slist_next(elem))
+        lr_handle_mirrorlist_target_done(repo->target->handle, elem->data);
+    g_slist_free(repo->list_targets);
+    lr_free(repo->path);
+    lr_free(repo->signature);
+    lr_free(repo);
 }
 
-GSList *
-appendPath(GSList *paths, const char *path)
+static void
+lr_metadatarepo_finish(LrMetadataRepo *repo)
 {
-    paths = g_slist_append(paths, g_strdup(path));
-    return paths;
+    if (repo->fd != -1) {
+        close(repo->fd);
+        repo->fd = -1;
+    }
+    repo->stage = LR_MDS_DONE;
 }
 
-void
-fillInvalidationValues(GSList **fd_list, GSList **paths)
+/** Prepare download target of repomd.xml. Mirrorlist and metalink of
+ * the handle must be already downloaded (or not needed) at this point,
+ * unless LRO_FASTESTMIRROR is enabled. Then they are downloaded and
+ * the mirrors are probed here (synchronously), so for such a handle
+ * it's called before the download starts.
+ */
+static LrDownloadTarget *
+create_repomd_xml_download_target(LrMetadataPipeline *pipeline,
+                                  LrMetadataRepo *repo)
 {
-    (*fd_list) = appendFdValue((*fd_list), -1);
-    (*paths) = appendPath((*paths), "");
-}
+    LrMetadataTarget *target = repo->target;
+    LrHandle *handle = target->handle;
+    LrDownloadTarget *download_target;
+    GSList *checksums = NULL;
+    GError *err = NULL;
+    char *path = NULL;
+    int fd = -1;
+
+    repo->stage = LR_MDS_DONE;
+
+    if (!lr_handle_prepare_internal_mirrorlist(handle,
+                                               handle->fastestmirror,
+                                               &err)) {
+        lr_metadatatarget_append_error(target, "Cannot prepare internal mirrorlist: %s", err->message, NULL);
+        g_error_free(err);
+        return NULL;
+    }
 
-void
-handle_failure(LrMetadataTarget *target,
-               GSList **fd_list,
-               GSList **paths,
-               GError *err)
-{
-    lr_metadatatarget_append_error(target, err->message, NULL);
-    fillInvalidationValues(fd_list, paths);
-    g_error_free(err);
+    if (mkdir(handle->destdir, S_IRWXU) == -1 && errno != EEXIST) {
+        lr_metadatatarget_append_error(target, "Cannot create tmpdir: %s %s", handle->destdir, g_strerror(errno), NULL);
+        return NULL;
+    }
+
+    if (!lr_prepare_repodata_dir(handle, &err)) {
+        lr_metadatatarget_append_error(target, err->message, NULL);
+        g_error_free(err);
+        return NULL;
+    }
+
+    if (!handle->update) {
+        if (!lr_store_mirrorlist_files(handle, target->repo, &err)) {
+            lr_metadatatarget_append_error(target, err->message, NULL);
+            g_error_free(err);
+            return NULL;
+        }
+
+        if (!lr_copy_metalink_content(handle, target->repo, &err)) {
+            lr_metadatatarget_append_error(target, err->message, NULL);
+            g_error_free(err);
+            return NULL;
+        }
+
+        if ((fd = lr_prepare_repomd_xml_file(handle, &path, &err)) == -1) {
+            lr_metadatatarget_append_error(target, err->message, NULL);
+            g_error_free(err);
+            return NULL;
+        }
+    }
+
+    if (handle->metalink && (handle->checks & LR_CHECK_CHECKSUM)) {
+        lr_get_best_checksum(handle->metalink, &checksums);
+    }
+
+    CbData *cbdata = lr_get_metadata_failure_callback(handle);
+
+    download_target = lr_downloadtarget_new(target->handle,
+                                            "repodata/repomd.xml",
+                                            NULL,
+                                            fd,
+                                            NULL,
+                                            checksums,
+                                            0,
+                                            0,
+                                            NULL,
+                                            cbdata,
+                                            NULL,
+                                            (cbdata) ? hmfcb : NULL,
+                                            target,
+                                            0,
+                                            0,
+                                            NULL,
+                                            TRUE,
+                                            FALSE);
+
+    target->download_target = download_target;
+
+    repo->stage = LR_MDS_REPOMD;
+    repo->fd = fd;
+    repo->path = path;
+
+    pipeline->download_targets = g_slist_append(pipeline->download_targets,
+                                                download_target);
+
+    return download_target;
 }
 
-void
+/** Create LrMetadataRepo for every valid target and return list
+ * of the first download targets (mirrorlists, metalinks or repomd.xml
+ * files if no list has to be downloaded).
+ */
+GSList *
 create_repomd_xml_download_targets(GSList *targets,
-                                   GSList **download_targets,
-                                   GSList **fd_list,
-                                   GSList **paths)
+                                   LrMetadataPipeline *pipeline)
 {
+    GSList *download_targets = NULL;
+
     for (GSList *elem = targets; elem; elem = g_slist_next(elem)) {
         LrMetadataTarget *target = elem->data;
         LrDownloadTarget *download_target;
-        GSList *checksums = NULL;
-        GError *err = NULL;
+        LrMetadataRepo *repo;
         LrHandle *handle;
-        char *path = NULL;
-        int fd = -1;
 
-        if (!target->handle) {
-            /* every target must have fd and path, even invalid */
-            fillInvalidationValues(fd_list, paths);
+        if (!target->handle)
             continue;
-        }
 
         handle = target->handle;
 
         if (!handle->urls && !handle->mirrorlisturl && !handle->metalinkurl) {
             lr_metadatatarget_append_error(target, "No LRO_URLS, LRO_MIRRORLISTURL nor LRO_METALINKURL specified", NULL);
-            fillInvalidationValues(fd_list, paths);
             continue;
         }
 
         if (handle->repotype != LR_YUMREPO) {
             lr_metadatatarget_append_error(target, "Bad LRO_REPOTYPE specified", NULL);
-            fillInvalidationValues(fd_list, paths);
             continue;
         }
 
+        if (handle->conditionalrefresh)
+            g_debug("%s: LRO_CONDITIONALREFRESH is not supported by "
+                    "lr_download_metadata(), the repository is downloaded "
+                    "completely", __func__);
+
         if (target->repo == NULL) {
             target->repo = lr_yum_repo_init();
         }
@@ -239,133 +394,224 @@ create_repomd_xml_download_targets(GSList *targets,
             target->repomd = lr_yum_repomd_init();
         }
 
-        if (!lr_handle_prepare_internal_mirrorlist(handle,
-                                                   handle->fastestmirror,
-                                                   &err)) {
-            lr_metadatatarget_append_error(target, "Cannot prepare internal mirrorlist: %s", err->message, NULL);
-            fillInvalidationValues(fd_list, paths);
-            g_error_free(err);
+        repo = lr_malloc0(sizeof(*repo));
+        repo->target = target;
+        repo->stage = LR_MDS_MIRRORLISTS;
+        repo->fd = -1;
+        pipeline->repos = g_slist_append(pipeline->repos, repo);
+
+        // Resolving of the fastest mirror would block the running
+        // download, the lists are prepared right away for it
+        if (!handle->fastestmirror)
+            repo->list_targets = lr_handle_mirrorlist_download_targets(handle);
+        if (repo->list_targets) {
+            pipeline->list_targets = g_slist_concat(pipeline->list_targets,
+                                                    g_slist_copy(repo->list_targets));
+            download_targets = g_slist_concat(download_targets,
+                                              g_slist_copy(repo->list_targets));
             continue;
         }
 
-        if (mkdir(handle->destdir, S_IRWXU) == -1 && errno != EEXIST) {
-            lr_metadatatarget_append_error(target, "Cannot create tmpdir: %s %s", handle->destdir, g_strerror(errno), NULL);
-            fillInvalidationValues(fd_list, paths);
-            g_error_free(err);
-            continue;
-        }
+        download_target = create_repomd_xml_download_target(pipeline, repo);
+        if (download_target)
+            download_targets = g_slist_append(download_targets, download_target);
+    }
 
-        if (!lr_prepare_repodata_dir(handle, &err)) {
-            handle_failure(target, fd_list, paths, err);
-            continue;
-        }
+    return download_targets;
+}
 
-        if (!handle->update) {
-            if (!lr_store_mirrorlist_files(handle, target->repo, &err)) {
-                handle_failure(target, fd_list, paths, err);
-                continue;
-            }
+/** Parse the downloaded repomd.xml and prepare download targets for
+ * the metadata files it lists.
+ */
+static GSList *
+enqueue_repomd_records(LrMetadataPipeline *pipeline, LrMetadataRepo *repo)
+{
+    LrMetadataTarget *target = repo->target;
+    LrHandle *handle = target->handle;
+    GSList *records = NULL;
+    GError *error = NULL;
 
-            if (!lr_copy_metalink_content(handle, target->repo, &err)) {
-                handle_failure(target, fd_list, paths, err);
-                continue;
-            }
+    lseek(repo->fd, 0, SEEK_SET);
+    if (!lr_yum_repomd_parse_file(target->repomd, repo->fd,
+                                  lr_xml_parser_warning_logger,
+                                  "Repomd xml parser", &error)) {
+        lr_metadatatarget_append_error(target, "Parsing unsuccessful: %s", error->message, NULL);
+        g_error_free(error);
+        lr_metadatarepo_finish(repo);
+        return NULL;
+    }
 
-            if ((fd = lr_prepare_repomd_xml_file(handle, &path, &err)) == -1) {
-                handle_failure(target, fd_list, paths, err);
-                continue;
-            }
-        }
+    lr_metadatarepo_finish(repo);
+    target->repo->destdir = g_strdup(handle->destdir);
+    target->repo->repomd = repo->path;
+    repo->path = NULL;
+
+    if (!prepare_repo_download_targets(handle,
+                                       target->repo,
+                                       target->repomd,
+                                       target,
+                                       &records,
+                                       &pipeline->cbdata_list,
+                                       &error)) {
+        lr_metadatatarget_append_error(target, error->message, NULL);
+        g_error_free(error);
+        return NULL;
+    }
 
-        if (handle->metalink && (handle->checks & LR_CHECK_CHECKSUM)) {
-            lr_get_best_checksum(handle->metalink, &checksums);
-        }
+    // "Inject" shared callbacks, same as lr_download_single_cb() does
+    for (GSList *elem = records; elem; elem = g_slist_next(elem)) {
+        LrDownloadTarget *record = elem->data;
+
+        LrCallbackData *lrcbdata = lr_malloc0(sizeof(*lrcbdata));
+        lrcbdata->userdata      = record->cbdata;
+        lrcbdata->sharedcbdata  = &pipeline->shared_cbdata;
+
+        record->progresscb      = (record->cbdata) ? lr_multi_progress_func : NULL;
+        record->mirrorfailurecb = (record->cbdata) ? lr_multi_mf_func : NULL;
+        record->cbdata          = lrcbdata;
+
+        pipeline->shared_cbdata.singlecbdata = g_slist_append(
+                pipeline->shared_cbdata.singlecbdata, lrcbdata);
 
-        CbData *cbdata = lr_get_metadata_failure_callback(handle);
-
-        download_target = lr_downloadtarget_new(target->handle,
-                                                "repodata/repomd.xml",
-                                                NULL,
-                                                fd,
-                                                NULL,
-                                                checksums,
-                                                0,
-                                                0,
-                                                NULL,
-                                                cbdata,
-                                                NULL,
-                                                (cbdata) ? hmfcb : NULL,
-                                                target,
-                                                0,
-                                                0,
-                                                NULL,
-                                                TRUE,
-                                                FALSE);
-
-        target->download_target = download_target;
-        (*download_targets) = g_slist_append((*download_targets), download_target);
-
-        (*fd_list) = appendFdValue((*fd_list), fd);
-        (*paths) = appendPath((*paths), path);
-        lr_free(path);
+        g_hash_table_insert(pipeline->record_targets, record, target);
     }
+
+    pipeline->records = g_slist_concat(pipeline->records, g_slist_copy(records));
+
+    return records;
 }
 
-void
-process_repomd_xml(GSList *targets,
-                   GSList *fd_list,
-                   GSList *paths)
+static GSList *
+repomd_xml_done(LrMetadataPipeline *pipeline,
+                LrMetadataRepo *repo,
+                LrDownloadTarget *download_target)
 {
-    GError *error = NULL;
+    LrMetadataTarget *target = repo->target;
+    LrHandle *handle = target->handle;
 
-    for (GSList *elem = targets, *fd = fd_list, *path = paths; elem;
-         elem = g_slist_next(elem), fd = g_slist_next(fd), path = g_slist_next(path)) {
+    lr_free(handle->used_mirror);
+    handle->used_mirror = g_strdup(download_target->usedmirror);
+    lr_free(handle->gnupghomedir);
+    handle->gnupghomedir = g_strdup(target->gnupghomedir);
 
-        LrMetadataTarget *target = elem->data;
-        LrHandle *handle;
-        gboolean ret;
-        int fd_value = *((int *) fd->data);
+    if (download_target->rcode != LRE_OK) {
+        lr_metadatatarget_append_error(target, (char *) lr_strerror(download_target->rcode), NULL);
+        lr_metadatarepo_finish(repo);
+        return NULL;
+    }
 
-        if (!target->handle || fd_value == -1) {
-            goto fail;
-        }
+    if (!(handle->checks & LR_CHECK_GPG))
+        return enqueue_repomd_records(pipeline, repo);
+
+    // Try to download repomd.xml.asc only from the mirror where repomd.xml
+    // itself was downloaded (see lr_check_repomd_xml_asc_availability())
+    repo->signature = lr_pathconcat(handle->destdir, "repodata/repomd.xml.asc", NULL);
+    int fd_sig = open(repo->signature, O_CREAT | O_TRUNC | O_RDWR, 0666);
+    if (fd_sig == -1) {
+        g_debug("%s: Cannot open: %s", __func__, repo->signature);
+        lr_metadatatarget_append_error(target, "Cannot open %s: %s", repo->signature, g_strerror(errno), NULL);
+        lr_metadatarepo_finish(repo);
+        return NULL;
+    }
 
-        handle = target->handle;
-        handle->used_mirror =  g_strdup(target->download_target->usedmirror);
-        handle->gnupghomedir = g_strdup(target->gnupghomedir);
+    _cleanup_free_ char *url = lr_pathconcat(handle->used_mirror, "repodata/repomd.xml.asc", NULL);
+    repo->signature_target = lr_downloadtarget_new(handle,
+                                                   url,
+                                                   NULL,
+                                                   fd_sig,
+                                                   NULL,
+                                                   NULL,
+                                                   0,
+                                                   0,
+                                                   NULL,
+                                                   NULL,
+                                                   NULL,
+                                                   NULL,
+                                                   NULL,
+                                                   0,
+                                                   0,
+                                                   NULL,
+                                                   FALSE,
+                                                   FALSE);
+    repo->stage = LR_MDS_SIGNATURE;
+    pipeline->download_targets = g_slist_append(pipeline->download_targets,
+                                                repo->signature_target);
+
+    return g_slist_prepend(NULL, repo->signature_target);
+}
 
-        if (target->download_target->rcode != LRE_OK) {
-            lr_metadatatarget_append_error(target, (char *) lr_strerror(target->download_target->rcode), NULL);
-            goto fail;
-        }
+static GSList *
+repomd_xml_asc_done(LrMetadataPipeline *pipeline,
+                    LrMetadataRepo *repo,
+                    LrDownloadTarget *download_target)
+{
+    LrMetadataTarget *target = repo->target;
+    GError *error = NULL;
 
-        if (!lr_check_repomd_xml_asc_availability(handle, target->repo, fd_value, path->data, &error)) {
-            lr_metadatatarget_append_error(target, error->message, NULL);
-            g_error_free(error);
-            goto fail;
-        }
+    close(download_target->fd);
 
-        lseek(fd_value, SEEK_SET, 0);
-        ret = lr_yum_repomd_parse_file(target->repomd, fd_value, lr_xml_parser_warning_logger,
-                                       "Repomd xml parser", &error);
-        if (!ret) {
-            lr_metadatatarget_append_error(target, "Parsing unsuccessful: %s", error->message, NULL);
-            g_error_free(error);
-            goto fail;
-        }
+    if (download_target->rcode != LRE_OK) {
+        lr_metadatatarget_append_error(target,
+                    "GPG verification is enabled, but GPG signature "
+                    "is not available. This may be an error or the "
+                    "repository does not support GPG verification: %s",
+                    download_target->err, NULL);
+        unlink(repo->signature);
+        lr_metadatarepo_finish(repo);
+        return NULL;
+    }
 
-        close(fd_value);
-        lr_free(fd->data);
-        target->repo->destdir = g_strdup(handle->destdir);
-        target->repo->repomd = path->data;
-        continue;
-    fail:
-        if (fd_value != -1) {
-            close(fd_value);
+    if (!lr_check_repomd_xml_asc(target->handle, target->repo,
+                                 repo->signature, repo->path, &error)) {
+        lr_metadatatarget_append_error(target, error->message, NULL);
+        g_error_free(error);
+        lr_metadatarepo_finish(repo);
+        return NULL;
+    }
+
+    return enqueue_repomd_records(pipeline, repo);
+}
+
+/** LrTargetDoneCb which moves the related repository to its next stage */
+static GSList *
+metadata_target_done(LrDownloadTarget *download_target, void *cbdata)
+{
+    LrMetadataPipeline *pipeline = cbdata;
+
+    for (GSList *elem = pipeline->repos; elem; elem = g_slist_next(elem)) {
+        LrMetadataRepo *repo = elem->data;
+
+        if (repo->stage == LR_MDS_MIRRORLISTS
+            && g_slist_find(repo->list_targets, download_target)) {
+            repo->list_targets = g_slist_remove(repo->list_targets,
+                                                download_target);
+            lr_handle_mirrorlist_target_done(repo->target->handle,
+                                             download_target);
+            if (repo->list_targets)
+                return NULL;  // Wait for the other list
+
+            LrDownloadTarget *repomd_target;
+            repomd_target = create_repomd_xml_download_target(pipeline, repo);
+            return (repomd_target) ? g_slist_prepend(NULL, repomd_target) : NULL;
         }
-        lr_free(path->data);
-        lr_free(fd->data);
+
+        if (repo->stage == LR_MDS_REPOMD
+            && repo->target->download_target == download_target)
+            return repomd_xml_done(pipeline, repo, download_target);
+
+        if (repo->stage == LR_MDS_SIGNATURE
+            && repo->signature_target == download_target)
+            return repomd_xml_asc_done(pipeline, repo, download_target);
     }
+
+    // Metadata file of some repository, nothing more to download
+    LrMetadataTarget *target = g_hash_table_lookup(pipeline->record_targets,
+                                                   download_target);
+    if (target)
+        lr_decompress_stage_push(pipeline->decompress, target->handle,
+                                 target->repo, target, download_target);
+
+    return NULL;
 }
 
 static gboolean
@@ -376,11 +622,16 @@ lr_metadata_download_cleanup(GSList *download_targets)
     for (GSList *elem = download_targets; elem; elem = g_slist_next(elem)) {
         LrDownloadTarget *download_target = elem->data;
         LrMetadataTarget *target = download_target->userdata;
-        if (download_target->err)
-            lr_metadatatarget_append_error(target, download_target->err, NULL);
 
-        if (target->err != NULL) {
-            ret = FALSE;
+        // repomd.xml.asc targets don't have the userdata set, their errors
+        // were already reported by repomd_xml_asc_done()
+        if (target) {
+            if (download_target->err)
+                lr_metadatatarget_append_error(target, download_target->err, NULL);
+
+            if (target->err != NULL) {
+                ret = FALSE;
+            }
         }
 
         lr_downloadtarget_free(download_target);
@@ -404,14 +655,74 @@ gboolean cleanup(GSList *download_targets, GError **err)
     return *err == NULL;
 }
 
+static void
+lr_metadata_pipeline_init(LrMetadataPipeline *pipeline, GSList *targets)
+{
+    memset(pipeline, 0, sizeof(*pipeline));
+    pipeline->shared_cbdata.cb   = lr_yum_progresscb;
+    pipeline->shared_cbdata.mfcb = hmfcb;
+    pipeline->decompress         = lr_decompress_stage_new();
+    pipeline->record_targets     = g_hash_table_new(g_direct_hash, g_direct_equal);
+    lr_progresslimiter_init(&pipeline->shared_cbdata.limiter,
+            targets ? ((LrMetadataTarget *) targets->data)->handle : NULL);
+}
+
+/** Finish the pipeline after its download ended, report the results
+ * to the metadata targets and free the pipeline.
+ * @param pipeline          Metadata pipeline
+ * @param download_error    Error of the download (the function takes
+ *                          its ownership) or NULL if the download
+ *                          succeeded
+ * @param err               GError **
+ * @return                  If FALSE then err is set.
+ */
+static gboolean
+lr_metadata_pipeline_finish(LrMetadataPipeline *pipeline,
+                            GError *download_error,
+                            GError **err)
+{
+    // Errors are reported in the related metadata targets
+    lr_decompress_stage_finish(pipeline->decompress, NULL);
+
+    // Remove injected callbacks and callback data
+    for (GSList *elem = pipeline->records; elem; elem = g_slist_next(elem)) {
+        LrDownloadTarget *record = elem->data;
+        LrCallbackData *cbdata = record->cbdata;
+        record->cbdata = cbdata->userdata;
+        record->progresscb = NULL;
+        record->mirrorfailurecb = NULL;
+        lr_free(cbdata);
+    }
+    g_slist_free(pipeline->shared_cbdata.singlecbdata);
+    g_hash_table_destroy(pipeline->record_targets);
+
+    if (!download_error) {
+        error_handling(pipeline->records, err, NULL);
+    } else {
+        g_propagate_error(err, download_error);
+        for (GSList *elem = pipeline->records; elem; elem = g_slist_next(elem))
+            close(((LrDownloadTarget *) elem->data)->fd);
+    }
+
+    g_slist_free_full(pipeline->cbdata_list, (GDestroyNotify) lr_cbdata_free);
+    g_slist_free_full(pipeline->records, (GDestroyNotify) lr_downloadtarget_free);
+    g_slist_free_full(pipeline->repos, (GDestroyNotify) lr_metadatarepo_free);
+    g_slist_free_full(pipeline->list_targets, (GDestroyNotify) lr_downloadtarget_free);
+
+    return cleanup(pipeline->download_targets, err);
+}
+
 gboolean
 lr_download_metadata(GSList *targets,
                      GError **err)
 {
+    gboolean ret;
     struct sigaction old_sigact;
-    GSList *download_targets = NULL;
-    GSList *fd_list = NULL;
-    GSList *paths = NULL;
+    LrMetadataPipeline pipeline;
+    GSList *initial_targets;
+    GError *download_error = NULL;
+    _cleanup_trace_span_ LrTraceSpan span = LR_TRACE_SPAN_INIT(
+            "repo", "lr_download_metadata", NULL);
 
     assert(!err || *err == NULL);
 
@@ -422,20 +733,118 @@ lr_download_metadata(GSList *targets,
         return FALSE;
     }
 
-    create_repomd_xml_download_targets(targets, &download_targets, &fd_list, &paths);
+    lr_metadata_pipeline_init(&pipeline, targets);
+
+    initial_targets = create_repomd_xml_download_targets(targets, &pipeline);
+
+    ret = lr_download_pipelined(initial_targets,
+                                FALSE,
+                                metadata_target_done,
+                                &pipeline,
+                                &download_error);
+    g_slist_free(initial_targets);
+
+    assert(ret || download_error);
+
+    return lr_metadata_pipeline_finish(&pipeline, download_error, err);
+}
+
+struct _LrMetadataDownload {
+    LrMetadataPipeline pipeline; /*!<
+        Metadata pipeline of all repositories */
+    LrDownloadSession *session; /*!<
+        Session running the pipeline, NULL once the download is finished */
+};
+
+LrMetadataDownload *
+lr_metadata_download_new(GSList *targets, GError **err)
+{
+    GSList *initial_targets;
+    LrHandle *handle = NULL;
+    GError *tmp_err = NULL;
+
+    assert(!err || *err == NULL);
+
+    LrMetadataDownload *download = lr_malloc0(sizeof(*download));
+    lr_metadata_pipeline_init(&download->pipeline, targets);
+
+    initial_targets = create_repomd_xml_download_targets(targets,
+                                                         &download->pipeline);
+
+    // Downloader configuration is taken from the handle of the first
+    // target, same as in lr_download_metadata()
+    if (initial_targets)
+        handle = ((LrDownloadTarget *) initial_targets->data)->handle;
+
+    download->session = lr_download_session_new_pipelined(handle,
+                                                          FALSE,
+                                                          metadata_target_done,
+                                                          &download->pipeline,
+                                                          &tmp_err);
+    if (!download->session) {
+        GError *finish_err = NULL;
+        g_slist_free(initial_targets);
+        lr_metadata_pipeline_finish(&download->pipeline, tmp_err, &finish_err);
+        g_propagate_error(err, finish_err);
+        lr_free(download);
+        return NULL;
+    }
+
+    // If a target cannot be added, the session fails and the error
+    // is reported by lr_metadata_download_finish()
+    for (GSList *elem = initial_targets; elem; elem = g_slist_next(elem))
+        if (!lr_download_session_add_target(download->session, elem->data, NULL))
+            break;
+    g_slist_free(initial_targets);
+
+    return download;
+}
+
+LrDownloadSession *
+lr_metadata_download_get_session(LrMetadataDownload *download)
+{
+    assert(download);
+    return download->session;
+}
 
-    if (!lr_download(download_targets, FALSE, err)) {
-        return cleanup(download_targets, err);
+gboolean
+lr_metadata_download_finish(LrMetadataDownload *download, GError **err)
+{
+    GError *download_error = NULL;
+
+    assert(download);
+    assert(!err || *err == NULL);
+
+    if (!download->session) {
+        g_set_error(err, LR_DOWNLOADER_ERROR, LRE_BADFUNCARG,
+                    "Metadata download was already finished");
+        return FALSE;
     }
 
-    process_repomd_xml(targets, fd_list, paths);
+    if (!lr_download_session_is_finished(download->session))
+        lr_download_session_cancel(download->session);
 
-    g_slist_free(fd_list);
-    g_slist_free(paths);
+    const GError *session_error = lr_download_session_get_error(download->session);
+    if (session_error)
+        download_error = g_error_copy(session_error);
 
-    lr_yum_download_repos(targets, err);
+    lr_download_session_free(download->session);
+    download->session = NULL;
 
-    return cleanup(download_targets, err);
+    return lr_metadata_pipeline_finish(&download->pipeline, download_error, err);
 }
 
+void
+lr_metadata_download_free(LrMetadataDownload *download)
+{
+    if (!download)
+        return;
+
+    if (download->session) {
+        GError *tmp_err = NULL;
+        lr_metadata_download_finish(download, &tmp_err);
+        g_clear_error(&tmp_err);
+    }
 
+    lr_free(download);
+}
@@ -27,6 +27,7 @@
 #include "handle.h"
 #include "repomd.h"
 #include "downloadtarget.h"
+#include "downloader.h"
 
 /** LrMetadataTarget structure */
 typedef struct {
@@ -111,6 +112,8 @@ lr_metadatatarget_free(LrMetadataTarget *target);
 
 /**
  * Download all LrMetadataTargets at the targets GSList.
+ * LRO_CONDITIONALREFRESH of the handles is ignored, the repositories
+ * are always downloaded completely.
  * @param targets GSList where each element is a ::LrPackageTarget object
  * @param err GError **
  * @return If FALSE then err is set.
@@ -118,4 +121,50 @@ lr_metadatatarget_free(LrMetadataTarget *target);
 gboolean
 lr_download_metadata(GSList *targets, GError **err);
 
+/** Non-blocking variant of lr_download_metadata().
+ *
+ * The download runs in a ::LrDownloadSession. Drive the session
+ * (see lr_metadata_download_get_session()) until
+ * lr_download_session_is_finished() returns TRUE and then call
+ * lr_metadata_download_finish() which reports the results the same way
+ * as lr_download_metadata() does.
+ */
+typedef struct _LrMetadataDownload LrMetadataDownload;
+
+/**
+ * Start non-blocking download of all LrMetadataTargets at the targets
+ * GSList. The targets must not be freed before the download is finished.
+ * @param targets GSList where each element is a ::LrMetadataTarget object
+ * @param err GError **
+ * @return New metadata download or NULL if err is set.
+ */
+LrMetadataDownload *
+lr_metadata_download_new(GSList *targets, GError **err);
+
+/**
+ * Get the session which runs the download. Don't add own targets to it
+ * and don't free it.
+ * @param download Metadata download
+ * @return Download session or NULL if the download was already finished.
+ */
+LrDownloadSession *
+lr_metadata_download_get_session(LrMetadataDownload *download);
+
+/**
+ * Finish the download. If the session is still running, it is cancelled.
+ * Waits for decompression of the downloaded files (see LRO_DECOMPRESS).
+ * @param download Metadata download
+ * @param err GError **
+ * @return Same as lr_download_metadata() - if FALSE then err is set.
+ */
+gboolean
+lr_metadata_download_finish(LrMetadataDownload *download, GError **err);
+
+/**
+ * Free the download. If it wasn't finished yet, it is cancelled.
+ * @param download Metadata download
+ */
+void
+lr_metadata_download_free(LrMetadataDownload *download);
+
 #endif //LIBREPO_METADATA_DOWNLOADER_H
@@ -31,21 +31,26 @@
 #include "metalink.h"
 #include "xmlparser_internal.h"
 
-/** TODO:
- * - (?) Use GStringChunk
- */
-
 #define CHUNK_SIZE              8192
 #define CONTENT_REALLOC_STEP    256
+#define STRING_CHUNK_SIZE       4096
 
-/* Metalink object manipulation helpers */
+/* Metalink object manipulation helpers
+ *
+ * All strings live in the metalink->chunk. Strings with only a few
+ * distinct values (protocols, types, locations, ...) are interned.
+ *
+ * New items are prepended to the lists (appending would be quadratic
+ * for metalinks with hundreds of mirrors) and the lists are reversed
+ * to the document order when the parsing is done.
+ */
 
 static LrMetalinkHash *
 lr_new_metalinkhash(LrMetalink *m)
 {
     assert(m);
     LrMetalinkHash *hash = lr_malloc0(sizeof(*hash));
-    m->hashes = g_slist_append(m->hashes, hash);
+    m->hashes = g_slist_prepend(m->hashes, hash);
     return hash;
 }
 
@@ -54,7 +59,7 @@ lr_new_metalinkalternate_hash(LrMetalinkAlternate *ma)
 {
     assert(ma);
     LrMetalinkHash *hash = lr_malloc0(sizeof(*hash));
-    ma->hashes = g_slist_append(ma->hashes, hash);
+    ma->hashes = g_slist_prepend(ma->hashes, hash);
     return hash;
 }
 
@@ -63,7 +68,7 @@ lr_new_metalinkurl(LrMetalink *m)
 {
     assert(m);
     LrMetalinkUrl *url = lr_malloc0(sizeof(*url));
-    m->urls = g_slist_append(m->urls, url);
+    m->urls = g_slist_prepend(m->urls, url);
     return url;
 }
 
@@ -72,43 +77,45 @@ lr_new_metalinkalternate(LrMetalink *m)
 {
     assert(m);
     LrMetalinkAlternate *alternate = lr_malloc0(sizeof(*alternate));
-    m->alternates = g_slist_append(m->alternates, alternate);
+    m->alternates = g_slist_prepend(m->alternates, alternate);
     return alternate;
 }
 
 static void
-lr_free_metalinkhash(LrMetalinkHash *metalinkhash)
+lr_free_metalinkalternate(LrMetalinkAlternate *metalinkalternate)
 {
-    if (!metalinkhash) return;
-    lr_free(metalinkhash->type);
-    lr_free(metalinkhash->value);
-    lr_free(metalinkhash);
+    if (!metalinkalternate) return;
+    g_slist_free_full(metalinkalternate->hashes, lr_free);
+    lr_free(metalinkalternate);
 }
 
-static void
-lr_free_metalinkurl(LrMetalinkUrl *metalinkurl)
+/** Insert a string with few distinct values (protocol, type, ...) */
+static char *
+lr_metalink_intern(LrMetalink *m, const char *str)
 {
-    if (!metalinkurl) return;
-    lr_free(metalinkurl->protocol);
-    lr_free(metalinkurl->type);
-    lr_free(metalinkurl->location);
-    lr_free(metalinkurl->url);
-    lr_free(metalinkurl);
+    if (!str)
+        return NULL;
+    return g_string_chunk_insert_const(m->chunk, str);
 }
 
 static void
-lr_free_metalinkalternate(LrMetalinkAlternate *metalinkalternate)
+lr_metalink_reverse_lists(LrMetalink *m)
 {
-    if (!metalinkalternate) return;
-    g_slist_free_full(metalinkalternate->hashes,
-                      (GDestroyNotify)lr_free_metalinkhash);
-    lr_free(metalinkalternate);
+    m->hashes = g_slist_reverse(m->hashes);
+    m->urls = g_slist_reverse(m->urls);
+    m->alternates = g_slist_reverse(m->alternates);
+    for (GSList *elem = m->alternates; elem; elem = g_slist_next(elem)) {
+        LrMetalinkAlternate *ma = elem->data;
+        ma->hashes = g_slist_reverse(ma->hashes);
+    }
 }
 
 LrMetalink *
 lr_metalink_init(void)
 {
-    return lr_malloc0(sizeof(LrMetalink));
+    LrMetalink *metalink = lr_malloc0(sizeof(LrMetalink));
+    metalink->chunk = g_string_chunk_new(STRING_CHUNK_SIZE);
+    return metalink;
 }
 
 void
@@ -117,13 +124,12 @@ lr_metalink_free(LrMetalink *metalink)
     if (!metalink)
         return;
 
-    lr_free(metalink->filename);
-    g_slist_free_full(metalink->hashes,
-                      (GDestroyNotify)lr_free_metalinkhash);
-    g_slist_free_full(metalink->urls,
-                      (GDestroyNotify)lr_free_metalinkurl);
+    // Hashes and urls don't own their strings, the chunk does
+    g_slist_free_full(metalink->hashes, lr_free);
+    g_slist_free_full(metalink->urls, lr_free);
     g_slist_free_full(metalink->alternates,
                       (GDestroyNotify)lr_free_metalinkalternate);
+    g_string_chunk_free(metalink->chunk);
     lr_free(metalink);
 }
 
@@ -210,8 +216,12 @@ lr_metalink_start_handler(void *pdata, const xmlChar *xmlElement, const xmlChar
     pd->lcontent = 0;
     pd->content[0] = '\0';
 
-    if (pd->ignore && pd->state != STATE_FILE)
-        return; /* Ignore all subelements of the current file element */
+    if (pd->ignore && pd->state != STATE_FILE) {
+        // Ignore all subelements of the current file element,
+        // don't even collect their text
+        pd->docontent = 0;
+        return;
+    }
 
     switch (pd->state) {
     case STATE_START:
@@ -238,7 +248,7 @@ lr_metalink_start_handler(void *pdata, const xmlChar *xmlElement, const xmlChar
             pd->ignore = 0;
             pd->found = 1;
         }
-        pd->metalink->filename = g_strdup(name);
+        pd->metalink->filename = lr_string_chunk_insert(pd->metalink->chunk, name);
         break;
     }
     case STATE_TIMESTAMP:
@@ -278,7 +288,7 @@ lr_metalink_start_handler(void *pdata, const xmlChar *xmlElement, const xmlChar
             break;
         }
         mh = lr_new_metalinkhash(pd->metalink);
-        mh->type = g_strdup(type);
+        mh->type = lr_metalink_intern(pd->metalink, type);
         pd->metalinkhash = mh;
         break;
     }
@@ -298,7 +308,7 @@ lr_metalink_start_handler(void *pdata, const xmlChar *xmlElement, const xmlChar
             break;
         }
         mh = lr_new_metalinkalternate_hash(pd->metalinkalternate);
-        mh->type = g_strdup(type);
+        mh->type = lr_metalink_intern(pd->metalink, type);
         pd->metalinkhash = mh;
         break;
     }
@@ -314,12 +324,12 @@ lr_metalink_start_handler(void *pdata, const xmlChar *xmlElement, const xmlChar
         const char *val;
         assert(!pd->metalinkurl);
         LrMetalinkUrl *url = lr_new_metalinkurl(pd->metalink);
-        if ((val = lr_find_attr("protocol", attr)))
-            url->protocol = g_strdup(val);
-        if ((val = lr_find_attr("type", attr)))
-            url->type = g_strdup(val);
-        if ((val = lr_find_attr("location", attr)))
-            url->location = g_strdup(val);
+        url->protocol = lr_metalink_intern(pd->metalink,
+                                           lr_find_attr("protocol", attr));
+        url->type = lr_metalink_intern(pd->metalink,
+                                       lr_find_attr("type", attr));
+        url->location = lr_metalink_intern(pd->metalink,
+                                           lr_find_attr("location", attr));
         if ((val = lr_find_attr("preference", attr))) {
             long long ll_val = lr_xml_parser_strtoll(pd, val, 0);
             if (ll_val < 0 || ll_val > 100) {
@@ -404,7 +414,8 @@ lr_metalink_end_handler(void *pdata, G_GNUC_UNUSED const xmlChar *element)
             break;
         }
 
-        pd->metalinkhash->value = g_strdup(pd->content);
+        pd->metalinkhash->value = g_string_chunk_insert(pd->metalink->chunk,
+                                                        pd->content);
         pd->metalinkhash = NULL;
         break;
 
@@ -442,7 +453,8 @@ lr_metalink_end_handler(void *pdata, G_GNUC_UNUSED const xmlChar *element)
             break;
         }
 
-        pd->metalinkhash->value = g_strdup(pd->content);
+        pd->metalinkhash->value = g_string_chunk_insert(pd->metalink->chunk,
+                                                        pd->content);
         pd->metalinkhash = NULL;
         break;
 
@@ -451,7 +463,8 @@ lr_metalink_end_handler(void *pdata, G_GNUC_UNUSED const xmlChar *element)
         assert(pd->metalinkurl);
         assert(!pd->metalinkhash);
 
-        pd->metalinkurl->url = g_strdup(pd->content);
+        pd->metalinkurl->url = g_string_chunk_insert(pd->metalink->chunk,
+                                                     pd->content);
         pd->metalinkurl = NULL;
         break;
 
@@ -462,13 +475,18 @@ lr_metalink_end_handler(void *pdata, G_GNUC_UNUSED const xmlChar *element)
     return;
 }
 
-gboolean
-lr_metalink_parse_file(LrMetalink *metalink,
-                       int fd,
-                       const char *filename,
-                       LrXmlParserWarningCb warningcb,
-                       void *warningcb_data,
-                       GError **err)
+/** Parse the metalink from the file descriptor or, if fd is -1,
+ * from the buffer.
+ */
+static gboolean
+lr_metalink_parse(LrMetalink *metalink,
+                  int fd,
+                  const char *buf,
+                  gsize len,
+                  const char *filename,
+                  LrXmlParserWarningCb warningcb,
+                  void *warningcb_data,
+                  GError **err)
 {
     gboolean ret = TRUE;
     LrParserData *pd;
@@ -476,7 +494,7 @@ lr_metalink_parse_file(LrMetalink *metalink,
     GError *tmp_err = NULL;
 
     assert(metalink);
-    assert(fd >= 0);
+    assert(fd >= 0 || buf || !len);
     assert(filename);
     assert(!err || *err == NULL);
 
@@ -504,7 +522,11 @@ lr_metalink_parse_file(LrMetalink *metalink,
 
     // Parsing
 
-    ret = lr_xml_parser_generic(parser, pd, fd, &tmp_err);
+    if (fd >= 0)
+        ret = lr_xml_parser_generic(parser, pd, fd, &tmp_err);
+    else
+        ret = lr_xml_parser_generic_buffer(parser, pd, buf, len, &tmp_err);
+    lr_metalink_reverse_lists(metalink);
     if (tmp_err) {
         g_propagate_error(err, tmp_err);
         goto err;
@@ -523,3 +545,29 @@ err:
 
     return ret;
 }
+
+gboolean
+lr_metalink_parse_file(LrMetalink *metalink,
+                       int fd,
+                       const char *filename,
+                       LrXmlParserWarningCb warningcb,
+                       void *warningcb_data,
+                       GError **err)
+{
+    assert(fd >= 0);
+    return lr_metalink_parse(metalink, fd, NULL, 0, filename,
+                             warningcb, warningcb_data, err);
+}
+
+gboolean
+lr_metalink_parse_buffer(LrMetalink *metalink,
+                         const char *buf,
+                         gsize len,
+                         const char *filename,
+                         LrXmlParserWarningCb warningcb,
+                         void *warningcb_data,
+                         GError **err)
+{
+    return lr_metalink_parse(metalink, -1, buf, len, filename,
+                             warningcb, warningcb_data, err);
+}
@@ -61,6 +61,8 @@ typedef struct {
     GSList *hashes;   /*!< List of pointers to LrMetalinkHashes (could be NULL) */
     GSList *urls;     /*!< List of pointers to LrMetalinkUrls (could be NULL) */
     GSList *alternates; /*!< List of pointers to LrMetalinkAlternates (could be NULL) */
+    GStringChunk *chunk; /*!< String chunk holding all strings of the metalink
+                              and of its hashes and urls */
 } LrMetalink;
 
 /** Create new empty metalink object.
@@ -70,7 +72,7 @@ LrMetalink *
 lr_metalink_init(void);
 
 /** Parse metalink file.
- * @param metalink          Metalink object.
+ * @param metalink          Empty metalink object.
  * @param fd                File descriptor.
  * @param filename          File to look for in metalink file.
  * @param warningcb         ::LrXmlParserWarningCb function or NULL
@@ -86,6 +88,25 @@ lr_metalink_parse_file(LrMetalink *metalink,
                        void *warningcb_data,
                        GError **err);
 
+/** Parse metalink in memory.
+ * @param metalink          Empty metalink object.
+ * @param buf               Content of the metalink file.
+ * @param len               Length of the content.
+ * @param filename          File to look for in metalink file.
+ * @param warningcb         ::LrXmlParserWarningCb function or NULL
+ * @param warningcb_data    Warning callback data or NULL
+ * @param err               GError **
+ * @return                  TRUE if everything is ok, FALSE if err is set.
+ */
+gboolean
+lr_metalink_parse_buffer(LrMetalink *metalink,
+                         const char *buf,
+                         gsize len,
+                         const char *filename,
+                         LrXmlParserWarningCb warningcb,
+                         void *warningcb_data,
+                         GError **err);
+
 /** Free metalink object and all its content.
  * @param metalink      Metalink object.
  */
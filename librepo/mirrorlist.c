@@ -48,6 +48,35 @@ lr_mirrorlist_free(LrMirrorlist *mirrorlist)
     lr_free(mirrorlist);
 }
 
+/** Parse a single line of the mirrorlist and append its URL
+ * (if there is any) to the mirrorlist.
+ */
+static void
+lr_mirrorlist_parse_line(LrMirrorlist *mirrorlist, char *p)
+{
+    int l;
+
+    /* Skip leading white characters */
+    while (*p == ' ' || *p == '\t')
+        p++;
+
+    if (!*p || *p == '#')
+        return;  /* End of string or comment */
+
+    l = strlen(p);
+    /* Remove trailing white characters */
+    while (l > 0 && (p[l-1] == ' ' || p[l-1] == '\n' || p[l-1] == '\t'))
+        l--;
+    p[l] = '\0';
+
+    if (!l)
+        return;
+
+    /* Append URL */
+    if (p[0] != '\0' && (strstr(p, "://") || p[0] == '/'))
+        mirrorlist->urls = g_slist_append(mirrorlist->urls, g_strdup(p));
+}
+
 gboolean
 lr_mirrorlist_parse_file(LrMirrorlist *mirrorlist, int fd, GError **err)
 {
@@ -75,31 +104,36 @@ lr_mirrorlist_parse_file(LrMirrorlist *mirrorlist, int fd, GError **err)
         return FALSE;
     }
 
-    while ((p = fgets(buf, BUF_LEN, f))) {
-        int l;
+    while ((p = fgets(buf, BUF_LEN, f)))
+        lr_mirrorlist_parse_line(mirrorlist, p);
 
-        /* Skip leading white characters */
-        while (*p == ' ' || *p == '\t')
-            p++;
+    fclose(f);
 
-        if (!*p || *p == '#')
-            continue;  /* End of string or comment */
+    return TRUE;
+}
+
+gboolean
+lr_mirrorlist_parse_buffer(LrMirrorlist *mirrorlist,
+                           const char *buf,
+                           gsize len,
+                           GError **err)
+{
+    assert(mirrorlist);
+    assert(buf || !len);
+    assert(!err || *err == NULL);
 
-        l = strlen(p);
-        /* Remove trailing white characters */
-        while (l > 0 && (p[l-1] == ' ' || p[l-1] == '\n' || p[l-1] == '\t'))
-            l--;
-        p[l] = '\0';
+    const char *end = buf + len;
+    while (buf < end) {
+        const char *eol = memchr(buf, '\n', end - buf);
+        if (!eol)
+            eol = end;
 
-        if (!l)
-            continue;
+        char *line = g_strndup(buf, eol - buf);
+        lr_mirrorlist_parse_line(mirrorlist, line);
+        g_free(line);
 
-        /* Append URL */
-        if (p[0] != '\0' && (strstr(p, "://") || p[0] == '/'))
-            mirrorlist->urls = g_slist_append(mirrorlist->urls, g_strdup(p));
+        buf = eol + 1;
     }
 
-    fclose(f);
-
     return TRUE;
 }
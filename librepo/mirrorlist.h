@@ -52,6 +52,20 @@ lr_mirrorlist_init(void);
 gboolean
 lr_mirrorlist_parse_file(LrMirrorlist *mirrorlist, int fd, GError **err);
 
+/**
+ * Parse mirrorlist in memory.
+ * @param mirrorlist    Mirrorlist object.
+ * @param buf           Content of the mirrorlist file.
+ * @param len           Length of the content.
+ * @param err           GError **
+ * @return              TRUE if everything is ok, FALSE if err is set.
+ */
+gboolean
+lr_mirrorlist_parse_buffer(LrMirrorlist *mirrorlist,
+                           const char *buf,
+                           gsize len,
+                           GError **err);
+
 /**
  * Free mirrorlist and all its content.
  * @param mirrorlist    Mirrorlist object.
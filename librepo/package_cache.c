@@ -0,0 +1,127 @@
+/* librepo - A library providing (libcURL like) API to downloading repository
+ * Copyright (C) 2026  agent
+ *
+ * Licensed under the GNU Lesser General Public License Version 2.1
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "cleanup.h"
+#include "util.h"
+#include "handle_internal.h"
+#include "package_cache_internal.h"
+
+gchar *
+lr_package_cache_path(LrHandle *handle,
+                      LrChecksumType type,
+                      const char *checksum)
+{
+    if (!handle || !handle->packagecache || !handle->cachedir
+        || !checksum || type == LR_CHECKSUM_UNKNOWN)
+        return NULL;
+
+    const char *type_str = lr_checksum_type_to_str(type);
+    if (!type_str)
+        return NULL;
+
+    // The checksum becomes a filename, accept only hex digests
+    size_t len = strlen(checksum);
+    if (len < 3)
+        return NULL;
+    for (size_t x = 0; x < len; x++)
+        if (!g_ascii_isxdigit(checksum[x]))
+            return NULL;
+
+    // <cachedir>/packages/<type>/<first two digits>/<checksum>
+    _cleanup_free_ gchar *name = g_ascii_strdown(checksum, len);
+    char prefix[3] = { name[0], name[1], '\0' };
+    return g_build_filename(handle->cachedir, LR_PACKAGE_CACHE_DIR,
+                            type_str, prefix, name, NULL);
+}
+
+gboolean
+lr_package_cache_lookup(LrHandle *handle,
+                        LrChecksumType type,
+                        const char *checksum,
+                        const char *path)
+{
+    _cleanup_free_ gchar *cached = lr_package_cache_path(handle, type,
+                                                         checksum);
+    if (!cached)
+        return FALSE;
+
+    int fd = open(cached, O_RDONLY);
+    if (fd == -1)
+        return FALSE;  // Not cached
+
+    // The cached file could be modified through one of its hard links.
+    // The checksum is cached in an extended attribute of the file, so
+    // it is calculated again only if the file was changed.
+    gboolean matches = FALSE;
+    GError *tmp_err = NULL;
+    if (!lr_checksum_fd_cmp(type, fd, checksum, TRUE, &matches, &tmp_err)) {
+        g_debug("%s: Cannot check checksum of %s: %s",
+                __func__, cached, tmp_err->message);
+        g_error_free(tmp_err);
+    }
+    close(fd);
+
+    if (!matches) {
+        g_debug("%s: Removing %s from the package cache, checksum mismatch",
+                __func__, cached);
+        unlink(cached);
+        return FALSE;
+    }
+
+    if (unlink(path) == -1 && errno != ENOENT) {
+        g_debug("%s: Cannot remove %s: %s", __func__, path, g_strerror(errno));
+        return FALSE;
+    }
+
+    if (!lr_link_or_copy(cached, path))
+        return FALSE;
+
+    g_debug("%s: %s taken from the package cache (%s)", __func__, path, cached);
+    return TRUE;
+}
+
+void
+lr_package_cache_store(LrHandle *handle,
+                       LrChecksumType type,
+                       const char *checksum,
+                       const char *path)
+{
+    _cleanup_free_ gchar *cached = lr_package_cache_path(handle, type,
+                                                         checksum);
+    if (!cached || g_access(cached, F_OK) == 0)
+        return;
+
+    _cleanup_free_ gchar *dir = g_path_get_dirname(cached);
+    if (g_mkdir_with_parents(dir, 0755) == -1) {
+        g_debug("%s: Cannot create %s: %s", __func__, dir, g_strerror(errno));
+        return;
+    }
+
+    if (lr_link_or_copy(path, cached))
+        g_debug("%s: %s stored in the package cache (%s)",
+                __func__, path, cached);
+}
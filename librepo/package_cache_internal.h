@@ -0,0 +1,78 @@
+/* librepo - A library providing (libcURL like) API to downloading repository
+ * Copyright (C) 2026  agent
+ *
+ * Licensed under the GNU Lesser General Public License Version 2.1
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef __LR_PACKAGE_CACHE_INTERNAL_H__
+#define __LR_PACKAGE_CACHE_INTERNAL_H__
+
+#include <glib.h>
+
+#include "checksum.h"
+#include "handle.h"
+
+G_BEGIN_DECLS
+
+/** Subdirectory of the LRO_CACHEDIR with the package cache */
+#define LR_PACKAGE_CACHE_DIR    "packages"
+
+/** Path of the package with the checksum in the package cache
+ * (see LRO_PACKAGECACHE).
+ * @param handle        Handle or NULL
+ * @param type          Checksum type
+ * @param checksum      Checksum of the package (hex digest) or NULL
+ * @return              Newly allocated path or NULL if the cache is not
+ *                      enabled for the handle or the checksum is unusable
+ */
+gchar *
+lr_package_cache_path(LrHandle *handle,
+                      LrChecksumType type,
+                      const char *checksum);
+
+/** Look for the package in the package cache. If it is there and its
+ * checksum matches, the path is replaced by a hard link (or a copy)
+ * of the cached file. Broken cached files are removed.
+ * @param handle        Handle or NULL
+ * @param type          Checksum type
+ * @param checksum      Checksum of the package or NULL
+ * @param path          Destination path of the package
+ * @return              TRUE if the path was created from the cache
+ */
+gboolean
+lr_package_cache_lookup(LrHandle *handle,
+                        LrChecksumType type,
+                        const char *checksum,
+                        const char *path);
+
+/** Add the verified package to the package cache as a hard link (or
+ * a copy) of the path. Nothing is done if it is already cached.
+ * Failures are only logged, the cache is an optimization.
+ * @param handle        Handle or NULL
+ * @param type          Checksum type
+ * @param checksum      Checksum of the package or NULL
+ * @param path          Path of the downloaded package
+ */
+void
+lr_package_cache_store(LrHandle *handle,
+                       LrChecksumType type,
+                       const char *checksum,
+                       const char *path);
+
+G_END_DECLS
+
+#endif
@@ -31,11 +31,14 @@
 
 #include "types.h"
 #include "cleanup.h"
+#include "trace_internal.h"
 #include "util.h"
 #include "package_downloader.h"
 #include "handle_internal.h"
 #include "downloader.h"
+#include "downloader_internal.h"
 #include "fastestmirror_internal.h"
+#include "package_cache_internal.h"
 
 /* Do NOT use resume on successfully downloaded files - download will fail */
 
@@ -64,15 +67,25 @@ lr_packagetarget_new(LrHandle *handle,
         return NULL;
     }
 
-    target->chunk = g_string_chunk_new(16);
+    if (handle) {
+        // Targets of one handle are usually created by thousands,
+        // share one chunk with the common destination and base url.
+        // Only deduplicated strings go there, the strings unique
+        // to the target are freed with it, so the chunk doesn't grow
+        // with the number of targets.
+        target->shared_chunk = lr_handle_packagetarget_chunk(handle);
+        target->chunk = target->shared_chunk->chunk;
+    } else {
+        target->chunk = g_string_chunk_new(16);
+    }
 
     target->handle = handle;
-    target->relative_url = lr_string_chunk_insert(target->chunk, relative_url);
-    target->dest = lr_string_chunk_insert(target->chunk, dest);
+    target->relative_url = g_strdup(relative_url);
+    target->dest = dest ? g_string_chunk_insert_const(target->chunk, dest) : NULL;
     target->checksum_type = checksum_type;
-    target->checksum = lr_string_chunk_insert(target->chunk, checksum);
+    target->checksum = g_strdup(checksum);
     target->expectedsize = expectedsize;
-    target->base_url = lr_string_chunk_insert(target->chunk, base_url);
+    target->base_url = base_url ? g_string_chunk_insert_const(target->chunk, base_url) : NULL;
     target->resume = resume;
     target->progresscb = progresscb;
     target->cbdata = cbdata;
@@ -163,8 +176,34 @@ lr_packagetarget_new_v3(LrHandle *handle,
 void
 lr_packagetarget_reset(LrPackageTarget *target)
 {
-    target->local_path = NULL;
-    target->err = NULL;
+    g_clear_pointer(&target->local_path, g_free);
+    g_clear_pointer(&target->err, g_free);
+    g_clear_pointer(&target->stats, g_free);
+}
+
+/** Set the error message of the target, the previous one is freed.
+ * The output fields are owned by the target, the shared string chunk
+ * would keep every message of every attempt.
+ * @param target            ::LrPackageTarget object
+ * @param msg               Error message or NULL
+ */
+static void
+lr_packagetarget_set_err(LrPackageTarget *target, const char *msg)
+{
+    g_free(target->err);
+    target->err = g_strdup(msg);
+}
+
+/** Set the local path of the target, the target takes the ownership
+ * of the local_path and the previous one is freed.
+ * @param target            ::LrPackageTarget object
+ * @param local_path        Local path
+ */
+static void
+lr_packagetarget_take_local_path(LrPackageTarget *target, char *local_path)
+{
+    g_free(target->local_path);
+    target->local_path = local_path;
 }
 
 void
@@ -172,26 +211,30 @@ lr_packagetarget_free(LrPackageTarget *target)
 {
     if (!target)
         return;
-    g_string_chunk_free(target->chunk);
+    if (target->shared_chunk)
+        lr_shared_chunk_unref(target->shared_chunk);
+    else
+        g_string_chunk_free(target->chunk);
+    g_free(target->relative_url);
+    g_free(target->checksum);
+    g_free(target->local_path);
+    g_free(target->err);
+    g_free(target->stats);
     g_free(target);
 }
 
-gboolean
-lr_download_packages(GSList *targets,
-                     LrPackageDownloadFlag flags,
-                     GError **err)
+/** Check the targets before the download.
+ * @param targets           GSList of ::LrPackageTarget objects
+ * @param interruptible     Set to TRUE if a handle of a target is
+ *                          interruptible
+ * @param err               GError **
+ * @return                  If FALSE then err is set.
+ */
+static gboolean
+lr_check_packagetargets(GSList *targets,
+                        gboolean *interruptible,
+                        GError **err)
 {
-    gboolean ret;
-    gboolean failfast = flags & LR_PACKAGEDOWNLOAD_FAILFAST;
-    struct sigaction old_sigact;
-    GSList *downloadtargets = NULL;
-    gboolean interruptible = FALSE;
-
-    assert(!err || *err == NULL);
-
-    if (!targets)
-        return TRUE;
-
     // Check targets
     for (GSList *elem = targets; elem; elem = g_slist_next(elem)) {
         LrPackageTarget *packagetarget = elem->data;
@@ -207,7 +250,7 @@ lr_download_packages(GSList *targets,
         }
 
         if (packagetarget->handle->interruptible)
-            interruptible = TRUE;
+            *interruptible = TRUE;
 
         // Check repotype
         // Note: Checked because lr_handle_prepare_internal_mirrorlist
@@ -220,157 +263,267 @@ lr_download_packages(GSList *targets,
         }
     }
 
-    // Setup sighandler
-    if (interruptible) {
-        struct sigaction sigact;
-        g_debug("%s: Using own SIGINT handler", __func__);
-        memset(&sigact, 0, sizeof(old_sigact));
-        memset(&sigact, 0, sizeof(sigact));
-        sigemptyset(&sigact.sa_mask);
-        sigact.sa_handler = lr_sigint_handler;
-        sigaddset(&sigact.sa_mask, SIGINT);
-        sigact.sa_flags = SA_RESTART;
-        if (sigaction(SIGINT, &sigact, &old_sigact) == -1) {
-            g_set_error(err, LR_PACKAGE_DOWNLOADER_ERROR, LRE_SIGACTION,
-                        "Cannot set Librepo SIGINT handler");
-            return FALSE;
-        }
-    }
+    return TRUE;
+}
 
-    // List of handles for fastest mirror resolving
-    GSList *fmr_handles = NULL;
+/** Whether the package target may be taken from and stored to
+ * the package cache (see LRO_PACKAGECACHE). Only whole files with
+ * a known checksum are cached.
+ */
+static gboolean
+lr_packagetarget_cacheable(LrPackageTarget *packagetarget)
+{
+    return packagetarget->handle
+           && packagetarget->handle->packagecache
+           && packagetarget->checksum
+           && packagetarget->checksum_type != LR_CHECKSUM_UNKNOWN
+           && packagetarget->byterangestart == 0
+           && packagetarget->byterangeend == 0;
+}
 
-    // Prepare targets
-    for (GSList *elem = targets; elem; elem = g_slist_next(elem)) {
-        _cleanup_free_ gchar *local_path = NULL;
-        LrPackageTarget *packagetarget = elem->data;
-        LrDownloadTarget *downloadtarget;
-        gint64 realsize = -1;
-        gboolean doresume = packagetarget->resume;
+/** Prepare the download target of the package target if the package
+ * is not downloaded yet. If it is, the end callback of the package
+ * target is called right away.
+ * Internal mirrorlist of the handle of the target is not prepared here.
+ * @param packagetarget     ::LrPackageTarget object
+ * @param downloadtarget    Prepared ::LrDownloadTarget or NULL if the package
+ *                          is already downloaded
+ * @param err               GError **
+ * @return                  If FALSE then err is set.
+ */
+static gboolean
+lr_prepare_packagetarget(LrPackageTarget *packagetarget,
+                         LrDownloadTarget **downloadtarget,
+                         GError **err)
+{
+    _cleanup_free_ gchar *local_path = NULL;
+    gint64 realsize = -1;
+    gboolean doresume = packagetarget->resume;
+    gboolean ret;
 
-        // Reset output attributes of the handle
-        lr_packagetarget_reset(packagetarget);
+    *downloadtarget = NULL;
 
-        // Prepare destination filename
-        if (packagetarget->dest) {
-            if (g_file_test(packagetarget->dest, G_FILE_TEST_IS_DIR)) {
-                // Dir specified
-                // unencode first in case there are any encoded slashes to
-                // prevent any path changing shenanigans
-                _cleanup_free_ gchar * unencoded_url = g_uri_unescape_string(packagetarget->relative_url, "");
-                _cleanup_free_ gchar * file_basename = g_path_get_basename(unencoded_url);
+    // Reset output attributes of the handle
+    lr_packagetarget_reset(packagetarget);
 
-                local_path = g_build_filename(packagetarget->dest,
-                                              file_basename,
-                                              NULL);
-            } else {
-                local_path = g_strdup(packagetarget->dest);
-            }
-        } else {
-            // No destination path specified
+    // Prepare destination filename
+    if (packagetarget->dest) {
+        if (g_file_test(packagetarget->dest, G_FILE_TEST_IS_DIR)) {
+            // Dir specified
             // unencode first in case there are any encoded slashes to
             // prevent any path changing shenanigans
             _cleanup_free_ gchar * unencoded_url = g_uri_unescape_string(packagetarget->relative_url, "");
-            local_path = g_path_get_basename(unencoded_url);
+            _cleanup_free_ gchar * file_basename = g_path_get_basename(unencoded_url);
+
+            local_path = g_build_filename(packagetarget->dest,
+                                          file_basename,
+                                          NULL);
+        } else {
+            local_path = g_strdup(packagetarget->dest);
         }
+    } else {
+        // No destination path specified
+        // unencode first in case there are any encoded slashes to
+        // prevent any path changing shenanigans
+        _cleanup_free_ gchar * unencoded_url = g_uri_unescape_string(packagetarget->relative_url, "");
+        local_path = g_path_get_basename(unencoded_url);
+    }
 
-        packagetarget->local_path = g_string_chunk_insert(packagetarget->chunk,
-                                                          local_path);
+    lr_packagetarget_take_local_path(packagetarget,
+                                     g_steal_pointer(&local_path));
+
+    // Check expected size and real size if the file exists
+    if (doresume
+        && g_access(packagetarget->local_path, R_OK) == 0
+        && packagetarget->expectedsize > 0)
+    {
+        struct stat buf;
+        if (stat(packagetarget->local_path, &buf)) {
+            g_set_error(err, LR_PACKAGE_DOWNLOADER_ERROR, LRE_IO,
+                    "Cannot stat %s: %s", packagetarget->local_path,
+                    g_strerror(errno));
+            return FALSE;
+        }
 
-        // Check expected size and real size if the file exists
-        if (doresume
-            && g_access(packagetarget->local_path, R_OK) == 0
-            && packagetarget->expectedsize > 0)
-        {
-            struct stat buf;
-            if (stat(packagetarget->local_path, &buf)) {
-                g_set_error(err, LR_PACKAGE_DOWNLOADER_ERROR, LRE_IO,
-                        "Cannot stat %s: %s", packagetarget->local_path,
-                        g_strerror(errno));
-                return FALSE;
-            }
+        realsize = buf.st_size;
 
-            realsize = buf.st_size;
+        if (packagetarget->expectedsize < realsize)
+            // Existing file is bigger then the one that is expected,
+            // disable resuming
+            doresume = FALSE;
+    }
 
-            if (packagetarget->expectedsize < realsize)
-                // Existing file is bigger then the one that is expected,
-                // disable resuming
-                doresume = FALSE;
+    if (g_access(packagetarget->local_path, R_OK) == 0
+        && packagetarget->checksum
+        && packagetarget->checksum_type != LR_CHECKSUM_UNKNOWN)
+    {
+        /* If the file exists and checksum is ok, then is pointless to
+         * download the file again.
+         * Moreover, if the resume is enabled and the file is already
+         * completely downloaded, then the download is going to fail.
+         */
+        int fd_r = open(packagetarget->local_path, O_RDONLY);
+        if (fd_r != -1) {
+            gboolean matches;
+            ret = lr_checksum_fd_cmp(packagetarget->checksum_type,
+                                     fd_r,
+                                     packagetarget->checksum,
+                                     1,
+                                     &matches,
+                                     NULL);
+            close(fd_r);
+            if (ret && matches) {
+                // Checksum calculation was ok and checksum matches
+                g_debug("%s: Package %s is already downloaded (checksum matches)",
+                        __func__, packagetarget->local_path);
+
+                if (lr_packagetarget_cacheable(packagetarget))
+                    lr_package_cache_store(packagetarget->handle,
+                                           packagetarget->checksum_type,
+                                           packagetarget->checksum,
+                                           packagetarget->local_path);
+
+                lr_packagetarget_set_err(packagetarget, "Already downloaded");
+
+                // Call end callback
+                LrEndCb end_cb = packagetarget->endcb;
+                if (end_cb)
+                    end_cb(packagetarget->cbdata,
+                           LR_TRANSFER_ALREADYEXISTS,
+                           "Already downloaded");
+
+                return TRUE;
+            } else if (ret) {
+                // Checksum calculation was ok but checksum doesn't match
+                if (realsize != -1 && realsize == packagetarget->expectedsize)
+                    // File size is the same as the expected one
+                    // Don't try to resume
+                    doresume = FALSE;
+            }
         }
+    }
 
-        if (g_access(packagetarget->local_path, R_OK) == 0
-            && packagetarget->checksum
-            && packagetarget->checksum_type != LR_CHECKSUM_UNKNOWN)
-        {
-            /* If the file exists and checksum is ok, then is pointless to
-             * download the file again.
-             * Moreover, if the resume is enabled and the file is already
-             * completely downloaded, then the download is going to fail.
-             */
-            int fd_r = open(packagetarget->local_path, O_RDONLY);
-            if (fd_r != -1) {
-                gboolean matches;
-                ret = lr_checksum_fd_cmp(packagetarget->checksum_type,
-                                         fd_r,
-                                         packagetarget->checksum,
-                                         1,
-                                         &matches,
-                                         NULL);
-                close(fd_r);
-                if (ret && matches) {
-                    // Checksum calculation was ok and checksum matches
-                    g_debug("%s: Package %s is already downloaded (checksum matches)",
-                            __func__, packagetarget->local_path);
+    if (doresume && realsize != -1 && realsize == packagetarget->expectedsize) {
+        // File's size matches the expected one, the resume is enabled and
+        // no checksum is known => expect that the file is
+        // the one the user wants
+        g_debug("%s: Package %s is already downloaded (size matches)",
+                __func__, packagetarget->local_path);
 
-                    packagetarget->err = g_string_chunk_insert(
-                                                packagetarget->chunk,
-                                                "Already downloaded");
-
-                    // Call end callback
-                    LrEndCb end_cb = packagetarget->endcb;
-                    if (end_cb)
-                        end_cb(packagetarget->cbdata,
-                               LR_TRANSFER_ALREADYEXISTS,
-                               "Already downloaded");
-
-                    continue;
-                } else if (ret) {
-                    // Checksum calculation was ok but checksum doesn't match
-                    if (realsize != -1 && realsize == packagetarget->expectedsize)
-                        // File size is the same as the expected one
-                        // Don't try to resume
-                        doresume = FALSE;
-                }
-            }
-        }
+        lr_packagetarget_set_err(packagetarget, "Already downloaded");
 
-        if (doresume && realsize != -1 && realsize == packagetarget->expectedsize) {
-            // File's size matches the expected one, the resume is enabled and
-            // no checksum is known => expect that the file is
-            // the one the user wants
-            g_debug("%s: Package %s is already downloaded (size matches)",
-                    __func__, packagetarget->local_path);
+        // Call end callback
+        LrEndCb end_cb = packagetarget->endcb;
+        if (end_cb)
+            end_cb(packagetarget->cbdata,
+                   LR_TRANSFER_ALREADYEXISTS,
+                   "Already downloaded");
 
-            packagetarget->err = g_string_chunk_insert(
-                                        packagetarget->chunk,
-                                        "Already downloaded");
+        return TRUE;
+    }
+
+    if (lr_packagetarget_cacheable(packagetarget)
+        && lr_package_cache_lookup(packagetarget->handle,
+                                   packagetarget->checksum_type,
+                                   packagetarget->checksum,
+                                   packagetarget->local_path))
+    {
+        lr_packagetarget_set_err(packagetarget, "Already downloaded");
+
+        // Call end callback
+        LrEndCb end_cb = packagetarget->endcb;
+        if (end_cb)
+            end_cb(packagetarget->cbdata,
+                   LR_TRANSFER_ALREADYEXISTS,
+                   "Already downloaded");
+
+        return TRUE;
+    }
+
+    GSList *checksums = NULL;
+    LrDownloadTargetChecksum *checksum;
+    checksum = lr_downloadtargetchecksum_new(packagetarget->checksum_type,
+                                             packagetarget->checksum);
+    checksums = g_slist_prepend(checksums, checksum);
+
+    *downloadtarget = lr_downloadtarget_new(packagetarget->handle,
+                                            packagetarget->relative_url,
+                                            packagetarget->base_url,
+                                            -1,
+                                            packagetarget->local_path,
+                                            checksums,
+                                            packagetarget->expectedsize,
+                                            doresume,
+                                            packagetarget->progresscb,
+                                            packagetarget->cbdata,
+                                            packagetarget->endcb,
+                                            packagetarget->mirrorfailurecb,
+                                            packagetarget,
+                                            packagetarget->byterangestart,
+                                            packagetarget->byterangeend,
+                                            NULL,
+                                            FALSE,
+                                            FALSE);
+    return TRUE;
+}
 
-            // Call end callback
-            LrEndCb end_cb = packagetarget->endcb;
-            if (end_cb)
-                end_cb(packagetarget->cbdata,
-                       LR_TRANSFER_ALREADYEXISTS,
-                       "Already downloaded");
+/** Prepare download targets of the package targets which are not
+ * downloaded yet. Remote mirrorlists and metalinks are downloaded
+ * and the fastest mirror resolving is done here.
+ * @param targets           GSList of ::LrPackageTarget objects
+ * @param downloadtargets   Prepared ::LrDownloadTarget objects are
+ *                          appended to this list (even if an error
+ *                          occurred)
+ * @param err               GError **
+ * @return                  If FALSE then err is set.
+ */
+static gboolean
+lr_prepare_packagetargets(GSList *targets,
+                          GSList **downloadtargets,
+                          GError **err)
+{
+    gboolean ret;
+
+    // Download remote mirrorlists and metalinks of all handles at once,
+    // lr_handle_prepare_internal_mirrorlist() then only parses them
+    GSList *handles = NULL;
+    for (GSList *elem = targets; elem; elem = g_slist_next(elem)) {
+        LrPackageTarget *packagetarget = elem->data;
+        if (packagetarget->handle)
+            handles = g_slist_prepend(handles, packagetarget->handle);
+    }
+    handles = g_slist_reverse(handles);
+    ret = lr_handle_prefetch_mirrorlists(handles, err);
+    g_slist_free(handles);
+    if (!ret)
+        return FALSE;
+
+    // List of handles for fastest mirror resolving
+    GSList *fmr_handles = NULL;
 
+    // Prepared targets in reversed order
+    GSList *prepared = NULL;
+
+    // Prepare targets
+    for (GSList *elem = targets; elem; elem = g_slist_next(elem)) {
+        LrPackageTarget *packagetarget = elem->data;
+        LrDownloadTarget *downloadtarget;
+
+        ret = lr_prepare_packagetarget(packagetarget, &downloadtarget, err);
+        if (!ret)
+            break;
+
+        if (!downloadtarget)  // Already downloaded
             continue;
-        }
+
+        prepared = g_slist_prepend(prepared, downloadtarget);
 
         if (packagetarget->handle) {
             ret = lr_handle_prepare_internal_mirrorlist(packagetarget->handle,
                                                         FALSE,
                                                         err);
             if (!ret)
-                goto cleanup;
+                break;
 
             if (packagetarget->handle->fastestmirror) {
                 if (!g_slist_find(fmr_handles, packagetarget->handle))
@@ -378,33 +531,14 @@ lr_download_packages(GSList *targets,
                                                   packagetarget->handle);
             }
         }
+    }
+
+    *downloadtargets = g_slist_concat(*downloadtargets,
+                                      g_slist_reverse(prepared));
 
-        GSList *checksums = NULL;
-        LrDownloadTargetChecksum *checksum;
-        checksum = lr_downloadtargetchecksum_new(packagetarget->checksum_type,
-                                                 packagetarget->checksum);
-        checksums = g_slist_prepend(checksums, checksum);
-
-        downloadtarget = lr_downloadtarget_new(packagetarget->handle,
-                                               packagetarget->relative_url,
-                                               packagetarget->base_url,
-                                               -1,
-                                               packagetarget->local_path,
-                                               checksums,
-                                               packagetarget->expectedsize,
-                                               doresume,
-                                               packagetarget->progresscb,
-                                               packagetarget->cbdata,
-                                               packagetarget->endcb,
-                                               packagetarget->mirrorfailurecb,
-                                               packagetarget,
-                                               packagetarget->byterangestart,
-                                               packagetarget->byterangeend,
-                                               NULL,
-                                               FALSE,
-                                               FALSE);
-
-        downloadtargets = g_slist_append(downloadtargets, downloadtarget);
+    if (!ret) {
+        g_slist_free(fmr_handles);
+        return FALSE;
     }
 
     // Do Fastest Mirror resolving for all handles in one shot
@@ -418,22 +552,305 @@ lr_download_packages(GSList *targets,
         }
     }
 
-    // Start downloading
-    ret = lr_download(downloadtargets, failfast, err);
+    return TRUE;
+}
 
-cleanup:
+/** Copy the download status to the package target of the download target.
+ * @param downloadtarget    ::LrDownloadTarget created by
+ *                          lr_prepare_packagetarget()
+ */
+static void
+lr_finish_packagetarget(LrDownloadTarget *downloadtarget)
+{
+    LrPackageTarget *packagetarget = downloadtarget->userdata;
+    if (downloadtarget->err)
+        lr_packagetarget_set_err(packagetarget, downloadtarget->err);
+    else if (downloadtarget->rcode == LRE_OK
+             && lr_packagetarget_cacheable(packagetarget))
+        // Downloaded and its checksum verified
+        lr_package_cache_store(packagetarget->handle,
+                               packagetarget->checksum_type,
+                               packagetarget->checksum,
+                               packagetarget->local_path);
+    if (downloadtarget->stats) {
+        // Take over the stats, the downloadtarget is freed by the caller
+        g_free(packagetarget->stats);
+        packagetarget->stats = downloadtarget->stats;
+        downloadtarget->stats = NULL;
+    }
+}
 
+/** Copy download statuses to the package targets and free the download
+ * targets.
+ * @param downloadtargets   GSList of ::LrDownloadTarget objects created
+ *                          by lr_prepare_packagetargets()
+ */
+static void
+lr_finish_packagetargets(GSList *downloadtargets)
+{
     // Copy download statuses from downloadtargets to targets
-    for (GSList *elem = downloadtargets; elem; elem = g_slist_next(elem)) {
-        LrDownloadTarget *downloadtarget = elem->data;
-        LrPackageTarget *packagetarget = downloadtarget->userdata;
-        if (downloadtarget->err)
-            packagetarget->err = g_string_chunk_insert(packagetarget->chunk,
-                                                       downloadtarget->err);
-    }
+    for (GSList *elem = downloadtargets; elem; elem = g_slist_next(elem))
+        lr_finish_packagetarget(elem->data);
 
     // Free downloadtargets list
     g_slist_free_full(downloadtargets, (GDestroyNotify)lr_downloadtarget_free);
+}
+
+gboolean
+lr_download_packages(GSList *targets,
+                     LrPackageDownloadFlag flags,
+                     GError **err)
+{
+    gboolean ret;
+    gboolean failfast = flags & LR_PACKAGEDOWNLOAD_FAILFAST;
+    struct sigaction old_sigact;
+    GSList *downloadtargets = NULL;
+    gboolean interruptible = FALSE;
+    _cleanup_trace_span_ LrTraceSpan span = LR_TRACE_SPAN_INIT(
+            "download", "lr_download_packages", NULL);
+
+    assert(!err || *err == NULL);
+
+    if (!targets)
+        return TRUE;
+
+    if (!lr_check_packagetargets(targets, &interruptible, err))
+        return FALSE;
+
+    // Setup sighandler
+    if (interruptible) {
+        struct sigaction sigact;
+        g_debug("%s: Using own SIGINT handler", __func__);
+        memset(&sigact, 0, sizeof(old_sigact));
+        memset(&sigact, 0, sizeof(sigact));
+        sigemptyset(&sigact.sa_mask);
+        sigact.sa_handler = lr_sigint_handler;
+        sigaddset(&sigact.sa_mask, SIGINT);
+        sigact.sa_flags = SA_RESTART;
+        if (sigaction(SIGINT, &sigact, &old_sigact) == -1) {
+            g_set_error(err, LR_PACKAGE_DOWNLOADER_ERROR, LRE_SIGACTION,
+                        "Cannot set Librepo SIGINT handler");
+            return FALSE;
+        }
+    }
+
+    ret = lr_prepare_packagetargets(targets, &downloadtargets, err);
+
+    // Start downloading
+    if (ret)
+        ret = lr_download(downloadtargets, failfast, err);
+
+    lr_finish_packagetargets(downloadtargets);
+
+    // Restore original signal handler
+    if (interruptible) {
+        g_debug("%s: Restoring an old SIGINT handler", __func__);
+        sigaction(SIGINT, &old_sigact, NULL);
+        if (lr_interrupt) {
+            if (err && *err != NULL)
+                g_clear_error(err);
+            g_set_error(err, LR_PACKAGE_DOWNLOADER_ERROR, LRE_INTERRUPTED,
+                        "Interrupted by a SIGINT signal");
+            return FALSE;
+        }
+    }
+
+    return ret;
+}
+
+/** Package targets pulled from a LrPackageTargetSourceCb */
+typedef struct {
+    LrPackageTargetSourceCb sourcecb; /*!<
+        Source of the package targets */
+    LrPackageTargetDoneCb donecb; /*!<
+        Called for every finished package target */
+    void *cbdata; /*!<
+        User data for the callbacks */
+    GHashTable *handles; /*!<
+        Handles whose internal mirrorlist was already prepared */
+    gboolean exhausted; /*!<
+        No more targets are pulled from the source */
+    GError *error; /*!<
+        Error which stopped pulling of the targets or NULL */
+} LrPackageSource;
+
+/** Prepare the handle of a pulled target before its first download:
+ * check it, get its internal mirrorlist and sort it if the fastest
+ * mirror is enabled.
+ */
+static gboolean
+lr_packagesource_prepare_handle(LrPackageSource *source,
+                                LrHandle *handle,
+                                GError **err)
+{
+    if (!handle || g_hash_table_contains(source->handles, handle))
+        return TRUE;
+    g_hash_table_add(source->handles, handle);
+
+    if (handle->repotype != LR_YUMREPO) {
+        g_debug("%s: Bad repo type", __func__);
+        g_set_error(err, LR_PACKAGE_DOWNLOADER_ERROR, LRE_BADFUNCARG,
+                    "Bad repo type");
+        return FALSE;
+    }
+
+    GSList handles = { handle, NULL };
+
+    if (!lr_handle_prefetch_mirrorlists(&handles, err))
+        return FALSE;
+    if (!lr_handle_prepare_internal_mirrorlist(handle, FALSE, err))
+        return FALSE;
+    if (handle->fastestmirror
+        && !lr_fastestmirror_sort_internalmirrorlists(&handles, err))
+        return FALSE;
+
+    return TRUE;
+}
+
+/** Pull package targets from the source until count download targets
+ * are prepared or the source is exhausted. Targets which don't need
+ * to be downloaded are passed to the donecb right away.
+ * @return                  GSList of new ::LrDownloadTarget objects
+ */
+static GSList *
+lr_packagesource_pull(LrPackageSource *source, guint count)
+{
+    GSList *downloadtargets = NULL;
+
+    while (count > 0 && !source->exhausted) {
+        LrPackageTarget *packagetarget = source->sourcecb(source->cbdata);
+        LrDownloadTarget *downloadtarget = NULL;
+        GError *tmp_err = NULL;
+
+        if (!packagetarget) {
+            source->exhausted = TRUE;
+            break;
+        }
+
+        if (!lr_prepare_packagetarget(packagetarget, &downloadtarget, &tmp_err)
+            || (downloadtarget
+                && !lr_packagesource_prepare_handle(source,
+                                                    packagetarget->handle,
+                                                    &tmp_err)))
+        {
+            // The error is reported when the download ends, the already
+            // pulled targets are downloaded, but no new are pulled
+            g_debug("%s: Cannot prepare %s: %s", __func__,
+                    packagetarget->relative_url, tmp_err->message);
+            lr_packagetarget_set_err(packagetarget, tmp_err->message);
+            lr_downloadtarget_free(downloadtarget);
+            source->donecb(packagetarget, source->cbdata);
+            source->error = tmp_err;
+            source->exhausted = TRUE;
+            break;
+        }
+
+        if (!downloadtarget) {
+            // Already downloaded
+            source->donecb(packagetarget, source->cbdata);
+            continue;
+        }
+
+        downloadtargets = g_slist_prepend(downloadtargets, downloadtarget);
+        count--;
+    }
+
+    return g_slist_reverse(downloadtargets);
+}
+
+/** Replace every finished download target by a new one from the source */
+static GSList *
+lr_packagesource_target_done(LrDownloadTarget *target G_GNUC_UNUSED,
+                             void *cbdata)
+{
+    return lr_packagesource_pull(cbdata, 1);
+}
+
+/** Report the released download target to the user and free it */
+static void
+lr_packagesource_target_release(LrDownloadTarget *target, void *cbdata)
+{
+    LrPackageSource *source = cbdata;
+    LrPackageTarget *packagetarget = target->userdata;
+
+    lr_finish_packagetarget(target);
+    lr_downloadtarget_free(target);
+    source->donecb(packagetarget, source->cbdata);
+}
+
+gboolean
+lr_download_packages_from_source(LrPackageTargetSourceCb sourcecb,
+                                 LrPackageTargetDoneCb donecb,
+                                 void *cbdata,
+                                 LrPackageDownloadFlag flags,
+                                 GError **err)
+{
+    gboolean ret = TRUE;
+    gboolean failfast = flags & LR_PACKAGEDOWNLOAD_FAILFAST;
+    struct sigaction old_sigact;
+    gboolean interruptible = FALSE;
+    _cleanup_trace_span_ LrTraceSpan span = LR_TRACE_SPAN_INIT(
+            "download", "lr_download_packages_from_source", NULL);
+
+    assert(sourcecb);
+    assert(donecb);
+    assert(!err || *err == NULL);
+
+    LrPackageSource source = {
+        .sourcecb = sourcecb,
+        .donecb = donecb,
+        .cbdata = cbdata,
+        .handles = g_hash_table_new(g_direct_hash, g_direct_equal),
+    };
+
+    // The downloader configuration is taken from the handle of the first
+    // target. Twice as many targets as it can download in parallel are
+    // kept in the download, every finished one is replaced by a new one.
+    GSList *targets = lr_packagesource_pull(&source, 1);
+    LrHandle *handle = targets ? ((LrDownloadTarget *) targets->data)->handle : NULL;
+    long parallel = handle ? handle->maxparalleldownloads
+                           : LRO_MAXPARALLELDOWNLOADS_DEFAULT;
+    targets = g_slist_concat(targets,
+                             lr_packagesource_pull(&source, 2 * parallel - 1));
+
+    // Setup sighandler
+    if (handle && handle->interruptible) {
+        struct sigaction sigact;
+        g_debug("%s: Using own SIGINT handler", __func__);
+        memset(&sigact, 0, sizeof(sigact));
+        sigemptyset(&sigact.sa_mask);
+        sigact.sa_handler = lr_sigint_handler;
+        sigaddset(&sigact.sa_mask, SIGINT);
+        sigact.sa_flags = SA_RESTART;
+        if (sigaction(SIGINT, &sigact, &old_sigact) == -1) {
+            g_set_error(err, LR_PACKAGE_DOWNLOADER_ERROR, LRE_SIGACTION,
+                        "Cannot set Librepo SIGINT handler");
+            for (GSList *elem = targets; elem; elem = g_slist_next(elem))
+                lr_packagesource_target_release(elem->data, &source);
+            g_slist_free(targets);
+            g_clear_error(&source.error);
+            g_hash_table_destroy(source.handles);
+            return FALSE;
+        }
+        interruptible = TRUE;
+    }
+
+    // Start downloading, the downloader releases all the targets
+    if (targets)
+        ret = lr_download_streamed(targets, failfast,
+                                   lr_packagesource_target_done,
+                                   lr_packagesource_target_release,
+                                   &source, err);
+    g_slist_free(targets);
+
+    if (source.error) {
+        if (ret)
+            g_propagate_error(err, source.error);
+        else
+            g_error_free(source.error);
+        ret = FALSE;
+    }
+    g_hash_table_destroy(source.handles);
 
     // Restore original signal handler
     if (interruptible) {
@@ -451,6 +868,107 @@ cleanup:
     return ret;
 }
 
+struct _LrPackageDownload {
+    GSList *downloadtargets; /*!<
+        Download targets of packages which weren't downloaded yet */
+    LrDownloadSession *session; /*!<
+        Session running the download, NULL once the download is finished */
+};
+
+LrPackageDownload *
+lr_package_download_new(GSList *targets,
+                        LrPackageDownloadFlag flags,
+                        GError **err)
+{
+    gboolean failfast = flags & LR_PACKAGEDOWNLOAD_FAILFAST;
+    gboolean interruptible = FALSE;
+    LrHandle *handle = NULL;
+
+    assert(!err || *err == NULL);
+
+    if (!lr_check_packagetargets(targets, &interruptible, err))
+        return NULL;
+
+    LrPackageDownload *download = lr_malloc0(sizeof(*download));
+
+    if (!lr_prepare_packagetargets(targets, &download->downloadtargets, err)) {
+        lr_finish_packagetargets(download->downloadtargets);
+        lr_free(download);
+        return NULL;
+    }
+
+    // Downloader configuration is taken from the handle of the first
+    // target, same as in lr_download_packages()
+    if (download->downloadtargets)
+        handle = ((LrDownloadTarget *) download->downloadtargets->data)->handle;
+
+    download->session = lr_download_session_new(handle, failfast, err);
+    if (!download->session) {
+        lr_finish_packagetargets(download->downloadtargets);
+        lr_free(download);
+        return NULL;
+    }
+
+    // If a target cannot be added, the session fails and the error
+    // is reported by lr_package_download_finish()
+    for (GSList *elem = download->downloadtargets; elem; elem = g_slist_next(elem))
+        if (!lr_download_session_add_target(download->session, elem->data, NULL))
+            break;
+
+    return download;
+}
+
+LrDownloadSession *
+lr_package_download_get_session(LrPackageDownload *download)
+{
+    assert(download);
+    return download->session;
+}
+
+gboolean
+lr_package_download_finish(LrPackageDownload *download, GError **err)
+{
+    gboolean ret = TRUE;
+
+    assert(download);
+    assert(!err || *err == NULL);
+
+    if (!download->session) {
+        g_set_error(err, LR_PACKAGE_DOWNLOADER_ERROR, LRE_BADFUNCARG,
+                    "Package download was already finished");
+        return FALSE;
+    }
+
+    if (!lr_download_session_is_finished(download->session))
+        lr_download_session_cancel(download->session);
+
+    const GError *session_error = lr_download_session_get_error(download->session);
+    if (session_error) {
+        g_propagate_error(err, g_error_copy(session_error));
+        ret = FALSE;
+    }
+
+    lr_download_session_free(download->session);
+    download->session = NULL;
+
+    lr_finish_packagetargets(download->downloadtargets);
+    download->downloadtargets = NULL;
+
+    return ret;
+}
+
+void
+lr_package_download_free(LrPackageDownload *download)
+{
+    if (!download)
+        return;
+
+    if (download->session)
+        lr_package_download_finish(download, NULL);
+
+    lr_free(download);
+}
+
 gboolean
 lr_download_package(LrHandle *handle,
                     const char *relative_url,
@@ -561,8 +1079,8 @@ lr_check_packages(GSList *targets,
             local_path = g_path_get_basename(packagetarget->relative_url);
         }
 
-        packagetarget->local_path = g_string_chunk_insert(packagetarget->chunk,
-                                                          local_path);
+        lr_packagetarget_take_local_path(packagetarget,
+                                         g_steal_pointer(&local_path));
 
         if (g_access(packagetarget->local_path, R_OK) == 0) {
             // If the file exists check its checksum
@@ -579,14 +1097,13 @@ lr_check_packages(GSList *targets,
                 close(fd_r);
                 if (ret && matches) {
                     // Checksum is ok
-                    packagetarget->err = NULL;
+                    lr_packagetarget_set_err(packagetarget, NULL);
                     g_debug("%s: Package %s is already downloaded (checksum matches)",
                             __func__, packagetarget->local_path);
                 } else {
                     // Checksum doesn't match or checksumming error
-                    packagetarget->err = g_string_chunk_insert(
-                                                packagetarget->chunk,
-                                                "Checksum of file doesn't match");
+                    lr_packagetarget_set_err(packagetarget,
+                                             "Checksum of file doesn't match");
                     if (failfast) {
                         ret = FALSE;
                         g_set_error(err, LR_PACKAGE_DOWNLOADER_ERROR,
@@ -597,8 +1114,7 @@ lr_check_packages(GSList *targets,
                 }
             } else {
                 // Cannot open the file
-                packagetarget->err = g_string_chunk_insert(packagetarget->chunk,
-                                       "Cannot be opened");
+                lr_packagetarget_set_err(packagetarget, "Cannot be opened");
                 if (failfast) {
                     ret = FALSE;
                     g_set_error(err, LR_PACKAGE_DOWNLOADER_ERROR, LRE_IO,
@@ -608,8 +1124,7 @@ lr_check_packages(GSList *targets,
             }
         } else {
             // File doesn't exists
-            packagetarget->err = g_string_chunk_insert(packagetarget->chunk,
-                                       "Doesn't exist");
+            lr_packagetarget_set_err(packagetarget, "Doesn't exist");
             if (failfast) {
                 ret = FALSE;
                 g_set_error(err, LR_PACKAGE_DOWNLOADER_ERROR, LRE_IO,
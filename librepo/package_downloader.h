@@ -26,6 +26,7 @@
 #include "rcodes.h"
 #include "handle.h"
 #include "checksum.h"
+#include "downloader.h"
 
 G_BEGIN_DECLS
 
@@ -123,13 +124,25 @@ typedef struct {
     // Will be filled by ::lr_download_packages()
 
     char *local_path; /*!<
-        Local path */
+        Local path (owned by the target) */
 
     char *err; /*!<
-        Error message or NULL. NULL means no error. */
+        Error message or NULL. NULL means no error.
+        (owned by the target) */
 
     GStringChunk *chunk; /*!<
-        String chunk */
+        String chunk of the dest and base_url (shared with the other
+        targets of the handle, see shared_chunk) */
+
+    LrTransferStats *stats; /*!<
+        Timing and size breakdown of the last transfer of the package
+        or NULL if no transfer was done (e.g. the package was already
+        downloaded). */
+
+    struct _LrSharedChunk *shared_chunk; /*!<
+        Internal. If the target was created with a handle, the chunk
+        is shared with the other package targets of the handle and
+        this is the reference to it. Otherwise NULL. */
 
 } LrPackageTarget;
 
@@ -275,6 +288,101 @@ lr_download_packages(GSList *targets,
                      LrPackageDownloadFlag flags,
                      GError **err);
 
+/** Source of package targets for lr_download_packages_from_source().
+ * @param cbdata            User data
+ * @return                  Next ::LrPackageTarget to download or NULL if
+ *                          there are no more targets.
+ */
+typedef LrPackageTarget *(*LrPackageTargetSourceCb)(void *cbdata);
+
+/** Called when a package target pulled from the source is finished.
+ * Its local_path, err and stats are filled the same way as by
+ * lr_download_packages(). The downloader doesn't use the target
+ * anymore, so the callback may free it.
+ * @param target            Finished package target
+ * @param cbdata            User data
+ */
+typedef void (*LrPackageTargetDoneCb)(LrPackageTarget *target, void *cbdata);
+
+/** Download package targets pulled from a source one by one.
+ * Unlike lr_download_packages() the targets don't have to be known
+ * up front. They are pulled only as the transfers finish (about twice
+ * as many as the allowed parallel downloads are queued), so the memory
+ * doesn't grow with the number of targets and the first transfer starts
+ * right after the first target is pulled.
+ * Every pulled target is passed to the donecb exactly once, also if
+ * the download fails.
+ * The downloader configuration is taken from the handle of the first
+ * target. Handles of the targets are prepared (mirrorlist download,
+ * fastest mirror sorting) when their first target is pulled.
+ * If preparation of a target fails, no more targets are pulled, the
+ * already pulled ones are downloaded and then FALSE is returned.
+ * @param sourcecb          Source of the targets
+ * @param donecb            Called for every finished target
+ * @param cbdata            User data for the callbacks
+ * @param flags             Bitfield with flags to download
+ * @param err               GError **
+ * @return                  If FALSE then err is set.
+ */
+gboolean
+lr_download_packages_from_source(LrPackageTargetSourceCb sourcecb,
+                                 LrPackageTargetDoneCb donecb,
+                                 void *cbdata,
+                                 LrPackageDownloadFlag flags,
+                                 GError **err);
+
+/** Non-blocking variant of lr_download_packages().
+ *
+ * The download runs in a ::LrDownloadSession. Drive the session
+ * (see lr_package_download_get_session()) until
+ * lr_download_session_is_finished() returns TRUE and then call
+ * lr_package_download_finish() which fills the results to the package
+ * targets the same way as lr_download_packages() does.
+ *
+ * Note: Remote mirrorlists and metalinks which were not downloaded yet
+ * and the fastest mirror resolving are still processed in a blocking
+ * way by lr_package_download_new().
+ */
+typedef struct _LrPackageDownload LrPackageDownload;
+
+/** Start non-blocking download of all LrPackageTargets at the targets
+ * GSList. The targets must not be freed before the download is finished.
+ * @param targets           GSList where each element is a ::LrPackageTarget
+ *                          object
+ * @param flags             Bitfield with flags to download
+ * @param err               GError **
+ * @return                  New package download or NULL if err is set.
+ */
+LrPackageDownload *
+lr_package_download_new(GSList *targets,
+                        LrPackageDownloadFlag flags,
+                        GError **err);
+
+/** Get the session which runs the download. Don't add own targets to it
+ * and don't free it.
+ * @param download          Package download
+ * @return                  Download session or NULL if the download
+ *                          was already finished.
+ */
+LrDownloadSession *
+lr_package_download_get_session(LrPackageDownload *download);
+
+/** Finish the download and fill the results to the package targets.
+ * If the session is still running, it is cancelled.
+ * @param download          Package download
+ * @param err               GError **
+ * @return                  Same as lr_download_packages() - if FALSE
+ *                          then err is set.
+ */
+gboolean
+lr_package_download_finish(LrPackageDownload *download, GError **err);
+
+/** Free the download. If it wasn't finished yet, it is cancelled.
+ * @param download          Package download
+ */
+void
+lr_package_download_free(LrPackageDownload *download);
+
 typedef enum {
     LR_PACKAGECHECK_FAILFAST    = 1 << 0, /*!<
         If TRUE, then whole check is stoped immediately when any
@@ -418,6 +418,102 @@ Version contants
     *Boolean* If enabled, librepo will try to keep timestamps of the downloaded files
     in sync with that on the remote side.
 
+.. data:: LRO_CONDITIONALREFRESH
+
+    *Boolean* If enabled, validators (ETag, Last-Modified) of repomd.xml
+    are stored in the :data:`.LRO_DESTDIR` and the next download into
+    the same :data:`.LRO_DESTDIR` asks the server for repomd.xml only
+    if it was modified. If it wasn't, the repository already present in
+    the :data:`.LRO_DESTDIR` is used and nothing else is downloaded.
+    If a metalink is used and repomd.xml in the :data:`.LRO_DESTDIR`
+    matches its checksum, even the request for repomd.xml is skipped.
+    Only :meth:`~.Handle.perform` supports this option,
+    :func:`~librepo.download_metadata` ignores it and always downloads
+    the whole repository.
+
+.. data:: LRO_DECOMPRESS
+
+    *Boolean* If enabled, compressed metadata files (.gz, .bz2, .xz, .zst)
+    are decompressed right after they are downloaded and the uncompressed
+    files are stored next to them. If :data:`.LR_CHECK_CHECKSUM` is set,
+    their open-checksum from repomd.xml is verified. Paths of
+    the uncompressed files are available in the ``yum_repo`` result
+    under ``<type>_open`` keys (e.g. ``primary_open``). Zchunk files are
+    not decompressed.
+
+.. data:: LRO_PROGRESSINTERVAL
+
+    *Integer or None*. Minimal interval in milliseconds between two calls
+    of the same progress callback (:data:`.LRO_PROGRESSCB`,
+    :data:`.LRO_TOTALPROGRESSCB` and progress callbacks of the targets).
+    Progress reported meanwhile is aggregated in the library and only
+    the latest state is passed to the callback, so the callback doesn't
+    need to take the GIL for every tick of a fast download. The first
+    call and the call reporting a finished download are always done.
+    0 (default) means no limit.
+
+.. data:: LRO_PROGRESSBYTES
+
+    *Integer or None*. Minimal number of bytes downloaded between two calls
+    of the same progress callback. Limits the same callbacks as
+    :data:`.LRO_PROGRESSINTERVAL` does. If both are set, a callback
+    is called only when both limits are crossed. 0 (default) means no limit.
+
+.. data:: LRO_TOTALPROGRESSCB
+
+    *Function or None*. Progress callback of the whole download.
+    It has the same format as the :data:`.LRO_PROGRESSCB` but it reports
+    summarized progress of all targets downloaded together (e.g. all
+    packages passed to :func:`~librepo.download_packages`). When targets
+    of more handles are downloaded together, the callback of the handle
+    of the first target is used. The total size grows as the sizes of
+    the targets are discovered.
+
+.. data:: LRO_TOTALPROGRESSDATA
+
+    *Any object*. Set user data for the :data:`.LRO_TOTALPROGRESSCB`.
+
+.. data:: LRO_TRACEFILE
+
+    *String or None*. If set, spans of the operations done by librepo
+    (mirrorlist and metalink fetching, fastest mirror detection,
+    transfers, checksum and GPG verification, zchunk processing, ...)
+    are recorded and written to this file in the Chrome trace-event JSON
+    format (viewable by chrome://tracing or Perfetto) when the handle
+    is freed. The trace is shared by the whole process; while it is
+    recorded, spans of all handles are included and other filenames are
+    refused (:class:`.LibrepoException` is raised). The default value is taken from the *LIBREPO_TRACE*
+    environment variable.
+
+.. data:: LRO_PACKAGECACHE
+
+    *Boolean* If enabled and :data:`.LRO_CACHEDIR` is set, packages with
+    a known checksum are kept in a content-addressed store in the
+    ``packages`` subdirectory of the :data:`.LRO_CACHEDIR`. Before
+    a package is downloaded, the store is searched and if the package
+    is there (and its checksum matches), it is hard-linked (or reflinked
+    or copied) to the destination instead of being downloaded.
+    Downloaded and verified packages are added to the store. Handles
+    with the same :data:`.LRO_CACHEDIR` share the store.
+
+.. data:: LRO_DROPPAGECACHE
+
+    *Boolean* If enabled, the writeback of downloaded data is started
+    while the file is being written and once the file is downloaded and
+    verified, its data are dropped from the page cache. Useful for bulk
+    downloads (e.g. mirroring) which shouldn't evict more useful data
+    from the memory.
+
+.. data:: LRO_LOCKTIMEOUT
+
+    *Integer or None*. Maximal time in seconds to wait for a target
+    file which is locked by another process (which is probably
+    downloading it). When the time runs out, the target fails.
+    0 means the target fails right away if its file is locked.
+    Default is 30 seconds. Note: While only such waiting targets are
+    left, blocking downloads sleep until the lock is released or the
+    time runs out.
+
 .. _handle-info-options-label:
 
 :class:`~.Handle` info options
@@ -472,6 +568,25 @@ Version contants
 .. data:: LRI_HTTPAUTHMETHODS
 .. data:: LRI_PROXYAUTHMETHODS
 .. data:: LRI_FTPUSEEPSV
+.. data:: LRI_CONDITIONALREFRESH
+.. data:: LRI_DECOMPRESS
+.. data:: LRI_PROGRESSINTERVAL
+.. data:: LRI_PROGRESSBYTES
+.. data:: LRI_TOTALPROGRESSCB
+.. data:: LRI_TOTALPROGRESSDATA
+.. data:: LRI_TRACEFILE
+.. data:: LRI_PACKAGECACHE
+.. data:: LRI_DROPPAGECACHE
+.. data:: LRI_LOCKTIMEOUT
+.. data:: LRI_STATS
+
+    *Dict*. Statistics of all downloads done with targets of the handle
+    since it was created (or since :meth:`~.Handle.clear_stats`). Keys are
+    ``transfers``, ``failed_transfers``, ``retries``, ``bytes_downloaded``,
+    ``reused_connections``, ``notmodified``, ``checksum_checks``,
+    ``checksum_cache_hits``, ``checksum_failures``, ``zck_bytes_reused``,
+    ``zck_bytes_downloaded`` and ``mirrors``. ``mirrors`` maps URL of every
+    used mirror to a dict with ``transfers``, ``failures`` and ``bytes``.
 
 .. _proxy-type-label:
 
@@ -799,6 +914,10 @@ LibRepo Error codes.
 
     (35) Interrupted by user cb.
 
+.. data:: LRE_DECOMPRESS
+
+    (42) Decompression error.
+
 .. data:: LRE_UNKNOWNERROR
 
     An unknown error.
@@ -1183,6 +1302,20 @@ class PackageTarget(_librepo.PackageTarget):
     """
     Represent a single package that will be downloaded by
     :func:`~librepo.download_packages`.
+
+    After the download, *local_path* contains the path of the downloaded
+    file, *err* the error message or *None*, and *stats* the timing and
+    size breakdown of the last transfer of the package (or *None* if no
+    transfer was done). *stats* is a dict with these keys:
+
+    * ``namelookup_time``, ``connect_time``, ``appconnect_time`` (TLS
+      handshake), ``pretransfer_time``, ``starttransfer_time`` (first byte),
+      ``redirect_time`` and ``total_time`` - Seconds since the start of
+      the transfer
+    * ``downloaded`` - Number of downloaded bytes
+    * ``speed`` - Average download speed in bytes per second
+    * ``http_version`` - 10, 11, 20, 30 or 0 if unknown (not HTTP)
+    * ``reused`` - *True* if an already opened connection was reused
     """
 
     def __init__(self, relative_url, dest=None, checksum_type=CHECKSUM_UNKNOWN,
@@ -1483,6 +1616,50 @@ class Handle(_librepo.Handle):
 
         See :data:`.LRO_PRESERVETIME`
 
+    .. attribute:: conditionalrefresh
+
+        See :data:`.LRO_CONDITIONALREFRESH`
+
+    .. attribute:: decompress
+
+        See :data:`.LRO_DECOMPRESS`
+
+    .. attribute:: progressinterval
+
+        See :data:`.LRO_PROGRESSINTERVAL`
+
+    .. attribute:: progressbytes
+
+        See :data:`.LRO_PROGRESSBYTES`
+
+    .. attribute:: totalprogresscb
+
+        See :data:`.LRO_TOTALPROGRESSCB`
+
+    .. attribute:: totalprogressdata
+
+        See :data:`.LRO_TOTALPROGRESSDATA`
+
+    .. attribute:: tracefile
+
+        See :data:`.LRO_TRACEFILE`
+
+    .. attribute:: packagecache
+
+        See :data:`.LRO_PACKAGECACHE`
+
+    .. attribute:: droppagecache
+
+        See :data:`.LRO_DROPPAGECACHE`
+
+    .. attribute:: locktimeout
+
+        See :data:`.LRO_LOCKTIMEOUT`
+
+    .. attribute:: stats
+
+        See :data:`.LRI_STATS` (read only)
+
     """
 
     def setopt(self, option, val):
@@ -1532,6 +1709,22 @@ class Handle(_librepo.Handle):
         """
         return _librepo.Handle.getinfo(self, option)
 
+    def clear_stats(self):
+        """Reset statistics of the :class:`.Handle` (see :data:`.LRI_STATS`)."""
+        _librepo.Handle.clear_stats(self)
+
+    def write_stats_prometheus(self, filename, labels=None):
+        """Write statistics of the :class:`.Handle` (see :data:`.LRI_STATS`)
+        to the file in the Prometheus text exposition format, e.g. for
+        the textfile collector of the node exporter. The file is replaced
+        atomically.
+
+        :param filename: Destination file
+        :param labels: Extra labels added to every sample, e.g.
+                       ``'repo="fedora"'``, or *None*
+        """
+        _librepo.Handle.write_stats_prometheus(self, filename, labels)
+
     def download(self, url, dest=None, checksum_type=CHECKSUM_UNKNOWN,
                  checksum=None, expectedsize=0, base_url=None, resume=0):
         """
@@ -1700,6 +1893,114 @@ def download_url(url, fd, handle=None):
     """
     return _librepo.download_url(handle, url, fd)
 
+async def _run_download_session(session):
+    """
+    Drive the :class:`~librepo._librepo.DownloadSession` by the running
+    asyncio event loop until it is finished and return result of its
+    *finish()* method.
+    """
+    # Imported here, the synchronous API doesn't need asyncio at all
+    import asyncio
+
+    loop = asyncio.get_running_loop()
+    ready = []
+    wakeup = None
+
+    def _wake_up(event=None):
+        if event:
+            ready.append(event)
+        if not wakeup.done():
+            wakeup.set_result(None)
+
+    try:
+        while not session.is_finished():
+            timeout = session.timeout()
+            if timeout == 0:
+                session.step()
+                # Let the other tasks run
+                await asyncio.sleep(0)
+                continue
+
+            # Sockets of the session change with every step,
+            # so they are registered only for one wait
+            fds = session.fds()
+            wakeup = loop.create_future()
+            for fd, readable, writable in fds:
+                if readable:
+                    loop.add_reader(fd, _wake_up, (fd, True, False))
+                if writable:
+                    loop.add_writer(fd, _wake_up, (fd, False, True))
+            timer = None
+            if timeout is not None:
+                timer = loop.call_later(timeout, _wake_up)
+
+            try:
+                await wakeup
+            finally:
+                for fd, readable, writable in fds:
+                    if readable:
+                        loop.remove_reader(fd)
+                    if writable:
+                        loop.remove_writer(fd)
+                if timer:
+                    timer.cancel()
+
+            events = ready[:]
+            del ready[:]
+            if not events:
+                # Timeout expired
+                session.step()
+            for fd, readable, writable in events:
+                session.step(fd, readable, writable)
+    finally:
+        # Cancelled task or an exception raised by a callback
+        if not session.is_finished():
+            session.cancel()
+
+    return session.finish()
+
+async def download_metadata_async(list):
+    """
+    Asynchronous (asyncio) variant of :func:`~librepo.download_metadata`.
+
+    The download doesn't block the running event loop (nor it uses
+    any thread), so many downloads could run concurrently on one loop.
+    Callbacks of the targets are called from the event loop thread.
+    If the task is cancelled, the download is stopped.
+
+    Note: Mirrorlists and metalinks of the handles with
+    :data:`.LRO_FASTESTMIRROR` and the fastest mirror resolving are
+    still processed in a blocking way when the download starts.
+
+    :param list: List of :class:`~.librepo.MetadataTarget` objects.
+    :returns: *None*
+    """
+    session = _librepo.download_metadata_start(list)
+    return await _run_download_session(session)
+
+async def download_packages_async(list, failfast=False):
+    """
+    Asynchronous (asyncio) variant of :func:`~librepo.download_packages`.
+
+    The download doesn't block the running event loop (nor it uses
+    any thread), so many downloads could run concurrently on one loop.
+    Callbacks of the targets are called from the event loop thread.
+    If the task is cancelled, the download is stopped.
+
+    Note: Mirrorlists and metalinks of the handles which were not
+    downloaded yet (e.g. by a previous metadata download with the same
+    handle) and the fastest mirror resolving are still processed
+    in a blocking way when the download starts.
+
+    :param list: List of :class:`~.librepo.PackageTarget` objects.
+    :param failfast: If *True*, stop whole downloading immediately when any
+                     of downloads fails. If *False*, ignore failed download(s)
+                     and continue with other downloads.
+    :returns: *None*
+    """
+    session = _librepo.download_packages_start(list, failfast)
+    return await _run_download_session(session)
+
 def yum_repomd_get_age(result_object):
     """
     Get the highest timestamp of the repo's repomd.xml.
@@ -0,0 +1,514 @@
+/* librepo - A library providing (libcURL like) API to downloading repository
+ * Copyright (C) 2026  agent
+ *
+ * Licensed under the GNU Lesser General Public License Version 2.1
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <Python.h>
+#undef NDEBUG
+#include <assert.h>
+
+#include "librepo/librepo.h"
+
+#include "downloadsession-py.h"
+#include "packagetarget-py.h"
+#include "metadatatarget-py.h"
+#include "exception-py.h"
+#include "downloader-py.h"
+#include "globalstate-py.h" // GIL Hack
+
+typedef struct {
+    PyObject_HEAD
+    LrPackageDownload *packagedownload;
+    LrMetadataDownload *metadatadownload;
+    /* Targets */
+    GSList *targets;        // LrPackageTarget or LrMetadataTarget objects
+    PyObject *py_targets;   // Their python objects
+    /* GIL Stuff */
+    PyThreadState *state;
+} _DownloadSessionObject;
+
+static LrDownloadSession *
+get_session(_DownloadSessionObject *self)
+{
+    if (self->packagedownload)
+        return lr_package_download_get_session(self->packagedownload);
+    if (self->metadatadownload)
+        return lr_metadata_download_get_session(self->metadatadownload);
+    return NULL;
+}
+
+static int
+check_DownloadSessionStatus(_DownloadSessionObject *self)
+{
+    assert(self != NULL);
+    assert(DownloadSessionObject_Check(self));
+    if (get_session(self) == NULL) {
+        PyErr_SetString(LrErr_Exception, "Download was already finished");
+        return -1;
+    }
+    return 0;
+}
+
+/* Librepo functions are called with released GIL,
+ * callbacks of the targets take it back by the self->state.
+ * The targets (and their handles, which can be shared by more
+ * sessions) point to the state only during the call.
+ */
+
+static void
+session_set_thread_state(_DownloadSessionObject *self, PyThreadState **state)
+{
+    if (!self->py_targets)
+        return;
+
+    Py_ssize_t len = PyList_Size(self->py_targets);
+    for (Py_ssize_t x=0; x < len; x++) {
+        PyObject *py_target = PyList_GetItem(self->py_targets, x);
+        if (PackageTargetObject_Check(py_target))
+            PackageTarget_SetThreadState(py_target, state);
+        else if (MetadataTargetObject_Check(py_target))
+            MetadataTarget_SetThreadState(py_target, state);
+    }
+}
+
+static int
+session_allow_threads_begin(_DownloadSessionObject *self)
+{
+    // XXX: GIL Hack
+    int hack_rc = gil_logger_hack_begin(&self->state);
+    if (hack_rc == GIL_HACK_ERROR)
+        return hack_rc;
+
+    session_set_thread_state(self, &self->state);
+    BeginAllowThreads(&self->state);
+    return hack_rc;
+}
+
+static gboolean
+session_allow_threads_end(_DownloadSessionObject *self, int hack_rc)
+{
+    EndAllowThreads(&self->state);
+    session_set_thread_state(self, NULL);
+
+    // XXX: GIL Hack
+    return gil_logger_hack_end(hack_rc);
+}
+
+/* Function on the type */
+
+static PyObject *
+downloadsession_new(PyTypeObject *type,
+                    G_GNUC_UNUSED PyObject *args,
+                    G_GNUC_UNUSED PyObject *kwds)
+{
+    _DownloadSessionObject *self = (_DownloadSessionObject *)type->tp_alloc(type, 0);
+    if (self) {
+        self->packagedownload = NULL;
+        self->metadatadownload = NULL;
+        self->targets = NULL;
+        self->py_targets = NULL;
+        self->state = NULL;
+    }
+    return (PyObject *)self;
+}
+
+static void
+downloadsession_dealloc(_DownloadSessionObject *o)
+{
+    PyObject *type, *value, *traceback;
+
+    // Running transfers are cancelled and end callbacks of their
+    // targets are called, keep the current exception (if any) aside
+    PyErr_Fetch(&type, &value, &traceback);
+
+    if (get_session(o)) {
+        int hack_rc = session_allow_threads_begin(o);
+        if (hack_rc == GIL_HACK_ERROR) {
+            PyErr_Clear();
+        } else {
+            if (o->packagedownload)
+                lr_package_download_finish(o->packagedownload, NULL);
+            if (o->metadatadownload)
+                lr_metadata_download_finish(o->metadatadownload, NULL);
+            if (!session_allow_threads_end(o, hack_rc))
+                PyErr_Clear();
+        }
+    }
+
+    PyErr_Restore(type, value, traceback);
+
+    if (o->packagedownload)
+        lr_package_download_free(o->packagedownload);
+    if (o->metadatadownload)
+        lr_metadata_download_free(o->metadatadownload);
+    g_slist_free(o->targets);
+    Py_XDECREF(o->py_targets);
+    Py_TYPE(o)->tp_free(o);
+}
+
+static PyObject *
+fds(_DownloadSessionObject *self, G_GNUC_UNUSED PyObject *noarg)
+{
+    guint nfds = 0;
+    GPollFD *pollfds = NULL;
+
+    if (check_DownloadSessionStatus(self))
+        return NULL;
+
+    pollfds = lr_download_session_get_fds(get_session(self), &nfds);
+
+    PyObject *list = PyList_New(0);
+    if (!list) {
+        g_free(pollfds);
+        return NULL;
+    }
+
+    for (guint x = 0; x < nfds; x++) {
+        PyObject *tuple = Py_BuildValue("(iOO)",
+                pollfds[x].fd,
+                (pollfds[x].events & G_IO_IN) ? Py_True : Py_False,
+                (pollfds[x].events & G_IO_OUT) ? Py_True : Py_False);
+        if (!tuple || PyList_Append(list, tuple) == -1) {
+            Py_XDECREF(tuple);
+            Py_DECREF(list);
+            g_free(pollfds);
+            return NULL;
+        }
+        Py_DECREF(tuple);
+    }
+
+    g_free(pollfds);
+    return list;
+}
+
+static PyObject *
+timeout(_DownloadSessionObject *self, G_GNUC_UNUSED PyObject *noarg)
+{
+    LrDownloadSession *session = get_session(self);
+
+    if (!session)
+        Py_RETURN_NONE;
+
+    long timeout_ms = lr_download_session_get_timeout(session);
+    if (timeout_ms < 0)
+        Py_RETURN_NONE;
+
+    return PyFloat_FromDouble(timeout_ms / 1000.0);
+}
+
+static PyObject *
+step(_DownloadSessionObject *self, PyObject *args)
+{
+    int fd = -1;
+    int readable = 0, writable = 0;
+    GIOCondition condition = 0;
+
+    if (!PyArg_ParseTuple(args, "|ipp:step", &fd, &readable, &writable))
+        return NULL;
+    if (check_DownloadSessionStatus(self))
+        return NULL;
+
+    if (readable)
+        condition |= G_IO_IN;
+    if (writable)
+        condition |= G_IO_OUT;
+
+    int hack_rc = session_allow_threads_begin(self);
+    if (hack_rc == GIL_HACK_ERROR)
+        return NULL;
+
+    // Error of a failed session is reported by finish()
+    lr_download_session_step(get_session(self), fd, condition, NULL);
+
+    if (!session_allow_threads_end(self, hack_rc))
+        return NULL;
+
+    if (PyErr_Occurred())
+        // Python exception occurred (in a python callback probably)
+        return NULL;
+
+    Py_RETURN_NONE;
+}
+
+static PyObject *
+is_finished(_DownloadSessionObject *self, G_GNUC_UNUSED PyObject *noarg)
+{
+    LrDownloadSession *session = get_session(self);
+
+    if (!session || lr_download_session_is_finished(session))
+        Py_RETURN_TRUE;
+    Py_RETURN_FALSE;
+}
+
+static PyObject *
+cancel(_DownloadSessionObject *self, G_GNUC_UNUSED PyObject *noarg)
+{
+    LrDownloadSession *session = get_session(self);
+
+    if (!session)
+        Py_RETURN_NONE;
+
+    int hack_rc = session_allow_threads_begin(self);
+    if (hack_rc == GIL_HACK_ERROR)
+        return NULL;
+
+    lr_download_session_cancel(session);
+
+    if (!session_allow_threads_end(self, hack_rc))
+        return NULL;
+
+    Py_RETURN_NONE;
+}
+
+static PyObject *
+finish(_DownloadSessionObject *self, G_GNUC_UNUSED PyObject *noarg)
+{
+    gboolean ret;
+    GError *tmp_err = NULL;
+
+    if (check_DownloadSessionStatus(self))
+        return NULL;
+
+    int hack_rc = session_allow_threads_begin(self);
+    if (hack_rc == GIL_HACK_ERROR)
+        return NULL;
+
+    if (self->packagedownload)
+        ret = lr_package_download_finish(self->packagedownload, &tmp_err);
+    else
+        ret = lr_metadata_download_finish(self->metadatadownload, &tmp_err);
+
+    if (!session_allow_threads_end(self, hack_rc)) {
+        g_clear_error(&tmp_err);
+        return NULL;
+    }
+
+    assert((ret && !tmp_err) || (!ret && tmp_err));
+
+    if (ret)
+        Py_RETURN_NONE; // All fine - Return None
+
+    // Error occurred
+    if (PyErr_Occurred()) {
+        // Python exception occurred (in a python callback probably)
+        g_error_free(tmp_err);
+        return NULL;
+    } else {
+        // Return exception created from GError
+        RETURN_ERROR(&tmp_err, -1, NULL);
+    }
+}
+
+static struct PyMethodDef downloadsession_methods[] = {
+    { "fds",            (PyCFunction)fds,           METH_NOARGS, NULL },
+    { "timeout",        (PyCFunction)timeout,       METH_NOARGS, NULL },
+    { "step",           (PyCFunction)step,          METH_VARARGS, NULL },
+    { "is_finished",    (PyCFunction)is_finished,   METH_NOARGS, NULL },
+    { "cancel",         (PyCFunction)cancel,        METH_NOARGS, NULL },
+    { "finish",         (PyCFunction)finish,        METH_NOARGS, NULL },
+    { NULL }
+};
+
+/* Object definition */
+
+PyTypeObject DownloadSession_Type = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    "_librepo.DownloadSession",     /* tp_name */
+    sizeof(_DownloadSessionObject), /* tp_basicsize */
+    0,                              /* tp_itemsize */
+    (destructor) downloadsession_dealloc,/* tp_dealloc */
+    0,                              /* tp_print */
+    0,                              /* tp_getattr */
+    0,                              /* tp_setattr */
+    0,                              /* tp_compare */
+    0,                              /* tp_repr */
+    0,                              /* tp_as_number */
+    0,                              /* tp_as_sequence */
+    0,                              /* tp_as_mapping */
+    0,                              /* tp_hash */
+    0,                              /* tp_call */
+    0,                              /* tp_str */
+    0,                              /* tp_getattro */
+    0,                              /* tp_setattro */
+    0,                              /* tp_as_buffer */
+    Py_TPFLAGS_DEFAULT,             /* tp_flags */
+    "DownloadSession object",       /* tp_doc */
+    0,                              /* tp_traverse */
+    0,                              /* tp_clear */
+    0,                              /* tp_richcompare */
+    0,                              /* tp_weaklistoffset */
+    0,                              /* tp_iter */
+    0,                              /* tp_iternext */
+    downloadsession_methods,        /* tp_methods */
+    0,                              /* tp_members */
+    0,                              /* tp_getset */
+    0,                              /* tp_base */
+    0,                              /* tp_dict */
+    0,                              /* tp_descr_get */
+    0,                              /* tp_descr_set */
+    0,                              /* tp_dictoffset */
+    0,                              /* tp_init */
+    0,                              /* tp_alloc */
+    0,                              /* tp_new */
+    0,                              /* tp_free */
+    0,                              /* tp_is_gc */
+};
+
+/* Module functions which start the downloads */
+
+static _DownloadSessionObject *
+downloadsession_alloc(PyObject *py_list)
+{
+    _DownloadSessionObject *self;
+
+    self = (_DownloadSessionObject *) downloadsession_new(&DownloadSession_Type,
+                                                          NULL, NULL);
+    if (!self)
+        return NULL;
+
+    Py_INCREF(py_list);
+    self->py_targets = py_list;
+    return self;
+}
+
+static PyObject *
+downloadsession_start_failed(_DownloadSessionObject *self, GError **err)
+{
+    Py_DECREF(self);
+
+    if (PyErr_Occurred()) {
+        // Python exception occurred (in a python callback probably)
+        g_clear_error(err);
+        return NULL;
+    }
+    RETURN_ERROR(err, -1, NULL);
+}
+
+PyObject *
+py_download_packages_start(G_GNUC_UNUSED PyObject *self, PyObject *args)
+{
+    PyObject *py_list;
+    int failfast;
+    LrPackageDownloadFlag flags = 0;
+    GError *tmp_err = NULL;
+    _DownloadSessionObject *session;
+
+    if (!PyArg_ParseTuple(args, "O!i:download_packages_start",
+                          &PyList_Type, &py_list, &failfast))
+        return NULL;
+
+    // Copy the list, the targets must live as long as the session
+    py_list = PyList_GetSlice(py_list, 0, PyList_Size(py_list));
+    if (!py_list)
+        return NULL;
+
+    session = downloadsession_alloc(py_list);
+    Py_DECREF(py_list);
+    if (!session)
+        return NULL;
+
+    // Convert python list to GSList
+    Py_ssize_t len = PyList_Size(py_list);
+    for (Py_ssize_t x=0; x < len; x++) {
+        PyObject *py_packagetarget = PyList_GetItem(py_list, x);
+        LrPackageTarget *target = PackageTarget_FromPyObject(py_packagetarget);
+        if (!target) {
+            Py_DECREF(session);
+            return NULL;
+        }
+        session->targets = g_slist_append(session->targets, target);
+    }
+
+    if (failfast)
+        flags |= LR_PACKAGEDOWNLOAD_FAILFAST;
+
+    int hack_rc = session_allow_threads_begin(session);
+    if (hack_rc == GIL_HACK_ERROR) {
+        Py_DECREF(session);
+        return NULL;
+    }
+
+    session->packagedownload = lr_package_download_new(session->targets,
+                                                       flags,
+                                                       &tmp_err);
+
+    if (!session_allow_threads_end(session, hack_rc)) {
+        g_clear_error(&tmp_err);
+        Py_DECREF(session);
+        return NULL;
+    }
+
+    if (!session->packagedownload)
+        return downloadsession_start_failed(session, &tmp_err);
+
+    return (PyObject *) session;
+}
+
+PyObject *
+py_download_metadata_start(G_GNUC_UNUSED PyObject *self, PyObject *args)
+{
+    PyObject *py_list;
+    GError *tmp_err = NULL;
+    _DownloadSessionObject *session;
+
+    if (!PyArg_ParseTuple(args, "O!:download_metadata_start",
+                          &PyList_Type, &py_list))
+        return NULL;
+
+    // Copy the list, the targets must live as long as the session
+    py_list = PyList_GetSlice(py_list, 0, PyList_Size(py_list));
+    if (!py_list)
+        return NULL;
+
+    session = downloadsession_alloc(py_list);
+    Py_DECREF(py_list);
+    if (!session)
+        return NULL;
+
+    // Convert python list to GSList
+    Py_ssize_t len = PyList_Size(py_list);
+    for (Py_ssize_t x=0; x < len; x++) {
+        PyObject *py_metadatatarget = PyList_GetItem(py_list, x);
+        LrMetadataTarget *target = MetadataTarget_FromPyObject(py_metadatatarget);
+        if (!target) {
+            Py_DECREF(session);
+            return NULL;
+        }
+        session->targets = g_slist_append(session->targets, target);
+    }
+
+    int hack_rc = session_allow_threads_begin(session);
+    if (hack_rc == GIL_HACK_ERROR) {
+        Py_DECREF(session);
+        return NULL;
+    }
+
+    session->metadatadownload = lr_metadata_download_new(session->targets,
+                                                         &tmp_err);
+
+    if (!session_allow_threads_end(session, hack_rc)) {
+        g_clear_error(&tmp_err);
+        Py_DECREF(session);
+        return NULL;
+    }
+
+    if (!session->metadatadownload)
+        return downloadsession_start_failed(session, &tmp_err);
+
+    return (PyObject *) session;
+}
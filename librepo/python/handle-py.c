@@ -43,6 +43,8 @@ typedef struct {
     PyObject *fastestmirror_cb;
     PyObject *fastestmirror_cb_data;
     PyObject *hmf_cb;
+    PyObject *total_progress_cb;
+    PyObject *total_progress_cb_data;
     /* GIL stuff */
     // See: http://docs.python.org/2/c-api/init.html#releasing-the-gil-from-extension-code
     PyThreadState **state;
@@ -123,6 +125,49 @@ progress_callback(void *data, double total_to_download, double now_downloaded)
     return ret;
 }
 
+static int
+total_progress_callback(void *data, double total_to_download, double now_downloaded)
+{
+    int ret = LR_CB_OK; // Assume everything will be ok
+    _HandleObject *self;
+    PyObject *user_data, *result;
+
+    self = (_HandleObject *)data;
+    if (!self->total_progress_cb)
+        return LR_CB_OK;
+
+    if (self->total_progress_cb_data)
+        user_data = self->total_progress_cb_data;
+    else
+        user_data = Py_None;
+
+    EndAllowThreads(self->state);
+    result = PyObject_CallFunction(self->total_progress_cb,
+                        "(Odd)", user_data, total_to_download, now_downloaded);
+
+    if (!result) {
+        // Exception raised in callback leads to the abortion
+        // of whole downloading (it is considered fatal)
+        ret = LR_CB_ERROR;
+    } else {
+        if (result == Py_None) {
+            // Assume that None means that everything is ok
+            ret = LR_CB_OK;
+        } else if (PyLong_Check(result)) {
+            ret = (int) PyLong_AsLong(result);
+        } else {
+            // It's an error if result is None neither int
+            PyErr_SetString(PyExc_TypeError, "Progress callback must return integer number");
+            ret = LR_CB_ERROR;
+        }
+    }
+
+    Py_XDECREF(result);
+    BeginAllowThreads(self->state);
+
+    return ret;
+}
+
 static void
 fastestmirror_callback(void *data, LrFastestMirrorStages stage, void *ptr)
 {
@@ -236,6 +281,8 @@ handle_new(PyTypeObject *type,
         self->fastestmirror_cb = NULL;
         self->fastestmirror_cb_data = NULL;
         self->hmf_cb = NULL;
+        self->total_progress_cb = NULL;
+        self->total_progress_cb_data = NULL;
         self->state = NULL;
     }
     return (PyObject *)self;
@@ -268,6 +315,8 @@ handle_dealloc(_HandleObject *o)
     Py_XDECREF(o->fastestmirror_cb);
     Py_XDECREF(o->fastestmirror_cb_data);
     Py_XDECREF(o->hmf_cb);
+    Py_XDECREF(o->total_progress_cb);
+    Py_XDECREF(o->total_progress_cb_data);
     Py_TYPE(o)->tp_free(o);
 }
 
@@ -306,6 +355,7 @@ py_setopt(_HandleObject *self, PyObject *args)
     case LRO_PROXY_SSLCLIENTKEY:
     case LRO_PROXY_SSLCACERT:
     case LRO_CACHEDIR:
+    case LRO_TRACEFILE:
     {
         char *str = NULL, *alloced = NULL;
 
@@ -375,6 +425,10 @@ py_setopt(_HandleObject *self, PyObject *args)
     case LRO_ADAPTIVEMIRRORSORTING:
     case LRO_FTPUSEEPSV:
     case LRO_PRESERVETIME:
+    case LRO_CONDITIONALREFRESH:
+    case LRO_DECOMPRESS:
+    case LRO_PACKAGECACHE:
+    case LRO_DROPPAGECACHE:
     case LRO_OFFLINE:
     {
         long d;
@@ -415,6 +469,9 @@ py_setopt(_HandleObject *self, PyObject *args)
     case LRO_LOWSPEEDLIMIT:
     case LRO_IPRESOLVE:
     case LRO_ALLOWEDMIRRORFAILURES:
+    case LRO_PROGRESSINTERVAL:
+    case LRO_PROGRESSBYTES:
+    case LRO_LOCKTIMEOUT:
     {
         int badarg = 0;
         long d;
@@ -442,6 +499,15 @@ py_setopt(_HandleObject *self, PyObject *args)
             case LRO_ALLOWEDMIRRORFAILURES:
                 d = LRO_ALLOWEDMIRRORFAILURES_DEFAULT;
                 break;
+            case LRO_PROGRESSINTERVAL:
+                d = LRO_PROGRESSINTERVAL_DEFAULT;
+                break;
+            case LRO_PROGRESSBYTES:
+                d = LRO_PROGRESSBYTES_DEFAULT;
+                break;
+            case LRO_LOCKTIMEOUT:
+                d = LRO_LOCKTIMEOUT_DEFAULT;
+                break;
             default:
                 badarg = 1;
             }
@@ -765,6 +831,40 @@ py_setopt(_HandleObject *self, PyObject *args)
         break;
     }
 
+    case LRO_TOTALPROGRESSCB: {
+        if (!PyCallable_Check(obj) && obj != Py_None) {
+            PyErr_SetString(PyExc_TypeError, "Only callable argument or None is supported with this option");
+            return NULL;
+        }
+
+        Py_XDECREF(self->total_progress_cb);
+        if (obj == Py_None) {
+            // None object
+            self->total_progress_cb = NULL;
+            res = lr_handle_setopt(self->handle,
+                                   &tmp_err,
+                                   (LrHandleOption)option,
+                                   NULL);
+            if (!res)
+                RETURN_ERROR(&tmp_err, -1, NULL);
+        } else {
+            // New callback object
+            Py_XINCREF(obj);
+            self->total_progress_cb = obj;
+            res = lr_handle_setopt(self->handle,
+                                   &tmp_err,
+                                   (LrHandleOption)option,
+                                   total_progress_callback);
+            if (!res)
+                RETURN_ERROR(&tmp_err, -1, NULL);
+            res = lr_handle_setopt(self->handle,
+                                   &tmp_err,
+                                   LRO_TOTALPROGRESSDATA,
+                                   self);
+        }
+        break;
+    }
+
     case LRO_HMFCB: {
         if (!PyCallable_Check(obj) && obj != Py_None) {
             PyErr_SetString(PyExc_TypeError, "Only callable argument or None is supported with this option");
@@ -823,6 +923,17 @@ py_setopt(_HandleObject *self, PyObject *args)
         break;
     }
 
+    case LRO_TOTALPROGRESSDATA: {
+        Py_XDECREF(self->total_progress_cb_data);
+        if (obj == Py_None) {
+            self->total_progress_cb_data = NULL;
+        } else {
+            Py_XINCREF(obj);
+            self->total_progress_cb_data = obj;
+        }
+        break;
+    }
+
     /*
      * Unknown options
      */
@@ -868,6 +979,7 @@ py_getinfo(_HandleObject *self, PyObject *args)
     case LRI_PROXY_SSLCLIENTKEY:
     case LRI_PROXY_SSLCACERT:
     case LRI_CACHEDIR:
+    case LRI_TRACEFILE:
         res = lr_handle_getinfo(self->handle,
                                 &tmp_err,
                                 (LrHandleInfoOption)option,
@@ -905,6 +1017,13 @@ py_getinfo(_HandleObject *self, PyObject *args)
     case LRI_LOWSPEEDTIME:
     case LRI_LOWSPEEDLIMIT:
     case LRI_FTPUSEEPSV:
+    case LRI_CONDITIONALREFRESH:
+    case LRI_DECOMPRESS:
+    case LRI_PACKAGECACHE:
+    case LRI_DROPPAGECACHE:
+    case LRI_PROGRESSINTERVAL:
+    case LRI_PROGRESSBYTES:
+    case LRI_LOCKTIMEOUT:
         res = lr_handle_getinfo(self->handle,
                                 &tmp_err,
                                 (LrHandleInfoOption)option,
@@ -1029,6 +1148,18 @@ py_getinfo(_HandleObject *self, PyObject *args)
         Py_INCREF(self->hmf_cb);
         return self->hmf_cb;
 
+    case LRI_TOTALPROGRESSCB:
+        if (self->total_progress_cb == NULL)
+            Py_RETURN_NONE;
+        Py_INCREF(self->total_progress_cb);
+        return self->total_progress_cb;
+
+    case LRI_TOTALPROGRESSDATA:
+        if (self->total_progress_cb_data == NULL)
+            Py_RETURN_NONE;
+        Py_INCREF(self->total_progress_cb_data);
+        return self->total_progress_cb_data;
+
     /* metalink */
     case LRI_METALINK: {
         PyObject *py_metalink;
@@ -1045,6 +1176,18 @@ py_getinfo(_HandleObject *self, PyObject *args)
         return py_metalink;
     }
 
+    /* stats */
+    case LRI_STATS: {
+        LrStats *stats;
+        res = lr_handle_getinfo(self->handle,
+                                &tmp_err,
+                                (LrHandleInfoOption)option,
+                                &stats);
+        if (!res)
+            RETURN_ERROR(&tmp_err, -1, NULL);
+        return PyObject_FromStats(stats);
+    }
+
     default:
         PyErr_SetString(PyExc_ValueError, "Unknown option");
         return NULL;
@@ -1172,12 +1315,49 @@ py_download_package(_HandleObject *self, PyObject *args)
     }
 }
 
+static PyObject *
+py_clear_stats(_HandleObject *self, G_GNUC_UNUSED PyObject *noarg)
+{
+    LrStats *stats;
+    GError *tmp_err = NULL;
+
+    if (check_HandleStatus(self))
+        return NULL;
+
+    if (!lr_handle_getinfo(self->handle, &tmp_err, LRI_STATS, &stats))
+        RETURN_ERROR(&tmp_err, -1, NULL);
+    lr_stats_clear(stats);
+    Py_RETURN_NONE;
+}
+
+static PyObject *
+py_write_stats_prometheus(_HandleObject *self, PyObject *args)
+{
+    char *filename, *labels = NULL;
+    LrStats *stats;
+    GError *tmp_err = NULL;
+
+    if (!PyArg_ParseTuple(args, "s|z:py_write_stats_prometheus",
+                          &filename, &labels))
+        return NULL;
+    if (check_HandleStatus(self))
+        return NULL;
+
+    if (!lr_handle_getinfo(self->handle, &tmp_err, LRI_STATS, &stats))
+        RETURN_ERROR(&tmp_err, -1, NULL);
+    if (!lr_stats_write_prometheus(stats, filename, labels, &tmp_err))
+        RETURN_ERROR(&tmp_err, -1, NULL);
+    Py_RETURN_NONE;
+}
+
 static struct
 PyMethodDef handle_methods[] = {
     { "setopt", (PyCFunction)py_setopt, METH_VARARGS, NULL },
     { "getinfo", (PyCFunction)py_getinfo, METH_VARARGS, NULL },
     { "perform", (PyCFunction)py_perform, METH_VARARGS, NULL },
     { "download_package", (PyCFunction)py_download_package, METH_VARARGS, NULL },
+    { "clear_stats", (PyCFunction)py_clear_stats, METH_NOARGS, NULL },
+    { "write_stats_prometheus", (PyCFunction)py_write_stats_prometheus, METH_VARARGS, NULL },
     { NULL }
 };
 
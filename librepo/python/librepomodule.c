@@ -23,6 +23,7 @@
 
 #include "librepo/librepo.h"
 
+#include "downloadsession-py.h"
 #include "exception-py.h"
 #include "handle-py.h"
 #include "metadatadownloader-py.h"
@@ -122,6 +123,10 @@ static struct PyMethodDef librepo_methods[] = {
       METH_VARARGS, NULL },
     { "download_url",           (PyCFunction)py_download_url,
       METH_VARARGS, NULL },
+    { "download_packages_start",(PyCFunction)py_download_packages_start,
+      METH_VARARGS, NULL },
+    { "download_metadata_start",(PyCFunction)py_download_metadata_start,
+      METH_VARARGS, NULL },
     { "log_set_file",           (PyCFunction)py_log_set_file,
       METH_VARARGS, NULL },
     { "log_remove_handler",     (PyCFunction)py_log_remove_handler,
@@ -215,6 +220,12 @@ PyInit__librepo(void)
     Py_INCREF(&MetadataTarget_Type);
     PyModule_AddObject(m, "MetadataTarget", (PyObject *)&MetadataTarget_Type);
 
+    // _librepo.DownloadSession
+    if (PyType_Ready(&DownloadSession_Type) < 0)
+        INITERROR;
+    Py_INCREF(&DownloadSession_Type);
+    PyModule_AddObject(m, "DownloadSession", (PyObject *)&DownloadSession_Type);
+
     // Init module
     Py_AtExit(exit_librepo);
 
@@ -295,6 +306,16 @@ PyInit__librepo(void)
     PYMODULE_ADDINTCONSTANT(LRO_FTPUSEEPSV);
     PYMODULE_ADDINTCONSTANT(LRO_CACHEDIR);
     PYMODULE_ADDINTCONSTANT(LRO_PRESERVETIME);
+    PYMODULE_ADDINTCONSTANT(LRO_CONDITIONALREFRESH);
+    PYMODULE_ADDINTCONSTANT(LRO_DECOMPRESS);
+    PYMODULE_ADDINTCONSTANT(LRO_PROGRESSINTERVAL);
+    PYMODULE_ADDINTCONSTANT(LRO_PROGRESSBYTES);
+    PYMODULE_ADDINTCONSTANT(LRO_TOTALPROGRESSCB);
+    PYMODULE_ADDINTCONSTANT(LRO_TOTALPROGRESSDATA);
+    PYMODULE_ADDINTCONSTANT(LRO_TRACEFILE);
+    PYMODULE_ADDINTCONSTANT(LRO_PACKAGECACHE);
+    PYMODULE_ADDINTCONSTANT(LRO_DROPPAGECACHE);
+    PYMODULE_ADDINTCONSTANT(LRO_LOCKTIMEOUT);
     PYMODULE_ADDINTCONSTANT(LRO_SENTINEL);
 
     // Handle info options
@@ -347,6 +368,17 @@ PyInit__librepo(void)
     PYMODULE_ADDINTCONSTANT(LRI_PROXYAUTHMETHODS);
     PYMODULE_ADDINTCONSTANT(LRI_FTPUSEEPSV);
     PYMODULE_ADDINTCONSTANT(LRI_CACHEDIR);
+    PYMODULE_ADDINTCONSTANT(LRI_CONDITIONALREFRESH);
+    PYMODULE_ADDINTCONSTANT(LRI_DECOMPRESS);
+    PYMODULE_ADDINTCONSTANT(LRI_PROGRESSINTERVAL);
+    PYMODULE_ADDINTCONSTANT(LRI_PROGRESSBYTES);
+    PYMODULE_ADDINTCONSTANT(LRI_TOTALPROGRESSCB);
+    PYMODULE_ADDINTCONSTANT(LRI_TOTALPROGRESSDATA);
+    PYMODULE_ADDINTCONSTANT(LRI_TRACEFILE);
+    PYMODULE_ADDINTCONSTANT(LRI_PACKAGECACHE);
+    PYMODULE_ADDINTCONSTANT(LRI_DROPPAGECACHE);
+    PYMODULE_ADDINTCONSTANT(LRI_LOCKTIMEOUT);
+    PYMODULE_ADDINTCONSTANT(LRI_STATS);
     PYMODULE_ADDINTCONSTANT(LRI_SENTINEL);
 
     // Check options
@@ -414,6 +446,7 @@ PyInit__librepo(void)
     PYMODULE_ADDINTCONSTANT(LRE_NOTSET);
     PYMODULE_ADDINTCONSTANT(LRE_FILE);
     PYMODULE_ADDINTCONSTANT(LRE_KEYFILE);
+    PYMODULE_ADDINTCONSTANT(LRE_DECOMPRESS);
     PYMODULE_ADDINTCONSTANT(LRE_UNKNOWNERROR);
 
     // Result option
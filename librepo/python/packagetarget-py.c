@@ -402,6 +402,14 @@ get_str(_PackageTargetObject *self, void *member_offset)
     return PyStringOrNone_FromString(str);
 }
 
+static PyObject *
+get_stats(_PackageTargetObject *self, G_GNUC_UNUSED void *member_offset)
+{
+    if (check_PackageTargetStatus(self))
+        return NULL;
+    return PyObject_FromTransferStats(self->target->stats);
+}
+
 static PyObject *
 get_pythonobj(_PackageTargetObject *self, void *member_offset)
 {
@@ -461,6 +469,7 @@ static PyGetSetDef packagetarget_getsetters[] = {
     {"mirrorfailurecb",(getter)get_pythonobj,NULL, NULL, OFFSET(mirrorfailurecb)},
     {"local_path",    (getter)get_str,       NULL, NULL, OFFSET(local_path)},
     {"err",           (getter)get_str,       NULL, NULL, OFFSET(err)},
+    {"stats",         (getter)get_stats,     NULL, NULL, OFFSET(stats)},
     {NULL, NULL, NULL, NULL, NULL} /* sentinel */
 };
 
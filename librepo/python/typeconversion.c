@@ -414,3 +414,100 @@ PyObject_FromMetalink(LrMetalink *metalink)
 
     return dict;
 }
+
+PyObject *
+PyObject_FromTransferStats(LrTransferStats *stats)
+{
+    PyObject *dict;
+
+    if (!stats)
+        Py_RETURN_NONE;
+
+    if ((dict = PyDict_New()) == NULL)
+        return NULL;
+
+    PyDict_SetItemStringAndDecref(dict, "namelookup_time",
+                    PyFloat_FromDouble(stats->namelookup_time));
+    PyDict_SetItemStringAndDecref(dict, "connect_time",
+                    PyFloat_FromDouble(stats->connect_time));
+    PyDict_SetItemStringAndDecref(dict, "appconnect_time",
+                    PyFloat_FromDouble(stats->appconnect_time));
+    PyDict_SetItemStringAndDecref(dict, "pretransfer_time",
+                    PyFloat_FromDouble(stats->pretransfer_time));
+    PyDict_SetItemStringAndDecref(dict, "starttransfer_time",
+                    PyFloat_FromDouble(stats->starttransfer_time));
+    PyDict_SetItemStringAndDecref(dict, "redirect_time",
+                    PyFloat_FromDouble(stats->redirect_time));
+    PyDict_SetItemStringAndDecref(dict, "total_time",
+                    PyFloat_FromDouble(stats->total_time));
+    PyDict_SetItemStringAndDecref(dict, "downloaded",
+                    PyLong_FromLongLong((PY_LONG_LONG) stats->downloaded));
+    PyDict_SetItemStringAndDecref(dict, "speed",
+                    PyFloat_FromDouble(stats->speed));
+    PyDict_SetItemStringAndDecref(dict, "http_version",
+                    PyLong_FromLong(stats->http_version));
+    PyDict_SetItemStringAndDecref(dict, "reused",
+                    PyBool_FromLong(stats->reused));
+
+    return dict;
+}
+
+PyObject *
+PyObject_FromStats(LrStats *stats)
+{
+    PyObject *dict, *mirrors;
+
+    if (!stats)
+        Py_RETURN_NONE;
+
+    if ((dict = PyDict_New()) == NULL)
+        return NULL;
+
+    PyDict_SetItemStringAndDecref(dict, "transfers",
+                    PyLong_FromLongLong((PY_LONG_LONG) stats->transfers));
+    PyDict_SetItemStringAndDecref(dict, "failed_transfers",
+                    PyLong_FromLongLong((PY_LONG_LONG) stats->failed_transfers));
+    PyDict_SetItemStringAndDecref(dict, "retries",
+                    PyLong_FromLongLong((PY_LONG_LONG) stats->retries));
+    PyDict_SetItemStringAndDecref(dict, "bytes_downloaded",
+                    PyLong_FromLongLong((PY_LONG_LONG) stats->bytes_downloaded));
+    PyDict_SetItemStringAndDecref(dict, "reused_connections",
+                    PyLong_FromLongLong((PY_LONG_LONG) stats->reused_connections));
+    PyDict_SetItemStringAndDecref(dict, "notmodified",
+                    PyLong_FromLongLong((PY_LONG_LONG) stats->notmodified));
+    PyDict_SetItemStringAndDecref(dict, "checksum_checks",
+                    PyLong_FromLongLong((PY_LONG_LONG) stats->checksum_checks));
+    PyDict_SetItemStringAndDecref(dict, "checksum_cache_hits",
+                    PyLong_FromLongLong((PY_LONG_LONG) stats->checksum_cache_hits));
+    PyDict_SetItemStringAndDecref(dict, "checksum_failures",
+                    PyLong_FromLongLong((PY_LONG_LONG) stats->checksum_failures));
+    PyDict_SetItemStringAndDecref(dict, "zck_bytes_reused",
+                    PyLong_FromLongLong((PY_LONG_LONG) stats->zck_bytes_reused));
+    PyDict_SetItemStringAndDecref(dict, "zck_bytes_downloaded",
+                    PyLong_FromLongLong((PY_LONG_LONG) stats->zck_bytes_downloaded));
+
+    // Mirrors
+    if ((mirrors = PyDict_New()) == NULL) {
+        Py_DECREF(dict);
+        return NULL;
+    }
+    PyDict_SetItemStringAndDecref(dict, "mirrors", mirrors);
+
+    for (GSList *elem = stats->mirrors; elem; elem = g_slist_next(elem)) {
+        LrMirrorStats *mirror = elem->data;
+        PyObject *pymirror = PyDict_New();
+        if (!pymirror) {
+            Py_DECREF(dict);
+            return NULL;
+        }
+        PyDict_SetItemStringAndDecref(pymirror, "transfers",
+                    PyLong_FromLongLong((PY_LONG_LONG) mirror->transfers));
+        PyDict_SetItemStringAndDecref(pymirror, "failures",
+                    PyLong_FromLongLong((PY_LONG_LONG) mirror->failures));
+        PyDict_SetItemStringAndDecref(pymirror, "bytes",
+                    PyLong_FromLongLong((PY_LONG_LONG) mirror->bytes));
+        PyDict_SetItemStringAndDecref(mirrors, mirror->url, pymirror);
+    }
+
+    return dict;
+}
@@ -24,6 +24,8 @@
 #include "librepo/repomd.h"
 #include "librepo/yum.h"
 #include "librepo/metalink.h"
+#include "librepo/downloadtarget.h"
+#include "librepo/stats.h"
 
 PyObject *PyStringOrNone_FromString(const char *str);
 PyObject *PyObject_FromYumRepo(LrYumRepo *repo);
@@ -31,6 +33,8 @@ PyObject *PyObject_FromYumRepo_v2(LrYumRepo *repo);
 PyObject *PyObject_FromYumRepoMd(LrYumRepoMd *repomd);
 PyObject *PyObject_FromYumRepoMd_v2(LrYumRepoMd *repomd);
 PyObject *PyObject_FromMetalink(LrMetalink *metalink);
+PyObject *PyObject_FromTransferStats(LrTransferStats *stats);
+PyObject *PyObject_FromStats(LrStats *stats);
 char *PyAnyStr_AsString(PyObject *str, PyObject **tmp_py_str);
 
 #endif
@@ -106,6 +106,8 @@ lr_strerror(int rc)
         return "File operation error";
     case LRE_KEYFILE:
         return "Key file parsing error";
+    case LRE_DECOMPRESS:
+        return "Decompression error";
     }
 
     return "Unknown error";
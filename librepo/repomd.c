@@ -533,19 +533,24 @@ lr_end_handler(void *pdata, G_GNUC_UNUSED const xmlChar *element)
     }
 }
 
-gboolean
-lr_yum_repomd_parse_file(LrYumRepoMd *repomd,
-                         int fd,
-                         LrXmlParserWarningCb warningcb,
-                         void *warningcb_data,
-                         GError **err)
+/** Parse the repomd.xml from the file descriptor or, if fd is -1,
+ * from the buffer.
+ */
+static gboolean
+lr_yum_repomd_parse(LrYumRepoMd *repomd,
+                    int fd,
+                    const char *buf,
+                    gsize len,
+                    LrXmlParserWarningCb warningcb,
+                    void *warningcb_data,
+                    GError **err)
 {
     gboolean ret = TRUE;
     LrParserData *pd;
     XmlParser parser;
     GError *tmp_err = NULL;
 
-    assert(fd >= 0);
+    assert(fd >= 0 || buf || !len);
     assert(repomd);
     assert(!err || *err == NULL);
 
@@ -570,7 +575,10 @@ lr_yum_repomd_parse_file(LrYumRepoMd *repomd,
 
     // Parsing
 
-    ret = lr_xml_parser_generic(parser, pd, fd, &tmp_err);
+    if (fd >= 0)
+        ret = lr_xml_parser_generic(parser, pd, fd, &tmp_err);
+    else
+        ret = lr_xml_parser_generic_buffer(parser, pd, buf, len, &tmp_err);
     if (tmp_err)
         g_propagate_error(err, tmp_err);
 
@@ -588,3 +596,27 @@ lr_yum_repomd_parse_file(LrYumRepoMd *repomd,
 
     return ret;
 }
+
+gboolean
+lr_yum_repomd_parse_file(LrYumRepoMd *repomd,
+                         int fd,
+                         LrXmlParserWarningCb warningcb,
+                         void *warningcb_data,
+                         GError **err)
+{
+    assert(fd >= 0);
+    return lr_yum_repomd_parse(repomd, fd, NULL, 0,
+                               warningcb, warningcb_data, err);
+}
+
+gboolean
+lr_yum_repomd_parse_buffer(LrYumRepoMd *repomd,
+                           const char *buf,
+                           gsize len,
+                           LrXmlParserWarningCb warningcb,
+                           void *warningcb_data,
+                           GError **err)
+{
+    return lr_yum_repomd_parse(repomd, -1, buf, len,
+                               warningcb, warningcb_data, err);
+}
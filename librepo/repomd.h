@@ -101,6 +101,23 @@ lr_yum_repomd_parse_file(LrYumRepoMd *repomd,
                          void *warningcb_data,
                          GError **err);
 
+/** Parse repomd.xml in memory.
+ * @param repomd            Empty repomd object.
+ * @param buf               Content of the repomd.xml file.
+ * @param len               Length of the content.
+ * @param warningcb         Callback for warnings
+ * @param warningcb_data    Warning callback user data
+ * @param err               GError **
+ * @return                  TRUE if everything is ok, FALSE if err is set.
+ */
+gboolean
+lr_yum_repomd_parse_buffer(LrYumRepoMd *repomd,
+                           const char *buf,
+                           gsize len,
+                           LrXmlParserWarningCb warningcb,
+                           void *warningcb_data,
+                           GError **err);
+
 /** Get repomd record from the repomd object.
  * @param repomd        Repomd record.
  * @param type          Type of record e.g. "primary", "filelists", ...
@@ -0,0 +1,240 @@
+/* librepo - A library providing (libcURL like) API to downloading repository
+ * Copyright (C) 2026  agent
+ *
+ * Licensed under the GNU Lesser General Public License Version 2.1
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <glib.h>
+#include <assert.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "cleanup.h"
+#include "rcodes.h"
+#include "util.h"
+#include "stats.h"
+#include "stats_internal.h"
+
+static void
+lr_mirrorstats_free(LrMirrorStats *mirror)
+{
+    if (!mirror)
+        return;
+    lr_free(mirror->url);
+    lr_free(mirror);
+}
+
+void
+lr_stats_clear(LrStats *stats)
+{
+    if (!stats)
+        return;
+    g_slist_free_full(stats->mirrors, (GDestroyNotify) lr_mirrorstats_free);
+    memset(stats, 0, sizeof(*stats));
+}
+
+LrMirrorStats *
+lr_stats_mirror(LrStats *stats, const char *url)
+{
+    assert(stats);
+
+    if (!url)
+        url = "";
+
+    for (GSList *elem = stats->mirrors; elem; elem = g_slist_next(elem)) {
+        LrMirrorStats *mirror = elem->data;
+        if (!strcmp(mirror->url, url))
+            return mirror;
+    }
+
+    LrMirrorStats *mirror = lr_malloc0(sizeof(*mirror));
+    mirror->url = g_strdup(url);
+    stats->mirrors = g_slist_append(stats->mirrors, mirror);
+    return mirror;
+}
+
+/** Append label value escaped by rules of the Prometheus text format */
+static void
+append_label_value(GString *str, const char *value)
+{
+    for (const char *c = value; *c; c++) {
+        switch (*c) {
+            case '\\': g_string_append(str, "\\\\"); break;
+            case '"':  g_string_append(str, "\\\""); break;
+            case '\n': g_string_append(str, "\\n"); break;
+            default:   g_string_append_c(str, *c);
+        }
+    }
+}
+
+static void
+append_header(GString *str, const char *name, const char *help)
+{
+    g_string_append_printf(str, "# HELP librepo_%s %s\n", name, help);
+    g_string_append_printf(str, "# TYPE librepo_%s counter\n", name);
+}
+
+static void
+append_sample(GString *str,
+              const char *name,
+              const char *labels,
+              const char *mirror,
+              gint64 value)
+{
+    g_string_append_printf(str, "librepo_%s", name);
+    if (labels || mirror) {
+        g_string_append_c(str, '{');
+        if (labels)
+            g_string_append(str, labels);
+        if (labels && mirror)
+            g_string_append_c(str, ',');
+        if (mirror) {
+            g_string_append(str, "mirror=\"");
+            append_label_value(str, mirror);
+            g_string_append_c(str, '"');
+        }
+        g_string_append_c(str, '}');
+    }
+    g_string_append_printf(str, " %"G_GINT64_FORMAT"\n", value);
+}
+
+gchar *
+lr_stats_to_prometheus(LrStats *stats, const char *labels)
+{
+    static const struct {
+        const char *name;
+        const char *help;
+        size_t offset;
+    } counters[] = {
+        { "transfers_total", "Finished transfers",
+          G_STRUCT_OFFSET(LrStats, transfers) },
+        { "failed_transfers_total", "Failed transfers",
+          G_STRUCT_OFFSET(LrStats, failed_transfers) },
+        { "retries_total", "Failed transfers tried again",
+          G_STRUCT_OFFSET(LrStats, retries) },
+        { "downloaded_bytes_total", "Bytes downloaded by all transfers",
+          G_STRUCT_OFFSET(LrStats, bytes_downloaded) },
+        { "reused_connections_total", "Transfers which reused a connection",
+          G_STRUCT_OFFSET(LrStats, reused_connections) },
+        { "notmodified_total", "Conditional transfers of up to date files",
+          G_STRUCT_OFFSET(LrStats, notmodified) },
+        { "checksum_checks_total", "Checksum verifications",
+          G_STRUCT_OFFSET(LrStats, checksum_checks) },
+        { "checksum_cache_hits_total", "Checksum verifications served from cache",
+          G_STRUCT_OFFSET(LrStats, checksum_cache_hits) },
+        { "checksum_failures_total", "Checksums which didn't match",
+          G_STRUCT_OFFSET(LrStats, checksum_failures) },
+        { "zck_reused_bytes_total", "Zchunk bytes found in local files",
+          G_STRUCT_OFFSET(LrStats, zck_bytes_reused) },
+        { "zck_downloaded_bytes_total", "Zchunk bytes downloaded",
+          G_STRUCT_OFFSET(LrStats, zck_bytes_downloaded) },
+        { NULL, NULL, 0 }
+    };
+
+    assert(stats);
+
+    if (labels && !*labels)
+        labels = NULL;
+
+    GString *str = g_string_new(NULL);
+
+    for (int i = 0; counters[i].name; i++) {
+        gint64 value = G_STRUCT_MEMBER(gint64, stats, counters[i].offset);
+        append_header(str, counters[i].name, counters[i].help);
+        append_sample(str, counters[i].name, labels, NULL, value);
+    }
+
+    if (stats->mirrors) {
+        append_header(str, "mirror_transfers_total", "Finished transfers per mirror");
+        for (GSList *elem = stats->mirrors; elem; elem = g_slist_next(elem)) {
+            LrMirrorStats *mirror = elem->data;
+            append_sample(str, "mirror_transfers_total", labels,
+                          mirror->url, mirror->transfers);
+        }
+        append_header(str, "mirror_failures_total", "Failed transfers per mirror");
+        for (GSList *elem = stats->mirrors; elem; elem = g_slist_next(elem)) {
+            LrMirrorStats *mirror = elem->data;
+            append_sample(str, "mirror_failures_total", labels,
+                          mirror->url, mirror->failures);
+        }
+        append_header(str, "mirror_downloaded_bytes_total", "Bytes downloaded per mirror");
+        for (GSList *elem = stats->mirrors; elem; elem = g_slist_next(elem)) {
+            LrMirrorStats *mirror = elem->data;
+            append_sample(str, "mirror_downloaded_bytes_total", labels,
+                          mirror->url, mirror->bytes);
+        }
+    }
+
+    return g_string_free(str, FALSE);
+}
+
+gboolean
+lr_stats_write_prometheus(LrStats *stats,
+                          const char *filename,
+                          const char *labels,
+                          GError **err)
+{
+    assert(stats);
+    assert(filename);
+    assert(!err || *err == NULL);
+
+    _cleanup_free_ gchar *content = lr_stats_to_prometheus(stats, labels);
+
+    // The collector could read the file anytime, so never let it see
+    // a partially written one
+    _cleanup_free_ gchar *tmp_filename = g_strconcat(filename, ".XXXXXX", NULL);
+    int fd = g_mkstemp(tmp_filename);
+    if (fd == -1) {
+        g_set_error(err, LR_HANDLE_ERROR, LRE_CANNOTCREATETMP,
+                    "Cannot create temporary file %s: %s",
+                    tmp_filename, g_strerror(errno));
+        return FALSE;
+    }
+
+    size_t len = strlen(content);
+    size_t written = 0;
+    while (written < len) {
+        ssize_t rc = write(fd, content + written, len - written);
+        if (rc < 0) {
+            if (errno == EINTR)
+                continue;
+            g_set_error(err, LR_HANDLE_ERROR, LRE_IO,
+                        "Cannot write %s: %s", tmp_filename, g_strerror(errno));
+            close(fd);
+            unlink(tmp_filename);
+            return FALSE;
+        }
+        written += rc;
+    }
+
+    // The textfile collector requires the usual permissions
+    fchmod(fd, 0644);
+    close(fd);
+
+    if (rename(tmp_filename, filename) != 0) {
+        g_set_error(err, LR_HANDLE_ERROR, LRE_IO,
+                    "Cannot rename %s to %s: %s",
+                    tmp_filename, filename, g_strerror(errno));
+        unlink(tmp_filename);
+        return FALSE;
+    }
+
+    return TRUE;
+}
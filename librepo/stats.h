@@ -0,0 +1,97 @@
+/* librepo - A library providing (libcURL like) API to downloading repository
+ * Copyright (C) 2026  agent
+ *
+ * Licensed under the GNU Lesser General Public License Version 2.1
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef __LR_STATS_H__
+#define __LR_STATS_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/** \defgroup   stats  Download statistics
+ *  \addtogroup stats
+ *  @{
+ */
+
+/** Statistics of a single mirror */
+typedef struct {
+    char *url;              /*!< URL of the mirror (or the base URL) */
+    gint64 transfers;       /*!< Finished transfers (successful or not) */
+    gint64 failures;        /*!< Failed transfers */
+    gint64 bytes;           /*!< Bytes downloaded from the mirror */
+} LrMirrorStats;
+
+/** Counters accumulated by the downloads done with targets of a handle.
+ * See LRI_STATS.
+ */
+typedef struct {
+    gint64 transfers;           /*!< Finished transfers (successful or not) */
+    gint64 failed_transfers;    /*!< Failed transfers */
+    gint64 retries;             /*!< Failed transfers tried again */
+    gint64 bytes_downloaded;    /*!< Bytes downloaded by all transfers */
+    gint64 reused_connections;  /*!< Transfers which reused a connection */
+    gint64 notmodified;         /*!< Conditional transfers which found
+                                     the local copy up to date */
+    gint64 checksum_checks;     /*!< Checksum verifications */
+    gint64 checksum_cache_hits; /*!< Verifications which used the checksum
+                                     cached in extended file attributes */
+    gint64 checksum_failures;   /*!< Checksums which didn't match */
+    gint64 zck_bytes_reused;    /*!< Zchunk bytes found in local files
+                                     (counted when the target is finished) */
+    gint64 zck_bytes_downloaded;/*!< Zchunk chunk bytes downloaded
+                                     (without the headers) */
+    GSList *mirrors;            /*!< List of pointers to LrMirrorStats */
+} LrStats;
+
+/** Reset all counters to zero and forget the mirrors.
+ * @param stats         Statistics
+ */
+void
+lr_stats_clear(LrStats *stats);
+
+/** Render the statistics in the Prometheus text exposition format.
+ * @param stats         Statistics
+ * @param labels        Extra labels added to every sample
+ *                      (e.g. "repo=\"fedora\"") or NULL
+ * @return              Newly allocated string
+ */
+gchar *
+lr_stats_to_prometheus(LrStats *stats, const char *labels);
+
+/** Write the statistics in the Prometheus text exposition format
+ * to a file (e.g. for the node-exporter textfile collector).
+ * The file is replaced atomically.
+ * @param stats         Statistics
+ * @param filename      Destination file
+ * @param labels        Extra labels added to every sample or NULL
+ * @param err           GError **
+ * @return              TRUE if everything is ok, FALSE if err is set.
+ */
+gboolean
+lr_stats_write_prometheus(LrStats *stats,
+                          const char *filename,
+                          const char *labels,
+                          GError **err);
+
+/** @} */
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,249 @@
+/* librepo - A library providing (libcURL like) API to downloading repository
+ * Copyright (C) 2026  agent
+ *
+ * Licensed under the GNU Lesser General Public License Version 2.1
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "trace_internal.h"
+
+/** Single recorded event */
+typedef struct {
+    gint64 start;       /*!< Start (microseconds since the trace start) */
+    gint64 duration;    /*!< Duration in microseconds */
+    guint64 id;         /*!< Id of an async event or 0 */
+    gint tid;           /*!< Thread which recorded the event */
+    const char *category; /*!< Static string */
+    const char *name;   /*!< Static string */
+    char *detail;       /*!< Copy of the detail or NULL */
+} LrTraceEvent;
+
+G_LOCK_DEFINE_STATIC(lr_trace);
+static gint lr_trace_users = 0;       // Access: g_atomic_int_*
+static char *lr_trace_filename = NULL;
+static gint64 lr_trace_epoch = 0;
+static GArray *lr_trace_events = NULL;
+
+static gint lr_trace_last_tid = 0;
+static GPrivate lr_trace_tid_key;
+
+/** Small sequential id of the current thread (Chrome trace viewer
+ * doesn't like huge thread ids) */
+static gint
+lr_trace_tid(void)
+{
+    gint tid = GPOINTER_TO_INT(g_private_get(&lr_trace_tid_key));
+    if (!tid) {
+        tid = g_atomic_int_add(&lr_trace_last_tid, 1) + 1;
+        g_private_set(&lr_trace_tid_key, GINT_TO_POINTER(tid));
+    }
+    return tid;
+}
+
+gboolean
+lr_trace_acquire(const char *filename)
+{
+    if (!filename || !*filename)
+        return TRUE;
+
+    G_LOCK(lr_trace);
+    if (!lr_trace_filename) {
+        lr_trace_filename = g_strdup(filename);
+        lr_trace_epoch = g_get_monotonic_time();
+        lr_trace_events = g_array_new(FALSE, FALSE, sizeof(LrTraceEvent));
+    } else if (g_strcmp0(lr_trace_filename, filename)) {
+        g_warning("%s: Trace is already recorded to %s, %s is refused",
+                  __func__, lr_trace_filename, filename);
+        G_UNLOCK(lr_trace);
+        return FALSE;
+    }
+    g_atomic_int_inc(&lr_trace_users);
+    G_UNLOCK(lr_trace);
+    return TRUE;
+}
+
+static void
+lr_trace_write_string(FILE *f, const char *str)
+{
+    fputc('"', f);
+    for (const char *c = str; *c; c++) {
+        switch (*c) {
+            case '"':  fputs("\\\"", f); break;
+            case '\\': fputs("\\\\", f); break;
+            case '\n': fputs("\\n", f); break;
+            case '\t': fputs("\\t", f); break;
+            default:
+                if ((unsigned char) *c < 0x20)
+                    fprintf(f, "\\u%04x", (unsigned char) *c);
+                else
+                    fputc(*c, f);
+        }
+    }
+    fputc('"', f);
+}
+
+static void
+lr_trace_write_event(FILE *f,
+                     const LrTraceEvent *event,
+                     const char *phase,
+                     gint64 ts,
+                     gint pid)
+{
+    fputs(",\n{\"name\":", f);
+    lr_trace_write_string(f, event->name);
+    fputs(",\"cat\":", f);
+    lr_trace_write_string(f, event->category);
+    fprintf(f, ",\"ph\":\"%s\",\"ts\":%"G_GINT64_FORMAT",\"pid\":%d,\"tid\":%d",
+            phase, ts, pid, event->tid);
+    if (event->id)
+        fprintf(f, ",\"id\":\"0x%"G_GINT64_MODIFIER"x\"", event->id);
+    else
+        fprintf(f, ",\"dur\":%"G_GINT64_FORMAT, event->duration);
+    if (event->detail && *phase != 'e') {
+        fputs(",\"args\":{\"detail\":", f);
+        lr_trace_write_string(f, event->detail);
+        fputc('}', f);
+    }
+    fputc('}', f);
+}
+
+static void
+lr_trace_write(const char *filename, GArray *events)
+{
+    gint pid = (gint) getpid();
+    FILE *f = g_fopen(filename, "w");
+    if (!f) {
+        g_warning("%s: Cannot open %s: %s", __func__, filename,
+                  g_strerror(errno));
+        return;
+    }
+
+    fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n"
+               "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,"
+               "\"args\":{\"name\":\"librepo\"}}", pid);
+
+    for (guint i = 0; i < events->len; i++) {
+        LrTraceEvent *event = &g_array_index(events, LrTraceEvent, i);
+        if (event->id) {
+            // Async events are written as begin/end pairs
+            lr_trace_write_event(f, event, "b", event->start, pid);
+            lr_trace_write_event(f, event, "e",
+                                 event->start + event->duration, pid);
+        } else {
+            lr_trace_write_event(f, event, "X", event->start, pid);
+        }
+    }
+
+    fputs("\n]}\n", f);
+    if (fclose(f))
+        g_warning("%s: Cannot write %s: %s", __func__, filename,
+                  g_strerror(errno));
+    else
+        g_debug("%s: Trace with %u events written to %s",
+                __func__, events->len, filename);
+}
+
+void
+lr_trace_release(void)
+{
+    char *filename = NULL;
+    GArray *events = NULL;
+
+    G_LOCK(lr_trace);
+    if (g_atomic_int_get(&lr_trace_users) > 0
+        && g_atomic_int_dec_and_test(&lr_trace_users))
+    {
+        filename = lr_trace_filename;
+        events = lr_trace_events;
+        lr_trace_filename = NULL;
+        lr_trace_events = NULL;
+    }
+    G_UNLOCK(lr_trace);
+
+    if (!events)
+        return;
+
+    lr_trace_write(filename, events);
+
+    for (guint i = 0; i < events->len; i++)
+        g_free(g_array_index(events, LrTraceEvent, i).detail);
+    g_array_free(events, TRUE);
+    g_free(filename);
+}
+
+gint64
+lr_trace_now(void)
+{
+    if (!g_atomic_int_get(&lr_trace_users))
+        return -1;
+    return g_get_monotonic_time();
+}
+
+static void
+lr_trace_record(gint64 start,
+                guint64 id,
+                const char *category,
+                const char *name,
+                const char *detail)
+{
+    LrTraceEvent event;
+    gint64 end = g_get_monotonic_time();
+
+    event.id = id;
+    event.tid = lr_trace_tid();
+    event.category = category;
+    event.name = name;
+    event.detail = NULL;
+
+    G_LOCK(lr_trace);
+    if (lr_trace_events) {
+        // Spans started before the trace are clipped to its start
+        start = MAX(start, lr_trace_epoch);
+        event.start = start - lr_trace_epoch;
+        event.duration = end - start;
+        event.detail = g_strdup(detail);
+        g_array_append_val(lr_trace_events, event);
+    }
+    G_UNLOCK(lr_trace);
+}
+
+void
+lr_trace_span_end(LrTraceSpan *span)
+{
+    if (span->start < 0)
+        return;
+    lr_trace_record(span->start, 0, span->category, span->name, span->detail);
+    span->start = -1;
+}
+
+void
+lr_trace_async(gint64 start,
+               guint64 id,
+               const char *category,
+               const char *name,
+               const char *detail)
+{
+    if (start < 0)
+        return;
+    lr_trace_record(start, id ? id : 1, category, name, detail);
+}
@@ -0,0 +1,99 @@
+/* librepo - A library providing (libcURL like) API to downloading repository
+ * Copyright (C) 2026  agent
+ *
+ * Licensed under the GNU Lesser General Public License Version 2.1
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef __LR_TRACE_INTERNAL_H__
+#define __LR_TRACE_INTERNAL_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/** Name of the environment variable with the default LRO_TRACEFILE */
+#define LR_TRACE_ENV    "LIBREPO_TRACE"
+
+/** Span of a synchronous operation. The span is recorded when
+ * it is ended by lr_trace_span_end(). Use LR_TRACE_SPAN_INIT()
+ * together with _cleanup_trace_span_ to end it automatically
+ * when the variable goes out of scope.
+ */
+typedef struct {
+    gint64 start; /*!<
+        Start of the span (see lr_trace_now()) or -1 if tracing
+        was disabled when the span was started */
+    const char *category; /*!<
+        Category of the span */
+    const char *name; /*!<
+        Name of the span */
+    const char *detail; /*!<
+        Detail (e.g. an URL or a path) or NULL. It must live at least
+        until the span is ended. */
+} LrTraceSpan;
+
+#define LR_TRACE_SPAN_INIT(category, name, detail) \
+    { lr_trace_now(), (category), (name), (detail) }
+
+#define _cleanup_trace_span_ __attribute__ ((cleanup(lr_trace_span_end)))
+
+/** Start recording of the trace. The trace is shared by the whole
+ * process; every successful call must be paired with lr_trace_release().
+ * @param filename      Where the trace will be written
+ * @return              FALSE if the trace is already being recorded
+ *                      to a different file (nothing is acquired then)
+ */
+gboolean
+lr_trace_acquire(const char *filename);
+
+/** Release the trace. When the last user releases it, the recorded
+ * events are written as a Chrome trace-event JSON file.
+ */
+void
+lr_trace_release(void);
+
+/** Current monotonic time in microseconds or -1 if the trace is not
+ * being recorded. Cheap enough to be called unconditionally.
+ */
+gint64
+lr_trace_now(void);
+
+/** Record a span of a synchronous operation started at start.
+ * Does nothing if start is negative.
+ */
+void
+lr_trace_span_end(LrTraceSpan *span);
+
+/** Record an operation that overlaps with other operations
+ * of the same thread, e.g. a transfer driven by curl multi handle.
+ * @param start         Start of the operation (see lr_trace_now())
+ * @param id            Identifier of the operation unique among
+ *                      the simultaneous operations
+ * @param category      Category of the operation
+ * @param name          Name of the operation
+ * @param detail        Detail or NULL
+ */
+void
+lr_trace_async(gint64 start,
+               guint64 id,
+               const char *category,
+               const char *name,
+               const char *detail);
+
+G_END_DECLS
+
+#endif
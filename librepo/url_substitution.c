@@ -24,6 +24,7 @@
 #include <string.h>
 #include <stdio.h>
 #include "url_substitution.h"
+#include "url_substitution_internal.h"
 #include "util.h"
 
 static LrVar *
@@ -89,68 +90,221 @@ lr_urlvars_free(LrUrlVars *list)
     g_slist_free(list);
 }
 
-char *
-lr_url_substitute(const char *url, LrUrlVars *list)
+/** Part of a compiled URL */
+typedef struct {
+    gsize offset;   /*!< Offset of the text in the URL */
+    gsize len;      /*!< Length of the text. For variables, it is the whole
+                         reference which is kept if the variable is unknown */
+    char *name;     /*!< Variable name or NULL for literal text */
+} LrUrlTemplatePart;
+
+struct _LrUrlTemplate {
+    char *url;
+    GArray *parts;  /*!< Array of LrUrlTemplatePart */
+};
+
+struct _LrUrlSubst {
+    GHashTable *vars;   /*!< Variable name -> value */
+    GHashTable *cache;  /*!< URL -> URL with substituted variables */
+};
+
+static void
+lr_url_template_add(LrUrlTemplate *tmpl,
+                    const char *start,
+                    const char *end,
+                    char *name)
 {
-    const char *cur = url;
-    const char *p = url;
+    LrUrlTemplatePart part;
+    part.offset = start - tmpl->url;
+    part.len = end - start;
+    part.name = name;
+    g_array_append_val(tmpl->parts, part);
+}
 
-    if (!url)
-        return NULL;
+LrUrlTemplate *
+lr_url_template_compile(const char *url)
+{
+    assert(url);
 
-    if (!list)
-        return g_strdup(url);
+    LrUrlTemplate *tmpl = lr_malloc0(sizeof(*tmpl));
+    tmpl->url = g_strdup(url);
+    tmpl->parts = g_array_new(FALSE, FALSE, sizeof(LrUrlTemplatePart));
 
-    char *res = g_strdup("");
+    const char *cur = tmpl->url;
+    const char *p = tmpl->url;  // Start of the not yet added literal text
 
     while (*cur != '\0') {
-        if (*cur == '$') {
-            // Adds unprocessed text before the variable to the "res".
-            if (cur-p) {
-                char *tmp = g_strndup(p, cur-p);
-                char *tmp_res = g_strconcat(res, tmp, NULL);
-                g_free(tmp);
-                g_free(res);
-                res = tmp_res;
-                p = cur;
-            }
+        if (*cur != '$') {
+            ++cur;
+            continue;
+        }
 
-            // Tries to substitute the variable and store result to the "res".
-            gboolean bracket;
-            if (*++cur == '{') {
-                bracket = TRUE;
-                ++cur;
-            } else {
-                bracket = FALSE;
-            }
-            const char *varname = cur;
-            for (; isalnum(*cur) || (*cur == '_' && isalnum(*(cur + 1))); ++cur);
-            if (cur != varname && (!bracket || *cur == '}')) {
-                for (LrUrlVars *elem = list; elem; elem = g_slist_next(elem)) {
-                    LrVar *var_val = elem->data;
-                    size_t var_len = strlen(var_val->var);
-                    if (var_len == cur - varname && strncmp(var_val->var, varname, var_len) == 0) {
-                        if (bracket)
-                            ++cur;
-                        p = cur;
-                        char *tmp_res = g_strconcat(res, var_val->val, NULL);
-                        g_free(res);
-                        res = tmp_res;
-                        break;
-                    }
-                }
-            }
+        const char *dollar = cur;
+        gboolean bracket;
+        if (*++cur == '{') {
+            bracket = TRUE;
+            ++cur;
         } else {
+            bracket = FALSE;
+        }
+        const char *varname = cur;
+        for (; isalnum(*cur) || (*cur == '_' && isalnum(*(cur + 1))); ++cur);
+        if (cur == varname || (bracket && *cur != '}'))
+            continue;  // Not a variable reference, it stays in the literal
+
+        char *name = g_strndup(varname, cur - varname);
+        if (bracket)
             ++cur;
+        if (dollar != p)
+            lr_url_template_add(tmpl, p, dollar, NULL);
+        lr_url_template_add(tmpl, dollar, cur, name);
+        p = cur;
+    }
+
+    if (*p != '\0')
+        lr_url_template_add(tmpl, p, cur, NULL);
+
+    return tmpl;
+}
+
+static const char *
+lr_url_template_part_value(LrUrlTemplatePart *part, GHashTable *vars)
+{
+    if (!part->name || !vars)
+        return NULL;
+    return g_hash_table_lookup(vars, part->name);
+}
+
+gsize
+lr_url_template_length(LrUrlTemplate *tmpl, GHashTable *vars)
+{
+    gsize len = 0;
+
+    assert(tmpl);
+
+    for (guint i = 0; i < tmpl->parts->len; i++) {
+        LrUrlTemplatePart *part = &g_array_index(tmpl->parts, LrUrlTemplatePart, i);
+        const char *value = lr_url_template_part_value(part, vars);
+        len += value ? strlen(value) : part->len;
+    }
+
+    return len;
+}
+
+char *
+lr_url_template_render(LrUrlTemplate *tmpl, GHashTable *vars, char *buf)
+{
+    assert(tmpl);
+    assert(buf);
+
+    for (guint i = 0; i < tmpl->parts->len; i++) {
+        LrUrlTemplatePart *part = &g_array_index(tmpl->parts, LrUrlTemplatePart, i);
+        const char *value = lr_url_template_part_value(part, vars);
+        if (value) {
+            size_t len = strlen(value);
+            memcpy(buf, value, len);
+            buf += len;
+        } else {
+            memcpy(buf, tmpl->url + part->offset, part->len);
+            buf += part->len;
         }
     }
 
-    // Adds remaining text to the "res".
-    if (*p != '\0') {
-        char *tmp_res = g_strconcat(res, p, NULL);
-        g_free(res);
-        res = tmp_res;
+    *buf = '\0';
+    return buf;
+}
+
+void
+lr_url_template_free(LrUrlTemplate *tmpl)
+{
+    if (!tmpl)
+        return;
+    for (guint i = 0; i < tmpl->parts->len; i++)
+        lr_free(g_array_index(tmpl->parts, LrUrlTemplatePart, i).name);
+    g_array_free(tmpl->parts, TRUE);
+    lr_free(tmpl->url);
+    lr_free(tmpl);
+}
+
+static GHashTable *
+lr_urlvars_table_new(LrUrlVars *list)
+{
+    GHashTable *vars = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                             g_free, g_free);
+    for (LrUrlVars *elem = list; elem; elem = g_slist_next(elem)) {
+        LrVar *var_val = elem->data;
+        // The first occurrence wins, as with the linear lookup
+        if (!var_val->var || g_hash_table_contains(vars, var_val->var))
+            continue;
+        g_hash_table_insert(vars, g_strdup(var_val->var),
+                            g_strdup(var_val->val ? var_val->val : ""));
     }
+    return vars;
+}
+
+static char *
+lr_url_render_new(const char *url, GHashTable *vars)
+{
+    LrUrlTemplate *tmpl = lr_url_template_compile(url);
+    char *res = lr_malloc(lr_url_template_length(tmpl, vars) + 1);
+    lr_url_template_render(tmpl, vars, res);
+    lr_url_template_free(tmpl);
+    return res;
+}
+
+LrUrlSubst *
+lr_urlsubst_new(LrUrlVars *vars)
+{
+    if (!vars)
+        return NULL;
+
+    LrUrlSubst *subst = lr_malloc0(sizeof(*subst));
+    subst->vars = lr_urlvars_table_new(vars);
+    subst->cache = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                         g_free, g_free);
+    return subst;
+}
+
+void
+lr_urlsubst_free(LrUrlSubst *subst)
+{
+    if (!subst)
+        return;
+    g_hash_table_destroy(subst->vars);
+    g_hash_table_destroy(subst->cache);
+    lr_free(subst);
+}
+
+char *
+lr_urlsubst_url(LrUrlSubst *subst, const char *url)
+{
+    if (!url)
+        return NULL;
+
+    // URLs without variables are not worth caching
+    if (!subst || !strchr(url, '$'))
+        return g_strdup(url);
+
+    const char *cached = g_hash_table_lookup(subst->cache, url);
+    if (cached)
+        return g_strdup(cached);
+
+    char *res = lr_url_render_new(url, subst->vars);
+    g_hash_table_insert(subst->cache, g_strdup(url), g_strdup(res));
+    return res;
+}
+
+char *
+lr_url_substitute(const char *url, LrUrlVars *list)
+{
+    if (!url)
+        return NULL;
+
+    if (!list || !strchr(url, '$'))
+        return g_strdup(url);
 
+    GHashTable *vars = lr_urlvars_table_new(list);
+    char *res = lr_url_render_new(url, vars);
+    g_hash_table_destroy(vars);
     return res;
 }
@@ -0,0 +1,94 @@
+/* librepo - A library providing (libcURL like) API to downloading repository
+ * Copyright (C) 2026  agent
+ *
+ * Licensed under the GNU Lesser General Public License Version 2.1
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef __LR_URL_SUBSTITUTION_INTERNAL_H__
+#define __LR_URL_SUBSTITUTION_INTERNAL_H__
+
+#include <glib.h>
+
+#include "url_substitution.h"
+
+G_BEGIN_DECLS
+
+/** URL compiled into a sequence of literal spans and variable references */
+typedef struct _LrUrlTemplate LrUrlTemplate;
+
+/** Variables of a LrUrlVars list in a hash table together with
+ * a cache of already substituted URLs. The variables are copied,
+ * so the substitution must be recreated when the list changes.
+ */
+typedef struct _LrUrlSubst LrUrlSubst;
+
+/** Compile URL into a template.
+ * @param url           URL with $var or ${var} references
+ * @return              New template
+ */
+LrUrlTemplate *
+lr_url_template_compile(const char *url);
+
+/** Length of the URL rendered with the variables (without the trailing
+ * zero byte).
+ * @param tmpl          Template
+ * @param vars          Hash table variable name -> value or NULL
+ * @return              Length of the rendered URL
+ */
+gsize
+lr_url_template_length(LrUrlTemplate *tmpl, GHashTable *vars);
+
+/** Render the template into a buffer.
+ * @param tmpl          Template
+ * @param vars          Hash table variable name -> value or NULL
+ * @param buf           Buffer of at least lr_url_template_length() + 1 bytes
+ * @return              Pointer to the trailing zero byte written to buf
+ */
+char *
+lr_url_template_render(LrUrlTemplate *tmpl, GHashTable *vars, char *buf);
+
+/** Free the template.
+ * @param tmpl          Template or NULL
+ */
+void
+lr_url_template_free(LrUrlTemplate *tmpl);
+
+/** Create a substitution for the variables.
+ * @param vars          List of variables
+ * @return              New substitution or NULL if vars is NULL
+ */
+LrUrlSubst *
+lr_urlsubst_new(LrUrlVars *vars);
+
+/** Free the substitution and its cache.
+ * @param subst         Substitution or NULL
+ */
+void
+lr_urlsubst_free(LrUrlSubst *subst);
+
+/** Substitute variables in the url. URLs with variables are compiled
+ * and rendered only once, the following calls copy the cached result.
+ * @param subst         Substitution or NULL (no substitution)
+ * @param url           URL or NULL
+ * @return              Newly allocated string or NULL if url is NULL
+ */
+char *
+lr_urlsubst_url(LrUrlSubst *subst, const char *url);
+
+G_END_DECLS
+
+#endif
@@ -29,14 +29,20 @@
 #include <stdio.h>
 #include <string.h>
 #include <unistd.h>
+#include <fcntl.h>
 #include <sys/types.h>
+#include <sys/ioctl.h>
 #include <stdarg.h>
+#ifdef __linux__
+#include <linux/fs.h>
+#endif
 #include <ftw.h>
 
 #include "util.h"
 #include "version.h"
 #include "metalink.h"
 #include "cleanup.h"
+#include "io_internal.h"
 #include "yum.h"
 
 #define DIR_SEPARATOR   "/"
@@ -308,23 +314,97 @@ lr_remove_dir(const char *path)
     return nftw(path, lr_remove_dir_cb, 64, FTW_DEPTH | FTW_PHYS);
 }
 
+static gboolean
+lr_copy_content_cb(gpointer data, const char *buf, gsize len)
+{
+    int dest = GPOINTER_TO_INT(data);
+
+    while (len > 0) {
+        ssize_t size = write(dest, buf, len);
+        if (size == -1) {
+            if (errno == EINTR)
+                continue;
+            return FALSE;
+        }
+        buf += size;
+        len -= size;
+    }
+    return TRUE;
+}
+
 int
 lr_copy_content(int source, int dest)
 {
-    const int bufsize = 2048;
-    char buf[bufsize];
-    ssize_t size;
-
     lseek(source, 0, SEEK_SET);
     lseek(dest, 0, SEEK_SET);
 
-    while ((size = read(source, buf, bufsize)) > 0)
-        if (write(dest, buf, size) == -1)
-            return -1;
+    // Big files are read ahead by io_uring (if available)
+    gssize size = lr_io_read_file(lr_io_ring_thread_default(), source,
+                                  lr_copy_content_cb, GINT_TO_POINTER(dest));
 
     return (size < 0) ? -1 : 0;
 }
 
+gboolean
+lr_link_or_copy(const char *src, const char *dst)
+{
+    if (link(src, dst) == 0)
+        return TRUE;
+
+    if (errno == EEXIST) {
+        g_debug("%s: %s already exists", __func__, dst);
+        return FALSE;
+    }
+
+    g_debug("%s: Cannot link %s to %s (%s), copying it",
+            __func__, src, dst, g_strerror(errno));
+
+    return lr_reflink_or_copy(src, dst);
+}
+
+gboolean
+lr_reflink_or_copy(const char *src, const char *dst)
+{
+    int fd_in = open(src, O_RDONLY);
+    if (fd_in == -1) {
+        g_debug("%s: Cannot open %s: %s", __func__, src, g_strerror(errno));
+        return FALSE;
+    }
+
+    _cleanup_free_ gchar *tmp = g_strconcat(dst, ".XXXXXX", NULL);
+    int fd_out = g_mkstemp_full(tmp, O_WRONLY, 0644);
+    if (fd_out == -1) {
+        g_debug("%s: Cannot create %s: %s", __func__, tmp, g_strerror(errno));
+        close(fd_in);
+        return FALSE;
+    }
+
+    gboolean copied = FALSE;
+#ifdef FICLONE
+    copied = (ioctl(fd_out, FICLONE, fd_in) == 0);
+#endif
+    if (!copied)
+        copied = (lr_copy_content(fd_in, fd_out) == 0);
+    if (!copied)
+        g_debug("%s: Cannot copy %s to %s: %s",
+                __func__, src, tmp, g_strerror(errno));
+
+    close(fd_in);
+    if (close(fd_out) == -1)
+        copied = FALSE;
+
+    if (copied && rename(tmp, dst) == -1) {
+        g_debug("%s: Cannot rename %s to %s: %s",
+                __func__, tmp, dst, g_strerror(errno));
+        copied = FALSE;
+    }
+
+    if (!copied)
+        unlink(tmp);
+
+    return copied;
+}
+
 char *
 lr_prepend_url_protocol(const char *path)
 {
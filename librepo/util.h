@@ -127,6 +127,26 @@ int lr_remove_dir(const char *path);
  */
 int lr_copy_content(int source, int dest);
 
+/** Create dst as a hard link of src. If it's not possible (e.g. they
+ * are on different filesystems), dst is created as a reflink (where
+ * supported) or a plain copy of src. The copy is written to a temporary
+ * file which is renamed to dst, so a partial copy is never visible.
+ * @param src           Existing file
+ * @param dst           Path which must not exist yet
+ * @return              TRUE on success, FALSE if dst exists or on error
+ */
+gboolean lr_link_or_copy(const char *src, const char *dst);
+
+/** Create dst as a reflink (where supported) or a plain copy of src.
+ * Unlike lr_link_or_copy() the files never share their inode, so
+ * changes of one of them don't affect the other one. The copy is
+ * written to a temporary file which is renamed to dst.
+ * @param src           Existing file
+ * @param dst           Destination path
+ * @return              TRUE on success, FALSE on error
+ */
+gboolean lr_reflink_or_copy(const char *src, const char *dst);
+
 /** If protocol is specified ("http://foo") return copy of path.
  * If path is absolute ("/foo/bar/") return path with "file://" prefix.
  * If path is relative ("bar/") return absolute path with "file://" prefix.
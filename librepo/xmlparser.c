@@ -142,6 +142,38 @@ lr_xml_parser_strtoll(LrParserData *pd,
     return val;
 }
 
+/** Pass a chunk of the document to the parser.
+ * @return          FALSE if err is set
+ */
+static gboolean
+lr_xml_parser_chunk(xmlParserCtxtPtr ctxt,
+                    LrParserData *pd,
+                    const char *buf,
+                    int len,
+                    GError **err)
+{
+    if (xmlParseChunk(ctxt, buf, len, len == 0)) {
+        xmlErrorPtr error = xmlCtxtGetLastError(ctxt);
+
+        g_debug("%s: Parse error at line: %d (%s)",
+                    __func__,
+                    xmlSAX2GetLineNumber(ctxt),
+                    error->message);
+        g_set_error(err, LR_XML_PARSER_ERROR, LRE_XMLPARSER,
+                    "Parse error at line: %d (%s)",
+                    xmlSAX2GetLineNumber(ctxt),
+                    error->message);
+        return FALSE;
+    }
+
+    if (pd->err) {
+        g_propagate_error(err, pd->err);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
 gboolean
 lr_xml_parser_generic(XmlParser parser,
                       LrParserData *pd,
@@ -173,29 +205,53 @@ lr_xml_parser_generic(XmlParser parser,
             break;
         }
 
-        if (xmlParseChunk(ctxt, buf, len, len == 0)) {
-            xmlErrorPtr error = xmlCtxtGetLastError(ctxt);
+        if (!lr_xml_parser_chunk(ctxt, pd, buf, len, err)) {
             ret = FALSE;
-
-            g_debug("%s: Parse error at line: %d (%s)",
-                        __func__,
-                        xmlSAX2GetLineNumber(ctxt),
-                        error->message);
-            g_set_error(err, LR_XML_PARSER_ERROR, LRE_XMLPARSER,
-                        "Parse error at line: %d (%s)",
-                        xmlSAX2GetLineNumber(ctxt),
-                        error->message);
             break;
         }
 
-        if (pd->err) {
+        if (len == 0)
+            break;
+    }
+
+    xmlFreeParserCtxt(ctxt);
+
+    return ret;
+}
+
+gboolean
+lr_xml_parser_generic_buffer(XmlParser parser,
+                             LrParserData *pd,
+                             const char *buf,
+                             gsize len,
+                             GError **err)
+{
+    /* Note: This function uses .err members of LrParserData! */
+
+    gboolean ret = TRUE;
+    xmlParserCtxtPtr ctxt = xmlCreatePushParserCtxt(&parser, pd, NULL, 0, NULL);
+    ctxt->linenumbers = 1;
+
+    assert(ctxt);
+    assert(pd);
+    assert(buf || !len);
+    assert(!err || *err == NULL);
+
+    // The buffer is passed by the same chunks as a file, so the parsing
+    // stops early on an error reported by the callbacks
+    while (1) {
+        int chunk_len = (int) MIN(len, XML_BUFFER_SIZE);
+
+        if (!lr_xml_parser_chunk(ctxt, pd, buf, chunk_len, err)) {
             ret = FALSE;
-            g_propagate_error(err, pd->err);
             break;
         }
 
-        if (len == 0)
+        if (chunk_len == 0)
             break;
+
+        buf += chunk_len;
+        len -= chunk_len;
     }
 
     xmlFreeParserCtxt(ctxt);
@@ -164,6 +164,15 @@ lr_xml_parser_generic(XmlParser parser,
                       int fd,
                       GError **err);
 
+/** Generic parser of a document in memory.
+ */
+gboolean
+lr_xml_parser_generic_buffer(XmlParser parser,
+                             LrParserData *pd,
+                             const char *buf,
+                             gsize len,
+                             GError **err);
+
 /** @} */
 
 G_END_DECLS
@@ -40,6 +40,8 @@
 #include "metalink.h"
 #include "repomd.h"
 #include "downloader.h"
+#include "downloader_internal.h"
+#include "decompress_internal.h"
 #include "handle_internal.h"
 #include "result_internal.h"
 #include "yum_internal.h"
@@ -264,11 +266,11 @@ lr_yum_repomd_record_enabled(LrHandle *handle, const char *type, GSList* records
     return TRUE;
 }
 
-static CbData *cbdata_new(void *userdata,
-                          void *cbdata,
-                          LrProgressCb progresscb,
-                          LrHandleMirrorFailureCb hmfcb,
-                          const char *metadata)
+CbData *lr_cbdata_new(void *userdata,
+                      void *cbdata,
+                      LrProgressCb progresscb,
+                      LrHandleMirrorFailureCb hmfcb,
+                      const char *metadata)
 {
     CbData *data = calloc(1, sizeof(*data));
     data->userdata = userdata;
@@ -279,16 +281,16 @@ static CbData *cbdata_new(void *userdata,
     return data;
 }
 
-static void
-cbdata_free(CbData *data)
+void
+lr_cbdata_free(CbData *data)
 {
     if (!data) return;
     free(data->metadata);
     free(data);
 }
 
-static int
-progresscb(void *clientp, double total_to_download, double downloaded)
+int
+lr_yum_progresscb(void *clientp, double total_to_download, double downloaded)
 {
     CbData *data = clientp;
     if (data->progresscb)
@@ -315,7 +317,8 @@ lr_prepare_repodata_dir(LrHandle *handle,
 
     path_to_repodata = lr_pathconcat(handle->destdir, "repodata", NULL);
 
-    if (handle->update) {  /* Check if should create repodata/ subdir */
+    if (handle->update || handle->conditionalrefresh) {
+        /* Check if should create repodata/ subdir */
         struct stat buf;
         if (stat(path_to_repodata, &buf) != -1)
             if (S_ISDIR(buf.st_mode))
@@ -340,6 +343,29 @@ lr_prepare_repodata_dir(LrHandle *handle,
     return TRUE;
 }
 
+/** Write the whole buffer to the file.
+ * @return          0 on success, -1 and errno set otherwise
+ */
+static int
+lr_write_content(int fd, const GByteArray *data)
+{
+    const guint8 *buf = data->data;
+    gsize len = data->len;
+
+    while (len > 0) {
+        ssize_t written = write(fd, buf, len);
+        if (written == -1) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        buf += written;
+        len -= written;
+    }
+
+    return 0;
+}
+
 gboolean
 lr_store_mirrorlist_files(LrHandle *handle,
                           LrYumRepo *repo,
@@ -348,7 +374,7 @@ lr_store_mirrorlist_files(LrHandle *handle,
     int fd;
     int rc;
 
-    if (handle->mirrorlist_fd != -1) {
+    if (handle->mirrorlist_data) {
         char *ml_file_path = lr_pathconcat(handle->destdir,
                                            "mirrorlist", NULL);
         fd = open(ml_file_path, O_CREAT|O_TRUNC|O_RDWR, 0666);
@@ -359,7 +385,7 @@ lr_store_mirrorlist_files(LrHandle *handle,
             lr_free(ml_file_path);
             return FALSE;
         }
-        rc = lr_copy_content(handle->mirrorlist_fd, fd);
+        rc = lr_write_content(fd, handle->mirrorlist_data);
         close(fd);
         if (rc != 0) {
             g_debug("%s: Cannot copy content of mirrorlist file", __func__);
@@ -383,7 +409,7 @@ lr_copy_metalink_content(LrHandle *handle,
     int fd;
     int rc;
 
-    if (handle->metalink_fd != -1) {
+    if (handle->metalink_data) {
         char *ml_file_path = lr_pathconcat(handle->destdir,
                                            "metalink.xml", NULL);
         fd = open(ml_file_path, O_CREAT|O_TRUNC|O_RDWR, 0666);
@@ -394,7 +420,7 @@ lr_copy_metalink_content(LrHandle *handle,
             lr_free(ml_file_path);
             return FALSE;
         }
-        rc = lr_copy_content(handle->metalink_fd, fd);
+        rc = lr_write_content(fd, handle->metalink_data);
         close(fd);
         if (rc != 0) {
             g_debug("%s: Cannot copy content of metalink file", __func__);
@@ -478,26 +504,41 @@ lr_check_repomd_xml_asc_availability(LrHandle *handle,
             return FALSE;
         } else {
             // Signature downloaded
-            repo->signature = g_strdup(signature);
-            ret = lr_gpg_check_signature(signature,
-                                         path,
-                                         handle->gnupghomedir,
-                                         &tmp_err);
+            ret = lr_check_repomd_xml_asc(handle, repo, signature, path, err);
             lr_free(signature);
-            if (!ret) {
-                g_debug("%s: GPG signature verification failed: %s",
-                        __func__, tmp_err->message);
-                g_propagate_prefixed_error(err, tmp_err,
-                                           "repomd.xml GPG signature verification error: ");
+            if (!ret)
                 return FALSE;
-            }
-            g_debug("%s: GPG signature successfully verified", __func__);
         }
     }
 
     return TRUE;
 }
 
+gboolean
+lr_check_repomd_xml_asc(LrHandle *handle,
+                        LrYumRepo *repo,
+                        const char *signature,
+                        const char *path,
+                        GError **err)
+{
+    GError *tmp_err = NULL;
+
+    repo->signature = g_strdup(signature);
+    if (!lr_gpg_check_signature(signature,
+                                path,
+                                handle->gnupghomedir,
+                                &tmp_err)) {
+        g_debug("%s: GPG signature verification failed: %s",
+                __func__, tmp_err->message);
+        g_propagate_prefixed_error(err, tmp_err,
+                                   "repomd.xml GPG signature verification error: ");
+        return FALSE;
+    }
+    g_debug("%s: GPG signature successfully verified", __func__);
+
+    return TRUE;
+}
+
 void
 lr_get_best_checksum(const LrMetalink *metalink,
                      GSList **checksums)
@@ -537,18 +578,21 @@ lr_get_metadata_failure_callback(const LrHandle *handle)
 {
     CbData *cbdata = NULL;
     if (handle->hmfcb) {
-        cbdata = cbdata_new(handle->user_data,
-                            NULL,
-                            NULL,
-                            handle->hmfcb,
-                            "repomd.xml");
+        cbdata = lr_cbdata_new(handle->user_data,
+                               NULL,
+                               NULL,
+                               handle->hmfcb,
+                               "repomd.xml");
     }
     return cbdata;
 }
 
-gboolean
-lr_yum_download_url(LrHandle *lr_handle, const char *url, int fd,
-                    gboolean no_cache, gboolean is_zchunk, GError **err)
+/** Download the URL into the fd or, if fd is -1, into memory.
+ */
+static gboolean
+lr_yum_download_url_target(LrHandle *lr_handle, const char *url, int fd,
+                           gboolean no_cache, gboolean is_zchunk,
+                           GByteArray **data, GError **err)
 {
     gboolean ret;
     LrDownloadTarget *target;
@@ -559,16 +603,16 @@ lr_yum_download_url(LrHandle *lr_handle, const char *url, int fd,
     assert(!err || *err == NULL);
 
     if (lr_handle != NULL)
-        cbdata = cbdata_new(lr_handle->user_data,
-                            NULL,
-                            lr_handle->user_cb,
-                            lr_handle->hmfcb,
-                            url);
+        cbdata = lr_cbdata_new(lr_handle->user_data,
+                               NULL,
+                               lr_handle->user_cb,
+                               lr_handle->hmfcb,
+                               url);
 
     // Prepare target
     target = lr_downloadtarget_new(lr_handle,
                                    url, NULL, fd, NULL,
-                                   NULL, 0, 0,(lr_handle && lr_handle->user_cb) ? progresscb : NULL, cbdata,
+                                   NULL, 0, 0,(lr_handle && lr_handle->user_cb) ? lr_yum_progresscb : NULL, cbdata,
                                    NULL, (lr_handle && lr_handle->hmfcb) ? hmfcb : NULL, NULL, 0, 0,
                                    NULL, no_cache, is_zchunk);
 
@@ -578,22 +622,66 @@ lr_yum_download_url(LrHandle *lr_handle, const char *url, int fd,
     assert(ret || tmp_err);
     assert(!(target->err) || !ret);
     if (cbdata)
-        cbdata_free(cbdata);
+        lr_cbdata_free(cbdata);
 
     if (!ret)
         g_propagate_error(err, tmp_err);
 
+    if (ret && data) {
+        *data = target->data;
+        target->data = NULL;
+    }
+
     lr_downloadtarget_free(target);
 
-    lseek(fd, 0, SEEK_SET);
+    if (fd != -1)
+        lseek(fd, 0, SEEK_SET);
 
     return ret;
 }
 
+gboolean
+lr_yum_download_url(LrHandle *lr_handle, const char *url, int fd,
+                    gboolean no_cache, gboolean is_zchunk, GError **err)
+{
+    assert(fd >= 0);
+    return lr_yum_download_url_target(lr_handle, url, fd, no_cache,
+                                      is_zchunk, NULL, err);
+}
+
+gboolean
+lr_yum_download_url_data(LrHandle *lr_handle, const char *url,
+                         gboolean no_cache, GByteArray **data, GError **err)
+{
+    assert(data);
+    return lr_yum_download_url_target(lr_handle, url, -1, no_cache,
+                                      FALSE, data, err);
+}
+
+/** Validators of repomd.xml used by LRO_CONDITIONALREFRESH */
+typedef struct {
+    gchar *etag; /*!<
+        ETag of repomd.xml or NULL */
+    gint64 lastmodified; /*!<
+        Last modification time of repomd.xml or 0 */
+    gboolean notmodified; /*!<
+        Server reported that repomd.xml in destdir is up to date */
+} LrRepomdValidators;
+
+static void
+lr_repomd_validators_clear(LrRepomdValidators *validators)
+{
+    g_free(validators->etag);
+    validators->etag = NULL;
+    validators->lastmodified = 0;
+    validators->notmodified = FALSE;
+}
+
 static gboolean
 lr_yum_download_repomd(LrHandle *handle,
                        LrMetalink *metalink,
                        int fd,
+                       LrRepomdValidators *validators,
                        GError **err)
 {
     int ret = TRUE;
@@ -608,11 +696,11 @@ lr_yum_download_repomd(LrHandle *handle,
         lr_get_best_checksum(metalink, &checksums);
     }
 
-    CbData *cbdata = cbdata_new(handle->user_data,
-                            NULL,
-                            handle->user_cb,
-                            handle->hmfcb,
-                            "repomd.xml");
+    CbData *cbdata = lr_cbdata_new(handle->user_data,
+                                   NULL,
+                                   handle->user_cb,
+                                   handle->hmfcb,
+                                   "repomd.xml");
 
     LrDownloadTarget *target = lr_downloadtarget_new(handle,
                                                      "repodata/repomd.xml",
@@ -622,7 +710,7 @@ lr_yum_download_repomd(LrHandle *handle,
                                                      checksums,
                                                      0,
                                                      0,
-                                                     (handle->user_cb) ? progresscb : NULL,
+                                                     (handle->user_cb) ? lr_yum_progresscb : NULL,
                                                      cbdata,
                                                      NULL,
                                                      (handle->hmfcb) ? hmfcb : NULL,
@@ -633,11 +721,16 @@ lr_yum_download_repomd(LrHandle *handle,
                                                      TRUE,
                                                      FALSE);
 
+    if (validators)
+        lr_downloadtarget_set_conditional(target,
+                                          validators->etag,
+                                          validators->lastmodified);
+
     ret = lr_download_target(target, &tmp_err);
     assert((ret && !tmp_err) || (!ret && tmp_err));
 
     if (cbdata)
-        cbdata_free(cbdata);
+        lr_cbdata_free(cbdata);
 
     if (tmp_err) {
         g_propagate_prefixed_error(err, tmp_err,
@@ -652,6 +745,13 @@ lr_yum_download_repomd(LrHandle *handle,
         // TODO: Get rid of use_mirror attr
         lr_free(handle->used_mirror);
         handle->used_mirror = g_strdup(target->usedmirror);
+
+        if (validators) {
+            g_free(validators->etag);
+            validators->etag = g_strdup(target->etag);
+            validators->lastmodified = target->lastmodified;
+            validators->notmodified = target->notmodified;
+        }
     }
 
     lr_downloadtarget_free(target);
@@ -664,6 +764,193 @@ lr_yum_download_repomd(LrHandle *handle,
     return ret;
 }
 
+#define VALIDATORS_GROUP "repomd.xml"
+
+static gchar *
+lr_yum_repomd_validators_path(LrHandle *handle)
+{
+    return lr_pathconcat(handle->destdir, "repodata/repomd.xml.validators", NULL);
+}
+
+/** Load validators stored by the last successful conditional refresh
+ * of the repository in destdir. Missing or broken file means no validators.
+ */
+static void
+lr_yum_load_repomd_validators(LrHandle *handle,
+                              LrRepomdValidators *validators)
+{
+    _cleanup_free_ gchar *path = lr_yum_repomd_validators_path(handle);
+    _cleanup_free_ gchar *repomd = NULL;
+    GKeyFile *keyfile = g_key_file_new();
+
+    repomd = lr_pathconcat(handle->destdir, "repodata/repomd.xml", NULL);
+    if (access(repomd, F_OK) == 0
+        && g_key_file_load_from_file(keyfile, path, G_KEY_FILE_NONE, NULL)) {
+        validators->etag = g_key_file_get_string(keyfile, VALIDATORS_GROUP,
+                                                 "etag", NULL);
+        validators->lastmodified = g_key_file_get_int64(keyfile,
+                                                        VALIDATORS_GROUP,
+                                                        "lastmodified",
+                                                        NULL);
+        g_debug("%s: ETag: %s, Last-Modified: %"G_GINT64_FORMAT, __func__,
+                validators->etag ? validators->etag : "-",
+                validators->lastmodified);
+    }
+
+    g_key_file_free(keyfile);
+}
+
+/** Store validators of repomd.xml in destdir. They are written only when
+ * the whole repository was successfully downloaded so that a partially
+ * downloaded repository is never considered up to date.
+ */
+static void
+lr_yum_save_repomd_validators(LrHandle *handle,
+                              LrRepomdValidators *validators)
+{
+    _cleanup_free_ gchar *path = lr_yum_repomd_validators_path(handle);
+    GError *tmp_err = NULL;
+    GKeyFile *keyfile;
+
+    if (!validators->etag && validators->lastmodified <= 0) {
+        // Server provides no validators
+        unlink(path);
+        return;
+    }
+
+    keyfile = g_key_file_new();
+    if (validators->etag)
+        g_key_file_set_string(keyfile, VALIDATORS_GROUP, "etag",
+                              validators->etag);
+    if (validators->lastmodified > 0)
+        g_key_file_set_int64(keyfile, VALIDATORS_GROUP, "lastmodified",
+                             validators->lastmodified);
+
+    if (!g_key_file_save_to_file(keyfile, path, &tmp_err)) {
+        // Not fatal, the next refresh will be a full one
+        g_debug("%s: Cannot save %s: %s", __func__, path, tmp_err->message);
+        g_error_free(tmp_err);
+    }
+
+    g_key_file_free(keyfile);
+}
+
+/** Check whether repomd.xml in destdir is the one described by
+ * the metalink. Checksums are cached in extended attributes of the file,
+ * so usually nothing needs to be hashed.
+ */
+static gboolean
+lr_yum_repomd_matches_metalink(LrHandle *handle)
+{
+    gboolean matches = FALSE;
+    GSList *checksums = NULL;
+    _cleanup_free_ gchar *path = NULL;
+    _cleanup_fd_close_ int fd = -1;
+
+    if (!handle->metalink)
+        return FALSE;
+
+    path = lr_pathconcat(handle->destdir, "repodata/repomd.xml", NULL);
+    fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return FALSE;
+
+    lr_get_best_checksum(handle->metalink, &checksums);
+    for (GSList *elem = checksums; elem && !matches; elem = g_slist_next(elem)) {
+        LrDownloadTargetChecksum *checksum = elem->data;
+        GError *tmp_err = NULL;
+
+        if (!lr_checksum_fd_cmp(checksum->type, fd, checksum->value, TRUE,
+                                &matches, &tmp_err)) {
+            g_debug("%s: Cannot checksum %s: %s",
+                    __func__, path, tmp_err->message);
+            g_error_free(tmp_err);
+            matches = FALSE;
+        }
+    }
+    g_slist_free_full(checksums, (GDestroyNotify) lr_downloadtargetchecksum_free);
+
+    if (matches)
+        g_debug("%s: %s matches the metalink", __func__, path);
+
+    return matches;
+}
+
+/** Download repomd.xml into destdir using a conditional request.
+ * repomd.xml is downloaded into a temporary file and moves to its place
+ * only if the server sent a new one. Otherwise fd is -1, path is NULL
+ * and validators->notmodified is TRUE.
+ * @param handle            Librepo handle
+ * @param use_validators    Send validators stored in destdir
+ * @param fd                Opened repomd.xml
+ * @param path              Path to repomd.xml
+ * @param validators        Validators returned by the server
+ * @param err               GError **
+ * @return                  TRUE on success, FALSE if an error occurred
+ */
+static gboolean
+lr_yum_download_repomd_conditional(LrHandle *handle,
+                                   gboolean use_validators,
+                                   int *fd,
+                                   char **path,
+                                   LrRepomdValidators *validators,
+                                   GError **err)
+{
+    _cleanup_free_ gchar *tmp_path = NULL;
+    _cleanup_free_ gchar *validators_path = NULL;
+    int tmp_fd;
+
+    assert(!err || *err == NULL);
+
+    *fd = -1;
+    *path = NULL;
+
+    if (use_validators)
+        lr_yum_load_repomd_validators(handle, validators);
+
+    tmp_path = lr_pathconcat(handle->destdir, "repodata/repomd.xml.part", NULL);
+    tmp_fd = open(tmp_path, O_CREAT|O_TRUNC|O_RDWR, 0666);
+    if (tmp_fd == -1) {
+        g_set_error(err, LR_YUM_ERROR, LRE_IO,
+                    "Cannot open %s: %s", tmp_path, g_strerror(errno));
+        return FALSE;
+    }
+
+    if (!lr_yum_download_repomd(handle, handle->metalink, tmp_fd,
+                                validators, err)) {
+        close(tmp_fd);
+        unlink(tmp_path);
+        return FALSE;
+    }
+
+    if (validators->notmodified) {
+        g_debug("%s: repomd.xml is up to date", __func__);
+        close(tmp_fd);
+        unlink(tmp_path);
+        return TRUE;
+    }
+
+    // The repository in destdir is going to be replaced, until it is
+    // completely downloaded, its validators are not valid
+    validators_path = lr_yum_repomd_validators_path(handle);
+    unlink(validators_path);
+
+    *path = lr_pathconcat(handle->destdir, "repodata/repomd.xml", NULL);
+    if (rename(tmp_path, *path) == -1) {
+        g_set_error(err, LR_YUM_ERROR, LRE_IO,
+                    "Cannot rename %s to %s: %s",
+                    tmp_path, *path, g_strerror(errno));
+        close(tmp_fd);
+        unlink(tmp_path);
+        lr_free(*path);
+        *path = NULL;
+        return FALSE;
+    }
+
+    *fd = tmp_fd;
+    return TRUE;
+}
+
 gboolean
 prepare_repo_download_std_target(LrHandle *handle,
                                  LrYumRepoMdRecord *record,
@@ -810,11 +1097,11 @@ prepare_repo_download_targets(LrHandle *handle,
         }
 
         if (handle->user_cb || handle->hmfcb) {
-            cbdata = cbdata_new(handle->user_data,
-                                user_cbdata,
-                                handle->user_cb,
-                                handle->hmfcb,
-                                record->type);
+            cbdata = lr_cbdata_new(handle->user_data,
+                                   user_cbdata,
+                                   handle->user_cb,
+                                   handle->hmfcb,
+                                   record->type);
             *cbdata_list = g_slist_append(*cbdata_list, cbdata);
         }
 
@@ -830,7 +1117,7 @@ prepare_repo_download_targets(LrHandle *handle,
                                        cbdata,
                                        endcb,
                                        NULL,
-                                       NULL,
+                                       record,
                                        0,
                                        0,
                                        NULL,
@@ -904,6 +1191,154 @@ error_handling(GSList *targets, GError **dest_error, GError *src_error)
     return TRUE;
 }
 
+/** Decompression of a single metadata file */
+typedef struct {
+    LrYumRepo *repo; /*!<
+        Repo where the decompressed file should be registered */
+    LrMetadataTarget *mdtarget; /*!<
+        Metadata target where errors should be reported or NULL */
+    gchar *type; /*!<
+        Type of the decompressed file, e.g. "primary_open" */
+    gchar *path; /*!<
+        Path to the downloaded compressed file */
+    gchar *dest; /*!<
+        Path to the decompressed file */
+    LrChecksumType checksum_type; /*!<
+        Type of the open-checksum or LR_CHECKSUM_UNKNOWN */
+    gchar *checksum; /*!<
+        Expected open-checksum */
+    GError *err; /*!<
+        Error of the decompression or NULL */
+} LrDecompressJob;
+
+struct _LrDecompressStage {
+    GThreadPool *pool; /*!<
+        Worker threads, created with the first job */
+    GSList *jobs; /*!<
+        List of all LrDecompressJob */
+};
+
+static void
+lr_decompressjob_free(LrDecompressJob *job)
+{
+    if (!job)
+        return;
+    g_free(job->type);
+    g_free(job->path);
+    g_free(job->dest);
+    g_free(job->checksum);
+    if (job->err)
+        g_error_free(job->err);
+    g_free(job);
+}
+
+static void
+lr_decompress_worker(gpointer data, G_GNUC_UNUSED gpointer user_data)
+{
+    LrDecompressJob *job = data;
+
+    g_debug("%s: Decompressing %s", __func__, job->path);
+    lr_decompress_file(job->path, job->dest, job->checksum_type,
+                       job->checksum, &job->err);
+}
+
+LrDecompressStage *
+lr_decompress_stage_new(void)
+{
+    return g_new0(LrDecompressStage, 1);
+}
+
+void
+lr_decompress_stage_push(LrDecompressStage *stage,
+                         LrHandle *handle,
+                         LrYumRepo *repo,
+                         LrMetadataTarget *mdtarget,
+                         LrDownloadTarget *target)
+{
+    LrYumRepoMdRecord *record = target->userdata;
+
+    if (!handle->decompress || !record || target->rcode != LRE_OK)
+        return;
+
+    if (target->is_zchunk
+        || lr_detect_compression(record->location_href) == LR_COMPRESSION_NONE)
+        return;
+
+    const char *path = lr_yum_repo_path(repo, record->type);
+    if (!path)
+        return;
+
+    LrDecompressJob *job = g_new0(LrDecompressJob, 1);
+    job->repo = repo;
+    job->mdtarget = mdtarget;
+    job->type = g_strconcat(record->type, "_open", NULL);
+    job->path = g_strdup(path);
+    job->dest = lr_path_without_compression_suffix(path);
+    job->checksum_type = LR_CHECKSUM_UNKNOWN;
+    if ((handle->checks & LR_CHECK_CHECKSUM) && record->checksum_open) {
+        job->checksum_type = lr_checksum_type(record->checksum_open_type);
+        job->checksum = g_strdup(record->checksum_open);
+    }
+
+    if (!stage->pool)
+        stage->pool = g_thread_pool_new(lr_decompress_worker, NULL,
+                                        g_get_num_processors(), FALSE, NULL);
+
+    stage->jobs = g_slist_prepend(stage->jobs, job);
+    g_thread_pool_push(stage->pool, job, NULL);
+}
+
+gboolean
+lr_decompress_stage_finish(LrDecompressStage *stage, GError **err)
+{
+    gboolean ret = TRUE;
+
+    assert(!err || *err == NULL);
+
+    if (!stage)
+        return TRUE;
+
+    // Wait for all queued jobs
+    if (stage->pool)
+        g_thread_pool_free(stage->pool, FALSE, TRUE);
+
+    stage->jobs = g_slist_reverse(stage->jobs);
+    for (GSList *elem = stage->jobs; elem; elem = g_slist_next(elem)) {
+        LrDecompressJob *job = elem->data;
+
+        if (!job->err) {
+            lr_yum_repo_update(job->repo, job->type, job->dest);
+        } else if (job->mdtarget) {
+            lr_metadatatarget_append_error(job->mdtarget, "%s",
+                                           job->err->message, NULL);
+        } else if (ret) {
+            g_propagate_error(err, job->err);
+            job->err = NULL;
+            ret = FALSE;
+        }
+    }
+
+    g_slist_free_full(stage->jobs, (GDestroyNotify) lr_decompressjob_free);
+    g_free(stage);
+
+    return ret;
+}
+
+/** LrTargetDoneCb of lr_yum_download_repo() */
+typedef struct {
+    LrHandle *handle;
+    LrYumRepo *repo;
+    LrDecompressStage *stage;
+} LrDownloadRepoData;
+
+static GSList *
+lr_yum_download_repo_target_done(LrDownloadTarget *target, void *cbdata)
+{
+    LrDownloadRepoData *data = cbdata;
+    lr_decompress_stage_push(data->stage, data->handle, data->repo, NULL, target);
+    return NULL;
+}
+
 gboolean
 lr_yum_download_repos(GSList *targets,
                       GError **err)
@@ -936,13 +1371,13 @@ lr_yum_download_repos(GSList *targets,
 
     ret = lr_download_single_cb(download_targets,
                                 FALSE,
-                                (cbdata_list) ? progresscb : NULL,
+                                (cbdata_list) ? lr_yum_progresscb : NULL,
                                 (cbdata_list) ? hmfcb : NULL,
                                 &download_error);
 
     error_handling(download_targets, err, download_error);
 
-    g_slist_free_full(cbdata_list, (GDestroyNotify)cbdata_free);
+    g_slist_free_full(cbdata_list, (GDestroyNotify)lr_cbdata_free);
     g_slist_free_full(download_targets, (GDestroyNotify)lr_downloadtarget_free);
 
     return ret;
@@ -966,16 +1401,24 @@ lr_yum_download_repo(LrHandle *handle,
     if (!targets)
         return TRUE;
 
-    ret = lr_download_single_cb(targets,
-                                FALSE,
-                                (cbdata_list) ? progresscb : NULL,
-                                (cbdata_list) ? hmfcb : NULL,
-                                &tmp_err);
+    LrDownloadRepoData data = { handle, repo, lr_decompress_stage_new() };
+
+    ret = lr_download_single_cb_pipelined(targets,
+                                          FALSE,
+                                          (cbdata_list) ? lr_yum_progresscb : NULL,
+                                          (cbdata_list) ? hmfcb : NULL,
+                                          lr_yum_download_repo_target_done,
+                                          &data,
+                                          &tmp_err);
 
     assert((ret && !tmp_err) || (!ret && tmp_err));
     ret = error_handling(targets, err, tmp_err);
 
-    g_slist_free_full(cbdata_list, (GDestroyNotify)cbdata_free);
+    // Decompressed files of a failed download are not interesting
+    if (!lr_decompress_stage_finish(data.stage, ret ? err : NULL))
+        ret = FALSE;
+
+    g_slist_free_full(cbdata_list, (GDestroyNotify)lr_cbdata_free);
     g_slist_free_full(targets, (GDestroyNotify)lr_downloadtarget_free);
 
     return ret;
@@ -1122,7 +1565,7 @@ lr_yum_use_local_load_base(LrHandle *handle,
     _cleanup_free_ gchar *sig = NULL;
     _cleanup_fd_close_ int fd = -1;
 
-    if (handle->mirrorlist_fd != -1) {
+    if (handle->mirrorlist_data && !repo->mirrorlist) {
         // Locate mirrorlist if available.
         gchar *mrl_fn = lr_pathconcat(baseurl, "mirrorlist", NULL);
         if (g_file_test(mrl_fn, G_FILE_TEST_IS_REGULAR)) {
@@ -1134,7 +1577,7 @@ lr_yum_use_local_load_base(LrHandle *handle,
         }
     }
 
-    if (handle->metalink_fd != -1) {
+    if (handle->metalink_data && !repo->metalink) {
         // Locate metalink.xml if available.
         gchar *mtl_fn = lr_pathconcat(baseurl, "metalink.xml", NULL);
         if (g_file_test(mtl_fn, G_FILE_TEST_IS_REGULAR)) {
@@ -1208,6 +1651,57 @@ lr_yum_use_local_load_base(LrHandle *handle,
     return TRUE;
 }
 
+/** Locate metadata files listed in repomd in the local repository.
+ */
+static gboolean
+lr_yum_locate_records(LrHandle *handle,
+                      LrYumRepo *repo,
+                      LrYumRepoMd *repomd,
+                      const char *baseurl,
+                      gboolean ignoremissing,
+                      GError **err)
+{
+    if(handle->cachedir) {
+        lr_yum_switch_to_zchunk(handle, repomd);
+        repo->use_zchunk = TRUE;
+    } else {
+        g_debug("%s: Cache directory not set, disabling zchunk", __func__);
+        repo->use_zchunk = FALSE;
+    }
+
+    for (GSList *elem = repomd->records; elem; elem = g_slist_next(elem)) {
+        _cleanup_free_ char *path = NULL;
+        LrYumRepoMdRecord *record = elem->data;
+
+        assert(record);
+
+        if (!lr_yum_repomd_record_enabled(handle, record->type, repomd->records))
+            continue; // Caller isn't interested in this record type
+        if (yum_repo_path(repo, record->type))
+            continue; // This path already exists in repo
+
+        path = lr_pathconcat(baseurl, record->location_href, NULL);
+
+        if (access(path, F_OK) == -1) {
+            // A repo file is missing
+            if (!ignoremissing) {
+                g_debug("%s: Incomplete repository - %s is missing",
+                        __func__, path);
+                g_set_error(err, LR_YUM_ERROR, LRE_INCOMPLETEREPO,
+                            "Incomplete repository - %s is missing",
+                            path);
+                return FALSE;
+            }
+
+            continue;
+        }
+
+        lr_yum_repo_append(repo, record->type, path);
+    }
+
+    return TRUE;
+}
+
 /* Do not duplicate repoata, just locate the local one */
 static gboolean
 lr_yum_use_local(LrHandle *handle, LrResult *result, GError **err)
@@ -1245,46 +1739,95 @@ lr_yum_use_local(LrHandle *handle, LrResult *result, GError **err)
             return FALSE;
     }
 
-    if(handle->cachedir) {
-        lr_yum_switch_to_zchunk(handle, repomd);
-        repo->use_zchunk = TRUE;
-    } else {
-        g_debug("%s: Cache directory not set, disabling zchunk", __func__);
-        repo->use_zchunk = FALSE;
-    }
-
     // Locate rest of metadata files
-    for (GSList *elem = repomd->records; elem; elem = g_slist_next(elem)) {
-        _cleanup_free_ char *path = NULL;
-        LrYumRepoMdRecord *record = elem->data;
+    if (!lr_yum_locate_records(handle, repo, repomd, baseurl,
+                               handle->ignoremissing, err))
+        return FALSE;
 
-        assert(record);
+    g_debug("%s: Repository was successfully located", __func__);
+    return TRUE;
+}
 
-        if (!lr_yum_repomd_record_enabled(handle, record->type, repomd->records))
-            continue; // Caller isn't interested in this record type
-        if (yum_repo_path(repo, record->type))
-            continue; // This path already exists in repo
+/** Register decompressed metadata files which are already present in
+ * the destdir (see LRO_DECOMPRESS). Missing or broken ones are
+ * decompressed again.
+ */
+static gboolean
+lr_yum_use_destdir_decompressed(LrHandle *handle,
+                                LrYumRepo *repo,
+                                LrYumRepoMd *repomd,
+                                GError **err)
+{
+    for (GSList *elem = repomd->records; elem; elem = g_slist_next(elem)) {
+        LrYumRepoMdRecord *record = elem->data;
+        const char *path = lr_yum_repo_path(repo, record->type);
+        _cleanup_free_ gchar *dest = lr_path_without_compression_suffix(path);
+        _cleanup_free_ gchar *type = NULL;
+        gboolean valid = FALSE;
+        LrChecksumType checksum_type = LR_CHECKSUM_UNKNOWN;
 
-        path = lr_pathconcat(baseurl, record->location_href, NULL);
+        if (!dest)  // Not compressed or zchunk
+            continue;
 
-        if (access(path, F_OK) == -1) {
-            // A repo file is missing
-            if (!handle->ignoremissing) {
-                g_debug("%s: Incomplete repository - %s is missing",
-                        __func__, path);
-                g_set_error(err, LR_YUM_ERROR, LRE_INCOMPLETEREPO,
-                            "Incomplete repository - %s is missing",
-                            path);
-                return FALSE;
-            }
+        if ((handle->checks & LR_CHECK_CHECKSUM) && record->checksum_open)
+            checksum_type = lr_checksum_type(record->checksum_open_type);
 
-            continue;
+        _cleanup_fd_close_ int fd = open(dest, O_RDONLY);
+        if (fd != -1 && checksum_type != LR_CHECKSUM_UNKNOWN) {
+            GError *tmp_err = NULL;
+            if (!lr_checksum_fd_cmp(checksum_type, fd, record->checksum_open,
+                                    TRUE, &valid, &tmp_err))
+                g_clear_error(&tmp_err);
+        } else {
+            valid = (fd != -1);
         }
 
-        lr_yum_repo_append(repo, record->type, path);
+        if (!valid && !lr_decompress_file(path, dest, checksum_type,
+                                          record->checksum_open, err))
+            return FALSE;
+
+        type = g_strconcat(record->type, "_open", NULL);
+        lr_yum_repo_update(repo, type, dest);
     }
 
-    g_debug("%s: Repository was successfully located", __func__);
+    return TRUE;
+}
+
+/** Use the repository downloaded into destdir earlier, its repomd.xml
+ * was reported to be up to date. Metadata files are checked the same way
+ * as if they were just downloaded.
+ */
+static gboolean
+lr_yum_use_destdir(LrHandle *handle, LrResult *result, GError **err)
+{
+    LrYumRepo *repo = result->yum_repo;
+    LrYumRepoMd *repomd = result->yum_repomd;
+
+    assert(!err || *err == NULL);
+
+    g_debug("%s: Using repo in %s", __func__, handle->destdir);
+
+    if (!lr_yum_use_local_load_base(handle, result, repo, repomd,
+                                    handle->destdir, err))
+        return FALSE;
+
+    if (!lr_yum_locate_records(handle, repo, repomd, handle->destdir,
+                               FALSE, err))
+        return FALSE;
+
+    if ((handle->checks & LR_CHECK_CHECKSUM)
+        && !lr_yum_check_repo_checksums(repo, repomd, err))
+        return FALSE;
+
+    if (handle->decompress
+        && !lr_yum_use_destdir_decompressed(handle, repo, repomd, err))
+        return FALSE;
+
+    if (handle->used_mirror)
+        repo->url = g_strdup(handle->used_mirror);
+    else  // Nothing was downloaded, the metalink proved repomd.xml is current
+        repo->url = g_strdup(lr_lrmirrorlist_nth_url(handle->internal_mirrorlist, 0));
+
     return TRUE;
 }
 
@@ -1296,6 +1839,8 @@ lr_yum_download_remote(LrHandle *handle, LrResult *result, GError **err)
     LrYumRepo *repo;
     LrYumRepoMd *repomd;
     GError *tmp_err = NULL;
+    __attribute__ ((cleanup(lr_repomd_validators_clear)))
+        LrRepomdValidators validators = { NULL, 0, FALSE };
 
     assert(!err || *err == NULL);
 
@@ -1316,15 +1861,64 @@ lr_yum_download_remote(LrHandle *handle, LrResult *result, GError **err)
         if (!lr_copy_metalink_content(handle, repo, err))
             return FALSE;
 
-        if ((fd = lr_prepare_repomd_xml_file(handle, &path, err)) == -1)
-            return FALSE;
+        if (handle->conditionalrefresh) {
+            gboolean uptodate = lr_yum_repomd_matches_metalink(handle);
 
-        /* Download repomd.xml */
-        ret = lr_yum_download_repomd(handle, handle->metalink, fd, err);
-        if (!ret) {
-            close(fd);
-            lr_free(path);
-            return FALSE;
+            /* Download repomd.xml only if it was changed */
+            if (!uptodate) {
+                if (!lr_yum_download_repomd_conditional(handle, TRUE, &fd,
+                                                        &path, &validators,
+                                                        err))
+                    return FALSE;
+                uptodate = validators.notmodified;
+            }
+
+            if (uptodate) {
+                if (lr_yum_use_destdir(handle, result, &tmp_err))
+                    return TRUE;
+
+                // Local repository is broken, start over
+                g_debug("%s: Cannot use repo in destdir: %s",
+                        __func__, tmp_err->message);
+                g_clear_error(&tmp_err);
+                lr_yum_repo_free(result->yum_repo);
+                lr_yum_repomd_free(result->yum_repomd);
+                lr_free(result->destdir);
+                result->destdir = NULL;
+                result->yum_repo = repo = lr_yum_repo_init();
+                result->yum_repomd = repomd = lr_yum_repomd_init();
+                lr_repomd_validators_clear(&validators);
+
+                if (!lr_store_mirrorlist_files(handle, repo, err))
+                    return FALSE;
+
+                if (!lr_copy_metalink_content(handle, repo, err))
+                    return FALSE;
+
+                if (!lr_yum_download_repomd_conditional(handle, FALSE, &fd,
+                                                        &path, &validators,
+                                                        err))
+                    return FALSE;
+
+                if (validators.notmodified) {
+                    g_set_error(err, LR_YUM_ERROR, LRE_BADSTATUS,
+                                "Server reported that repomd.xml was not "
+                                "modified, but no validators were sent");
+                    return FALSE;
+                }
+            }
+        } else {
+            if ((fd = lr_prepare_repomd_xml_file(handle, &path, err)) == -1)
+                return FALSE;
+
+            /* Download repomd.xml */
+            ret = lr_yum_download_repomd(handle, handle->metalink, fd,
+                                         NULL, err);
+            if (!ret) {
+                close(fd);
+                lr_free(path);
+                return FALSE;
+            }
         }
 
         if (!lr_check_repomd_xml_asc_availability(handle, repo, fd, path, err)) {
@@ -1370,6 +1964,9 @@ lr_yum_download_remote(LrHandle *handle, LrResult *result, GError **err)
         return FALSE;
     }
 
+    if (handle->conditionalrefresh && !handle->update)
+        lr_yum_save_repomd_validators(handle, &validators);
+
     return TRUE;
 }
 
@@ -135,6 +135,18 @@ lr_prepare_repomd_xml_file(LrHandle *handle, char **path, GError **err);
 gboolean
 lr_check_repomd_xml_asc_availability(LrHandle *handle, LrYumRepo *repo, int fd, char *path, GError **err);
 
+/** Verifies already downloaded repomd.xml.asc against repomd.xml
+ * and stores the signature path to the repo.
+ * @param handle        Handle object containing gnupg home dir
+ * @param repo          Yum repository
+ * @param signature     Path to the downloaded repomd.xml.asc
+ * @param path          Path to the repomd.xml
+ * @param err           Object for storing errors
+ * @return              True if the signature is valid
+ */
+gboolean
+lr_check_repomd_xml_asc(LrHandle *handle, LrYumRepo *repo, const char *signature, const char *path, GError **err);
+
 /** Stores best checksum on the beginning of @param checksums
  * @param metalink      Metalink
  * @param checksums     List of checksums
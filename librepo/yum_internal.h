@@ -26,6 +26,8 @@
 #include "rcodes.h"
 #include "result.h"
 #include "handle.h"
+#include "yum.h"
+#include "metadata_downloader.h"
 
 G_BEGIN_DECLS
 
@@ -35,6 +37,69 @@ gboolean
 lr_yum_download_url(LrHandle *lr_handle, const char *url, int fd,
                     gboolean no_cache, gboolean is_zchunk, GError **err);
 
+/** Download the URL into memory.
+ * @param data      On success, the downloaded data are pointed here,
+ *                  the buffer must be freed by caller.
+ */
+gboolean
+lr_yum_download_url_data(LrHandle *lr_handle, const char *url,
+                         gboolean no_cache, GByteArray **data, GError **err);
+
+CbData *
+lr_cbdata_new(void *userdata, void *cbdata, LrProgressCb progresscb,
+              LrHandleMirrorFailureCb hmfcb, const char *metadata);
+int
+lr_yum_progresscb(void *clientp, double total_to_download, double downloaded);
+void
+lr_cbdata_free(CbData *data);
+gboolean
+prepare_repo_download_targets(LrHandle *handle, LrYumRepo *repo,
+                              LrYumRepoMd *repomd, LrMetadataTarget *mdtarget,
+                              GSList **targets, GSList **cbdata_list,
+                              GError **err);
+gboolean
+error_handling(GSList *targets, GError **dest_error, GError *src_error);
+void
+lr_metadatatarget_append_error(LrMetadataTarget *target, char *format, ...);
+
+/** Decompression stage of downloaded metadata files (see LRO_DECOMPRESS).
+ * Files are decompressed in worker threads as soon as their download
+ * is finished, so the decompression overlaps with the rest of the download.
+ */
+typedef struct _LrDecompressStage LrDecompressStage;
+
+/** Create new empty decompression stage. */
+LrDecompressStage *
+lr_decompress_stage_new(void);
+
+/** Queue decompression of the finished metadata file download.
+ * The target must be prepared by prepare_repo_download_targets().
+ * Nothing is done if LRO_DECOMPRESS is disabled, the download failed or
+ * the file is not compressed.
+ * @param stage         Decompression stage
+ * @param handle        Handle of the repository
+ * @param repo          Repository the file belongs to
+ * @param mdtarget      Metadata target where errors should be appended
+ *                      or NULL to report them by lr_decompress_stage_finish()
+ * @param target        Finished download target
+ */
+void
+lr_decompress_stage_push(LrDecompressStage *stage,
+                         LrHandle *handle,
+                         LrYumRepo *repo,
+                         LrMetadataTarget *mdtarget,
+                         LrDownloadTarget *target);
+
+/** Wait for all queued decompressions, register decompressed files as
+ * "<type>_open" in their repositories and free the stage.
+ * @param stage         Decompression stage
+ * @param err           GError **
+ * @return              FALSE if a decompression without metadata
+ *                      target failed, err is set then.
+ */
+gboolean
+lr_decompress_stage_finish(LrDecompressStage *stage, GError **err);
+
 G_END_DECLS
 
 #endif
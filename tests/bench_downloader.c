@@ -0,0 +1,177 @@
+/* Benchmark of the scheduling loop of the downloader.
+ *
+ * Many small packages are downloaded from a handle with many file://
+ * mirrors. Only the last mirror has the packages, all the others fail,
+ * so every mirror selection walks the whole table of mirrors and most
+ * of the time is spent by the downloader itself rather than by the
+ * transfers. Wall and CPU time per target are reported.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/resource.h>
+#include <glib.h>
+
+#include "librepo/librepo.h"
+
+static gint64
+cpu_time(void)
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return (gint64) (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * G_USEC_PER_SEC
+           + usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+}
+
+/** Create mirror directories, only the last one contains the packages */
+static gchar **
+prepare_mirrors(const char *tmpdir, int mirrors, int targets, int size)
+{
+    gchar **urls = g_new0(gchar *, mirrors + 1);
+    gchar *content = g_malloc(size);
+    memset(content, 'x', size);
+
+    for (int i = 0; i < mirrors; i++) {
+        gchar *dir = g_strdup_printf("%s/mirror%d", tmpdir, i);
+        g_mkdir_with_parents(dir, 0755);
+        urls[i] = g_strdup_printf("file://%s/", dir);
+        if (i == mirrors - 1) {
+            for (int j = 0; j < targets; j++) {
+                gchar *fn = g_strdup_printf("%s/package-%d.rpm", dir, j);
+                g_file_set_contents(fn, content, size, NULL);
+                g_free(fn);
+            }
+        }
+        g_free(dir);
+    }
+
+    g_free(content);
+    return urls;
+}
+
+static gboolean
+bench(LrHandle *handle, const char *destdir, int targets,
+      gint64 *wall, gint64 *cpu)
+{
+    GError *tmp_err = NULL;
+    GSList *list = NULL;
+    gboolean ret = TRUE;
+
+    for (int i = targets - 1; i >= 0; i--) {
+        gchar *path = g_strdup_printf("package-%d.rpm", i);
+        LrPackageTarget *target = lr_packagetarget_new_v2(
+                handle, path, destdir, LR_CHECKSUM_UNKNOWN, NULL, 0,
+                NULL, FALSE, NULL, NULL, NULL, NULL, &tmp_err);
+        g_free(path);
+        if (!target) {
+            fprintf(stderr, "%s\n", tmp_err->message);
+            g_error_free(tmp_err);
+            g_slist_free_full(list, (GDestroyNotify) lr_packagetarget_free);
+            return FALSE;
+        }
+        list = g_slist_prepend(list, target);
+    }
+
+    gint64 wall_start = g_get_monotonic_time();
+    gint64 cpu_start = cpu_time();
+    if (!lr_download_packages(list, LR_PACKAGEDOWNLOAD_FAILFAST, &tmp_err)) {
+        fprintf(stderr, "%s\n", tmp_err->message);
+        g_error_free(tmp_err);
+        ret = FALSE;
+    }
+    *wall = g_get_monotonic_time() - wall_start;
+    *cpu = cpu_time() - cpu_start;
+
+    g_slist_free_full(list, (GDestroyNotify) lr_packagetarget_free);
+    return ret;
+}
+
+int
+main(int argc, char *argv[])
+{
+    GError *tmp_err = NULL;
+    gint targets = 10000;
+    gint mirrors = 100;
+    gint parallel = 5;
+    gint size = 64;
+    gint repeat = 3;
+    gboolean ret = TRUE;
+
+    GOptionEntry entries[] = {
+        { "targets", 't', 0, G_OPTION_ARG_INT, &targets,
+          "Downloaded packages (default: 10000)", "N" },
+        { "mirrors", 'm', 0, G_OPTION_ARG_INT, &mirrors,
+          "Mirrors of the handle (default: 100)", "N" },
+        { "parallel", 'p', 0, G_OPTION_ARG_INT, &parallel,
+          "LRO_MAXPARALLELDOWNLOADS (default: 5)", "N" },
+        { "size", 's', 0, G_OPTION_ARG_INT, &size,
+          "Size of a package in bytes (default: 64)", "BYTES" },
+        { "repeat", 'r', 0, G_OPTION_ARG_INT, &repeat,
+          "Runs of the download (default: 3)", "N" },
+        { NULL, 0, 0, 0, NULL, NULL, NULL }
+    };
+
+    GOptionContext *context = g_option_context_new(
+        "- benchmark scheduling of many targets over many mirrors");
+    g_option_context_add_main_entries(context, entries, NULL);
+    if (!g_option_context_parse(context, &argc, &argv, &tmp_err)) {
+        fprintf(stderr, "%s\n", tmp_err->message);
+        g_error_free(tmp_err);
+        g_option_context_free(context);
+        return EXIT_FAILURE;
+    }
+    g_option_context_free(context);
+
+    if (targets < 1 || mirrors < 1 || parallel < 1 || size < 1 || repeat < 1) {
+        fprintf(stderr, "All the numbers must be positive\n");
+        return EXIT_FAILURE;
+    }
+
+    gchar *tmpdir = g_dir_make_tmp("librepo-bench-XXXXXX", &tmp_err);
+    if (!tmpdir) {
+        fprintf(stderr, "%s\n", tmp_err->message);
+        g_error_free(tmp_err);
+        return EXIT_FAILURE;
+    }
+
+    gchar **urls = prepare_mirrors(tmpdir, mirrors, targets, size);
+
+    LrHandle *handle = lr_handle_init();
+    if (!lr_handle_setopt(handle, &tmp_err, LRO_REPOTYPE, LR_YUMREPO)
+        || !lr_handle_setopt(handle, &tmp_err, LRO_URLS, urls)
+        || !lr_handle_setopt(handle, &tmp_err, LRO_MAXPARALLELDOWNLOADS, (long) parallel))
+    {
+        fprintf(stderr, "%s\n", tmp_err->message);
+        g_error_free(tmp_err);
+        ret = FALSE;
+    }
+
+    printf("%8s %8s %8s %10s %10s %12s %12s\n",
+           "targets", "mirrors", "run", "wall s", "cpu s",
+           "wall us/tgt", "cpu us/tgt");
+
+    for (int run = 0; ret && run < repeat; run++) {
+        gint64 wall, cpu;
+        gchar *destdir = g_strdup_printf("%s/dest%d", tmpdir, run);
+        g_mkdir_with_parents(destdir, 0755);
+
+        ret = bench(handle, destdir, targets, &wall, &cpu);
+        if (ret)
+            printf("%8d %8d %8d %10.3f %10.3f %12.2f %12.2f\n",
+                   targets, mirrors, run,
+                   (double) wall / G_USEC_PER_SEC,
+                   (double) cpu / G_USEC_PER_SEC,
+                   (double) wall / targets,
+                   (double) cpu / targets);
+        g_free(destdir);
+    }
+
+    lr_handle_free(handle);
+    g_strfreev(urls);
+    lr_remove_dir(tmpdir);
+    g_free(tmpdir);
+
+    return ret ? EXIT_SUCCESS : EXIT_FAILURE;
+}
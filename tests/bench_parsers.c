@@ -0,0 +1,349 @@
+/* Microbenchmarks of the repomd, metalink and mirrorlist parsers.
+ *
+ * Large synthetic documents are generated to temporary files and every
+ * one is parsed repeatedly. Parse time, throughput and the number of
+ * heap allocations per parse are reported.
+ *
+ * Allocations are counted by wrappers of malloc(), calloc() and realloc()
+ * which are only available with glibc. Elsewhere the counts are -1.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <glib.h>
+
+#include "librepo/repomd.h"
+#include "librepo/metalink.h"
+#include "librepo/mirrorlist.h"
+
+/* Allocation counting */
+
+static gboolean count_allocations = FALSE;
+static gint64 allocations = 0;
+static gint64 allocated_bytes = 0;
+
+#ifdef __GLIBC__
+#define HAVE_ALLOCATION_COUNTING 1
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+void *
+malloc(size_t size)
+{
+    if (count_allocations) {
+        allocations++;
+        allocated_bytes += size;
+    }
+    return __libc_malloc(size);
+}
+
+void *
+calloc(size_t nmemb, size_t size)
+{
+    if (count_allocations) {
+        allocations++;
+        allocated_bytes += nmemb * size;
+    }
+    return __libc_calloc(nmemb, size);
+}
+
+void *
+realloc(void *ptr, size_t size)
+{
+    if (count_allocations) {
+        allocations++;
+        allocated_bytes += size;
+    }
+    return __libc_realloc(ptr, size);
+}
+#else
+#define HAVE_ALLOCATION_COUNTING 0
+#endif
+
+/* Document generators */
+
+static gchar *
+generate_repomd(int records)
+{
+    GString *str = g_string_new(
+        "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+        "<repomd xmlns=\"http://linux.duke.edu/metadata/repo\" "
+        "xmlns:rpm=\"http://linux.duke.edu/metadata/rpm\">\n"
+        "  <revision>1347459931</revision>\n"
+        "  <tags>\n"
+        "    <content>binary-x86_64</content>\n"
+        "    <distro cpeid=\"cpe:/o:fedoraproject:fedora:40\">Fedora 40</distro>\n"
+        "  </tags>\n");
+
+    for (int i = 0; i < records; i++) {
+        g_string_append_printf(str,
+            "  <data type=\"type%d\">\n"
+            "    <checksum type=\"sha256\">%064x</checksum>\n"
+            "    <open-checksum type=\"sha256\">%064x</open-checksum>\n"
+            "    <header-checksum type=\"sha256\">%064x</header-checksum>\n"
+            "    <location href=\"repodata/%064x-type%d.xml.zck\"/>\n"
+            "    <timestamp>%d</timestamp>\n"
+            "    <size>%d</size>\n"
+            "    <open-size>%d</open-size>\n"
+            "    <header-size>%d</header-size>\n"
+            "    <database_version>10</database_version>\n"
+            "  </data>\n",
+            i, i, i + 1, i + 2, i, i,
+            1347459930 + i, 1000 + i, 5000 + i, 200 + i);
+    }
+
+    g_string_append(str, "</repomd>\n");
+    return g_string_free(str, FALSE);
+}
+
+static void
+append_metalink_hashes(GString *str, int seed, const char *indent)
+{
+    g_string_append_printf(str,
+        "%s<verification>\n"
+        "%s  <hash type=\"md5\">%032x</hash>\n"
+        "%s  <hash type=\"sha1\">%040x</hash>\n"
+        "%s  <hash type=\"sha256\">%064x</hash>\n"
+        "%s  <hash type=\"sha512\">%0128x</hash>\n"
+        "%s</verification>\n",
+        indent, indent, seed, indent, seed, indent, seed,
+        indent, seed, indent);
+}
+
+static gchar *
+generate_metalink(int mirrors, int alternates)
+{
+    static const char *protocols[] = { "http", "https", "ftp", "rsync" };
+    static const char *countries[] = { "US", "CZ", "DE", "GB", "FR", "JP" };
+
+    GString *str = g_string_new(
+        "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n"
+        "<metalink version=\"3.0\" xmlns=\"http://www.metalinker.org/\" "
+        "type=\"dynamic\" pubdate=\"Tue, 15 Oct 2013 08:48:18 GMT\" "
+        "generator=\"mirrormanager\" "
+        "xmlns:mm0=\"http://fedorahosted.org/mirrormanager\">\n"
+        "  <files>\n"
+        "    <file name=\"repomd.xml\">\n"
+        "      <mm0:timestamp>1381706941</mm0:timestamp>\n"
+        "      <size>4761</size>\n");
+    append_metalink_hashes(str, 0, "      ");
+
+    if (alternates > 0) {
+        g_string_append(str, "      <mm0:alternates>\n");
+        for (int i = 0; i < alternates; i++) {
+            g_string_append_printf(str,
+                "        <mm0:alternate>\n"
+                "          <mm0:timestamp>%d</mm0:timestamp>\n"
+                "          <size>%d</size>\n",
+                1381706940 - i, 4700 + i);
+            append_metalink_hashes(str, i + 1, "          ");
+            g_string_append(str, "        </mm0:alternate>\n");
+        }
+        g_string_append(str, "      </mm0:alternates>\n");
+    }
+
+    g_string_append(str, "      <resources maxconnections=\"1\">\n");
+    for (int i = 0; i < mirrors; i++) {
+        const char *protocol = protocols[i % G_N_ELEMENTS(protocols)];
+        g_string_append_printf(str,
+            "        <url protocol=\"%s\" type=\"%s\" location=\"%s\" "
+            "preference=\"%d\" >%s://mirror%d.example.com/pub/fedora/linux/"
+            "updates/40/Everything/x86_64/repodata/repomd.xml</url>\n",
+            protocol, protocol, countries[i % G_N_ELEMENTS(countries)],
+            100 - (i * 100 / (mirrors + 1)), protocol, i);
+    }
+    g_string_append(str,
+        "      </resources>\n"
+        "    </file>\n"
+        "  </files>\n"
+        "</metalink>\n");
+
+    return g_string_free(str, FALSE);
+}
+
+static gchar *
+generate_mirrorlist(int mirrors)
+{
+    GString *str = g_string_new(
+        "# repo = fedora-40 arch = x86_64 country = US country = CA\n");
+    for (int i = 0; i < mirrors; i++)
+        g_string_append_printf(str,
+            "http://mirror%d.example.com/pub/fedora/linux/releases/40/"
+            "Everything/x86_64/os/\n", i);
+    return g_string_free(str, FALSE);
+}
+
+/* Parsers */
+
+static gboolean
+parse_repomd(int fd, GError **err)
+{
+    LrYumRepoMd *repomd = lr_yum_repomd_init();
+    gboolean ret = lr_yum_repomd_parse_file(repomd, fd, NULL, NULL, err);
+    lr_yum_repomd_free(repomd);
+    return ret;
+}
+
+static gboolean
+parse_metalink(int fd, GError **err)
+{
+    LrMetalink *metalink = lr_metalink_init();
+    gboolean ret = lr_metalink_parse_file(metalink, fd, "repomd.xml",
+                                          NULL, NULL, err);
+    lr_metalink_free(metalink);
+    return ret;
+}
+
+static gboolean
+parse_mirrorlist(int fd, GError **err)
+{
+    LrMirrorlist *mirrorlist = lr_mirrorlist_init();
+    gboolean ret = lr_mirrorlist_parse_file(mirrorlist, fd, err);
+    lr_mirrorlist_free(mirrorlist);
+    return ret;
+}
+
+typedef gboolean (*ParseFunc)(int fd, GError **err);
+
+/* Benchmark */
+
+static gint64 iterations = 0;
+static double min_time = 1.0;
+
+static gboolean
+bench(const char *name, const gchar *document, ParseFunc parse)
+{
+    GError *tmp_err = NULL;
+    gchar *filename = NULL;
+    size_t len = strlen(document);
+
+    int fd = g_file_open_tmp("librepo-bench-XXXXXX", &filename, &tmp_err);
+    if (fd == -1) {
+        fprintf(stderr, "%s: %s\n", name, tmp_err->message);
+        g_error_free(tmp_err);
+        return FALSE;
+    }
+    unlink(filename);
+    g_free(filename);
+
+    if (write(fd, document, len) != (ssize_t) len) {
+        fprintf(stderr, "%s: Cannot write: %s\n", name, g_strerror(errno));
+        close(fd);
+        return FALSE;
+    }
+
+    // Warm up and count the allocations of a single parse
+    lseek(fd, 0, SEEK_SET);
+    allocations = allocated_bytes = 0;
+    count_allocations = TRUE;
+    gboolean ret = parse(fd, &tmp_err);
+    count_allocations = FALSE;
+    if (!ret) {
+        fprintf(stderr, "%s: %s\n", name, tmp_err->message);
+        g_error_free(tmp_err);
+        close(fd);
+        return FALSE;
+    }
+    gint64 parse_allocations = HAVE_ALLOCATION_COUNTING ? allocations : -1;
+    gint64 parse_bytes = HAVE_ALLOCATION_COUNTING ? allocated_bytes : -1;
+
+    // Parse repeatedly for the requested count or time
+    gint64 count = 0;
+    gint64 start = g_get_monotonic_time();
+    gint64 elapsed = 0;
+    while (iterations > 0 ? count < iterations
+                          : elapsed < (gint64) (min_time * G_USEC_PER_SEC)) {
+        lseek(fd, 0, SEEK_SET);
+        if (!parse(fd, &tmp_err)) {
+            fprintf(stderr, "%s: %s\n", name, tmp_err->message);
+            g_error_free(tmp_err);
+            close(fd);
+            return FALSE;
+        }
+        count++;
+        elapsed = g_get_monotonic_time() - start;
+    }
+    close(fd);
+
+    double seconds = (double) elapsed / G_USEC_PER_SEC;
+    printf("%-28s %10zu %8"G_GINT64_FORMAT" %12.2f %10.2f %12"G_GINT64_FORMAT" %14"G_GINT64_FORMAT"\n",
+           name,
+           len,
+           count,
+           seconds * 1e6 / count,
+           (len * count) / seconds / (1024 * 1024),
+           parse_allocations,
+           parse_bytes);
+    return TRUE;
+}
+
+int
+main(int argc, char *argv[])
+{
+    GError *tmp_err = NULL;
+    gint records = 50;
+    gint mirrors = 500;
+    gint alternates = 20;
+    gboolean ret = TRUE;
+
+    GOptionEntry entries[] = {
+        { "records", 'r', 0, G_OPTION_ARG_INT, &records,
+          "Records in the big repomd.xml (default: 50)", "N" },
+        { "mirrors", 'm', 0, G_OPTION_ARG_INT, &mirrors,
+          "Mirrors in the big metalink and mirrorlist (default: 500)", "N" },
+        { "alternates", 'a', 0, G_OPTION_ARG_INT, &alternates,
+          "Alternates in the big metalink (default: 20)", "N" },
+        { "iterations", 'i', 0, G_OPTION_ARG_INT64, &iterations,
+          "Parse every document N times (default: as many as fit into --time)", "N" },
+        { "time", 't', 0, G_OPTION_ARG_DOUBLE, &min_time,
+          "Seconds spent by every document (default: 1.0)", "SECONDS" },
+        { NULL, 0, 0, 0, NULL, NULL, NULL }
+    };
+
+    GOptionContext *context = g_option_context_new(
+        "- benchmark repomd, metalink and mirrorlist parsers");
+    g_option_context_add_main_entries(context, entries, NULL);
+    if (!g_option_context_parse(context, &argc, &argv, &tmp_err)) {
+        fprintf(stderr, "%s\n", tmp_err->message);
+        g_error_free(tmp_err);
+        g_option_context_free(context);
+        return EXIT_FAILURE;
+    }
+    g_option_context_free(context);
+
+    struct {
+        gchar *name;
+        gchar *document;
+        ParseFunc parse;
+    } docs[] = {
+        { g_strdup("repomd-small"), generate_repomd(5), parse_repomd },
+        { g_strdup_printf("repomd-%d", records),
+          generate_repomd(records), parse_repomd },
+        { g_strdup("metalink-small"), generate_metalink(10, 0), parse_metalink },
+        { g_strdup_printf("metalink-%d", mirrors),
+          generate_metalink(mirrors, 0), parse_metalink },
+        { g_strdup_printf("metalink-%d-alt%d", mirrors, alternates),
+          generate_metalink(mirrors, alternates), parse_metalink },
+        { g_strdup("mirrorlist-small"), generate_mirrorlist(10), parse_mirrorlist },
+        { g_strdup_printf("mirrorlist-%d", mirrors),
+          generate_mirrorlist(mirrors), parse_mirrorlist },
+    };
+
+    printf("%-28s %10s %8s %12s %10s %12s %14s\n",
+           "document", "bytes", "parses", "us/parse", "MiB/s",
+           "allocs/parse", "alloc B/parse");
+
+    for (size_t i = 0; i < G_N_ELEMENTS(docs); i++) {
+        if (!bench(docs[i].name, docs[i].document, docs[i].parse))
+            ret = FALSE;
+        g_free(docs[i].name);
+        g_free(docs[i].document);
+    }
+
+    return ret ? EXIT_SUCCESS : EXIT_FAILURE;
+}
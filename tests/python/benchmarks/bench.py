@@ -0,0 +1,295 @@
+#!/usr/bin/env python3
+"""
+End-to-end throughput benchmarks of librepo.
+
+A synthetic repository is generated and served by a farm of local
+mirrors which simulate latency, limited bandwidth and failures.
+Every scenario is run in a fresh child process, so the measured
+CPU time (and optionally syscalls) belongs only to the scenario.
+The results are written as JSON.
+
+Scenarios:
+
+* ``metadata`` - download_metadata() of --repos repositories
+* ``packages`` - download_packages() of all the packages
+* ``fastestmirror`` - fetch the mirrorlist and sort it by the speed
+
+Example::
+
+    bench.py --mirrors 8 --packages 5000 --latency 0.02 -o results.json
+"""
+
+import argparse
+import json
+import os
+import platform
+import re
+import resource
+import shutil
+import statistics
+import subprocess
+import sys
+import tempfile
+import time
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+
+import librepo
+import mirrorfarm
+import synthrepo
+
+SCENARIOS = ["metadata", "packages", "fastestmirror"]
+
+
+def new_handle(args, urls=None):
+    h = librepo.Handle()
+    h.repotype = librepo.YUMREPO
+    h.maxparalleldownloads = args.parallel
+    if urls:
+        h.urls = urls
+    return h
+
+
+def run_metadata(args, workdir):
+    targets = []
+    for i in range(args.repos):
+        h = new_handle(args, args.mirrors_urls)
+        h.destdir = os.path.join(workdir, "repo%d" % i)
+        os.mkdir(h.destdir)
+        targets.append(librepo.MetadataTarget(handle=h))
+    librepo.download_metadata(targets)
+    failed = [t.err for t in targets if t.err]
+    if failed:
+        raise RuntimeError("Metadata download failed: %s" % failed[0])
+
+
+def run_packages(args, workdir):
+    h = new_handle(args, args.mirrors_urls)
+    with open(os.path.join(args.repodir, "packages.json")) as f:
+        packages = json.load(f)
+    targets = [librepo.PackageTarget(location, dest=workdir,
+                                     checksum_type=librepo.CHECKSUM_SHA256,
+                                     checksum=checksum,
+                                     expectedsize=size,
+                                     handle=h)
+               for location, checksum, size in packages]
+    librepo.download_packages(targets)
+    failed = [t.err for t in targets if t.err]
+    if failed:
+        raise RuntimeError("%d packages failed: %s" % (len(failed), failed[0]))
+
+
+def run_fastestmirror(args, workdir):
+    h = new_handle(args)
+    h.mirrorlisturl = args.mirrorlist_url
+    h.destdir = workdir
+    h.fetchmirrors = True
+    h.fastestmirror = True
+    h.fastestmirrorcache = os.path.join(workdir, "fastestmirror.cache")
+    h.perform()
+
+
+def run_noop(args, workdir):
+    pass
+
+
+RUNNERS = {
+    "metadata": run_metadata,
+    "packages": run_packages,
+    "fastestmirror": run_fastestmirror,
+    "noop": run_noop,
+}
+
+
+def child_main(args):
+    """Run a single scenario and print its measurements as JSON"""
+    workdir = tempfile.mkdtemp(prefix="librepo-bench-", dir=args.workdir)
+    try:
+        before = resource.getrusage(resource.RUSAGE_SELF)
+        start = time.perf_counter()
+        RUNNERS[args.run](args, workdir)
+        wall = time.perf_counter() - start
+        after = resource.getrusage(resource.RUSAGE_SELF)
+    finally:
+        shutil.rmtree(workdir, ignore_errors=True)
+
+    print(json.dumps({
+        "wall_time": wall,
+        "user_time": after.ru_utime - before.ru_utime,
+        "system_time": after.ru_stime - before.ru_stime,
+        "max_rss_kb": after.ru_maxrss,
+        "voluntary_ctx_switches": after.ru_nvcsw - before.ru_nvcsw,
+        "involuntary_ctx_switches": after.ru_nivcsw - before.ru_nivcsw,
+    }))
+
+
+STRACE_TOTAL_RE = re.compile(r"^\s*100\.00\s+\S+\s+(?:\S+\s+)?(\d+)\s+(?:\d+\s+)?total\s*$")
+
+
+def parse_strace_total(filename):
+    """Return total number of syscalls from the output of strace -c"""
+    with open(filename) as f:
+        for line in f:
+            match = STRACE_TOTAL_RE.match(line)
+            if match:
+                return int(match.group(1))
+    return None
+
+
+def run_child(args, scenario, farm, syscalls):
+    cmd = [sys.executable, os.path.abspath(__file__),
+           "--run", scenario,
+           "--repodir", args.repodir,
+           "--mirrors-urls", ",".join(farm.mirrors),
+           "--mirrorlist-url", farm.mirrorlist_url,
+           "--repos", str(args.repos),
+           "--parallel", str(args.parallel)]
+    if args.workdir:
+        cmd += ["--workdir", args.workdir]
+
+    strace_out = None
+    if syscalls:
+        fd, strace_out = tempfile.mkstemp(prefix="librepo-strace-")
+        os.close(fd)
+        cmd = ["strace", "-f", "-c", "-o", strace_out] + cmd
+
+    try:
+        output = subprocess.check_output(cmd, universal_newlines=True)
+        result = json.loads(output.strip().splitlines()[-1])
+        if strace_out:
+            result["syscalls"] = parse_strace_total(strace_out)
+    finally:
+        if strace_out:
+            os.unlink(strace_out)
+    return result
+
+
+def summarize(runs):
+    summary = {}
+    for key in runs[0]:
+        values = [r[key] for r in runs if r.get(key) is not None]
+        if values:
+            summary[key] = statistics.median(values)
+    return summary
+
+
+def parse_args():
+    parser = argparse.ArgumentParser(
+        description="End-to-end throughput benchmarks of librepo")
+    parser.add_argument("--mirrors", type=int, default=4,
+                        help="Number of mirrors (default: %(default)s)")
+    parser.add_argument("--packages", type=int, default=2000,
+                        help="Number of packages (default: %(default)s)")
+    parser.add_argument("--package-size", type=int, default=16384,
+                        help="Size of a package in bytes (default: %(default)s)")
+    parser.add_argument("--metadata-padding", type=int, default=0,
+                        help="Extra bytes in every metadata file")
+    parser.add_argument("--repos", type=int, default=8,
+                        help="Repositories downloaded by the metadata "
+                             "scenario (default: %(default)s)")
+    parser.add_argument("--parallel", type=int, default=5,
+                        help="LRO_MAXPARALLELDOWNLOADS (default: %(default)s)")
+    parser.add_argument("--latency", type=float, default=0.0,
+                        help="Latency of mirrors in seconds")
+    parser.add_argument("--bandwidth", type=int, default=0,
+                        help="Bandwidth per connection in bytes per second "
+                             "(default: unlimited)")
+    parser.add_argument("--failure-rate", type=float, default=0.0,
+                        help="Portion of requests failed by mirrors (0.0-1.0)")
+    parser.add_argument("--seed", type=int, default=0,
+                        help="Seed of the simulated failures")
+    parser.add_argument("--repeat", type=int, default=3,
+                        help="Runs of every scenario (default: %(default)s)")
+    parser.add_argument("--scenario", action="append", choices=SCENARIOS,
+                        help="Scenario to run (default: all)")
+    parser.add_argument("--syscalls", action="store_true",
+                        help="Count syscalls with strace")
+    parser.add_argument("--workdir",
+                        help="Directory for temporary files")
+    parser.add_argument("-o", "--output",
+                        help="Output JSON file (default: stdout)")
+    # Internal options used by the child processes
+    parser.add_argument("--run", choices=sorted(RUNNERS),
+                        help=argparse.SUPPRESS)
+    parser.add_argument("--repodir", help=argparse.SUPPRESS)
+    parser.add_argument("--mirrors-urls", help=argparse.SUPPRESS)
+    parser.add_argument("--mirrorlist-url", help=argparse.SUPPRESS)
+    return parser.parse_args()
+
+
+def main():
+    args = parse_args()
+
+    if args.run:
+        args.mirrors_urls = args.mirrors_urls.split(",")
+        child_main(args)
+        return 0
+
+    if args.syscalls and not shutil.which("strace"):
+        print("strace not found, cannot count syscalls", file=sys.stderr)
+        return 1
+
+    scenarios = args.scenario or SCENARIOS
+    tmpdir = tempfile.mkdtemp(prefix="librepo-bench-repo-", dir=args.workdir)
+    try:
+        args.repodir = tmpdir
+        start = time.perf_counter()
+        packages = synthrepo.generate(tmpdir, args.packages, args.package_size,
+                                      args.metadata_padding)
+        with open(os.path.join(tmpdir, "packages.json"), "w") as f:
+            json.dump([(p.location, p.checksum, p.size) for p in packages], f)
+        generate_time = time.perf_counter() - start
+
+        with mirrorfarm.MirrorFarm(tmpdir, args.mirrors, args.latency,
+                                   args.bandwidth, args.failure_rate,
+                                   args.seed) as farm:
+            # Syscalls of the interpreter startup and librepo import
+            baseline = None
+            if args.syscalls:
+                baseline = run_child(args, "noop", farm, True)["syscalls"]
+
+            results = {}
+            for scenario in scenarios:
+                runs = []
+                for _ in range(args.repeat):
+                    run = run_child(args, scenario, farm, args.syscalls)
+                    if baseline is not None and run.get("syscalls") is not None:
+                        run["syscalls"] -= baseline
+                    runs.append(run)
+                results[scenario] = {"runs": runs, "median": summarize(runs)}
+    finally:
+        shutil.rmtree(tmpdir, ignore_errors=True)
+
+    report = {
+        "librepo_version": librepo.VERSION,
+        "python": platform.python_version(),
+        "platform": platform.platform(),
+        "generate_time": generate_time,
+        "config": {
+            "mirrors": args.mirrors,
+            "packages": args.packages,
+            "package_size": args.package_size,
+            "metadata_padding": args.metadata_padding,
+            "repos": args.repos,
+            "parallel": args.parallel,
+            "latency": args.latency,
+            "bandwidth": args.bandwidth,
+            "failure_rate": args.failure_rate,
+            "seed": args.seed,
+            "repeat": args.repeat,
+        },
+        "scenarios": results,
+    }
+
+    if args.output:
+        with open(args.output, "w") as f:
+            json.dump(report, f, indent=2)
+            f.write("\n")
+    else:
+        json.dump(report, sys.stdout, indent=2)
+        print()
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
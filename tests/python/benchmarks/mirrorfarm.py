@@ -0,0 +1,154 @@
+"""
+Farm of local HTTP mirrors for benchmarks.
+
+Every mirror serves the same directory and can simulate latency
+(delay before the response), bandwidth (cap per connection) and
+failures (portion of requests answered by 503). The farm runs in
+a separate process so it doesn't skew the measured CPU time and
+syscalls of the benchmarked process.
+
+Besides the files, every mirror serves "/mirrorlist" with URLs
+of all the mirrors of the farm.
+"""
+
+import multiprocessing
+import random
+import threading
+import time
+
+from http.server import SimpleHTTPRequestHandler, ThreadingHTTPServer
+
+CHUNK_SIZE = 16384
+
+
+class MirrorHandler(SimpleHTTPRequestHandler):
+    protocol_version = "HTTP/1.1"   # Keep-alive, librepo reuses connections
+
+    def log_message(self, format, *args):
+        pass
+
+    def _fail(self):
+        settings = self.server.settings
+        if settings["failure_rate"] <= 0:
+            return False
+        with self.server.random_lock:
+            return self.server.random.random() < settings["failure_rate"]
+
+    def _send_mirrorlist(self, head_only):
+        body = "".join("%s\n" % url for url in self.server.mirrors).encode()
+        self.send_response(200)
+        self.send_header("Content-Type", "text/plain")
+        self.send_header("Content-Length", str(len(body)))
+        self.end_headers()
+        if not head_only:
+            self.wfile.write(body)
+
+    def _handle(self, head_only):
+        settings = self.server.settings
+        if settings["latency"] > 0:
+            time.sleep(settings["latency"])
+
+        if self.path.split("?")[0] == "/mirrorlist":
+            return self._send_mirrorlist(head_only)
+
+        if self._fail():
+            self.send_error(503, "Simulated failure")
+            return
+
+        if settings["bandwidth"] <= 0 or head_only:
+            if head_only:
+                return SimpleHTTPRequestHandler.do_HEAD(self)
+            return SimpleHTTPRequestHandler.do_GET(self)
+
+        # Bandwidth limited transfer
+        f = self.send_head()
+        if not f:
+            return
+        try:
+            start = time.monotonic()
+            sent = 0
+            while True:
+                chunk = f.read(CHUNK_SIZE)
+                if not chunk:
+                    break
+                self.wfile.write(chunk)
+                sent += len(chunk)
+                ahead = sent / settings["bandwidth"] - (time.monotonic() - start)
+                if ahead > 0:
+                    time.sleep(ahead)
+        finally:
+            f.close()
+
+    def do_GET(self):
+        self._handle(False)
+
+    def do_HEAD(self):
+        self._handle(True)
+
+
+def _serve(root, count, settings, queue, stop):
+    servers = []
+    for i in range(count):
+        handler = lambda *args, **kwargs: MirrorHandler(*args,
+                                                        directory=root,
+                                                        **kwargs)
+        server = ThreadingHTTPServer(("127.0.0.1", 0), handler)
+        server.daemon_threads = True
+        server.settings = settings
+        server.random = random.Random(settings["seed"] + i)
+        server.random_lock = threading.Lock()
+        servers.append(server)
+
+    mirrors = ["http://127.0.0.1:%d/" % s.server_address[1] for s in servers]
+    for server in servers:
+        server.mirrors = mirrors
+        threading.Thread(target=server.serve_forever, daemon=True).start()
+
+    queue.put(mirrors)
+    stop.wait()
+    for server in servers:
+        server.shutdown()
+
+
+class MirrorFarm(object):
+    """Context manager running *count* mirrors of the *root* directory.
+
+    :param latency: Delay of every response in seconds
+    :param bandwidth: Bytes per second per connection, 0 means unlimited
+    :param failure_rate: Portion (0.0 - 1.0) of failed requests
+    """
+
+    def __init__(self, root, count=4, latency=0.0, bandwidth=0,
+                 failure_rate=0.0, seed=0):
+        self.root = root
+        self.count = count
+        self.settings = {
+            "latency": latency,
+            "bandwidth": bandwidth,
+            "failure_rate": failure_rate,
+            "seed": seed,
+        }
+        self.mirrors = []
+        self._process = None
+        self._stop = None
+
+    def __enter__(self):
+        queue = multiprocessing.Queue()
+        self._stop = multiprocessing.Event()
+        self._process = multiprocessing.Process(
+            target=_serve,
+            args=(self.root, self.count, self.settings, queue, self._stop))
+        self._process.start()
+        self.mirrors = queue.get(timeout=30)
+        return self
+
+    def __exit__(self, *args):
+        self._stop.set()
+        self._process.join(10)
+        if self._process.is_alive():
+            self._process.terminate()
+            self._process.join()
+
+    @property
+    def mirrorlist_url(self):
+        return self.mirrors[0] + "mirrorlist"
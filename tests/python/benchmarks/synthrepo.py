@@ -0,0 +1,134 @@
+"""
+Generator of synthetic rpm-md repositories for benchmarks.
+
+The packages are not real rpms, they are blobs of random data of the
+requested size. librepo never looks into them, so for the downloader
+they are as good as the real ones.
+"""
+
+import gzip
+import hashlib
+import os
+import time
+
+REPOMD_TEMPLATE = """<?xml version="1.0" encoding="UTF-8"?>
+<repomd xmlns="http://linux.duke.edu/metadata/repo" xmlns:rpm="http://linux.duke.edu/metadata/rpm">
+  <revision>{timestamp}</revision>
+{records}</repomd>
+"""
+
+RECORD_TEMPLATE = """  <data type="{type}">
+    <checksum type="sha256">{checksum}</checksum>
+    <open-checksum type="sha256">{open_checksum}</open-checksum>
+    <location href="repodata/{checksum}-{type}.xml.gz"/>
+    <timestamp>{timestamp}</timestamp>
+    <size>{size}</size>
+    <open-size>{open_size}</open-size>
+  </data>
+"""
+
+PACKAGE_TEMPLATE = """<package type="rpm">
+  <name>{name}</name>
+  <arch>noarch</arch>
+  <version epoch="0" ver="1.0" rel="1"/>
+  <checksum type="sha256" pkgid="YES">{checksum}</checksum>
+  <summary>Synthetic package {name}</summary>
+  <description>Synthetic package generated for benchmarks.</description>
+  <packager></packager>
+  <url></url>
+  <time file="{timestamp}" build="{timestamp}"/>
+  <size package="{size}" installed="{size}" archive="{size}"/>
+  <location href="{location}"/>
+  <format>
+    <rpm:license>MIT</rpm:license>
+    <rpm:provides>
+      <rpm:entry name="{name}" flags="EQ" epoch="0" ver="1.0" rel="1"/>
+    </rpm:provides>
+  </format>
+</package>
+"""
+
+
+class Package(object):
+    """Generated package"""
+
+    def __init__(self, name, location, checksum, size):
+        self.name = name
+        self.location = location    # Relative to the root of the repo
+        self.checksum = checksum    # sha256
+        self.size = size
+
+
+def _write_record(repodir, mdtype, content, timestamp):
+    compressed = gzip.compress(content.encode("utf-8"), mtime=timestamp)
+    checksum = hashlib.sha256(compressed).hexdigest()
+    filename = os.path.join(repodir, "repodata",
+                            "%s-%s.xml.gz" % (checksum, mdtype))
+    with open(filename, "wb") as f:
+        f.write(compressed)
+    return RECORD_TEMPLATE.format(
+        type=mdtype,
+        checksum=checksum,
+        open_checksum=hashlib.sha256(content.encode("utf-8")).hexdigest(),
+        timestamp=timestamp,
+        size=len(compressed),
+        open_size=len(content.encode("utf-8")))
+
+
+def generate(repodir, packages=1000, package_size=16384, padding=0):
+    """Generate a repository with *packages* packages of *package_size*
+    bytes to *repodir*. *padding* bytes of comments are appended
+    to every metadata file to simulate big metadata.
+    Return list of :class:`Package`.
+    """
+    timestamp = int(time.time())
+    os.makedirs(os.path.join(repodir, "Packages"), exist_ok=True)
+    os.makedirs(os.path.join(repodir, "repodata"), exist_ok=True)
+
+    pkgs = []
+    primary = []
+    for i in range(packages):
+        name = "bench-%06d" % i
+        location = "Packages/%s-1.0-1.noarch.rpm" % name
+        data = os.urandom(package_size)
+        with open(os.path.join(repodir, location), "wb") as f:
+            f.write(data)
+        checksum = hashlib.sha256(data).hexdigest()
+        pkgs.append(Package(name, location, checksum, package_size))
+        primary.append(PACKAGE_TEMPLATE.format(name=name,
+                                               checksum=checksum,
+                                               timestamp=timestamp,
+                                               size=package_size,
+                                               location=location))
+
+    pad = "<!-- %s -->\n" % ("x" * padding) if padding else ""
+    header = '<?xml version="1.0" encoding="UTF-8"?>\n'
+    contents = {
+        "primary": header
+            + '<metadata xmlns="http://linux.duke.edu/metadata/common" '
+              'xmlns:rpm="http://linux.duke.edu/metadata/rpm" '
+              'packages="%d">\n' % packages
+            + "".join(primary) + pad + "</metadata>\n",
+        "filelists": header
+            + '<filelists xmlns="http://linux.duke.edu/metadata/filelists" '
+              'packages="%d">\n' % packages
+            + "".join('<package pkgid="%s" name="%s" arch="noarch">'
+                      '<version epoch="0" ver="1.0" rel="1"/>'
+                      '<file>/usr/share/%s/README</file></package>\n'
+                      % (p.checksum, p.name, p.name) for p in pkgs)
+            + pad + "</filelists>\n",
+        "other": header
+            + '<otherdata xmlns="http://linux.duke.edu/metadata/other" '
+              'packages="%d">\n' % packages
+            + "".join('<package pkgid="%s" name="%s" arch="noarch">'
+                      '<version epoch="0" ver="1.0" rel="1"/></package>\n'
+                      % (p.checksum, p.name) for p in pkgs)
+            + pad + "</otherdata>\n",
+    }
+
+    records = "".join(_write_record(repodir, mdtype, content, timestamp)
+                      for mdtype, content in sorted(contents.items()))
+    with open(os.path.join(repodir, "repodata", "repomd.xml"), "w") as f:
+        f.write(REPOMD_TEMPLATE.format(timestamp=timestamp, records=records))
+
+    return pkgs
@@ -21,6 +21,8 @@ REPO_YUM_03_PATH = REPOS_YUM+"03/"
 
 REPO_YUM_04_PATH = REPOS_YUM+"04/"
 
+REPO_YUM_05_PATH = REPOS_YUM+"05/"
+
 METALINK_DIR = "yum/static/metalink/"
 METALINK_GOOD_01 = METALINK_DIR+"good_01.xml"
 METALINK_GOOD_02 = METALINK_DIR+"good_02.xml"
@@ -1,5 +1,6 @@
 import os
 import shutil
+import asyncio
 import os.path
 import librepo
 import hashlib
@@ -254,6 +255,29 @@ class TestCaseYumPackagesDownloading(TestCaseWithFlask):
             self.assertTrue(pkg.err is None)
             self.assertTrue(os.path.isfile(pkg.local_path))
 
+    def test_download_packages_stats(self):
+        h = librepo.Handle()
+
+        url = "%s%s" % (self.MOCKURL, config.REPO_YUM_01_PATH)
+        h.urls = [url]
+        h.repotype = librepo.LR_YUMREPO
+
+        pkg = librepo.PackageTarget(config.PACKAGE_01_01,
+                                    handle=h,
+                                    dest=self.tmpdir)
+        self.assertTrue(pkg.stats is None)
+
+        librepo.download_packages([pkg])
+
+        self.assertTrue(pkg.err is None)
+        stats = pkg.stats
+        self.assertEqual(stats["downloaded"], os.path.getsize(pkg.local_path))
+        self.assertTrue(stats["http_version"] in (10, 11, 20))
+        self.assertTrue(stats["connect_time"] >= stats["namelookup_time"])
+        self.assertTrue(stats["total_time"] >= stats["starttransfer_time"])
+        self.assertTrue(stats["speed"] >= 0)
+        self.assertTrue(isinstance(stats["reused"], bool))
+
     def test_download_packages_02(self):
         h = librepo.Handle()
 
@@ -355,6 +379,86 @@ class TestCaseYumPackagesDownloading(TestCaseWithFlask):
         self.assertTrue(pkgs[1].err is not None)
         self.assertFalse(os.path.isfile(pkgs[1].local_path))
 
+    def test_download_packages_async_one_url_is_bad(self):
+        h = librepo.Handle()
+
+        url = "%s%s" % (self.MOCKURL, config.REPO_YUM_01_PATH)
+        h.urls = [url]
+        h.repotype = librepo.LR_YUMREPO
+
+        pkgs = []
+        pkgs.append(librepo.PackageTarget(config.PACKAGE_01_01,
+                                          handle=h,
+                                          dest=self.tmpdir))
+        pkgs.append(librepo.PackageTarget("so_bad_url_of_foo_rpm.rpm",
+                                          handle=h,
+                                          dest=self.tmpdir))
+
+        asyncio.run(librepo.download_packages_async(pkgs))
+
+        self.assertTrue(pkgs[0].err is None)
+        self.assertTrue(os.path.isfile(pkgs[0].local_path))
+
+        self.assertTrue(pkgs[1].err is not None)
+        self.assertFalse(os.path.isfile(pkgs[1].local_path))
+
+    def test_download_packages_async_concurrently(self):
+        h = librepo.Handle()
+
+        url = "%s%s" % (self.MOCKURL, config.REPO_YUM_01_PATH)
+        h.urls = [url]
+        h.repotype = librepo.LR_YUMREPO
+
+        dests = [os.path.join(self.tmpdir, "foo-%d.rpm" % x) for x in range(3)]
+        batches = [[librepo.PackageTarget(config.PACKAGE_01_01,
+                                          handle=h,
+                                          dest=dest)] for dest in dests]
+
+        async def download_all():
+            await asyncio.gather(*[librepo.download_packages_async(batch)
+                                   for batch in batches])
+
+        asyncio.run(download_all())
+
+        for batch in batches:
+            self.assertTrue(batch[0].err is None)
+            self.assertTrue(os.path.isfile(batch[0].local_path))
+
+    def test_download_packages_async_concurrently_with_callbacks(self):
+        h = librepo.Handle()
+
+        url = "%s%s" % (self.MOCKURL, config.REPO_YUM_01_PATH)
+        h.urls = [url]
+        h.repotype = librepo.LR_YUMREPO
+
+        ended = []
+
+        def endcb(data, status, msg):
+            ended.append(data)
+
+        # Sessions of one handle finish at different times,
+        # callbacks of the others must still work
+        batches = []
+        for x in range(3):
+            dest = os.path.join(self.tmpdir, "foo-%d.rpm" % x)
+            batches.append([librepo.PackageTarget(config.PACKAGE_01_01,
+                                                  handle=h,
+                                                  dest=dest,
+                                                  cbdata=x,
+                                                  endcb=endcb)])
+
+        async def download_all():
+            await librepo.download_packages_async(batches[0])
+            await asyncio.gather(*[librepo.download_packages_async(batch)
+                                   for batch in batches[1:]])
+
+        asyncio.run(download_all())
+
+        self.assertEqual(sorted(ended), [0, 1, 2])
+        for batch in batches:
+            self.assertTrue(batch[0].err is None)
+            self.assertTrue(os.path.isfile(batch[0].local_path))
+
     def test_download_packages_with_checksum_check(self):
         h = librepo.Handle()
 
@@ -366,7 +470,7 @@ class TestCaseYumPackagesDownloading(TestCaseWithFlask):
         pkgs.append(librepo.PackageTarget(config.PACKAGE_01_01,
                                           handle=h,
                                           dest=self.tmpdir,
-                                          checksum_type=librepo.SHA256,
+                                          checksum_type=librepo.CHECKSUM_SHA256,
                                           checksum=config.PACKAGE_01_01_SHA256))
 
         librepo.download_packages(pkgs)
@@ -394,7 +498,7 @@ class TestCaseYumPackagesDownloading(TestCaseWithFlask):
         pkgs.append(librepo.PackageTarget(config.PACKAGE_01_01,
                                           handle=h,
                                           dest=self.tmpdir,
-                                          checksum_type=librepo.SHA256,
+                                          checksum_type=librepo.CHECKSUM_SHA256,
                                           checksum="badchecksum"))
 
         librepo.download_packages(pkgs)
@@ -413,7 +517,7 @@ class TestCaseYumPackagesDownloading(TestCaseWithFlask):
         pkgs.append(librepo.PackageTarget(config.PACKAGE_01_01,
                                           handle=h,
                                           dest=self.tmpdir,
-                                          checksum_type=librepo.SHA256,
+                                          checksum_type=librepo.CHECKSUM_SHA256,
                                           checksum="badchecksum"))
 
         self.assertRaises(librepo.LibrepoException, librepo.download_packages,
@@ -467,7 +571,7 @@ class TestCaseYumPackagesDownloading(TestCaseWithFlask):
                                           handle=h,
                                           dest=self.tmpdir,
                                           resume=True,
-                                          checksum_type=librepo.SHA256,
+                                          checksum_type=librepo.CHECKSUM_SHA256,
                                           checksum=config.PACKAGE_01_01_SHA256))
 
         librepo.download_packages(pkgs)
@@ -771,7 +875,7 @@ class TestCaseYumPackagesDownloading(TestCaseWithFlask):
                                           handle=h,
                                           dest=fn,
                                           resume=True,
-                                          checksum_type=librepo.SHA256,
+                                          checksum_type=librepo.CHECKSUM_SHA256,
                                           checksum=config.PACKAGE_01_01_SHA256))
 
         # Download should fail (path is bad, the file doesn't exist)
@@ -899,3 +1003,43 @@ class TestCaseYumPackagesDownloading(TestCaseWithFlask):
                           librepo.download_packages, pkgs, failfast=True)
         self.assertTrue(pkgs[0].err)
 
+
+    def test_download_packages_with_packagecache(self):
+        url = "%s%s" % (self.MOCKURL, config.REPO_YUM_01_PATH)
+        cachedir = os.path.join(self.tmpdir, "cache")
+
+        h = librepo.Handle()
+        h.urls = [url]
+        h.repotype = librepo.YUMREPO
+        h.cachedir = cachedir
+        h.packagecache = True
+        self.assertTrue(h.packagecache)
+
+        # 1) Downloaded package is stored to the cache
+        pkgs = [librepo.PackageTarget(config.PACKAGE_01_01,
+                                      handle=h,
+                                      checksum_type=librepo.CHECKSUM_SHA256,
+                                      checksum=config.PACKAGE_01_01_SHA256,
+                                      dest=os.path.join(self.tmpdir, "01"))]
+        os.mkdir(os.path.join(self.tmpdir, "01"))
+        librepo.download_packages(pkgs)
+        self.assertFalse(pkgs[0].err)
+
+        cached = os.path.join(cachedir, "packages", "sha256",
+                              config.PACKAGE_01_01_SHA256[:2],
+                              config.PACKAGE_01_01_SHA256)
+        self.assertTrue(os.path.isfile(cached))
+
+        # 2) Package is taken from the cache without any transfer
+        h.offline = True
+        pkgs = [librepo.PackageTarget(config.PACKAGE_01_01,
+                                      handle=h,
+                                      checksum_type=librepo.CHECKSUM_SHA256,
+                                      checksum=config.PACKAGE_01_01_SHA256,
+                                      dest=os.path.join(self.tmpdir, "02"))]
+        os.mkdir(os.path.join(self.tmpdir, "02"))
+        librepo.download_packages(pkgs)
+        self.assertEqual(pkgs[0].err, "Already downloaded")
+        pkg = os.path.join(self.tmpdir, "02", config.PACKAGE_01_01)
+        self.assertTrue(os.path.isfile(pkg))
+        self.assertTrue(os.path.samefile(pkg, cached))
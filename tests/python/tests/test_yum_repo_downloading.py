@@ -1,5 +1,6 @@
 import sys
 import time
+import hashlib
 import shutil
 import os.path
 import tempfile
@@ -1743,3 +1744,160 @@ class TestCaseYumRepoDownloading(TestCaseWithFlask):
         self.assertEqual(h.mirrors, EXP_MRS)
 
 
+
+    def test_download_metadata_of_multiple_repos(self):
+        targets = []
+        for repo_path in (config.REPO_YUM_01_PATH, config.REPO_YUM_02_PATH,
+                          config.BADURL):
+            h = librepo.Handle()
+            h.urls = ["%s%s" % (self.MOCKURL, repo_path)]
+            h.repotype = librepo.LR_YUMREPO
+            h.destdir = tempfile.mkdtemp(dir=self.tmpdir)
+            targets.append(librepo.MetadataTarget(h))
+
+        librepo.download_metadata(targets)
+
+        # Good repositories are downloaded completely, even if
+        # one of the repositories fails
+        for target in targets[:2]:
+            self.assertFalse(target.err)
+            repodata = os.path.join(target.handle.destdir, "repodata")
+            self.assertTrue(os.path.isfile(os.path.join(repodata, "repomd.xml")))
+            self.assertTrue(any(f.endswith("primary.xml.gz")
+                                for f in os.listdir(repodata)))
+        self.assertTrue(targets[2].err)
+
+    def test_download_repo_01_conditional_refresh(self):
+        url = "%s%s" % (self.MOCKURL, config.REPO_YUM_01_PATH)
+
+        def download():
+            h = librepo.Handle()
+            r = librepo.Result()
+            h.urls = [url]
+            h.repotype = librepo.LR_YUMREPO
+            h.destdir = self.tmpdir
+            h.conditionalrefresh = True
+            h.perform(r)
+            return r.getinfo(librepo.LRR_YUM_REPO)
+
+        yum_repo = download()
+        self.assertTrue(os.path.isfile(os.path.join(
+            self.tmpdir, "repodata", "repomd.xml.validators")))
+
+        # repomd.xml wasn't modified, so the downloaded repo is used as is
+        os.utime(yum_repo["primary"], (1, 1))
+        self.assertEqual(download(), yum_repo)
+        self.assertEqual(os.stat(yum_repo["primary"]).st_mtime, 1)
+
+        # Broken local repo is downloaded again
+        os.unlink(yum_repo["primary"])
+        self.assertEqual(download(), yum_repo)
+        self.assertTrue(os.path.isfile(yum_repo["primary"]))
+
+    def test_download_repo_01_decompress(self):
+        h = librepo.Handle()
+        r = librepo.Result()
+
+        url = "%s%s" % (self.MOCKURL, config.REPO_YUM_01_PATH)
+        h.urls = [url]
+        h.repotype = librepo.LR_YUMREPO
+        h.destdir = self.tmpdir
+        h.checks = librepo.LR_CHECK_CHECKSUM
+        h.decompress = True
+        self.assertTrue(h.decompress)
+        h.perform(r)
+
+        yum_repo   = r.getinfo(librepo.LRR_YUM_REPO)
+        yum_repomd = r.getinfo(librepo.LRR_YUM_REPOMD)
+
+        for md_type in ("primary", "filelists", "other",
+                        "primary_db", "filelists_db", "other_db"):
+            path = yum_repo[md_type + "_open"]
+            self.assertEqual(path, os.path.splitext(yum_repo[md_type])[0])
+            self.assertTrue(os.path.isfile(path))
+            self.assertFalse(os.path.exists(path + ".part"))
+            self.assertEqual(os.path.getsize(path),
+                             yum_repomd[md_type]["size_open"])
+            with open(path, "rb") as f:
+                self.assertEqual(hashlib.sha1(f.read()).hexdigest(),
+                                 yum_repomd[md_type]["checksum_open"])
+
+    def test_download_repo_01_via_metalink_conditional_refresh(self):
+        def download():
+            h = librepo.Handle()
+            r = librepo.Result()
+            h.metalinkurl = "%s%s" % (self.MOCKURL, config.METALINK_GOOD_01)
+            h.repotype = librepo.LR_YUMREPO
+            h.destdir = self.tmpdir
+            h.conditionalrefresh = True
+            h.perform(r)
+            return r.getinfo(librepo.LRR_YUM_REPO)
+
+        yum_repo = download()
+
+        # Without validators, only the metalink proves repomd.xml is current
+        os.unlink(os.path.join(self.tmpdir, "repodata", "repomd.xml.validators"))
+        os.utime(yum_repo["primary"], (1, 1))
+        self.assertEqual(download(), yum_repo)
+        self.assertEqual(os.stat(yum_repo["primary"]).st_mtime, 1)
+
+    def test_download_repo_05_complete_zchunk(self):
+        url = "%s%s" % (self.MOCKURL, config.REPO_YUM_05_PATH)
+        zck = "cb8b33d29cfab5d51e91dfa4566d67f8dabff0335c863689363b005755083639-primary.xml.zck"
+        src = os.path.join(os.path.dirname(__file__), "servermock", "yum_mock",
+                           "static", "05", "repodata", zck)
+        os.mkdir(os.path.join(self.tmpdir, "repodata"))
+        shutil.copy(src, os.path.join(self.tmpdir, "repodata", zck))
+
+        h = librepo.Handle()
+        h.urls = [url]
+        h.repotype = librepo.LR_YUMREPO
+        h.destdir = self.tmpdir
+        h.cachedir = self.tmpdir
+        h.yumdlist = ["primary"]
+        h.checks = librepo.LR_CHECK_CHECKSUM
+        h.conditionalrefresh = True
+
+        # The complete zchunk file is used without any further transfer,
+        # the target is still finished like a downloaded one
+        t = librepo.MetadataTarget(h)
+        librepo.download_metadata([t])
+        self.assertFalse(t.err)
+
+        r = librepo.Result()
+        h.perform(r)
+        yum_repo = r.getinfo(librepo.LRR_YUM_REPO)
+        self.assertTrue(os.path.isfile(yum_repo["primary"]))
+        if yum_repo["primary"].endswith(".zck"):
+            with open(src, "rb") as f, open(yum_repo["primary"], "rb") as g:
+                self.assertEqual(f.read(), g.read())
+
+    def test_download_repo_05_zchunk_retry_stats(self):
+        # The zchunk file is missing on the first mirror, so the target
+        # is retried on the second one
+        badurl = "%s%s%s" % (self.MOCKURL, config.MISSINGFILE % "primary.xml",
+                             config.REPO_YUM_05_PATH)
+        url = "%s%s" % (self.MOCKURL, config.REPO_YUM_05_PATH)
+        zck = "cb8b33d29cfab5d51e91dfa4566d67f8dabff0335c863689363b005755083639-primary.xml.zck"
+        src = os.path.join(os.path.dirname(__file__), "servermock", "yum_mock",
+                           "static", "05", "repodata", zck)
+
+        h = librepo.Handle()
+        h.urls = [badurl, url]
+        h.repotype = librepo.LR_YUMREPO
+        h.destdir = self.tmpdir
+        h.cachedir = self.tmpdir
+        h.yumdlist = ["primary"]
+        h.checks = librepo.LR_CHECK_CHECKSUM
+
+        r = librepo.Result()
+        h.perform(r)
+        yum_repo = r.getinfo(librepo.LRR_YUM_REPO)
+        self.assertTrue(os.path.isfile(yum_repo["primary"]))
+
+        # Neither the reused nor the downloaded chunks are counted twice
+        stats = h.stats
+        self.assertTrue(stats["failed_transfers"] >= 1)
+        self.assertTrue(stats["zck_bytes_reused"] >= 0)
+        self.assertTrue(stats["zck_bytes_reused"] +
+                        stats["zck_bytes_downloaded"] <= os.path.getsize(src))
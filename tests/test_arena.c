@@ -0,0 +1,54 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "librepo/arena_internal.h"
+
+#include "testsys.h"
+#include "test_arena.h"
+
+START_TEST(test_arena_alloc)
+{
+    LrArena *arena = lr_arena_new(1024);
+    fail_if(!arena);
+    fail_if(lr_arena_size(arena) != 0);
+
+    // Small allocations are aligned, zeroed and don't overlap
+    char *prev = NULL;
+    for (int i = 0; i < 100; i++) {
+        char *mem = lr_arena_alloc0(arena, 24);
+        fail_if(!mem);
+        fail_if(((uintptr_t) mem) % 16);
+        for (int x = 0; x < 24; x++)
+            fail_if(mem[x] != 0);
+        memset(mem, 0xff, 24);
+        fail_if(prev && mem == prev);
+        prev = mem;
+    }
+    gsize size = lr_arena_size(arena);
+    fail_if(size < 100 * 24);
+
+    // Large allocation gets its own block
+    char *large = lr_arena_alloc0(arena, 4096);
+    fail_if(!large);
+    fail_if(large[4095] != 0);
+    fail_if(lr_arena_size(arena) < size + 4096);
+
+    char *str = lr_arena_strdup(arena, "http://foo/bar");
+    fail_if(strcmp(str, "http://foo/bar"));
+    fail_if(lr_arena_strdup(arena, NULL) != NULL);
+
+    lr_arena_free(arena);
+    lr_arena_free(NULL);
+}
+END_TEST
+
+Suite *
+arena_suite(void)
+{
+    Suite *s = suite_create("arena");
+    TCase *tc = tcase_create("Main");
+    tcase_add_test(tc, test_arena_alloc);
+    suite_add_tcase(s, tc);
+    return s;
+}
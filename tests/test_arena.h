@@ -0,0 +1,8 @@
+#ifndef LR_TEST_ARENA_H
+#define LR_TEST_ARENA_H
+
+#include <check.h>
+
+Suite *arena_suite(void);
+
+#endif
@@ -90,6 +90,29 @@ START_TEST(test_checksum_fd)
 }
 END_TEST
 
+START_TEST(test_checksum_fd_big)
+{
+    char *file;
+    FILE *fp;
+
+    // The file consists of several blocks read ahead (if io_uring is
+    // available) and a short one at the end
+
+    file = lr_pathconcat(test_globals.tmpdir, "/test_checksum_big", NULL);
+    fp = fopen(file, "w");
+    fail_if(fp == NULL);
+    for (int i = 0; i < 1000003; i++)
+        fail_if(fputc(i % 251, fp) == EOF);
+    fclose(fp);
+
+    test_checksum(file, LR_CHECKSUM_SHA256,
+        "a7c4bea888022868c93104055fd56077cc81fe9eb624820fe2f717f313188782");
+
+    fail_if(remove(file) != 0, "Cannot delete temporary test file");
+    lr_free(file);
+}
+END_TEST
+
 START_TEST(test_cached_checksum_matches)
 {
     FILE *f;
@@ -303,6 +326,7 @@ checksum_suite(void)
     Suite *s = suite_create("checksum");
     TCase *tc = tcase_create("Main");
     tcase_add_test(tc, test_checksum_fd);
+    tcase_add_test(tc, test_checksum_fd_big);
     tcase_add_test(tc, test_cached_checksum_matches);
     tcase_add_test(tc, test_cached_checksum_value);
     tcase_add_test(tc, test_cached_checksum_clear);
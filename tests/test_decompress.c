@@ -0,0 +1,156 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+
+#include "librepo/util.h"
+#include "librepo/rcodes.h"
+#include "librepo/checksum.h"
+#include "librepo/decompress_internal.h"
+
+#include "fixtures.h"
+#include "testsys.h"
+#include "test_decompress.h"
+
+#define PRIMARY_XML_GZ  "repo_yum_01/repodata/4543ad62e4d86337cd1949346f9aec976b847b58-primary.xml.gz"
+#define PRIMARY_XML_SHA1 "68457ceb8e20bda004d46e0a4dfa4a69ce71db48"
+#define OTHER_DB_BZ2    "repo_yum_01/repodata/fd96942c919628895187778633001cff61e872b8-other.sqlite.bz2"
+#define OTHER_DB_SHA1   "c5262f62b6b3360722b9b2fb5d0a9335d0a51112"
+
+START_TEST(test_detect_compression)
+{
+    char *path;
+
+    fail_if(lr_detect_compression(NULL) != LR_COMPRESSION_NONE);
+    fail_if(lr_detect_compression("primary.xml") != LR_COMPRESSION_NONE);
+    fail_if(lr_detect_compression("primary.xml.zck") != LR_COMPRESSION_NONE);
+    fail_if(lr_detect_compression("primary.xml.gz") != LR_COMPRESSION_GZ);
+    fail_if(lr_detect_compression("primary.sqlite.bz2") != LR_COMPRESSION_BZ2);
+    fail_if(lr_detect_compression("primary.xml.xz") != LR_COMPRESSION_XZ);
+    fail_if(lr_detect_compression("primary.xml.zst") != LR_COMPRESSION_ZSTD);
+
+    fail_if(lr_path_without_compression_suffix("primary.xml") != NULL);
+    path = lr_path_without_compression_suffix("/tmp/primary.xml.gz");
+    ck_assert_str_eq(path, "/tmp/primary.xml");
+    g_free(path);
+}
+END_TEST
+
+#ifdef WITH_DECOMPRESSION
+
+static void
+test_decompress(const char *relpath, const char *expected)
+{
+    int fd;
+    gboolean ret, matches;
+    char *path, *dest, *part;
+    GError *tmp_err = NULL;
+
+    path = lr_pathconcat(test_globals.testdata_dir, relpath, NULL);
+    dest = lr_pathconcat(test_globals.tmpdir, "/test_decompress", NULL);
+    part = lr_pathconcat(dest, ".part", NULL);
+
+    ret = lr_decompress_file(path, dest, LR_CHECKSUM_SHA1, expected, &tmp_err);
+    fail_if(!ret);
+    fail_if(tmp_err);
+    fail_if(access(part, F_OK) == 0);
+
+    fd = open(dest, O_RDONLY);
+    fail_if(fd < 0);
+    ret = lr_checksum_fd_cmp(LR_CHECKSUM_SHA1, fd, expected, FALSE,
+                             &matches, &tmp_err);
+    fail_if(!ret);
+    fail_if(!matches);
+    close(fd);
+
+    unlink(dest);
+    lr_free(path);
+    lr_free(dest);
+    lr_free(part);
+}
+
+START_TEST(test_decompress_gz)
+{
+    test_decompress(PRIMARY_XML_GZ, PRIMARY_XML_SHA1);
+}
+END_TEST
+
+START_TEST(test_decompress_bz2)
+{
+    test_decompress(OTHER_DB_BZ2, OTHER_DB_SHA1);
+}
+END_TEST
+
+START_TEST(test_decompress_bad_checksum)
+{
+    gboolean ret;
+    char *path, *dest, *part;
+    GError *tmp_err = NULL;
+
+    path = lr_pathconcat(test_globals.testdata_dir, PRIMARY_XML_GZ, NULL);
+    dest = lr_pathconcat(test_globals.tmpdir, "/test_decompress_bad", NULL);
+    part = lr_pathconcat(dest, ".part", NULL);
+
+    ret = lr_decompress_file(path, dest, LR_CHECKSUM_SHA1, OTHER_DB_SHA1,
+                             &tmp_err);
+    fail_if(ret);
+    fail_if(!tmp_err);
+    fail_if(tmp_err->code != LRE_BADCHECKSUM);
+    fail_if(access(dest, F_OK) == 0);
+    fail_if(access(part, F_OK) == 0);
+
+    g_error_free(tmp_err);
+    lr_free(path);
+    lr_free(dest);
+    lr_free(part);
+}
+END_TEST
+
+START_TEST(test_decompress_corrupted)
+{
+    gboolean ret;
+    char *path, *dest;
+    GError *tmp_err = NULL;
+
+    // Uncompressed data with a .gz suffix
+    path = lr_pathconcat(test_globals.tmpdir, "/test_corrupted.gz", NULL);
+    dest = lr_pathconcat(test_globals.tmpdir, "/test_corrupted", NULL);
+    FILE *f = fopen(path, "w");
+    fail_if(!f);
+    fputs("this is not a gzip file\n", f);
+    fclose(f);
+
+    ret = lr_decompress_file(path, dest, LR_CHECKSUM_UNKNOWN, NULL, &tmp_err);
+    fail_if(ret);
+    fail_if(!tmp_err);
+    fail_if(tmp_err->code != LRE_DECOMPRESS);
+    fail_if(access(dest, F_OK) == 0);
+
+    g_error_free(tmp_err);
+    unlink(path);
+    lr_free(path);
+    lr_free(dest);
+}
+END_TEST
+
+#endif /* WITH_DECOMPRESSION */
+
+Suite *
+decompress_suite(void)
+{
+    Suite *s = suite_create("decompress");
+    TCase *tc = tcase_create("Main");
+    tcase_add_test(tc, test_detect_compression);
+#ifdef WITH_DECOMPRESSION
+    tcase_add_test(tc, test_decompress_gz);
+    tcase_add_test(tc, test_decompress_bz2);
+    tcase_add_test(tc, test_decompress_bad_checksum);
+    tcase_add_test(tc, test_decompress_corrupted);
+#endif /* WITH_DECOMPRESSION */
+    suite_add_tcase(s, tc);
+    return s;
+}
@@ -13,6 +13,8 @@
 #include "librepo/util.h"
 #include "librepo/downloader.h"
 #include "librepo/handle_internal.h"
+#include "librepo/downloader_internal.h"
+#include "librepo/xattr_internal.h"
 
 #include "fixtures.h"
 #include "testsys.h"
@@ -362,12 +364,25 @@ START_TEST(test_downloader_checksum)
         fail_if(!ret);
         fail_if(err);
 
+        LrStats *stats = NULL;
+        fail_if(!lr_handle_getinfo(handle, NULL, LRI_STATS, &stats));
+        fail_if(stats->transfers < 1);
+        fail_if(stats->checksum_checks < 1);
+        if (tests[i].expect_err)
+            fail_if(stats->checksum_failures < 1 || stats->failed_transfers < 1);
+        else
+            fail_if(stats->checksum_failures != 0 || stats->failed_transfers != 0);
+        fail_if(g_slist_length(stats->mirrors) != 1);
+
         lr_handle_free(handle);
 
         // Check results
 
         for (GSList *elem = list; elem; elem = g_slist_next(elem)) {
                 LrDownloadTarget *dtarget = elem->data;
+                fail_if(!dtarget->stats);
+                fail_if(dtarget->stats->total_time < 0.0);
+                fail_if(dtarget->stats->http_version != 0);
                 if (!tests[i].expect_err) {
                     if (dtarget->err) {
                         printf("Error msg: %s\n", dtarget->err);
@@ -386,6 +401,1003 @@ START_TEST(test_downloader_checksum)
 }
 END_TEST
 
+static int
+duplicates_end_cb(void *data,
+                  LrTransferStatus status,
+                  G_GNUC_UNUSED const char *msg)
+{
+    int *count = data;
+    fail_if(status != LR_TRANSFER_SUCCESSFUL);
+    (*count)++;
+    return LR_CB_OK;
+}
+
+START_TEST(test_downloader_duplicates)
+{
+    gboolean ret;
+    LrHandle *handle;
+    GSList *list = NULL;
+    GError *tmp_err = NULL;
+    int ended = 0;
+    char *fns[3];
+
+    handle = lr_handle_init();
+    fail_if(handle == NULL);
+
+    char *urls[] = {"file:///", NULL};
+    lr_handle_setopt(handle, NULL, LRO_URLS, urls);
+    lr_handle_prepare_internal_mirrorlist(handle, FALSE, &tmp_err);
+    fail_if(tmp_err);
+
+    // Three targets with the same checksum, only one is downloaded
+
+    for (int x = 0; x < 3; x++) {
+        GSList *checksums = g_slist_append(NULL,
+            lr_downloadtargetchecksum_new(LR_CHECKSUM_SHA512,
+                "cf83e1357eefb8bdf1542850d66d8007d620e4050b5715dc83f4a921d36ce9ce"
+                "47d0d13c5d85f2b0ff8318d2877eec2f63b931bd47417a81a538327af927da3e"));
+        fns[x] = g_strdup_printf("%s/duplicate_%d", test_globals.tmpdir, x);
+        LrDownloadTarget *t = lr_downloadtarget_new(handle, "dev/null", NULL,
+                                                    -1, fns[x], checksums, 0,
+                                                    0, NULL, &ended,
+                                                    duplicates_end_cb, NULL,
+                                                    NULL, 0, 0, NULL, FALSE,
+                                                    FALSE);
+        fail_if(!t);
+        list = g_slist_append(list, t);
+    }
+
+    ret = lr_download(list, TRUE, &tmp_err);
+    fail_if(!ret);
+    fail_if(tmp_err);
+    fail_if(ended != 3);
+
+    LrStats *stats = NULL;
+    fail_if(!lr_handle_getinfo(handle, NULL, LRI_STATS, &stats));
+    fail_if(stats->transfers != 1);
+
+    // The duplicates are copies, not hard links of the downloaded file
+    for (int x = 0; x < 3; x++) {
+        LrDownloadTarget *t = g_slist_nth_data(list, x);
+        struct stat st;
+        fail_if(t->rcode != LRE_OK, "%s", t->err);
+        fail_if(t->err);
+        fail_if(!g_file_test(fns[x], G_FILE_TEST_IS_REGULAR));
+        fail_if(stat(fns[x], &st));
+        fail_if(st.st_nlink != 1);
+    }
+
+    for (int x = 0; x < 3; x++) {
+        unlink(fns[x]);
+        g_free(fns[x]);
+    }
+
+    g_slist_free_full(list, (GDestroyNotify) lr_downloadtarget_free);
+    lr_handle_free(handle);
+}
+END_TEST
+
+#ifdef F_OFD_SETLK
+static int
+locked_file_end_cb(void *data,
+                   LrTransferStatus status,
+                   G_GNUC_UNUSED const char *msg)
+{
+    int *count = data;
+    fail_if(status != LR_TRANSFER_ALREADYEXISTS);
+    (*count)++;
+    return LR_CB_OK;
+}
+
+static gpointer
+locked_file_release(gpointer data)
+{
+    g_usleep(G_USEC_PER_SEC / 2);
+    close(GPOINTER_TO_INT(data));
+    return NULL;
+}
+
+START_TEST(test_downloader_locked_file)
+{
+    gboolean ret;
+    LrHandle *handle;
+    GError *tmp_err = NULL;
+    int ended = 0;
+
+    handle = lr_handle_init();
+    fail_if(handle == NULL);
+
+    char *urls[] = {"file:///", NULL};
+    lr_handle_setopt(handle, NULL, LRO_URLS, urls);
+    lr_handle_prepare_internal_mirrorlist(handle, FALSE, &tmp_err);
+    fail_if(tmp_err);
+
+    // The file is locked as if another process was downloading it,
+    // it's complete when the lock is released, so no transfer is done
+
+    char *fn = g_strdup_printf("%s/locked_file", test_globals.tmpdir);
+    int fd = open(fn, O_CREAT|O_TRUNC|O_RDWR, 0666);
+    fail_if(fd == -1);
+    struct flock fl = { .l_type = F_WRLCK, .l_whence = SEEK_SET };
+    fail_if(fcntl(fd, F_OFD_SETLK, &fl) == -1);
+    GThread *thread = g_thread_new("release", locked_file_release,
+                                   GINT_TO_POINTER(fd));
+
+    GSList *checksums = g_slist_append(NULL,
+        lr_downloadtargetchecksum_new(LR_CHECKSUM_SHA512,
+            "cf83e1357eefb8bdf1542850d66d8007d620e4050b5715dc83f4a921d36ce9ce"
+            "47d0d13c5d85f2b0ff8318d2877eec2f63b931bd47417a81a538327af927da3e"));
+    LrDownloadTarget *t = lr_downloadtarget_new(handle, "dev/null", NULL,
+                                                -1, fn, checksums, 0,
+                                                0, NULL, &ended,
+                                                locked_file_end_cb, NULL,
+                                                NULL, 0, 0, NULL, FALSE,
+                                                FALSE);
+    fail_if(!t);
+    GSList *list = g_slist_append(NULL, t);
+
+    ret = lr_download(list, TRUE, &tmp_err);
+    g_thread_join(thread);
+    fail_if(!ret);
+    fail_if(tmp_err);
+    fail_if(ended != 1);
+    fail_if(t->rcode != LRE_OK, "%s", t->err);
+
+    LrStats *stats = NULL;
+    fail_if(!lr_handle_getinfo(handle, NULL, LRI_STATS, &stats));
+    fail_if(stats->transfers != 0);
+    fail_if(!g_file_test(fn, G_FILE_TEST_IS_REGULAR));
+
+    unlink(fn);
+    g_free(fn);
+    g_slist_free_full(list, (GDestroyNotify) lr_downloadtarget_free);
+    lr_handle_free(handle);
+}
+END_TEST
+
+static int
+locked_file_timeout_end_cb(void *data,
+                           LrTransferStatus status,
+                           G_GNUC_UNUSED const char *msg)
+{
+    int *count = data;
+    fail_if(status != LR_TRANSFER_ERROR);
+    (*count)++;
+    return LR_CB_OK;
+}
+
+START_TEST(test_downloader_locked_file_timeout)
+{
+    gboolean ret;
+    LrHandle *handle;
+    GError *tmp_err = NULL;
+    int ended = 0;
+    long timeout = -1;
+
+    handle = lr_handle_init();
+    fail_if(handle == NULL);
+
+    fail_if(!lr_handle_getinfo(handle, NULL, LRI_LOCKTIMEOUT, &timeout));
+    fail_if(timeout != LRO_LOCKTIMEOUT_DEFAULT);
+    fail_if(lr_handle_setopt(handle, NULL, LRO_LOCKTIMEOUT, -1L));
+    fail_if(!lr_handle_setopt(handle, NULL, LRO_LOCKTIMEOUT, 1L));
+    fail_if(!lr_handle_getinfo(handle, NULL, LRI_LOCKTIMEOUT, &timeout));
+    fail_if(timeout != 1);
+
+    char *urls[] = {"file:///", NULL};
+    lr_handle_setopt(handle, NULL, LRO_URLS, urls);
+    lr_handle_prepare_internal_mirrorlist(handle, FALSE, &tmp_err);
+    fail_if(tmp_err);
+
+    // The file stays locked by another process, the target fails
+    // when LRO_LOCKTIMEOUT runs out
+
+    char *fn = g_strdup_printf("%s/locked_file_timeout", test_globals.tmpdir);
+    int fd = open(fn, O_CREAT|O_TRUNC|O_RDWR, 0666);
+    fail_if(fd == -1);
+    struct flock fl = { .l_type = F_WRLCK, .l_whence = SEEK_SET };
+    fail_if(fcntl(fd, F_OFD_SETLK, &fl) == -1);
+
+    LrDownloadTarget *t = lr_downloadtarget_new(handle, "dev/null", NULL,
+                                                -1, fn, NULL, 0,
+                                                0, NULL, &ended,
+                                                locked_file_timeout_end_cb,
+                                                NULL, NULL, 0, 0, NULL,
+                                                FALSE, FALSE);
+    fail_if(!t);
+    GSList *list = g_slist_append(NULL, t);
+
+    gint64 start = g_get_monotonic_time();
+    ret = lr_download(list, FALSE, &tmp_err);
+    fail_if(!ret);
+    fail_if(tmp_err);
+    fail_if(g_get_monotonic_time() - start < G_USEC_PER_SEC);
+    fail_if(ended != 1);
+    fail_if(t->rcode != LRE_FILE);
+
+    // The file of the other process is kept
+    fail_if(!g_file_test(fn, G_FILE_TEST_IS_REGULAR));
+
+    close(fd);
+    unlink(fn);
+    g_free(fn);
+    g_slist_free_full(list, (GDestroyNotify) lr_downloadtarget_free);
+    lr_handle_free(handle);
+}
+END_TEST
+
+START_TEST(test_downloader_linked_file)
+{
+    gboolean ret;
+    LrHandle *handle;
+    GError *tmp_err = NULL;
+    gchar *content = NULL;
+    struct stat st;
+
+    handle = lr_handle_init();
+    fail_if(handle == NULL);
+
+    char *src = g_strdup_printf("%s/linked_file_src", test_globals.tmpdir);
+    char *other = g_strdup_printf("%s/linked_file_other", test_globals.tmpdir);
+    char *fn = g_strdup_printf("%s/linked_file", test_globals.tmpdir);
+    fail_if(!g_file_set_contents(src, "new content\n", -1, NULL));
+    fail_if(!g_file_set_contents(other, "old content\n", -1, NULL));
+    fail_if(link(other, fn));
+
+    char *url = g_strdup_printf("file://%s", src);
+    LrDownloadTarget *t = lr_downloadtarget_new(handle, url, NULL, -1, fn,
+                                                NULL, 0, 0, NULL, NULL, NULL,
+                                                NULL, NULL, 0, 0, NULL,
+                                                FALSE, FALSE);
+    fail_if(!t);
+    GSList *list = g_slist_append(NULL, t);
+
+    // The locked destination is replaced by a new (locked) file,
+    // the other link of the original file is untouched
+    ret = lr_download(list, FALSE, &tmp_err);
+    fail_if(!ret);
+    fail_if(tmp_err);
+    fail_if(t->err);
+
+    fail_if(!g_file_get_contents(fn, &content, NULL, NULL));
+    ck_assert_str_eq(content, "new content\n");
+    g_free(content);
+    fail_if(!g_file_get_contents(other, &content, NULL, NULL));
+    ck_assert_str_eq(content, "old content\n");
+    g_free(content);
+    fail_if(stat(other, &st));
+    fail_if(st.st_nlink != 1);
+
+    unlink(src);
+    unlink(other);
+    unlink(fn);
+    g_free(src);
+    g_free(other);
+    g_free(fn);
+    g_free(url);
+    g_slist_free_full(list, (GDestroyNotify) lr_downloadtarget_free);
+    lr_handle_free(handle);
+}
+END_TEST
+#endif /* F_OFD_SETLK */
+
+START_TEST(test_downloader_memory)
+{
+    gboolean ret;
+    LrHandle *handle;
+    GError *tmp_err = NULL;
+    const char *content = "memory target\n";
+
+    handle = lr_handle_init();
+    fail_if(handle == NULL);
+
+    char *fn = g_strdup_printf("%s/memory_target", test_globals.tmpdir);
+    fail_if(!g_file_set_contents(fn, content, -1, NULL));
+    char *url = g_strdup_printf("file://%s", fn);
+
+    // Neither fd nor fn, the data are kept in memory
+    GSList *checksums = g_slist_append(NULL,
+        lr_downloadtargetchecksum_new(LR_CHECKSUM_SHA256,
+            "807e8891136e92230cf4515485f5ce25bab8dba52ad59cdc63b4f89a1fe76245"));
+    LrDownloadTarget *t1 = lr_downloadtarget_new(handle, url, NULL, -1, NULL,
+                                                 checksums, 0, 0, NULL, NULL,
+                                                 NULL, NULL, NULL, 0, 0, NULL,
+                                                 FALSE, FALSE);
+    fail_if(!t1);
+    fail_if(!t1->data);
+
+    checksums = g_slist_append(NULL,
+        lr_downloadtargetchecksum_new(LR_CHECKSUM_SHA256,
+            "0000000000000000000000000000000000000000000000000000000000000000"));
+    LrDownloadTarget *t2 = lr_downloadtarget_new(handle, url, NULL, -1, NULL,
+                                                 checksums, 0, 0, NULL, NULL,
+                                                 NULL, NULL, NULL, 0, 0, NULL,
+                                                 FALSE, FALSE);
+    fail_if(!t2);
+
+    GSList *list = g_slist_append(NULL, t1);
+    list = g_slist_append(list, t2);
+
+    ret = lr_download(list, FALSE, &tmp_err);
+    fail_if(!ret);
+    fail_if(tmp_err);
+
+    fail_if(t1->rcode != LRE_OK, "%s", t1->err);
+    ck_assert_int_eq(t1->data->len, strlen(content));
+    fail_if(memcmp(t1->data->data, content, t1->data->len) != 0);
+
+    fail_if(t2->rcode != LRE_BADCHECKSUM);
+
+    unlink(fn);
+    g_free(fn);
+    g_free(url);
+    g_slist_free_full(list, (GDestroyNotify) lr_downloadtarget_free);
+    lr_handle_free(handle);
+}
+END_TEST
+
+START_TEST(test_downloader_memory_limit)
+{
+    gboolean ret;
+    LrHandle *handle;
+    GError *tmp_err = NULL;
+    const char *content = "memory target\n";
+
+    handle = lr_handle_init();
+    fail_if(handle == NULL);
+
+    char *fn = g_strdup_printf("%s/memory_target_limit", test_globals.tmpdir);
+    fail_if(!g_file_set_contents(fn, content, -1, NULL));
+    char *url = g_strdup_printf("file://%s", fn);
+
+    // The file is larger than expectedsize, the buffer must not grow
+    // over it
+    LrDownloadTarget *t1 = lr_downloadtarget_new(handle, url, NULL, -1, NULL,
+                                                 NULL, 5, 0, NULL, NULL,
+                                                 NULL, NULL, NULL, 0, 0, NULL,
+                                                 FALSE, FALSE);
+    fail_if(!t1);
+
+    // The file fits exactly
+    LrDownloadTarget *t2 = lr_downloadtarget_new(handle, url, NULL, -1, NULL,
+                                                 NULL, strlen(content), 0,
+                                                 NULL, NULL, NULL, NULL, NULL,
+                                                 0, 0, NULL, FALSE, FALSE);
+    fail_if(!t2);
+
+    GSList *list = g_slist_append(NULL, t1);
+    list = g_slist_append(list, t2);
+
+    ret = lr_download(list, FALSE, &tmp_err);
+    fail_if(!ret);
+    fail_if(tmp_err);
+
+    ck_assert_int_eq(t1->rcode, LRE_IO);
+    fail_if(t1->data->len > 5);
+
+    fail_if(t2->rcode != LRE_OK, "%s", t2->err);
+    ck_assert_int_eq(t2->data->len, strlen(content));
+
+    unlink(fn);
+    g_free(fn);
+    g_free(url);
+    g_slist_free_full(list, (GDestroyNotify) lr_downloadtarget_free);
+    lr_handle_free(handle);
+}
+END_TEST
+
+/** Size of a source file which doesn't fit in the write buffer
+ * of the downloader (256 KiB) */
+#define SOURCE_FILE_SIZE    (3 * 256 * 1024 + 12345)
+
+static char *
+source_data(gsize size)
+{
+    char *data = g_malloc(size);
+    for (gsize i = 0; i < size; i++)
+        data[i] = (char) (i % 251);
+    return data;
+}
+
+/** Create a file with source_data() in the tmpdir and return its URL.
+ */
+static char *
+source_file_url(const char *name, gsize size)
+{
+    char *fn = g_strdup_printf("%s/%s", test_globals.tmpdir, name);
+    char *data = source_data(size);
+    fail_if(!g_file_set_contents(fn, data, size, NULL));
+    char *url = g_strdup_printf("file://%s", fn);
+    g_free(data);
+    g_free(fn);
+    return url;
+}
+
+static void
+check_file_content(const char *fn, const char *expected, gsize len)
+{
+    gchar *content = NULL;
+    gsize content_len = 0;
+
+    fail_if(!g_file_get_contents(fn, &content, &content_len, NULL));
+    ck_assert_int_eq(content_len, len);
+    fail_if(memcmp(content, expected, len) != 0);
+    g_free(content);
+}
+
+START_TEST(test_downloader_large_file)
+{
+    gboolean ret;
+    LrHandle *handle;
+    GError *tmp_err = NULL;
+    long droppagecache = -1;
+
+    handle = lr_handle_init();
+    fail_if(handle == NULL);
+
+    fail_if(!lr_handle_getinfo(handle, NULL, LRI_DROPPAGECACHE, &droppagecache));
+    fail_if(droppagecache != LRO_DROPPAGECACHE_DEFAULT);
+    fail_if(!lr_handle_setopt(handle, NULL, LRO_DROPPAGECACHE, 1L));
+    fail_if(!lr_handle_getinfo(handle, NULL, LRI_DROPPAGECACHE, &droppagecache));
+    fail_if(droppagecache != 1);
+
+    // The file is larger than the write buffer, it's written in more
+    // blocks into the preallocated file
+
+    char *url = source_file_url("large_file_source", SOURCE_FILE_SIZE);
+    char *fn = g_strdup_printf("%s/large_file", test_globals.tmpdir);
+    char *data = source_data(SOURCE_FILE_SIZE);
+    char *checksum = g_compute_checksum_for_data(G_CHECKSUM_SHA256,
+                                                 (guchar *) data,
+                                                 SOURCE_FILE_SIZE);
+    GSList *checksums = g_slist_append(NULL,
+        lr_downloadtargetchecksum_new(LR_CHECKSUM_SHA256, checksum));
+    LrDownloadTarget *t = lr_downloadtarget_new(handle, url, NULL, -1, fn,
+                                                checksums, SOURCE_FILE_SIZE,
+                                                0, NULL, NULL, NULL, NULL,
+                                                NULL, 0, 0, NULL, FALSE,
+                                                FALSE);
+    fail_if(!t);
+    GSList *list = g_slist_append(NULL, t);
+
+    ret = lr_download(list, FALSE, &tmp_err);
+    fail_if(!ret);
+    fail_if(tmp_err);
+    fail_if(t->rcode != LRE_OK, "%s", t->err);
+    check_file_content(fn, data, SOURCE_FILE_SIZE);
+
+    unlink(fn);
+    g_free(fn);
+    g_free(url);
+    g_free(data);
+    g_free(checksum);
+    g_slist_free_full(list, (GDestroyNotify) lr_downloadtarget_free);
+    lr_handle_free(handle);
+}
+END_TEST
+
+START_TEST(test_downloader_resume)
+{
+    gboolean ret;
+    LrHandle *handle;
+    GError *tmp_err = NULL;
+    const gsize partial = 100000;
+
+    handle = lr_handle_init();
+    fail_if(handle == NULL);
+
+    // The first part of the file was downloaded by an interrupted
+    // download, the rest is appended behind it
+
+    char *url = source_file_url("resume_source", SOURCE_FILE_SIZE);
+    char *fn = g_strdup_printf("%s/resume", test_globals.tmpdir);
+    char *data = source_data(SOURCE_FILE_SIZE);
+    int fd = open(fn, O_CREAT|O_TRUNC|O_RDWR, 0666);
+    fail_if(fd == -1);
+    fail_if(write(fd, data, partial) != (ssize_t) partial);
+    // Only files marked as being downloaded by librepo are resumed,
+    // if the filesystem has no xattrs, the whole file is downloaded
+    gboolean resumable = FSETXATTR(fd, "user.Librepo.DownloadInProgress",
+                                   "1", 1, 0) == 0;
+    close(fd);
+
+    LrDownloadTarget *t = lr_downloadtarget_new(handle, url, NULL, -1, fn,
+                                                NULL, 0, TRUE, NULL, NULL,
+                                                NULL, NULL, NULL, 0, 0, NULL,
+                                                FALSE, FALSE);
+    fail_if(!t);
+    GSList *list = g_slist_append(NULL, t);
+
+    ret = lr_download(list, FALSE, &tmp_err);
+    fail_if(!ret);
+    fail_if(tmp_err);
+    fail_if(t->rcode != LRE_OK, "%s", t->err);
+    check_file_content(fn, data, SOURCE_FILE_SIZE);
+
+    if (resumable) {
+        LrStats *stats = NULL;
+        fail_if(!lr_handle_getinfo(handle, NULL, LRI_STATS, &stats));
+        ck_assert_int_eq(stats->bytes_downloaded, SOURCE_FILE_SIZE - partial);
+    }
+
+    unlink(fn);
+    g_free(fn);
+    g_free(url);
+    g_free(data);
+    g_slist_free_full(list, (GDestroyNotify) lr_downloadtarget_free);
+    lr_handle_free(handle);
+}
+END_TEST
+
+START_TEST(test_downloader_fd_offset)
+{
+    gboolean ret;
+    LrHandle *handle;
+    GError *tmp_err = NULL;
+    const char *prefix = "Data of the caller before the download\n";
+    const gsize prefix_len = strlen(prefix);
+
+    handle = lr_handle_init();
+    fail_if(handle == NULL);
+
+    // The supplied descriptor isn't at the start of the file, the data
+    // are written behind its offset and it's left behind them
+
+    char *url = source_file_url("fd_offset_source", SOURCE_FILE_SIZE);
+    char *fn = g_strdup_printf("%s/fd_offset", test_globals.tmpdir);
+    int fd = open(fn, O_CREAT|O_TRUNC|O_RDWR, 0666);
+    fail_if(fd == -1);
+    fail_if(write(fd, prefix, prefix_len) != (ssize_t) prefix_len);
+
+    LrDownloadTarget *t = lr_downloadtarget_new(handle, url, NULL, fd, NULL,
+                                                NULL, 0, 0, NULL, NULL, NULL,
+                                                NULL, NULL, 0, 0, NULL, FALSE,
+                                                FALSE);
+    fail_if(!t);
+    GSList *list = g_slist_append(NULL, t);
+
+    ret = lr_download(list, FALSE, &tmp_err);
+    fail_if(!ret);
+    fail_if(tmp_err);
+    fail_if(t->rcode != LRE_OK, "%s", t->err);
+    ck_assert_int_eq(lseek(fd, 0, SEEK_CUR), prefix_len + SOURCE_FILE_SIZE);
+
+    char *expected = g_malloc(prefix_len + SOURCE_FILE_SIZE);
+    char *data = source_data(SOURCE_FILE_SIZE);
+    memcpy(expected, prefix, prefix_len);
+    memcpy(expected + prefix_len, data, SOURCE_FILE_SIZE);
+    check_file_content(fn, expected, prefix_len + SOURCE_FILE_SIZE);
+
+    close(fd);
+    unlink(fn);
+    g_free(fn);
+    g_free(url);
+    g_free(data);
+    g_free(expected);
+    g_slist_free_full(list, (GDestroyNotify) lr_downloadtarget_free);
+    lr_handle_free(handle);
+}
+END_TEST
+
+START_TEST(test_downloader_byte_range)
+{
+    gboolean ret;
+    LrHandle *handle;
+    GError *tmp_err = NULL;
+    const gint64 start = 1000, end = 300000;
+
+    handle = lr_handle_init();
+    fail_if(handle == NULL);
+
+    // Only the range (including its last byte) is written to the file
+
+    char *url = source_file_url("byte_range_source", SOURCE_FILE_SIZE);
+    char *fn = g_strdup_printf("%s/byte_range", test_globals.tmpdir);
+    LrDownloadTarget *t = lr_downloadtarget_new(handle, url, NULL, -1, fn,
+                                                NULL, 0, 0, NULL, NULL, NULL,
+                                                NULL, NULL, start, end, NULL,
+                                                FALSE, FALSE);
+    fail_if(!t);
+    GSList *list = g_slist_append(NULL, t);
+
+    ret = lr_download(list, FALSE, &tmp_err);
+    fail_if(!ret);
+    fail_if(tmp_err);
+    fail_if(t->rcode != LRE_OK, "%s", t->err);
+
+    char *data = source_data(SOURCE_FILE_SIZE);
+    check_file_content(fn, data + start, end - start + 1);
+
+    unlink(fn);
+    g_free(fn);
+    g_free(url);
+    g_free(data);
+    g_slist_free_full(list, (GDestroyNotify) lr_downloadtarget_free);
+    lr_handle_free(handle);
+}
+END_TEST
+
+static gboolean
+session_done_cb(LrDownloadSession *session, gpointer user_data)
+{
+    GMainLoop *loop = user_data;
+
+    if (!lr_download_session_is_finished(session))
+        return G_SOURCE_CONTINUE;
+
+    g_main_loop_quit(loop);
+    return G_SOURCE_REMOVE;
+}
+
+START_TEST(test_downloader_session)
+{
+    gboolean ret;
+    LrHandle *handle;
+    LrDownloadSession *session;
+    LrDownloadTarget *t1, *t2, *finished;
+    GMainLoop *loop;
+    GSource *source;
+    GError *tmp_err = NULL;
+    int fd1, fd2, count = 0;
+    char *tmpfn1, *tmpfn2;
+
+    handle = lr_handle_init();
+    fail_if(handle == NULL);
+
+    char *urls[] = {"file:///", NULL};
+    lr_handle_setopt(handle, NULL, LRO_URLS, urls);
+    lr_handle_prepare_internal_mirrorlist(handle, FALSE, &tmp_err);
+    fail_if(tmp_err);
+
+    tmpfn1 = lr_pathconcat(test_globals.tmpdir, "session_XXXXXX", NULL);
+    tmpfn2 = lr_pathconcat(test_globals.tmpdir, "session_XXXXXX", NULL);
+    fd1 = mkstemp(tmpfn1);
+    fd2 = mkstemp(tmpfn2);
+    fail_if(fd1 < 0);
+    fail_if(fd2 < 0);
+
+    t1 = lr_downloadtarget_new(handle, "dev/null", NULL, fd1, NULL, NULL,
+                               0, 0, NULL, NULL, NULL, NULL, NULL, 0, 0, NULL,
+                               FALSE, FALSE);
+    t2 = lr_downloadtarget_new(handle, "nonexistent/file", NULL, fd2, NULL,
+                               NULL, 0, 0, NULL, NULL, NULL, NULL, NULL, 0, 0,
+                               NULL, FALSE, FALSE);
+
+    session = lr_download_session_new(handle, FALSE, &tmp_err);
+    fail_if(!session);
+    fail_if(tmp_err);
+
+    ret = lr_download_session_add_target(session, t1, &tmp_err);
+    fail_if(!ret);
+    ret = lr_download_session_add_target(session, t2, &tmp_err);
+    fail_if(!ret);
+    fail_if(tmp_err);
+
+    // Drive the session from a main loop
+    loop = g_main_loop_new(NULL, FALSE);
+    source = lr_download_session_source_new(session);
+    g_source_set_callback(source, (GSourceFunc) (void (*)(void)) session_done_cb,
+                          loop, NULL);
+    g_source_attach(source, NULL);
+    g_main_loop_run(loop);
+    g_source_destroy(source);
+    g_source_unref(source);
+    g_main_loop_unref(loop);
+
+    fail_if(lr_download_session_get_error(session));
+    while ((finished = lr_download_session_pop_finished(session))) {
+        count++;
+        if (finished == t1)
+            fail_if(finished->rcode != LRE_OK, "%s", finished->err);
+        else
+            fail_if(finished->rcode == LRE_OK);
+    }
+    fail_if(count != 2);
+
+    lr_download_session_free(session);
+    lr_downloadtarget_free(t1);
+    lr_downloadtarget_free(t2);
+    lr_handle_free(handle);
+    close(fd1);
+    close(fd2);
+    unlink(tmpfn1);
+    unlink(tmpfn2);
+    lr_free(tmpfn1);
+    lr_free(tmpfn2);
+}
+END_TEST
+
+START_TEST(test_downloader_session_cancel)
+{
+    LrHandle *handle;
+    LrDownloadSession *session;
+    GError *tmp_err = NULL;
+
+    handle = lr_handle_init();
+    fail_if(handle == NULL);
+
+    session = lr_download_session_new(handle, TRUE, &tmp_err);
+    fail_if(!session);
+    fail_if(!lr_download_session_is_finished(session));
+    fail_if(lr_download_session_pop_finished(session));
+
+    lr_download_session_cancel(session);
+    fail_if(!lr_download_session_get_error(session));
+    fail_if(lr_download_session_get_error(session)->code != LRE_INTERRUPTED);
+    fail_if(lr_download_session_step(session, -1, 0, &tmp_err));
+    fail_if(!tmp_err);
+    g_error_free(tmp_err);
+
+    lr_download_session_free(session);
+    lr_handle_free(handle);
+}
+END_TEST
+
+static int
+session_interrupt_end_cb(void *data,
+                         LrTransferStatus status,
+                         G_GNUC_UNUSED const char *msg)
+{
+    int *count = data;
+    fail_if(status != LR_TRANSFER_ERROR);
+    (*count)++;
+    return LR_CB_OK;
+}
+
+START_TEST(test_downloader_session_interrupt)
+{
+    LrHandle *handle;
+    LrDownloadSession *session;
+    LrDownloadTarget *t1, *t2, *finished;
+    GError *tmp_err = NULL;
+    int fd1, fd2, count = 0, ended = 0;
+    char *tmpfn1, *tmpfn2;
+
+    handle = lr_handle_init();
+    fail_if(handle == NULL);
+
+    char *urls[] = {"file:///", NULL};
+    lr_handle_setopt(handle, NULL, LRO_URLS, urls);
+    lr_handle_setopt(handle, NULL, LRO_MAXPARALLELDOWNLOADS, 1L);
+    lr_handle_prepare_internal_mirrorlist(handle, FALSE, &tmp_err);
+    fail_if(tmp_err);
+
+    tmpfn1 = lr_pathconcat(test_globals.tmpdir, "session_XXXXXX", NULL);
+    tmpfn2 = lr_pathconcat(test_globals.tmpdir, "session_XXXXXX", NULL);
+    fd1 = mkstemp(tmpfn1);
+    fd2 = mkstemp(tmpfn2);
+    fail_if(fd1 < 0);
+    fail_if(fd2 < 0);
+
+    t1 = lr_downloadtarget_new(handle, "dev/null", NULL, fd1, NULL, NULL,
+                               0, 0, NULL, &ended, session_interrupt_end_cb,
+                               NULL, NULL, 0, 0, NULL, FALSE, FALSE);
+    t2 = lr_downloadtarget_new(handle, "dev/zero", NULL, fd2, NULL, NULL,
+                               0, 0, NULL, &ended, session_interrupt_end_cb,
+                               NULL, NULL, 0, 0, NULL, FALSE, FALSE);
+
+    session = lr_download_session_new(handle, FALSE, &tmp_err);
+    fail_if(!session);
+
+    // Only the first target is transferred, the second one waits
+    fail_if(!lr_download_session_add_target(session, t1, &tmp_err));
+    fail_if(!lr_download_session_add_target(session, t2, &tmp_err));
+    fail_if(tmp_err);
+
+    // SIGINT (see lr_sigint_handler()) stops the session like lr_download()
+    lr_interrupt = 1;
+    fail_if(lr_download_session_step(session, -1, 0, &tmp_err));
+    lr_interrupt = 0;
+    fail_if(!tmp_err);
+    fail_if(tmp_err->code != LRE_INTERRUPTED);
+    g_clear_error(&tmp_err);
+    fail_if(!lr_download_session_is_finished(session));
+
+    // Both the running and the waiting target are finished
+    while ((finished = lr_download_session_pop_finished(session))) {
+        count++;
+        fail_if(finished->rcode == LRE_OK);
+        if (finished == t2)
+            fail_if(finished->rcode != LRE_INTERRUPTED);
+    }
+    fail_if(count != 2);
+    fail_if(ended != 2);
+
+    lr_download_session_free(session);
+    lr_downloadtarget_free(t1);
+    lr_downloadtarget_free(t2);
+    lr_handle_free(handle);
+    close(fd1);
+    close(fd2);
+    unlink(tmpfn1);
+    unlink(tmpfn2);
+    lr_free(tmpfn1);
+    lr_free(tmpfn2);
+}
+END_TEST
+
+START_TEST(test_downloader_trace)
+{
+    gboolean ret;
+    LrHandle *handle;
+    GSList *list = NULL;
+    GError *err = NULL;
+    GError *tmp_err = NULL;
+    int fd;
+    char *tmpfn, *tracefn, *tracefile = NULL;
+    gchar *content = NULL;
+    LrDownloadTargetChecksum *checksum;
+    LrDownloadTarget *t;
+
+    tracefn = lr_pathconcat(test_globals.tmpdir, "trace.json", NULL);
+
+    handle = lr_handle_init();
+    fail_if(handle == NULL);
+    char *urls[] = {"file:///", NULL};
+    fail_if(!lr_handle_setopt(handle, NULL, LRO_URLS, urls));
+    fail_if(!lr_handle_setopt(handle, NULL, LRO_TRACEFILE, tracefn));
+    fail_if(!lr_handle_getinfo(handle, NULL, LRI_TRACEFILE, &tracefile));
+    ck_assert_str_eq(tracefile, tracefn);
+    lr_handle_prepare_internal_mirrorlist(handle, FALSE, &tmp_err);
+    fail_if(tmp_err);
+
+    tmpfn = lr_pathconcat(test_globals.tmpdir, "trace_target_XXXXXX", NULL);
+    mktemp(tmpfn);
+    fd = open(tmpfn, O_RDWR|O_CREAT|O_TRUNC, 0666);
+    lr_free(tmpfn);
+    fail_if(fd < 0);
+
+    checksum = lr_downloadtargetchecksum_new(LR_CHECKSUM_SHA256,
+        "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855");
+    t = lr_downloadtarget_new(handle, "dev/null", NULL, fd, NULL,
+                              g_slist_append(NULL, checksum),
+                              0, 0, NULL, NULL, NULL, NULL, NULL, 0, 0, NULL,
+                              FALSE, FALSE);
+    fail_if(!t);
+    list = g_slist_append(list, t);
+
+    ret = lr_download(list, FALSE, &err);
+    fail_if(!ret);
+    fail_if(err);
+    fail_if(t->err);
+
+    // Trace is written when the last handle which records it is freed
+    fail_if(g_file_test(tracefn, G_FILE_TEST_EXISTS));
+    lr_handle_free(handle);
+    fail_if(!g_file_get_contents(tracefn, &content, NULL, NULL));
+
+    fail_if(!strstr(content, "\"traceEvents\""));
+    fail_if(!strstr(content, "\"name\":\"lr_download\",\"cat\":\"download\",\"ph\":\"X\""));
+    fail_if(!strstr(content, "\"name\":\"dev/null\",\"cat\":\"transfer\",\"ph\":\"b\""));
+    fail_if(!strstr(content, "\"name\":\"dev/null\",\"cat\":\"transfer\",\"ph\":\"e\""));
+    fail_if(!strstr(content, "\"name\":\"checksum\",\"cat\":\"verify\""));
+
+    g_free(content);
+    unlink(tracefn);
+    lr_free(tracefn);
+    g_slist_free_full(list, (GDestroyNotify) lr_downloadtarget_free);
+}
+END_TEST
+
+START_TEST(test_downloader_progresslimiter)
+{
+    LrProgressLimiter limiter;
+    double total, downloaded;
+    LrHandle *handle = lr_handle_init();
+
+    // No limits, every call passes
+    lr_progresslimiter_init(&limiter, handle);
+    ck_assert(lr_progresslimiter_check(&limiter, 100.0, 1.0));
+    ck_assert(lr_progresslimiter_check(&limiter, 100.0, 2.0));
+    ck_assert(!lr_progresslimiter_flush(&limiter, &total, &downloaded));
+
+    // At least 10 bytes between two calls
+    ck_assert(lr_handle_setopt(handle, NULL, LRO_PROGRESSBYTES, 10L));
+    lr_progresslimiter_init(&limiter, handle);
+    ck_assert(lr_progresslimiter_check(&limiter, 100.0, 1.0));    // First
+    ck_assert(!lr_progresslimiter_check(&limiter, 100.0, 5.0));
+    ck_assert(!lr_progresslimiter_check(&limiter, 100.0, 10.0));
+    ck_assert(lr_progresslimiter_check(&limiter, 100.0, 11.0));
+    ck_assert(!lr_progresslimiter_check(&limiter, 100.0, 12.0));
+    ck_assert(lr_progresslimiter_check(&limiter, 100.0, 3.0));    // Restarted
+    ck_assert(!lr_progresslimiter_check(&limiter, 100.0, 4.0));
+
+    // The suppressed progress is flushed only once
+    ck_assert(lr_progresslimiter_flush(&limiter, &total, &downloaded));
+    ck_assert(total == 100.0);
+    ck_assert(downloaded == 4.0);
+    ck_assert(!lr_progresslimiter_flush(&limiter, &total, &downloaded));
+
+    // The finished download is always reported, but only once
+    ck_assert(lr_progresslimiter_check(&limiter, 100.0, 100.0));
+    ck_assert(!lr_progresslimiter_check(&limiter, 100.0, 100.0));
+
+    // Both limits have to be crossed
+    ck_assert(lr_handle_setopt(handle, NULL, LRO_PROGRESSINTERVAL, 3600000L));
+    lr_progresslimiter_init(&limiter, handle);
+    ck_assert(lr_progresslimiter_check(&limiter, 100.0, 1.0));
+    ck_assert(!lr_progresslimiter_check(&limiter, 100.0, 50.0));
+
+    ck_assert(!lr_handle_setopt(handle, NULL, LRO_PROGRESSINTERVAL, -1L));
+
+    lr_handle_free(handle);
+}
+END_TEST
+
+static int
+shared_progress_cb(void *data,
+                   G_GNUC_UNUSED double total,
+                   double downloaded)
+{
+    double *reported = data;
+    *reported = downloaded;
+    return LR_CB_OK;
+}
+
+static int
+shared_progress_end_cb(void *data,
+                       LrTransferStatus status,
+                       G_GNUC_UNUSED const char *msg)
+{
+    // Targets of lr_download_single_cb() get their LrCallbackData
+    LrCallbackData *cbdata = data;
+    double *reported = cbdata->userdata;
+    double downloaded = 0.0;
+
+    fail_if(status != LR_TRANSFER_SUCCESSFUL);
+    for (GSList *elem = cbdata->sharedcbdata->singlecbdata; elem;
+         elem = g_slist_next(elem))
+        downloaded += ((LrCallbackData *) elem->data)->downloaded;
+    fail_if(*reported != downloaded);
+    return LR_CB_OK;
+}
+
+START_TEST(test_downloader_shared_progress_flush)
+{
+    gboolean ret;
+    LrHandle *handle;
+    GSList *list = NULL;
+    GError *tmp_err = NULL;
+    double reported = 0.0;
+    char *fns[2];
+
+    handle = lr_handle_init();
+    fail_if(handle == NULL);
+    fail_if(!lr_handle_setopt(handle, NULL, LRO_PROGRESSINTERVAL, 3600000L));
+
+    // The summarized progress suppressed by the limiter is reported
+    // before the end callback of each target
+
+    char *url = source_file_url("shared_progress_source", SOURCE_FILE_SIZE);
+    for (int x = 0; x < 2; x++) {
+        fns[x] = g_strdup_printf("%s/shared_progress_%d",
+                                 test_globals.tmpdir, x);
+        LrDownloadTarget *t = lr_downloadtarget_new(handle, url, NULL, -1,
+                                                    fns[x], NULL, 0, 0, NULL,
+                                                    &reported,
+                                                    shared_progress_end_cb,
+                                                    NULL, NULL, 0, 0, NULL,
+                                                    FALSE, FALSE);
+        fail_if(!t);
+        list = g_slist_append(list, t);
+    }
+
+    ret = lr_download_single_cb(list, FALSE, shared_progress_cb, NULL,
+                                &tmp_err);
+    fail_if(!ret);
+    fail_if(tmp_err);
+    fail_if(reported != 2.0 * SOURCE_FILE_SIZE);
+
+    for (int x = 0; x < 2; x++) {
+        unlink(fns[x]);
+        g_free(fns[x]);
+    }
+    g_free(url);
+    g_slist_free_full(list, (GDestroyNotify) lr_downloadtarget_free);
+    lr_handle_free(handle);
+}
+END_TEST
+
 Suite *
 downloader_suite(void)
 {
@@ -397,6 +1409,24 @@ downloader_suite(void)
     tcase_add_test(tc, test_downloader_two_files);
     tcase_add_test(tc, test_downloader_three_files_with_error);
     tcase_add_test(tc, test_downloader_checksum);
+    tcase_add_test(tc, test_downloader_memory);
+    tcase_add_test(tc, test_downloader_memory_limit);
+    tcase_add_test(tc, test_downloader_large_file);
+    tcase_add_test(tc, test_downloader_resume);
+    tcase_add_test(tc, test_downloader_fd_offset);
+    tcase_add_test(tc, test_downloader_byte_range);
+    tcase_add_test(tc, test_downloader_duplicates);
+#ifdef F_OFD_SETLK
+    tcase_add_test(tc, test_downloader_locked_file);
+    tcase_add_test(tc, test_downloader_locked_file_timeout);
+    tcase_add_test(tc, test_downloader_linked_file);
+#endif
+    tcase_add_test(tc, test_downloader_session);
+    tcase_add_test(tc, test_downloader_session_cancel);
+    tcase_add_test(tc, test_downloader_session_interrupt);
+    tcase_add_test(tc, test_downloader_trace);
+    tcase_add_test(tc, test_downloader_progresslimiter);
+    tcase_add_test(tc, test_downloader_shared_progress_flush);
     suite_add_tcase(s, tc);
     return s;
 }
@@ -162,6 +162,43 @@ START_TEST(test_handle_getinfo)
 }
 END_TEST
 
+START_TEST(test_handle_tracefile)
+{
+    char *str = NULL;
+    GError *tmp_err = NULL;
+    LrHandle *h1 = lr_handle_init();
+    LrHandle *h2 = lr_handle_init();
+    char *tracefn1 = lr_pathconcat(test_globals.tmpdir, "trace1.json", NULL);
+    char *tracefn2 = lr_pathconcat(test_globals.tmpdir, "trace2.json", NULL);
+
+    fail_if(!lr_handle_setopt(h1, NULL, LRO_TRACEFILE, tracefn1));
+
+    // The trace is already recorded to another file
+    fail_if(lr_handle_setopt(h2, &tmp_err, LRO_TRACEFILE, tracefn2));
+    fail_if(!tmp_err);
+    fail_if(tmp_err->code != LRE_BADOPTARG);
+    g_error_free(tmp_err);
+    fail_if(!lr_handle_getinfo(h2, NULL, LRI_TRACEFILE, &str));
+    fail_if(str != NULL);
+
+    // The same file is shared
+    fail_if(!lr_handle_setopt(h2, NULL, LRO_TRACEFILE, tracefn1));
+    fail_if(!lr_handle_getinfo(h2, NULL, LRI_TRACEFILE, &str));
+    ck_assert_str_eq(str, tracefn1);
+
+    // When the trace is written, another file can be used
+    lr_handle_free(h1);
+    fail_if(!lr_handle_setopt(h2, NULL, LRO_TRACEFILE, NULL));
+    fail_if(!g_file_test(tracefn1, G_FILE_TEST_EXISTS));
+    fail_if(!lr_handle_setopt(h2, NULL, LRO_TRACEFILE, tracefn2));
+    lr_handle_free(h2);
+    fail_if(!g_file_test(tracefn2, G_FILE_TEST_EXISTS));
+
+    lr_free(tracefn1);
+    lr_free(tracefn2);
+}
+END_TEST
+
 Suite *
 handle_suite(void)
 {
@@ -169,6 +206,7 @@ handle_suite(void)
     TCase *tc = tcase_create("Main");
     tcase_add_test(tc, test_handle);
     tcase_add_test(tc, test_handle_getinfo);
+    tcase_add_test(tc, test_handle_tracefile);
     suite_add_tcase(s, tc);
     return s;
 }
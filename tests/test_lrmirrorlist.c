@@ -21,11 +21,13 @@ START_TEST(test_lrmirrorlist_append_url)
 
     iml = lr_lrmirrorlist_append_url(iml, url1, NULL);
     iml = lr_lrmirrorlist_append_url(iml, url2, NULL);
-    iml = lr_lrmirrorlist_append_url(iml, url3, vars);
+    LrUrlSubst *subst = lr_urlsubst_new(vars);
+    iml = lr_lrmirrorlist_append_url(iml, url3, subst);
 
     g_free(url1);
     g_free(url2);
     g_free(url3);
+    lr_urlsubst_free(subst);
     lr_urlvars_free(vars);
 
     mirror = lr_lrmirrorlist_nth(iml, 0);
@@ -10,7 +10,9 @@
 #include "librepo/util.h"
 
 #include "fixtures.h"
+#include "test_arena.h"
 #include "test_checksum.h"
+#include "test_decompress.h"
 #include "test_downloader.h"
 #include "test_gpg.h"
 #include "test_handle.h"
@@ -20,6 +22,7 @@
 #include "test_package_downloader.h"
 #include "test_repoconf.h"
 #include "test_repomd.h"
+#include "test_stats.h"
 #include "test_url_substitution.h"
 #include "test_util.h"
 #include "test_version.h"
@@ -104,9 +107,11 @@ main(int argc, char **argv)
     printf("Tests using directory: %s\n", test_globals.tmpdir);
 
     SRunner *sr = srunner_create(checksum_suite());
+    srunner_add_suite(sr, arena_suite());
     if (downloading) {
         srunner_add_suite(sr, downloader_suite());
     }
+    srunner_add_suite(sr, decompress_suite());
     srunner_add_suite(sr, gpg_suite());
     srunner_add_suite(sr, handle_suite());
     srunner_add_suite(sr, lrmirrorlist_suite());
@@ -115,6 +120,7 @@ main(int argc, char **argv)
     srunner_add_suite(sr, package_downloader_suite());
     srunner_add_suite(sr, repoconf_suite());
     srunner_add_suite(sr, repomd_suite());
+    srunner_add_suite(sr, stats_suite());
     srunner_add_suite(sr, url_substitution_suite());
     srunner_add_suite(sr, util_suite());
     srunner_add_suite(sr, version_suite());
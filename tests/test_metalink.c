@@ -195,6 +195,49 @@ START_TEST(test_metalink_good_02)
 }
 END_TEST
 
+START_TEST(test_metalink_buffer)
+{
+    gboolean ret;
+    char *path;
+    gchar *content = NULL;
+    gsize len = 0;
+    LrMetalink *ml = NULL;
+    GError *tmp_err = NULL;
+
+    path = lr_pathconcat(test_globals.testdata_dir, METALINK_DIR,
+                         "metalink_good_02", NULL);
+    fail_if(!g_file_get_contents(path, &content, &len, NULL));
+    lr_free(path);
+    ml = lr_metalink_init();
+    fail_if(ml == NULL);
+    ret = lr_metalink_parse_buffer(ml, content, len, REPOMD,
+                                   NULL, NULL, &tmp_err);
+    fail_if(!ret);
+    fail_if(tmp_err);
+
+    fail_if(ml->filename == NULL);
+    fail_if(strcmp(ml->filename, "repomd.xml"));
+    fail_if(g_slist_length(ml->urls) != 3);
+
+    LrMetalinkUrl *mlurl = g_slist_nth_data(ml->urls, 0);
+    fail_if(!mlurl);
+    fail_if(mlurl->preference != 97);
+    fail_if(strcmp(mlurl->url,
+                   "http://mirror.pnl.gov/fedora/linux/releases/17/Everything/x86_64/os/repodata/repomd.xml"));
+    lr_metalink_free(ml);
+
+    // Truncated document
+    ml = lr_metalink_init();
+    ret = lr_metalink_parse_buffer(ml, content, len / 2, REPOMD,
+                                   NULL, NULL, &tmp_err);
+    fail_if(ret);
+    fail_if(!tmp_err);
+    g_error_free(tmp_err);
+    lr_metalink_free(ml);
+    g_free(content);
+}
+END_TEST
+
 START_TEST(test_metalink_good_03)
 {
     int fd;
@@ -513,6 +556,44 @@ START_TEST(test_metalink_with_alternates)
 }
 END_TEST
 
+START_TEST(test_metalink_interned_strings)
+{
+    int fd;
+    gboolean ret;
+    char *path;
+    LrMetalink *ml = NULL;
+    GError *tmp_err = NULL;
+
+    path = lr_pathconcat(test_globals.testdata_dir, METALINK_DIR,
+                         "metalink_good_01", NULL);
+    fd = open(path, O_RDONLY);
+    lr_free(path);
+    fail_if(fd < 0);
+    ml = lr_metalink_init();
+    fail_if(ml == NULL);
+    ret = lr_metalink_parse_file(ml, fd, REPOMD, NULL, NULL, &tmp_err);
+    fail_if(!ret);
+    fail_if(tmp_err);
+    close(fd);
+
+    // Repeated attribute values share a single copy
+    LrMetalinkUrl *first = g_slist_nth_data(ml->urls, 0);
+    LrMetalinkUrl *second = g_slist_nth_data(ml->urls, 1);
+    fail_if(!first || !second);
+    fail_if(strcmp(first->protocol, "http"));
+    fail_if(first->protocol != second->protocol);
+    fail_if(first->type != second->type);
+    fail_if(first->location != second->location);
+    fail_if(first->url == second->url);
+
+    // Document order is kept
+    fail_if(first->preference != 99);
+    fail_if(second->preference != 98);
+
+    lr_metalink_free(ml);
+}
+END_TEST
+
 Suite *
 metalink_suite(void)
 {
@@ -521,6 +602,7 @@ metalink_suite(void)
     tcase_add_test(tc, test_metalink_init);
     tcase_add_test(tc, test_metalink_good_01);
     tcase_add_test(tc, test_metalink_good_02);
+    tcase_add_test(tc, test_metalink_buffer);
     tcase_add_test(tc, test_metalink_good_03);
     tcase_add_test(tc, test_metalink_bad_01);
     tcase_add_test(tc, test_metalink_bad_02);
@@ -528,6 +610,7 @@ metalink_suite(void)
     tcase_add_test(tc, test_metalink_really_bad_02);
     tcase_add_test(tc, test_metalink_really_bad_03);
     tcase_add_test(tc, test_metalink_with_alternates);
+    tcase_add_test(tc, test_metalink_interned_strings);
     suite_add_tcase(s, tc);
     return s;
 }
@@ -2,6 +2,7 @@
 #include <sys/stat.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <string.h>
 
 #include "testsys.h"
 #include "fixtures.h"
@@ -105,6 +106,50 @@ START_TEST(test_mirrorlist_03)
 }
 END_TEST
 
+START_TEST(test_mirrorlist_buffer)
+{
+    gboolean ret;
+    char *path;
+    gchar *content = NULL;
+    gsize len = 0;
+    GSList *elem = NULL;
+    LrMirrorlist *ml = NULL;
+    GError *tmp_err = NULL;
+
+    path = lr_pathconcat(test_globals.testdata_dir, MIRRORLIST_DIR,
+                         "mirrorlist_01", NULL);
+    fail_if(!g_file_get_contents(path, &content, &len, NULL));
+    lr_free(path);
+    ml = lr_mirrorlist_init();
+    fail_if(ml == NULL);
+    ret = lr_mirrorlist_parse_buffer(ml, content, len, &tmp_err);
+    g_free(content);
+    fail_if(!ret);
+    fail_if(tmp_err);
+
+    fail_if(g_slist_length(ml->urls) != 2);
+
+    elem = g_slist_nth(ml->urls, 0);
+    fail_if(!elem);
+    fail_if(g_strcmp0(elem->data, "http://foo.bar/fedora/linux/"));
+
+    elem = g_slist_nth(ml->urls, 1);
+    fail_if(!elem);
+    fail_if(g_strcmp0(elem->data, "ftp://ftp.bar.foo/Fedora/17/"));
+    lr_mirrorlist_free(ml);
+
+    // The last line doesn't need to be terminated
+    const char *buf = "# comment\n\nhttp://foo.bar/a\n  /local/b";
+    ml = lr_mirrorlist_init();
+    ret = lr_mirrorlist_parse_buffer(ml, buf, strlen(buf), &tmp_err);
+    fail_if(!ret);
+    fail_if(tmp_err);
+    fail_if(g_slist_length(ml->urls) != 2);
+    fail_if(g_strcmp0(g_slist_nth_data(ml->urls, 1), "/local/b"));
+    lr_mirrorlist_free(ml);
+}
+END_TEST
+
 Suite *
 mirrorlist_suite(void)
 {
@@ -114,6 +159,7 @@ mirrorlist_suite(void)
     tcase_add_test(tc, test_mirrorlist_01);
     tcase_add_test(tc, test_mirrorlist_02);
     tcase_add_test(tc, test_mirrorlist_03);
+    tcase_add_test(tc, test_mirrorlist_buffer);
     suite_add_tcase(s, tc);
     return s;
 }
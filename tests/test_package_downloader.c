@@ -15,6 +15,7 @@
 #include "librepo/librepo.h"
 #include "librepo/rcodes.h"
 #include "librepo/package_downloader.h"
+#include "librepo/cleanup.h"
 
 START_TEST(test_package_downloader_new_and_free)
 {
@@ -67,12 +68,208 @@ START_TEST(test_package_downloader_new_and_free)
 }
 END_TEST
 
+START_TEST(test_package_downloader_shared_chunk)
+{
+    LrPackageTarget *t1, *t2;
+    GError *err = NULL;
+    LrHandle *h = lr_handle_init();
+
+    // Targets of the same handle share their strings
+
+    t1 = lr_packagetarget_new(h, "url1", "dest", LR_CHECKSUM_SHA256, "aaa", 0,
+                              "baseurl", FALSE, NULL, NULL, &err);
+    fail_if(!t1);
+    fail_if(err);
+    t2 = lr_packagetarget_new(h, "url2", "dest", LR_CHECKSUM_SHA256, "bbb", 0,
+                              "baseurl", FALSE, NULL, NULL, &err);
+    fail_if(!t2);
+    fail_if(err);
+
+    fail_if(t1->chunk != t2->chunk);
+    fail_if(t1->dest != t2->dest);
+    fail_if(t1->base_url != t2->base_url);
+    fail_if(strcmp(t1->relative_url, "url1"));
+    fail_if(strcmp(t2->relative_url, "url2"));
+    fail_if(strcmp(t2->checksum, "bbb"));
+
+    // Strings stay valid until the last target is freed,
+    // even after the handle is gone
+
+    lr_packagetarget_free(t1);
+    lr_handle_free(h);
+    fail_if(strcmp(t2->relative_url, "url2"));
+    fail_if(strcmp(t2->dest, "dest"));
+    lr_packagetarget_free(t2);
+}
+END_TEST
+
+typedef struct {
+    GSList *targets;    // Targets not pulled yet
+    guint pulled;
+    guint done;
+} TestSource;
+
+static LrPackageTarget *
+test_source_pull(void *cbdata)
+{
+    TestSource *source = cbdata;
+    if (!source->targets)
+        return NULL;
+    LrPackageTarget *target = source->targets->data;
+    source->targets = g_slist_delete_link(source->targets, source->targets);
+    source->pulled++;
+    return target;
+}
+
+static void
+test_source_done(LrPackageTarget *target, void *cbdata)
+{
+    TestSource *source = cbdata;
+    fail_if(!target->err);
+    source->done++;
+    lr_packagetarget_free(target);
+}
+
+START_TEST(test_package_downloader_from_source)
+{
+    gboolean ret;
+    GError *err = NULL;
+    TestSource source = { NULL, 0, 0 };
+
+    // Empty source
+
+    ret = lr_download_packages_from_source(test_source_pull, test_source_done,
+                                           &source, 0, &err);
+    fail_if(!ret);
+    fail_if(err);
+    fail_if(source.pulled != 0);
+    fail_if(source.done != 0);
+
+    // Target which cannot be prepared stops pulling of the next targets
+
+    LrHandle *h = lr_handle_init();
+    for (int x = 0; x < 3; x++) {
+        LrPackageTarget *target = lr_packagetarget_new(h, "url", NULL, 0, NULL,
+                                                       0, NULL, FALSE, NULL,
+                                                       NULL, &err);
+        fail_if(!target);
+        source.targets = g_slist_append(source.targets, target);
+    }
+
+    ret = lr_download_packages_from_source(test_source_pull, test_source_done,
+                                           &source, 0, &err);
+    fail_if(ret);
+    fail_if(!err);
+    fail_if(err->code != LRE_BADFUNCARG);
+    fail_if(source.pulled != 1);
+    fail_if(source.done != 1);
+    g_clear_error(&err);
+
+    g_slist_free_full(source.targets, (GDestroyNotify) lr_packagetarget_free);
+    lr_handle_free(h);
+}
+END_TEST
+
+#define STREAM_TARGETS      200
+#define STREAM_PARALLEL     2
+
+typedef struct {
+    LrHandle *handle;
+    char *destdir;
+    guint pulled;
+    guint done;
+    guint max_alive;    // Maximum of targets pulled and not done yet
+    const char *dest;   // Destination shared by all the targets
+} TestStream;
+
+static LrPackageTarget *
+test_stream_pull(void *cbdata)
+{
+    TestStream *stream = cbdata;
+    GError *err = NULL;
+
+    if (stream->pulled == STREAM_TARGETS)
+        return NULL;
+
+    // Targets are created only when they are pulled
+    _cleanup_free_ gchar *url = g_strdup_printf("pkg-%u.rpm", stream->pulled);
+    LrPackageTarget *target = lr_packagetarget_new(stream->handle, url,
+                                                   stream->destdir, 0, NULL,
+                                                   0, NULL, FALSE, NULL,
+                                                   NULL, &err);
+    fail_if(!target);
+    fail_if(err);
+    if (!stream->dest)
+        stream->dest = target->dest;
+    stream->pulled++;
+    if (stream->pulled - stream->done > stream->max_alive)
+        stream->max_alive = stream->pulled - stream->done;
+    return target;
+}
+
+static void
+test_stream_done(LrPackageTarget *target, void *cbdata)
+{
+    TestStream *stream = cbdata;
+    fail_if(target->err, target->err);
+    fail_if(!target->local_path);
+    fail_if(!g_file_test(target->local_path, G_FILE_TEST_IS_REGULAR));
+    // The destination is stored once for all the targets
+    fail_if(target->dest != stream->dest);
+    stream->done++;
+    lr_packagetarget_free(target);
+}
+
+START_TEST(test_package_downloader_from_source_stream)
+{
+    gboolean ret;
+    GError *err = NULL;
+    TestStream stream = { 0 };
+    _cleanup_free_ gchar *srcdir = lr_pathconcat(test_globals.tmpdir,
+                                                 "stream_src", NULL);
+    stream.destdir = lr_pathconcat(test_globals.tmpdir, "stream_dest", NULL);
+    fail_if(g_mkdir(srcdir, 0755));
+    fail_if(g_mkdir(stream.destdir, 0755));
+
+    for (guint x = 0; x < STREAM_TARGETS; x++) {
+        _cleanup_free_ gchar *name = g_strdup_printf("pkg-%u.rpm", x);
+        _cleanup_free_ gchar *path = lr_pathconcat(srcdir, name, NULL);
+        fail_if(!g_file_set_contents(path, name, -1, NULL));
+    }
+
+    _cleanup_free_ gchar *url = g_strconcat("file://", srcdir, NULL);
+    char *urls[] = {url, NULL};
+    stream.handle = lr_handle_init();
+    fail_if(!lr_handle_setopt(stream.handle, NULL, LRO_URLS, urls));
+    fail_if(!lr_handle_setopt(stream.handle, NULL, LRO_REPOTYPE, LR_YUMREPO));
+    fail_if(!lr_handle_setopt(stream.handle, NULL, LRO_MAXPARALLELDOWNLOADS,
+                              (long) STREAM_PARALLEL));
+
+    ret = lr_download_packages_from_source(test_stream_pull, test_stream_done,
+                                           &stream, 0, &err);
+    fail_if(!ret);
+    fail_if(err);
+
+    // Every target was released by the donecb while the stream went on,
+    // only a few of them were alive at once
+    fail_if(stream.pulled != STREAM_TARGETS);
+    fail_if(stream.done != STREAM_TARGETS);
+    fail_if(stream.max_alive > 4 * STREAM_PARALLEL);
+
+    lr_handle_free(stream.handle);
+    lr_free(stream.destdir);
+}
+END_TEST
+
 Suite *
 package_downloader_suite(void)
 {
     Suite *s = suite_create("package_downloader");
     TCase *tc = tcase_create("Main");
     tcase_add_test(tc, test_package_downloader_new_and_free);
+    tcase_add_test(tc, test_package_downloader_shared_chunk);
+    tcase_add_test(tc, test_package_downloader_from_source);
+    tcase_add_test(tc, test_package_downloader_from_source_stream);
     suite_add_tcase(s, tc);
     return s;
 }
@@ -54,12 +54,54 @@ START_TEST(test_repomd_parsing)
 }
 END_TEST
 
+START_TEST(test_repomd_parsing_buffer)
+{
+    gboolean ret;
+    LrYumRepoMd *repomd;
+    char *repomd_path;
+    gchar *content = NULL;
+    gsize len = 0;
+    GError *tmp_err = NULL;
+
+    repomd_path = lr_pathconcat(test_globals.testdata_dir,
+                                "repo_yum_02/repodata/repomd.xml",
+                                NULL);
+    fail_if(!g_file_get_contents(repomd_path, &content, &len, NULL));
+    repomd = lr_yum_repomd_init();
+    fail_if(!repomd);
+
+    ret = lr_yum_repomd_parse_buffer(repomd, content, len,
+                                     NULL, NULL, &tmp_err);
+    g_free(content);
+
+    fail_if(!ret);
+    fail_if(tmp_err);
+    fail_if(g_slist_length(repomd->records) != 12);
+    fail_if(!lr_yum_repomd_get_record(repomd, "primary"));
+    fail_if(!lr_yum_repomd_get_record(repomd, "deltainfo"));
+    fail_if(lr_yum_repomd_get_record(repomd, "foo"));
+
+    lr_yum_repomd_free(repomd);
+    lr_free(repomd_path);
+
+    // No <repomd> element
+    repomd = lr_yum_repomd_init();
+    ret = lr_yum_repomd_parse_buffer(repomd, "<foo/>", 6,
+                                     NULL, NULL, &tmp_err);
+    fail_if(ret);
+    fail_if(!tmp_err);
+    g_error_free(tmp_err);
+    lr_yum_repomd_free(repomd);
+}
+END_TEST
+
 Suite *
 repomd_suite(void)
 {
     Suite *s = suite_create("repomd");
     TCase *tc = tcase_create("Main");
     tcase_add_test(tc, test_repomd_parsing);
+    tcase_add_test(tc, test_repomd_parsing_buffer);
     suite_add_tcase(s, tc);
     return s;
 }
@@ -0,0 +1,109 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+
+#include "librepo/librepo.h"
+#include "librepo/stats.h"
+#include "librepo/stats_internal.h"
+
+#include "fixtures.h"
+#include "testsys.h"
+#include "test_stats.h"
+
+START_TEST(test_stats_prometheus)
+{
+    LrStats stats;
+    LrMirrorStats *mirror;
+    gchar *text;
+
+    memset(&stats, 0, sizeof(stats));
+    stats.transfers = 3;
+    stats.bytes_downloaded = 1024;
+    stats.checksum_cache_hits = 1;
+
+    mirror = lr_stats_mirror(&stats, "http://foo/\"bar\"");
+    mirror->transfers = 2;
+    mirror->bytes = 1000;
+    fail_if(lr_stats_mirror(&stats, "http://foo/\"bar\"") != mirror);
+    lr_stats_mirror(&stats, "http://baz/")->failures = 1;
+    fail_if(g_slist_length(stats.mirrors) != 2);
+
+    text = lr_stats_to_prometheus(&stats, NULL);
+    fail_if(!strstr(text, "# TYPE librepo_transfers_total counter\n"
+                          "librepo_transfers_total 3\n"));
+    fail_if(!strstr(text, "\nlibrepo_downloaded_bytes_total 1024\n"));
+    fail_if(!strstr(text, "\nlibrepo_checksum_cache_hits_total 1\n"));
+    fail_if(!strstr(text, "\nlibrepo_mirror_downloaded_bytes_total"
+                          "{mirror=\"http://foo/\\\"bar\\\"\"} 1000\n"));
+    fail_if(!strstr(text, "\nlibrepo_mirror_failures_total"
+                          "{mirror=\"http://baz/\"} 1\n"));
+    g_free(text);
+
+    text = lr_stats_to_prometheus(&stats, "repo=\"fedora\"");
+    fail_if(!strstr(text, "\nlibrepo_transfers_total{repo=\"fedora\"} 3\n"));
+    fail_if(!strstr(text, "\nlibrepo_mirror_failures_total"
+                          "{repo=\"fedora\",mirror=\"http://baz/\"} 1\n"));
+    g_free(text);
+
+    lr_stats_clear(&stats);
+    fail_if(stats.transfers != 0);
+    fail_if(stats.mirrors != NULL);
+}
+END_TEST
+
+START_TEST(test_stats_write_prometheus)
+{
+    LrStats stats;
+    GError *err = NULL;
+    gchar *content = NULL;
+    char *filename = lr_pathconcat(test_globals.tmpdir, "librepo.prom", NULL);
+
+    memset(&stats, 0, sizeof(stats));
+    stats.retries = 5;
+
+    fail_if(!lr_stats_write_prometheus(&stats, filename, NULL, &err));
+    fail_if(err);
+    fail_if(!g_file_get_contents(filename, &content, NULL, NULL));
+    fail_if(!strstr(content, "\nlibrepo_retries_total 5\n"));
+    g_free(content);
+
+    fail_if(lr_stats_write_prometheus(&stats, "/nonexistent/dir/x.prom",
+                                      NULL, &err));
+    fail_if(!err);
+    g_error_free(err);
+
+    unlink(filename);
+    lr_free(filename);
+}
+END_TEST
+
+START_TEST(test_stats_handle)
+{
+    LrHandle *handle;
+    LrStats *stats = NULL;
+
+    handle = lr_handle_init();
+    fail_if(!lr_handle_getinfo(handle, NULL, LRI_STATS, &stats));
+    fail_if(!stats);
+    fail_if(stats->transfers != 0);
+    fail_if(stats->mirrors != NULL);
+    lr_handle_free(handle);
+}
+END_TEST
+
+Suite *
+stats_suite(void)
+{
+    Suite *s = suite_create("stats");
+    TCase *tc = tcase_create("Main");
+    tcase_add_test(tc, test_stats_prometheus);
+    tcase_add_test(tc, test_stats_write_prometheus);
+    tcase_add_test(tc, test_stats_handle);
+    suite_add_tcase(s, tc);
+    return s;
+}
@@ -0,0 +1,8 @@
+#ifndef LR_TEST_STATS_H
+#define LR_TEST_STATS_H
+
+#include <check.h>
+
+Suite *stats_suite(void);
+
+#endif
@@ -10,6 +10,7 @@
 #include "librepo/rcodes.h"
 #include "librepo/util.h"
 #include "librepo/url_substitution.h"
+#include "librepo/url_substitution_internal.h"
 
 #include "fixtures.h"
 #include "testsys.h"
@@ -146,6 +147,63 @@ START_TEST(test_url_substitute_braces)
 }
 END_TEST
 
+START_TEST(test_urlsubst)
+{
+    char *url;
+    LrUrlVars *urlvars = NULL;
+    LrUrlSubst *subst;
+
+    fail_if(lr_urlsubst_new(NULL) != NULL);
+    url = lr_urlsubst_url(NULL, "http://foo/$bar");
+    fail_if(strcmp(url, "http://foo/$bar"));
+    lr_free(url);
+
+    urlvars = lr_urlvars_set(urlvars, "foo", "version");
+    urlvars = lr_urlvars_set(urlvars, "bar", "repo");
+    subst = lr_urlsubst_new(urlvars);
+    lr_urlvars_free(urlvars);  // The substitution has its own copy
+    fail_if(!subst);
+
+    fail_if(lr_urlsubst_url(subst, NULL) != NULL);
+
+    url = lr_urlsubst_url(subst, "http://foo");
+    fail_if(strcmp(url, "http://foo"));
+    lr_free(url);
+
+    // The second call is served from the cache
+    for (int i = 0; i < 2; i++) {
+        url = lr_urlsubst_url(subst, "http://${foo}/$bar/$baz/${bar");
+        fail_if(strcmp(url, "http://version/repo/$baz/${bar"));
+        lr_free(url);
+    }
+
+    lr_urlsubst_free(subst);
+}
+END_TEST
+
+START_TEST(test_url_template)
+{
+    char buf[64];
+    LrUrlTemplate *tmpl;
+    GHashTable *vars = g_hash_table_new(g_str_hash, g_str_equal);
+
+    g_hash_table_insert(vars, "arch", "x86_64");
+
+    tmpl = lr_url_template_compile("http://foo/$arch/${releasever}/");
+    fail_if(lr_url_template_length(tmpl, NULL) != strlen("http://foo/$arch/${releasever}/"));
+    fail_if(lr_url_template_length(tmpl, vars) != strlen("http://foo/x86_64/${releasever}/"));
+
+    g_hash_table_insert(vars, "releasever", "40");
+    fail_if(lr_url_template_length(tmpl, vars) != strlen("http://foo/x86_64/40/"));
+    char *end = lr_url_template_render(tmpl, vars, buf);
+    fail_if(strcmp(buf, "http://foo/x86_64/40/"));
+    fail_if(end != buf + strlen(buf));
+
+    lr_url_template_free(tmpl);
+    g_hash_table_destroy(vars);
+}
+END_TEST
+
 Suite *
 url_substitution_suite(void)
 {
@@ -155,6 +213,8 @@ url_substitution_suite(void)
     tcase_add_test(tc, test_url_substitute_without_urlvars);
     tcase_add_test(tc, test_url_substitute);
     tcase_add_test(tc, test_url_substitute_braces);
+    tcase_add_test(tc, test_urlsubst);
+    tcase_add_test(tc, test_url_template);
     suite_add_tcase(s, tc);
     return s;
 }